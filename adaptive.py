@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+#
+#   Adaptive sample counts
+#
+#   Decides when a spec has been measured precisely enough to stop early.
+#   client.py --adaptive applies the rule to each spec's samples as they stream
+#   in and tells the console to move on once it is met, up to the run count
+#   patched into the ROM as the hard maximum.
+#
+#   Run on a results file, this script replays every spec's samples through the
+#   same rule in the order and chunks the console sent them, and reports how
+#   many samples each spec would have taken and how far the early estimate
+#   lands from the one over all the recorded samples.
+#
+
+import argparse, math, statistics, sys
+import numpy as np
+
+from analyze import prune_outliers, rdp_clk_to_ms
+from rdp_results import load_results
+
+# Samples per result packet, as CHECKPOINT_RUNS in src/test_main.c
+CHECKPOINT_RUNS = 100
+
+class StoppingRule:
+    """
+    A spec is done once, for each of `counters`, the `level` confidence
+    interval of the mean after analyze.py's outlier pruning reaches at most
+    `target` RDP clocks either side. Specs are never stopped before
+    `min_samples`, which also limits how much checking at every checkpoint
+    can stop on an early lucky streak.
+    """
+
+    def __init__(self, target, level=0.95, min_samples=200, counters=("buf", "pipe")):
+        self.target = target
+        self.level = level
+        self.min_samples = min_samples
+        self.counters = counters
+        self.z = statistics.NormalDist().inv_cdf((1 + level) / 2)
+
+    def half_width(self, samples):
+        """
+        Half width of the confidence interval of the pruned mean, in RDP clocks
+        """
+        pruned = np.asarray(prune_outliers(samples), dtype=np.float64)
+        if len(pruned) < 2:
+            return math.inf
+        return self.z * pruned.std(ddof=1) / math.sqrt(len(pruned))
+
+    def should_stop(self, counters):
+        num_samples = len(next(iter(counters.values())))
+        if num_samples < self.min_samples:
+            return False
+        return all(self.half_width(counters[name]) <= self.target for name in self.counters if name in counters)
+
+def stop_point(rule, counters, chunk=CHECKPOINT_RUNS, latency=1, max_runs=0):
+    """
+    Number of samples the console sends for a spec under `rule`, given all
+    the samples it would take without stopping. The host sees the samples
+    `chunk` at a time and its stop request reaches the console `latency`
+    checkpoints later, as the console carries on while the host decides.
+    """
+    total = len(next(iter(counters.values())))
+    if max_runs != 0:
+        total = min(total, max_runs)
+    for end in range(chunk, total, chunk):
+        if rule.should_stop({ name : samples[:end] for name,samples in counters.items() }):
+            return min(total, end + latency * chunk)
+    return total
+
+def evaluate(results, rule, chunk=CHECKPOINT_RUNS, latency=1, max_runs=0, verbose=False):
+    """
+    Replays recorded specs through `rule`, returning the samples used with and
+    without stopping early and how often the full-data mean fell inside the
+    early confidence interval
+    """
+    used = 0
+    available = 0
+    covered = 0
+    compared = 0
+    worst = 0
+    for res in results:
+        n = stop_point(rule, res.counters, chunk, latency, max_runs)
+        used += n
+        available += res.num_samples
+        if verbose:
+            print(f"{res.desc}")
+            print(f"    {n} of {res.num_samples} samples")
+        for name in rule.counters:
+            samples = res.counters[name]
+            early = np.mean(prune_outliers(samples[:n]))
+            full = np.mean(prune_outliers(samples))
+            width = rule.half_width(samples[:n])
+            diff = abs(early - full)
+            covered += diff <= width
+            compared += 1
+            worst = max(worst, diff)
+            if verbose:
+                print(f"    {name.capitalize() + ':':5} {rdp_clk_to_ms(early):.07f} +/- {rdp_clk_to_ms(width):.07f}, "
+                      f"all samples {rdp_clk_to_ms(full):.07f} ({early - full:+.2f} clocks)")
+    return used, available, covered, compared, worst
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Replay recorded results through the adaptive stopping rule")
+    parser.add_argument("results", help="binary result file or text log")
+    parser.add_argument("--target", help="stop once every counter's confidence interval is within this many RDP clocks either side of the mean (default 5)", type=float, default=5)
+    parser.add_argument("--level", help="confidence level of the interval (default 0.95)", type=float, default=0.95)
+    parser.add_argument("--min-samples", help="never stop a spec before this many samples (default 200)", type=int, default=200)
+    parser.add_argument("--max-runs", help="hard maximum of samples per spec, 0 for all recorded (default 0)", type=int, default=0)
+    parser.add_argument("--chunk", help=f"samples per result packet (default {CHECKPOINT_RUNS})", type=int, default=CHECKPOINT_RUNS)
+    parser.add_argument("--latency", help="checkpoints between the host deciding to stop and the console stopping (default 1)", type=int, default=1)
+    parser.add_argument("--verbose", help="report every spec", action="store_true")
+    args = parser.parse_args()
+
+    results = load_results(args.results)
+    if len(results) == 0:
+        print(f"No results in {args.results}", file=sys.stderr)
+        sys.exit(1)
+
+    rule = StoppingRule(args.target, args.level, args.min_samples)
+    used, available, covered, compared, worst = evaluate(results, rule, args.chunk, args.latency, args.max_runs,
+                                                         args.verbose)
+    print(f"{len(results)} specs: {used} of {available} samples ({100 * used / available:.1f}%)")
+    print(f"Mean over all samples inside the early {100 * args.level:g}% interval for {covered} of {compared} counters "
+          f"({100 * covered / compared:.1f}%), furthest {worst:.2f} clocks away")
@@ -1,54 +1,97 @@
 #!/usr/bin/env python3
 #
-#   Reads results.txt containing debug prints emitted by rdp_fill_timing and
-#   collects results
+#   Reads the results emitted by rdp_fill_timing and collects results. Accepts
+#   either the binary result file written by client.py --results or the
+#   results.txt debug prints of a text build.
+#
+#   With --follow the file is tailed while a campaign is still running and each
+#   spec is reported as soon as its results are complete.
+#
+#   Results merged from a farm of consoles (client.py --farm) are labelled with
+#   the console that ran them. --bias reports how much slower or faster each
+#   console measures the specs run on more than one console, and
+#   --correct-bias scales each console's samples to match the first console.
 #
 
-import os
+import argparse, os, sys, time
 import numpy as np
-import matplotlib.pyplot as plt
+
+from rdp_results import COUNTER_NAMES, ResultStreamParser, load_results
 
 # Whether to plot the result data
 DO_PLOTS = False
-FILENAME = "results.txt"
+FILENAME = "results.bin" if os.path.exists("results.bin") else "results.txt"
 
 def rdp_clk_to_ms(clk):
     return clk / 62500
 
-contents = None
-with open(FILENAME, "r") as infile:
-    contents = infile.read()
-
-contents = contents.split("!!BEGIN!!")[1].split("!!DONE!!")[0].strip()
-
-data_segments = []
-for i,line in enumerate(contents.split("\n")):
-    if i % 7 == 0:
-        data_segments.append([])
-    data_segments[-1].append(line)
-
-for i,seg in enumerate(data_segments):
-    desc = seg[0]
-    assert seg[1] == "BUF = ["
-    buf_data = seg[2].strip()
-    assert seg[3] == "]"
-    assert seg[4] == "PIPE = ["
-    pipe_data = seg[5].strip()
-    assert seg[6] == "]"
-    assert len(seg) == 7
-
-    assert buf_data[-1] == ","
-    assert pipe_data[-1] == ","
-    buf_data = buf_data[:-1]
-    pipe_data = pipe_data[:-1]
-
-    buf_data = [int(buf) for buf in buf_data.split(", ")]
-    pipe_data = [int(pipe) for pipe in pipe_data.split(", ")]
-
-    assert len(buf_data) == len(pipe_data)
+def prune_outliers(data):
+    # Identify outliers (<1% or >99%)
+    lo = np.quantile(data, 0.01)
+    hi = np.quantile(data, 0.99)
+    # Prune outliers
+    return [v for v in data if lo <= v <= hi]
+
+def summarize(data):
+    # min, average, max in ms
+    return rdp_clk_to_ms(min(data)), rdp_clk_to_ms(sum(data) / len(data)), rdp_clk_to_ms(max(data))
+
+def console_bias(results):
+    """
+    Per-console scale factors relative to the lowest numbered console, from
+    the specs measured on more than one console. Returns a dict of console to
+    (buf scale, pipe scale, number of specs compared); consoles sharing no
+    spec with the first are left out.
+    """
+    means = {}
+    for res in results:
+        means.setdefault(res.desc, {})[res.console] = (np.mean(prune_outliers(res.buf)),
+                                                       np.mean(prune_outliers(res.pipe)))
+    consoles = sorted({ res.console for res in results })
+    if len(consoles) == 0:
+        return {}
+    ref = consoles[0]
+
+    # geometric mean of the ratios, so no single spec's size dominates
+    logs = { c : [] for c in consoles }
+    for by_console in means.values():
+        if ref not in by_console or len(by_console) < 2:
+            continue
+        ref_buf, ref_pipe = by_console[ref]
+        for c,(buf, pipe) in by_console.items():
+            logs[c].append((np.log(buf / ref_buf), np.log(pipe / ref_pipe)))
+
+    bias = {}
+    for c in consoles:
+        if len(logs[c]) != 0:
+            buf, pipe = np.exp(np.mean(logs[c], axis=0))
+            bias[c] = (buf, pipe, len(logs[c]))
+    return bias
+
+def print_bias(bias):
+    print("Console bias relative to console", min(bias) if len(bias) != 0 else "-")
+    for c,(buf, pipe, n) in sorted(bias.items()):
+        print(f"    Console {c}: buf {100 * (buf - 1):+.3f}%, pipe {100 * (pipe - 1):+.3f}% over {n} shared specs")
+
+def correct_bias(results, bias):
+    """
+    Divides each console's samples by its scale factor
+    """
+    for res in results:
+        if res.console not in bias:
+            print(f"Warning: no bias estimate for console {res.console}, left uncorrected", file=sys.stderr)
+            continue
+        buf, pipe, _ = bias[res.console]
+        res.counters["buf"] = [round(v / buf) for v in res.buf]
+        res.counters["pipe"] = [round(v / pipe) for v in res.pipe]
+
+def analyze_result(i, res, label_console=False):
+    desc = res.desc
+    buf_data = res.buf
 
     # Plot results including outliers
     if DO_PLOTS:
+        import matplotlib.pyplot as plt
         os.makedirs("figures/outliers", exist_ok=True)
         plt.title(desc)
         plt.plot(range(len(buf_data)), buf_data)
@@ -58,15 +101,10 @@ for i,seg in enumerate(data_segments):
 
     orig_num = len(buf_data)
 
-    # Identify outliers (<1% or >99%)
-    bmin = np.quantile(buf_data, 0.01)
-    bmax = np.quantile(buf_data, 0.99)
-    pmin = np.quantile(pipe_data, 0.01)
-    pmax = np.quantile(pipe_data, 0.99)
-
-    # Prune outliers
-    buf_data = [buf for buf in buf_data if bmin <= buf <= bmax]
-    pipe_data = [pipe for pipe in pipe_data if pmin <= pipe <= pmax]
+    # TMEM and CLOCK are reported after BUF and PIPE when the ROM sent them
+    names = [name for name in COUNTER_NAMES.values() if res.counters.get(name) is not None]
+    pruned = { name : prune_outliers(res.counters[name]) for name in names }
+    buf_data = pruned["buf"]
 
     # Plot results without outliers
     if DO_PLOTS:
@@ -76,17 +114,76 @@ for i,seg in enumerate(data_segments):
         plt.clf()
         plt.cla()
 
-    # Collect results
-    min_buf = rdp_clk_to_ms(min(buf_data))
-    avg_buf = rdp_clk_to_ms(sum(buf_data) / len(buf_data))
-    max_buf = rdp_clk_to_ms(max(buf_data))
-    min_pipe = rdp_clk_to_ms(min(pipe_data))
-    avg_pipe = rdp_clk_to_ms(sum(pipe_data) / len(pipe_data))
-    max_pipe = rdp_clk_to_ms(max(pipe_data))
-
     # Print aggregate statistics
-    print(desc)
-    print(f"    Buf:  pruned {orig_num - len(buf_data)} outliers")
-    print(f"    Pipe: pruned {orig_num - len(pipe_data)} outliers")
-    print(f"    Buf result:  {min_buf:.07f}, {avg_buf:.07f}, {max_buf:.07f}")
-    print(f"    Pipe result: {min_pipe:.07f}, {avg_pipe:.07f}, {max_pipe:.07f}")
+    print(f"{desc} [console {res.console}]" if label_console else desc)
+    for name in names:
+        print(f"    {name.capitalize() + ':':5} pruned {orig_num - len(pruned[name])} outliers")
+    for name in names:
+        lo, avg, hi = summarize(pruned[name])
+        print(f"    {name.capitalize() + ' result:':12} {lo:.07f}, {avg:.07f}, {hi:.07f}")
+
+    # How much of the time the RDP was running each unit was busy, the rest is stalls
+    if "clock" in pruned:
+        clock = sum(pruned["clock"]) / len(pruned["clock"])
+        if clock > 0:
+            shares = ", ".join(f"{name} {100 * (sum(pruned[name]) / len(pruned[name])) / clock:.1f}%"
+                               for name in names if name != "clock")
+            print(f"    Busy share of clock: {shares}")
+
+def follow(filename, idle_timeout, poll_interval=0.2):
+    # Wait for the client to create the file
+    while not os.path.exists(filename):
+        time.sleep(poll_interval)
+
+    parser = ResultStreamParser()
+    num = 0
+    last_data = time.time()
+    with open(filename, "rb") as infile:
+        while not parser.done:
+            if os.fstat(infile.fileno()).st_size < infile.tell():
+                # Truncated by a new campaign starting, begin again
+                print("Results file truncated, restarting", file=sys.stderr)
+                infile.seek(0)
+                parser = ResultStreamParser()
+                num = 0
+
+            data = infile.read()
+            if len(data) == 0:
+                if idle_timeout is not None and time.time() - last_data > idle_timeout:
+                    print(f"No new data for {idle_timeout} seconds, stopping", file=sys.stderr)
+                    break
+                time.sleep(poll_interval)
+                continue
+            last_data = time.time()
+
+            for res in parser.feed(data):
+                analyze_result(num, res)
+                num += 1
+            sys.stdout.flush()
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Collect min/average/max timings from rdp_fill_timing results")
+    parser.add_argument("results", nargs="?", default=FILENAME, help="binary result file or text log")
+    parser.add_argument("--follow", help="keep reading the file as it grows, reporting each spec once complete", action="store_true")
+    parser.add_argument("--idle-timeout", help="with --follow, stop after this many seconds without new data", type=float)
+    parser.add_argument("--bias", help="report each console's bias on the specs measured by several consoles of a farm", action="store_true")
+    parser.add_argument("--correct-bias", help="scale each console's samples by its bias before summarizing", action="store_true")
+    args = parser.parse_args()
+    if args.follow and (args.bias or args.correct_bias):
+        parser.error("bias estimates need the whole campaign, not --follow")
+
+    if args.follow:
+        try:
+            follow(args.results, args.idle_timeout)
+        except KeyboardInterrupt:
+            pass
+    else:
+        results = load_results(args.results)
+        if args.bias or args.correct_bias:
+            bias = console_bias(results)
+            print_bias(bias)
+            if args.correct_bias:
+                correct_bias(results, bias)
+        multi_console = len({ res.console for res in results }) > 1
+        for i,res in enumerate(results):
+            analyze_result(i, res, multi_console)
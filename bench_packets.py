@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+#
+#   PacketStream throughput benchmark
+#
+#   Feeds synthetic UNFLoader framed traffic (the debugf output of a text
+#   build, or result packets with --binary) from memory through the packet
+#   layer of client.py, in chunks the size a serial read would return, and
+#   reports the parse rate in MB/s. That layer keeps one bytearray with a read
+#   offset, compacted once half of it is consumed. The original byte-slicing
+#   implementation is kept here for comparison.
+#
+
+import argparse, random, time
+
+from client import ExtDevice, PacketStream
+from fake_device import DATATYPE_TEXT, frame_packet
+from rdp_results import RESULTS_DATATYPE, SpecResult, encode_result
+
+DATATYPE_HEARTBEAT = 0x05
+
+class MemoryDevice(ExtDevice):
+    """
+    Device returning a prepared byte string in fixed size reads
+    """
+
+    def __init__(self, data, chunk_size):
+        self.data = memoryview(data)
+        self.chunk_size = chunk_size
+        self.offset = 0
+
+    def wait(self, timeout=None):
+        # the traffic ends with the power off marker, so streams never read past it
+        if self.offset == len(self.data):
+            raise EOFError()
+        return min(self.chunk_size, len(self.data) - self.offset)
+
+    def read(self, n):
+        out = bytes(self.data[self.offset:self.offset + n])
+        self.offset += len(out)
+        return out
+
+class LegacyPacketStream:
+    """
+    PacketStream as it was before the buffer rewrite, re-slicing on every byte consumed
+    """
+
+    def __init__(self, dev : ExtDevice):
+        self.dev : ExtDevice = dev
+        self.data = b''
+
+    def more_data(self):
+        assert len(self.data) == 0
+        data_len = self.dev.wait()
+        self.data = self.dev.read(data_len)
+
+    def peekc(self):
+        if len(self.data) == 0:
+            self.more_data()
+        return self.data[0]
+
+    def getc(self):
+        u8 = self.peekc()
+        self.data = self.data[1:]
+        return u8
+
+    def get_n(self, n):
+        if len(self.data) == 0:
+            self.more_data()
+        data_out = self.data[:n]
+        self.data = self.data[n:]
+        got_len = len(data_out)
+        if got_len != n:
+            data_out += self.get_n(n - got_len)
+        return data_out
+
+    def get_pkt(self):
+        # compares against 0 rather than '\0' so the benchmark terminates
+        if self.peekc() == 0:
+            return None
+        dma = self.get_n(4)
+        assert dma == b'DMA@'
+        pkt_type = self.getc()
+        pkt_length = (self.getc() << 16) | (self.getc() << 8) | self.getc()
+        pkt_data = self.get_n(pkt_length)
+        cmph = self.get_n(4)
+        assert cmph == b'CMPH'
+        pos = 4 + 1 + 3 + pkt_length + 4
+        aligned = (pos + 1) & ~1
+        _ = self.get_n(aligned - pos)
+        return pkt_type, pkt_data
+
+def spec_packets(res, binary):
+    """
+    Packets for one spec as the ROM sends them, one per debugf call in text builds
+    """
+    yield DATATYPE_TEXT, f"{res.desc}\n".encode("ascii")
+    if binary:
+        yield RESULTS_DATATYPE, encode_result(res)
+    else:
+        for name, samples in (("BUF", res.buf), ("PIPE", res.pipe)):
+            yield DATATYPE_TEXT, f"{name} = [\n    ".encode("ascii")
+            for v in samples:
+                yield DATATYPE_TEXT, f"{v}, ".encode("ascii")
+            yield DATATYPE_TEXT, b"\n]\n"
+    yield DATATYPE_HEARTBEAT, b""
+
+def synthetic_traffic(size, num_samples, binary, seed=0):
+    """
+    Framed packets totalling at least `size` bytes, followed by the power off marker
+    """
+    rng = random.Random(seed)
+    out = bytearray()
+    pkts = []
+    spec_id = 0
+    while len(out) < size:
+        res = SpecResult(spec_id, f"Spec {spec_id}, synthetic", {
+            "buf"  : [rng.randrange(90000, 240000) for _ in range(num_samples)],
+            "pipe" : [rng.randrange(90000, 240000) for _ in range(num_samples)],
+        })
+        for pkt in spec_packets(res, binary):
+            pkts.append(pkt)
+            out += frame_packet(*pkt)
+        spec_id += 1
+    out.append(0)
+    return bytes(out), pkts
+
+def run(stream_cls, data, chunk_size):
+    stream = stream_cls(MemoryDevice(data, chunk_size))
+    pkts = []
+    t = time.perf_counter()
+    while True:
+        pkt = stream.get_pkt()
+        if pkt is None:
+            break
+        pkts.append(pkt)
+    return time.perf_counter() - t, pkts
+
+def report(label, stream_cls, data, chunk_size, expected):
+    elapsed, pkts = run(stream_cls, data, chunk_size)
+    assert pkts == expected, f"{label} PacketStream parsed the traffic differently"
+    mb = len(data) / (1024 * 1024)
+    print(f"{label:>8}: {mb:8.2f} MB in {elapsed:8.3f} s, {mb / elapsed:10.2f} MB/s")
+    return mb / elapsed
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Measure PacketStream throughput on synthetic traffic")
+    parser.add_argument("--mb", help="amount of traffic for the current PacketStream", type=float, default=32)
+    parser.add_argument("--legacy-mb", help="amount of traffic for the original PacketStream, 0 to skip", type=float, default=1)
+    parser.add_argument("--chunk", help="bytes returned per device read", type=int, default=4096)
+    parser.add_argument("--samples", help="samples per counter for each spec", type=int, default=1000)
+    parser.add_argument("--binary", help="send binary result packets rather than the debugf text of a text build", action="store_true")
+    args = parser.parse_args()
+
+    data, expected = synthetic_traffic(int(args.mb * 1024 * 1024), args.samples, args.binary)
+    print(f"{len(expected)} packets, {args.chunk} byte reads")
+
+    rate = report("current", PacketStream, data, args.chunk, expected)
+    if args.legacy_mb > 0:
+        data, expected = synthetic_traffic(int(args.legacy_mb * 1024 * 1024), args.samples, args.binary)
+        legacy_rate = report("original", LegacyPacketStream, data, args.chunk, expected)
+        print(f"Speedup: {rate / legacy_rate:.1f}x")
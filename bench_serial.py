@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+#
+#   Serial wait benchmark
+#
+#   Streams text and heartbeat packets at a steady rate over a local pty pair
+#   into client.py's device and packet layers, and reports the host CPU time
+#   spent receiving along with the latency from send to get_pkt(). Runs with
+#   the select based ED64Device.wait() and with the original inWaiting() spin
+#   for comparison.
+#
+
+import argparse, os, resource, struct, time, tty
+import serial
+
+from client import ED64Device, PacketStream
+from fake_device import DATATYPE_TEXT, frame_packet
+
+DATATYPE_HEARTBEAT = 0x05
+
+class SpinED64Device(ED64Device):
+    """
+    ED64Device with the original busy-waiting wait()
+    """
+
+    def wait(self, timeout=None):
+        data_len = self.ser.inWaiting()
+        while not (data_len > 0):
+            data_len = self.ser.inWaiting()
+        return data_len
+
+def stamp():
+    return struct.pack(">Q", time.monotonic_ns())
+
+def writer(fd, rate, duration, heartbeat_every):
+    # Paced to absolute deadlines so slow writes do not lower the rate
+    interval = 1 / rate
+    start = time.monotonic()
+    n = 0
+    while True:
+        due = start + n * interval
+        if due - start >= duration:
+            break
+        delay = due - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+
+        if heartbeat_every != 0 and n % heartbeat_every == heartbeat_every - 1:
+            pkt = frame_packet(DATATYPE_HEARTBEAT, stamp())
+        else:
+            pkt = frame_packet(DATATYPE_TEXT, stamp() + f" line {n}\n".encode("ascii"))
+        os.write(fd, pkt)
+        n += 1
+    os.write(fd, frame_packet(DATATYPE_TEXT, stamp() + b"!!DONE!!\n"))
+
+def measure(dev_cls, rate, duration, heartbeat_every):
+    master, slave = os.openpty()
+    tty.setraw(master)
+    tty.setraw(slave)
+
+    # the device is opened first, ED64Device flushes the port when created
+    dev = dev_cls(serial.Serial(os.ttyname(slave), timeout=5))
+    stream = PacketStream(dev)
+
+    pid = os.fork()
+    if pid == 0:
+        try:
+            writer(master, rate, duration, heartbeat_every)
+        finally:
+            os._exit(0)
+
+    usage_start = resource.getrusage(resource.RUSAGE_SELF)
+    wall_start = time.monotonic()
+    latencies = []
+    counts = { DATATYPE_TEXT : 0, DATATYPE_HEARTBEAT : 0 }
+    while True:
+        pkt_type, data = stream.get_pkt()
+        latencies.append(time.monotonic_ns() - struct.unpack_from(">Q", data)[0])
+        counts[pkt_type] += 1
+        if data.endswith(b"!!DONE!!\n"):
+            break
+    wall = time.monotonic() - wall_start
+    usage_end = resource.getrusage(resource.RUSAGE_SELF)
+
+    os.waitpid(pid, 0)
+    dev.close()
+    os.close(master)
+    os.close(slave)
+
+    cpu = (usage_end.ru_utime - usage_start.ru_utime) + (usage_end.ru_stime - usage_start.ru_stime)
+    latencies.sort()
+    return {
+        "text"   : counts[DATATYPE_TEXT],
+        "hb"     : counts[DATATYPE_HEARTBEAT],
+        "cpu"    : 100 * cpu / wall,
+        "p50"    : latencies[len(latencies) // 2] / 1000,
+        "p99"    : latencies[len(latencies) * 99 // 100] / 1000,
+        "max"    : latencies[-1] / 1000,
+    }
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Measure host CPU use and packet latency of the serial wait")
+    parser.add_argument("--rate", help="packets per second", type=float, default=1000)
+    parser.add_argument("--duration", help="seconds to stream for each mode", type=float, default=5)
+    parser.add_argument("--heartbeat-every", help="send every Nth packet as a heartbeat, 0 for none", type=int, default=10)
+    args = parser.parse_args()
+
+    print(f"{args.rate:g} packets/s for {args.duration:g} s")
+    print(f"{'mode':>8} {'text':>7} {'heartbt':>7} {'CPU %':>7} {'p50 us':>9} {'p99 us':>9} {'max us':>9}")
+    for name, dev_cls in (("select", ED64Device), ("spin", SpinED64Device)):
+        r = measure(dev_cls, args.rate, args.duration, args.heartbeat_every)
+        print(f"{name:>8} {r['text']:7} {r['hb']:7} {r['cpu']:7.1f} {r['p50']:9.1f} {r['p99']:9.1f} {r['max']:9.1f}")
@@ -3,14 +3,13 @@
 #   Flashcart USB Client
 #
 
-import argparse, math, signal, struct, sys, time
+import argparse, hashlib, io, itertools, json, math, os, queue, random, select, signal, struct, sys, threading, time
 import serial, serial.tools.list_ports
 
-def pad_buffer(buf, boundary=512):
-    if len(buf) % boundary != 0:
-        diff = math.ceil(len(buf) / boundary) * boundary - len(buf)
-        buf += b"\0" * diff
-    return buf
+from rdp_results import RESULTS_DATATYPE, RESULTS_HEADER, RESULTS_HEADER_V2, RESULTS_HEADER_V3, RESULTS_STOP, \
+                        RESULTS_STOP_DATATYPE, RUN_CONFIG_VERSION, RunConfig, TextLogParser, decode_result, \
+                        encode_result, load_results
+from spec_table import SPEC_TABLE_DATATYPE, SPEC_TABLE_VERSION, decode_spec_table, load_spec_table
 
 class ExtDevice:
     """
@@ -28,7 +27,11 @@ class ExtDevice:
     def reset(self):
         raise NotImplementedError()
 
-    def wait(self):
+    def wait(self, timeout=None):
+        """
+        Blocks until data can be read, returning the number of bytes waiting,
+        or 0 if `timeout` seconds pass first. None waits indefinitely.
+        """
         raise NotImplementedError()
 
     def read(self, n):
@@ -37,20 +40,44 @@ class ExtDevice:
     def write(self, data):
         raise NotImplementedError()
 
-    def boot_rom(self, filename):
+    # host to console packets are padded to a multiple of this
+    PACKET_ALIGN = 2
+
+    def send_packet(self, pkt_type, data):
+        """
+        Sends a packet to the ROM, framed as the packets it sends (see PacketStream)
+        """
+        pkt = b"DMA@" + struct.pack(">I", (pkt_type << 24) | len(data)) + data + b"CMPH"
+        self.write(pkt + bytes(-len(pkt) % self.PACKET_ALIGN))
+
+    def boot_rom(self, filename, block_size=None, verify=False, cache=None, delta=False, run_config=None):
         raise NotImplementedError()
 
     def whoami(self):
         raise NotImplementedError()
 
+    def ping(self):
+        """
+        Whether the flashcart is ready to take a ROM, i.e. the console is in its menu
+        """
+        raise NotImplementedError()
+
     @staticmethod
-    def try_detect():
-        dev = ED64Device.try_detect()
+    def try_detect(ports=None):
+        dev = ED64Device.try_detect(ports)
         if dev is not None:
             return dev
         # TODO support more flashcarts
         return None
 
+    @staticmethod
+    def try_detect_all(ports=None):
+        """
+        Every flashcart found, in port order
+        """
+        # TODO support more flashcarts
+        return ED64Device.try_detect_all(ports)
+
 ED64_CMD_TEST       = 't'
 ED64_CMD_ROM_START  = 's'
 ED64_CMD_ROM_WRITE  = 'W'
@@ -59,6 +86,22 @@ ED64_CMD_ROM_FILL   = 'c'
 ED64_CMD_RAM_READ   = 'r'
 ED64_CMD_FPGA_WRITE = 'f'
 
+ED64_ROM_BASE = 0x10000000
+# The ROM area is at least this large, the rest is filled before smaller ROMs are written
+ED64_ROM_FILL_SIZE = 0x101000
+# Transfers are in whole 512-byte sectors
+ED64_SECTOR_SIZE = 512
+
+# Size of each write during the ROM upload, and of each readback during verification
+UPLOAD_BLOCK_SIZE = 256 * 1024
+# Number of blocks read from disk ahead of the USB transfer
+UPLOAD_QUEUE_DEPTH = 4
+
+# Delta uploads: sectors read back to check the cache still describes the cart
+ROM_CACHE_SAMPLES = 8
+# Changed ranges closer than this many sectors are sent as one write
+DELTA_MERGE_GAP = 16
+
 def ed64_make_cmd(cmd, address=0, length=0, arg=0):
     buf = bytearray()
     buf.extend([ord('c'), ord('m'), ord('d'), ord(cmd)])
@@ -67,10 +110,81 @@ def ed64_make_cmd(cmd, address=0, length=0, arg=0):
     buf.extend(struct.pack(">I", arg))
     return buf
 
+def load_rom(filename, run_config):
+    """
+    Reads a ROM image with its run configuration block set to `run_config`
+    """
+    with open(filename, "rb") as infile:
+        image = bytearray(infile.read())
+    offset = RunConfig.find(image)
+    if offset is None or RunConfig.version(image, offset) != RUN_CONFIG_VERSION:
+        raise ValueError(f"{filename} has no run configuration block of this version, rebuild it")
+    packed = run_config.pack()
+    image[offset:offset + len(packed)] = packed
+    return image
+
+def sector_digest(data):
+    return hashlib.blake2b(data, digest_size=8).digest()
+
+def sector_digests(image):
+    with memoryview(image) as view:
+        return [sector_digest(view[o:o + ED64_SECTOR_SIZE]) for o in range(0, len(image), ED64_SECTOR_SIZE)]
+
+class RomCache:
+    """
+    Host-side record of the ROM last written to a flashcart, as a digest per
+    512-byte sector. Stored per port, under the user's cache directory unless
+    a path is given.
+    """
+
+    VERSION = 1
+
+    def __init__(self, port, path=None):
+        if path is None:
+            cache_home = os.environ.get("XDG_CACHE_HOME") or os.path.expanduser("~/.cache")
+            name = os.path.basename(port) or "default"
+            path = os.path.join(cache_home, "rdp_fill_timing", f"rom_{name}.json")
+        self.path = path
+
+    def load(self):
+        try:
+            with open(self.path, "r") as infile:
+                cache = json.load(infile)
+        except (OSError, ValueError):
+            return None
+        if cache.get("version") != self.VERSION or cache.get("sector_size") != ED64_SECTOR_SIZE:
+            return None
+        digests = bytes.fromhex(cache["digests"])
+        return [digests[i:i + 8] for i in range(0, len(digests), 8)]
+
+    def save(self, digests):
+        os.makedirs(os.path.dirname(os.path.abspath(self.path)), exist_ok=True)
+        tmp_path = self.path + ".tmp"
+        with open(tmp_path, "w") as outfile:
+            json.dump({ "version" : self.VERSION, "sector_size" : ED64_SECTOR_SIZE,
+                        "digests" : b"".join(digests).hex() }, outfile)
+        os.replace(tmp_path, self.path)
+
+    def invalidate(self):
+        try:
+            os.remove(self.path)
+        except FileNotFoundError:
+            pass
+
 class ED64Device(ExtDevice):
 
+    # Polling interval where the port cannot be waited on with select (Windows)
+    POLL_INTERVAL = 0.001
+
+    # the cart moves USB data to the console in whole sectors
+    PACKET_ALIGN = ED64_SECTOR_SIZE
+
     def __init__(self, ser : serial.Serial):
         self.ser = ser
+        try:
+            self.fd = ser.fileno()
+        except (AttributeError, OSError):
+            self.fd = None
         self.reset()
 
     def close(self):
@@ -80,11 +194,24 @@ class ED64Device(ExtDevice):
         self.ser.reset_input_buffer()
         self.ser.reset_output_buffer()
 
-    def wait(self):
-        data_len = self.ser.inWaiting()
-        while not (data_len > 0):
-            data_len = self.ser.inWaiting()
-        return data_len
+    def wait(self, timeout=None):
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while True:
+            data_len = self.ser.in_waiting
+            if data_len > 0:
+                return data_len
+
+            remaining = None
+            if deadline is not None:
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    return 0
+
+            # sleep in the kernel until the port is readable rather than spinning
+            if self.fd is not None:
+                select.select([self.fd], [], [], remaining)
+            else:
+                time.sleep(self.POLL_INTERVAL if remaining is None else min(self.POLL_INTERVAL, remaining))
 
     def read(self, n):
         return self.ser.read(n)
@@ -95,32 +222,192 @@ class ED64Device(ExtDevice):
     def close(self):
         self.ser.close()
 
-    def boot_rom(self, filename):
-        rom_data = None
-        with open(filename, "rb") as infile:
-            rom_data = bytes(infile.read())
-
-        rom_data = pad_buffer(rom_data)
-        size = len(rom_data)
+    def upload(self, address, infile, size, block_size, progress=True, keep=False, digests=None):
+        """
+        Writes `size` bytes from `infile` to ROM at `address`, zero padding the
+        final block. Blocks are read from disk on this thread while a sender
+        thread writes the previous ones to the port, so the transfer is never
+        waiting on the file. Returns the blocks sent if `keep` is set, for
+        verify(), and appends the digest of each sector sent to `digests`.
+        """
+        self.write(ed64_make_cmd(ED64_CMD_ROM_WRITE, address, size))
+
+        blocks = queue.Queue(UPLOAD_QUEUE_DEPTH)
+        errors = []
+
+        def sender():
+            while (blk := blocks.get()) is not None:
+                # after a failure keep taking blocks so the reader is not left blocked
+                if len(errors) == 0:
+                    try:
+                        self.write(blk)
+                    except Exception as e:
+                        errors.append(e)
+
+        thread = threading.Thread(target=sender, daemon=True)
+        thread.start()
+
+        sent = []
+        offset = 0
+        next_report = size // 10
+        t = time.time()
+        while offset < size and len(errors) == 0:
+            blk = infile.read(min(block_size, size - offset))
+            blk = blk + b"\0" * (min(block_size, size - offset) - len(blk))
+            blocks.put(blk)
+            if keep:
+                sent.append(blk)
+            if digests is not None:
+                digests += sector_digests(blk)
+            offset += len(blk)
+            if progress and (offset >= next_report or offset == size):
+                print(f"Uploaded {offset / size * 100:.2f}%")
+                next_report += size // 10
+        blocks.put(None)
+        thread.join()
+        if len(errors) != 0:
+            raise errors[0]
+
+        # wait for the port to finish sending so the rate reflects the transfer
+        self.ser.flush()
+        dt = time.time() - t
+        if progress:
+            print(f"Upload took {dt:.3f} seconds ({size / dt / 1e6:.2f} MB/s)")
+        return sent
+
+    def verify(self, address, blocks, progress=True):
+        """
+        Reads back the blocks written at `address` with ROM_READ, raising
+        an exception listing the sectors that differ. This runs once the
+        upload is done: the cart takes one command at a time and a ROM_WRITE
+        holds the link until all of its data has arrived, so a readback
+        cannot overlap the write.
+        """
+        t = time.time()
+        bad_sectors = []
+        offset = 0
+        for blk in blocks:
+            self.write(ed64_make_cmd(ED64_CMD_ROM_READ, address + offset, len(blk)))
+            readback = self.read(len(blk))
+            if len(readback) != len(blk):
+                raise RuntimeError(f"ROM readback timed out at 0x{address + offset:08X}")
+            if readback != blk:
+                for sector in range(0, len(blk), ED64_SECTOR_SIZE):
+                    if readback[sector:sector+ED64_SECTOR_SIZE] != blk[sector:sector+ED64_SECTOR_SIZE]:
+                        bad_sectors.append(address - ED64_ROM_BASE + offset + sector)
+            offset += len(blk)
+        dt = time.time() - t
+
+        if len(bad_sectors) != 0:
+            listed = ", ".join(f"0x{o:X}" for o in bad_sectors[:8])
+            raise RuntimeError(f"ROM verification failed for {len(bad_sectors)} sectors at ROM offsets {listed}" +
+                               (", ..." if len(bad_sectors) > 8 else ""))
+        if progress:
+            print(f"Verified in {dt:.3f} seconds ({offset / dt / 1e6:.2f} MB/s)")
+
+    def cache_valid(self, digests):
+        """
+        Reads back a random sample of cached sectors, checking the cart still holds what the cache says
+        """
+        sectors = {0} | set(random.sample(range(len(digests)), min(ROM_CACHE_SAMPLES, len(digests))))
+        for i in sorted(sectors):
+            self.write(ed64_make_cmd(ED64_CMD_ROM_READ, ED64_ROM_BASE + i * ED64_SECTOR_SIZE, ED64_SECTOR_SIZE))
+            data = self.read(ED64_SECTOR_SIZE)
+            if len(data) != ED64_SECTOR_SIZE:
+                raise RuntimeError(f"ROM readback timed out at sector {i}")
+            if sector_digest(data) != digests[i]:
+                return False
+        return True
+
+    def upload_delta(self, image, cache, block_size, verify):
+        """
+        Writes only the sectors of `image` that differ from what `cache` records
+        as being on the cart, then updates the cache
+        """
+        t = time.time()
+        new = sector_digests(image)
+
+        old = cache.load()
+        if old is not None and not self.cache_valid(old):
+            print("ROM cache does not match the cart, uploading everything")
+            old = None
+        if old is None:
+            # start from a known state, as a full upload does
+            self.write(ed64_make_cmd(ED64_CMD_ROM_FILL, ED64_ROM_BASE, ED64_ROM_FILL_SIZE))
+            old = sector_digests(bytes(ED64_ROM_FILL_SIZE))
+
+        # Changed sectors, coalesced into ranges [start, end)
+        ranges = []
+        for i in range(len(new)):
+            if i < len(old) and old[i] == new[i]:
+                continue
+            if len(ranges) != 0 and i - ranges[-1][1] <= DELTA_MERGE_GAP:
+                ranges[-1][1] = i + 1
+            else:
+                ranges.append([i, i + 1])
+
+        # an interrupted upload must not leave a cache describing the old contents
+        cache.invalidate()
+
+        written = 0
+        for start, end in ranges:
+            offset, length = start * ED64_SECTOR_SIZE, (end - start) * ED64_SECTOR_SIZE
+            with memoryview(image) as view, io.BytesIO(view[offset:offset + length]) as data:
+                blocks = self.upload(ED64_ROM_BASE + offset, data, length, block_size, progress=False, keep=verify)
+            if verify:
+                self.verify(ED64_ROM_BASE + offset, blocks, progress=False)
+            written += length
+        self.ser.flush()
+
+        # sectors past the end of a shorter ROM keep their previous contents
+        cache.save(new + old[len(new):])
+
+        print(f"Delta upload wrote 0x{written:X} of 0x{len(image):X} bytes in {len(ranges)} ranges" +
+              (" and verified them" if verify and written != 0 else "") + f", took {time.time() - t:.3f} seconds")
+
+    def boot_rom(self, filename, block_size=None, verify=False, cache=None, delta=False, run_config=None):
+        """
+        Uploads and starts a ROM. With a RomCache, a full upload records what
+        was written and `delta` writes only the sectors that changed since.
+        A RunConfig is patched into the uploaded image.
+        """
+        block_size = UPLOAD_BLOCK_SIZE if block_size is None else block_size
+        if block_size <= 0 or block_size % ED64_SECTOR_SIZE != 0:
+            raise ValueError(f"Block size must be a multiple of {ED64_SECTOR_SIZE} bytes")
+
+        image = None if run_config is None else load_rom(filename, run_config)
+
+        # padded to whole sectors
+        size = os.path.getsize(filename)
+        size = math.ceil(size / ED64_SECTOR_SIZE) * ED64_SECTOR_SIZE
 
         print(f"Uploading ROM.. (0x{size:X} bytes)")
 
-        if size < 0x101000:
-            self.write(ed64_make_cmd(ED64_CMD_ROM_FILL, 0x10000000, 0x101000))
-        self.write(ed64_make_cmd(ED64_CMD_ROM_WRITE, 0x10000000, size))
+        if cache is not None and delta:
+            # the cart contents including the filled area, as a full upload leaves them
+            if image is None:
+                with open(filename, "rb") as infile:
+                    image = infile.read()
+            image += bytes(max(size, ED64_ROM_FILL_SIZE) - len(image))
+            self.upload_delta(image, cache, block_size, verify)
+        else:
+            if cache is not None:
+                cache.invalidate()
 
-        rom_mem = memoryview(rom_data)
+            if size < ED64_ROM_FILL_SIZE:
+                self.write(ed64_make_cmd(ED64_CMD_ROM_FILL, ED64_ROM_BASE, ED64_ROM_FILL_SIZE))
 
-        t = time.time()
-        offset = 0
-        rem = size
-        while rem > 0:
-            blksize = min(1024 * 1024, rem)
-            self.write(rom_mem[offset:offset+blksize])
-            offset += blksize
-            rem -= blksize
-            print(f"Uploaded {offset / size * 100:.2f}%")
-        print(f"Upload took {time.time() - t} seconds")
+            digests = None if cache is None else []
+            with (open(filename, "rb") if image is None else io.BytesIO(image)) as infile:
+                blocks = self.upload(ED64_ROM_BASE, infile, size, block_size, keep=verify, digests=digests)
+
+            if verify:
+                self.verify(ED64_ROM_BASE, blocks)
+
+            if cache is not None:
+                # the rest of the filled area is zero
+                fill = max(0, ED64_ROM_FILL_SIZE - size)
+                cache.save(digests + sector_digests(bytes(fill)))
 
         print("Booting ROM..")
         self.write(ed64_make_cmd(ED64_CMD_ROM_START, arg=1))
@@ -131,100 +418,345 @@ class ED64Device(ExtDevice):
     def whoami(self):
         return f"Everdrive 64 on {self.ser.port}"
 
+    def ping(self):
+        self.reset()
+        self.write(ed64_make_cmd(ED64_CMD_TEST))
+        dat = self.read(16)
+        # anything after the reply is not needed
+        self.reset()
+        return dat[0:4] == b'cmdr'
+
     @staticmethod
-    def try_detect():
-        found = None
-
-        for port in serial.tools.list_ports.comports():
-            try:
-                with serial.Serial(port.device, 9600, timeout=1, writeTimeout=1, rtscts=1) as ser:
-                    ser.write(ed64_make_cmd(ED64_CMD_TEST))
-                    dat = ser.read(512)
-                    if dat[0:4].decode('ascii') == 'cmdr':
-                        found = port
-                        break
-            except OSError as e:
-                pass
+    def probe(port):
+        """
+        Whether an Everdrive answers on `port`
+        """
+        try:
+            with serial.Serial(port, 9600, timeout=1, writeTimeout=1, rtscts=1) as ser:
+                ser.write(ed64_make_cmd(ED64_CMD_TEST))
+                dat = ser.read(512)
+                return dat[0:4] == b'cmdr'
+        except OSError as e:
+            return False
 
-        if found is None:
-            return None
+    @staticmethod
+    def open(port):
+        return ED64Device(serial.Serial(port, 9600, timeout=5, writeTimeout=2, rtscts=True))
 
-        return ED64Device(serial.Serial(found.device, 9600, timeout=5, writeTimeout=2, rtscts=True))
+    @staticmethod
+    def try_detect(ports=None):
+        if ports is None:
+            ports = [port.device for port in serial.tools.list_ports.comports()]
 
-class PacketStream:
+        for port in ports:
+            if ED64Device.probe(port):
+                return ED64Device.open(port)
+        return None
 
-    def __init__(self, dev : ExtDevice):
-        self.dev : ExtDevice = dev
-        self.data = b''
+    @staticmethod
+    def try_detect_all(ports=None):
+        if ports is None:
+            ports = [port.device for port in serial.tools.list_ports.comports()]
 
-    def more_data(self):
-        # we clobber the existing data so there better be none of it
-        assert len(self.data) == 0
-        # wait for data, TODO we might be able to switch to just reading n and waiting in ser.read()
-        data_len = self.dev.wait()
-        # read all waiting data
-        self.data = self.dev.read(data_len)
-
-    def peekc(self):
-        # read 1 byte and don't advance
-
-        # get data if there is none
-        if len(self.data) == 0:
-            self.more_data()
-        # return the first byte without advancing
-        return self.data[0]
+        return [ED64Device.open(port) for port in ports if ED64Device.probe(port)]
 
-    def getc(self):
-        # read 1 byte and advance
-        u8 = self.peekc()
-        self.data = self.data[1:]
-        return u8
+# Raw capture log: a header, then per device read a record of the read's time
+# in nanoseconds since capture start and its length, followed by the bytes read
+CAPTURE_MAGIC = b"RDPCAP01"
+CAPTURE_RECORD = struct.Struct(">QI")
 
-    def get_n(self, n):
-        # read n bytes and advance
+class CaptureDevice(ExtDevice):
+    """
+    Passes through to another device, logging every byte read from it with a host timestamp
+    """
 
-        # get data if there is none
-        if len(self.data) == 0:
-            self.more_data()
+    def __init__(self, dev : ExtDevice, filename):
+        self.dev = dev
+        self.outfile = open(filename, "wb")
+        self.outfile.write(CAPTURE_MAGIC)
+        self.start = time.monotonic_ns()
+
+    def close(self):
+        if not self.outfile.closed:
+            self.outfile.close()
+        self.dev.close()
+
+    def reset(self):
+        self.dev.reset()
+
+    def wait(self, timeout=None):
+        return self.dev.wait(timeout)
+
+    def read(self, n):
+        data = self.dev.read(n)
+        self.outfile.write(CAPTURE_RECORD.pack(time.monotonic_ns() - self.start, len(data)))
+        self.outfile.write(data)
+        # kept on disk as it arrives, so the bytes that broke the parser survive it
+        self.outfile.flush()
+        return data
+
+    def write(self, data):
+        self.dev.write(data)
+
+    def send_packet(self, pkt_type, data):
+        self.dev.send_packet(pkt_type, data)
+
+    def boot_rom(self, *args, **kwargs):
+        # the upload is not part of the capture
+        self.dev.boot_rom(*args, **kwargs)
 
-        # try to read n bytes of data and advance
-        data_out = self.data[:n]
-        self.data = self.data[n:]
-        # check how much data we actually got
-        got_len = len(data_out)
-        if got_len != n:
-            # didn't get enough, read remaining
-            data_out += self.get_n(n - got_len)
+    def whoami(self):
+        return self.dev.whoami()
+
+    def ping(self):
+        return self.dev.ping()
+
+class ReplayDevice(ExtDevice):
+    """
+    Plays back a capture log as if it came from the console. `speed` scales
+    the recorded timing (2 is twice as fast), 0 delivers everything at once.
+    Reads past the end of the log raise EOFError.
+    """
 
-        return data_out
+    def __init__(self, filename, speed=1.0):
+        with open(filename, "rb") as infile:
+            self.log = infile.read()
+        assert self.log[:len(CAPTURE_MAGIC)] == CAPTURE_MAGIC , f"{filename} is not a capture log"
+        self.filename = filename
+        self.speed = speed
+        self.offset = len(CAPTURE_MAGIC)
+        # bytes of the current record not read yet
+        self.pending = memoryview(b"")
+        self.start = None
+        self.first_time = 0
+        self.total = 0
+
+    def close(self):
+        if self.start is not None:
+            dt = time.monotonic() - self.start
+            print(f"Replayed {self.total} bytes in {dt:.3f} seconds ({self.total / max(dt, 1e-9) / 1e6:.2f} MB/s)",
+                  file=sys.stderr)
+
+    def reset(self):
+        pass
+
+    def wait(self, timeout=None):
+        if len(self.pending) != 0:
+            return len(self.pending)
+        # a capture cut short by the client being killed ends at its last whole record header
+        if self.offset + CAPTURE_RECORD.size > len(self.log):
+            raise EOFError("End of capture")
+        when, length = CAPTURE_RECORD.unpack_from(self.log, self.offset)
+        if self.start is None:
+            # the capture clock starts before the ROM upload, playback starts at the first data
+            self.start = time.monotonic()
+            self.first_time = when
+        if self.speed > 0:
+            delay = self.start + (when - self.first_time) / 1e9 / self.speed - time.monotonic()
+            if timeout is not None and delay > timeout:
+                time.sleep(timeout)
+                return 0
+            if delay > 0:
+                time.sleep(delay)
+
+        self.offset += CAPTURE_RECORD.size
+        self.pending = memoryview(self.log)[self.offset:self.offset + length]
+        self.offset += length
+        return length
+
+    def read(self, n):
+        data = bytes(self.pending[:n])
+        self.pending = self.pending[n:]
+        self.total += len(data)
+        return data
+
+    def write(self, data):
+        pass
+
+    def whoami(self):
+        return f"Capture replay of {self.filename}"
+
+class ConsoleIdle(Exception):
+    """
+    No data arrived from the console within the idle timeout
+    """
+
+class PacketStream:
+    """
+    Splits the byte stream from the device into UNFLoader packets.
+
+    Received data is appended to a single buffer and consumed by advancing an
+    offset rather than re-slicing, so each byte is copied a bounded number of
+    times however much is buffered. Consumed bytes are released from the front
+    of the buffer once they make up at least half of it.
+    """
+
+    # 'DMA@', then the type in the top byte and the 24-bit length below it
+    HEADER = struct.Struct(">4sI")
+    # bodies at least this long are copied out through a memoryview, below it the view costs more than a second copy
+    VIEW_MIN = 1024
+
+    def __init__(self, dev : ExtDevice, idle_timeout=None):
+        self.dev : ExtDevice = dev
+        self.idle_timeout = idle_timeout
+        self.buf = bytearray()
+        self.pos = 0
+
+    def available(self):
+        return len(self.buf) - self.pos
+
+    def more_data(self):
+        # wait for data, then read all of it
+        data_len = self.dev.wait(self.idle_timeout)
+        if data_len == 0:
+            raise ConsoleIdle(f"No data from the console for {self.idle_timeout} seconds")
+        if self.pos != 0 and self.pos * 2 >= len(self.buf):
+            del self.buf[:self.pos]
+            self.pos = 0
+        self.buf += self.dev.read(data_len)
+
+    def fill(self, n):
+        # buffer at least n unread bytes
+        while self.available() < n:
+            self.more_data()
 
     def get_pkt(self):
-        # if we get '\0' it means console was powered off
-        if self.peekc() == '\0':
+        # only call out to fill() when short of data, this runs once per debugf on the console
+        if len(self.buf) - self.pos < self.HEADER.size:
+            self.fill(1)
+            # if we get '\0' it means console was powered off
+            if self.buf[self.pos] == 0:
+                return None
+            self.fill(self.HEADER.size)
+        elif self.buf[self.pos] == 0:
             return None
 
-        # check dma@
-        dma = self.get_n(4)
-        assert dma == b'DMA@' , f"Not DMA@? {dma + self.data}"
+        # check dma@ and read the packet header
+        pos = self.pos
+        dma, type_length = self.HEADER.unpack_from(self.buf, pos)
+        assert dma == b'DMA@' , f"Not DMA@? {bytes(self.buf[pos:pos+16])}"
+        pkt_length = type_length & 0xFFFFFF
+
+        # header, body and cmph, padded to a 2-byte boundary (old protocol was 16-byte)
+        size = (self.HEADER.size + pkt_length + 4 + 1) & ~1
+        if len(self.buf) - pos < size:
+            self.fill(size)
+            pos = self.pos
+
+        data_start = pos + self.HEADER.size
+        data_end = data_start + pkt_length
+        assert self.buf[data_end:data_end+4] == b'CMPH' , f"Not CMPH? {bytes(self.buf[data_end:data_end+16])}"
+        if pkt_length < self.VIEW_MIN:
+            pkt_data = bytes(self.buf[data_start:data_end])
+        else:
+            # copied once through a view rather than sliced and copied again
+            with memoryview(self.buf) as view:
+                pkt_data = bytes(view[data_start:data_end])
+        self.pos = pos + size
+
+        # return type + data
+        return type_length >> 24, pkt_data
+
+class ResultStitcher:
+    """
+    Joins the result packets the console sends while it runs a spec (one
+    per CHECKPOINT_RUNS samples, see src/results.h) into one packet per
+    spec, written to `out` once the spec is complete. Tracks how far the
+    campaign got so a restarted console can carry on from there, from the
+    console text of text builds, which send no result packets.
+    """
+
+    def __init__(self, out=None):
+        self.out = out
+        self.partial = None
+        self.last_spec = None
+        self.boot()
+
+    def boot(self, config=None):
+        """
+        The console is booted with RunConfig `config`, it prints the specs it
+        selects in order
+        """
+        start = 0 if config is None else config.start_spec
+        self.text_ids = (i for i in itertools.count(start) if config is None or config.selects(i))
+        self.text_pending = ""
+        self.text_block = False
+
+    def text(self, txt):
+        """
+        Console text, a spec of a text build is finished when its last block of samples closes
+        """
+        *lines, self.text_pending = (self.text_pending + txt).split("\n")
+        for line in lines:
+            line = line.rstrip("\r")
+            if line == TextLogParser.BLOCKS[-1]:
+                self.text_block = True
+            elif line == "]" and self.text_block:
+                self.text_block = False
+                self.finished(next(self.text_ids))
+
+    def resume_point(self):
+        """
+        The spec and sample to restart the console at
+        """
+        if self.partial is not None:
+            return self.partial.spec_id, self.partial.num_samples
+        return (0 if self.last_spec is None else self.last_spec + 1), 0
+
+    def finished(self, spec_id):
+        self.partial = None
+        self.last_spec = spec_id if self.last_spec is None else max(self.last_spec, spec_id)
 
-        # read packet header and body
-        pkt_type = self.getc()
-        pkt_length = (self.getc() << 16) | (self.getc() << 8) | self.getc()
-        pkt_data = self.get_n(pkt_length)
+    def write(self, data):
+        _, version, spec_id, _, _, num_samples = RESULTS_HEADER.unpack_from(data)
+        first_sample, total_samples = 0, num_samples
+        if version >= 3:
+            first_sample, total_samples = RESULTS_HEADER_V3.unpack_from(data, RESULTS_HEADER.size + RESULTS_HEADER_V2.size)
+
+        if first_sample == 0 and num_samples == total_samples:
+            # already whole, as from ROMs built before checkpointing
+            self.partial = None
+            self.emit(data, spec_id)
+            return
+
+        res, _ = decode_result(data)
+        partial = self.partial
+        if partial is not None and (partial.spec_id != spec_id or partial.num_samples != first_sample):
+            print(f"\nDiscarding {partial.num_samples} samples of spec {partial.spec_id}, the console went on to "
+                  f"spec {spec_id} sample {first_sample}", file=sys.stderr)
+            partial = None
+        if partial is None:
+            if first_sample != 0:
+                print(f"\nDiscarding samples {first_sample}..{first_sample + num_samples} of spec {spec_id}, "
+                      "the start of the spec is missing", file=sys.stderr)
+                return
+            partial = res
+        else:
+            for name,samples in res.counters.items():
+                partial.counters[name] += samples
+            # cut short when the host stopped the spec early
+            partial.total_samples = res.total_samples
 
-        # check cmph
-        cmph = self.get_n(4)
-        assert cmph == b'CMPH' , f"Not CMPH? {cmph + self.data}"
+        if partial.num_samples == partial.total_samples:
+            self.emit(encode_result(partial), spec_id)
+        else:
+            self.partial = partial
 
-        # discard up to 2-byte boundary (old protocol was 16-byte)
-        pos = 4 + 1 + 3 + pkt_length + 4
-        aligned = (pos + 1) & ~1
-        _ = self.get_n(aligned - pos)
+    def emit(self, data, spec_id):
+        self.finished(spec_id)
+        if self.out is not None:
+            self.out.write(data)
 
-        # return type + data
-        return pkt_type, pkt_data
+    def flush(self):
+        if self.out is not None:
+            self.out.flush()
 
-def listen_spinloop(dev, tcp_port=411):
+def listen(dev, results_out=None, idle_timeout=None, tcp_port=411, spec_table=None, rule=None):
+    """
+    Handles packets from the console until it reports it is done, returning
+    True, or until it powers off or goes silent for `idle_timeout` seconds,
+    returning False.
+    """
     def handle_sigint(signum, frame):
         print("exit")
         dev.close()
@@ -232,15 +764,32 @@ def listen_spinloop(dev, tcp_port=411):
 
     signal.signal(signal.SIGINT, handle_sigint)
 
+    return handle_packets(dev, ResultStitcher(results_out), idle_timeout, spec_table=spec_table, rule=rule)
+
+def handle_packets(dev, results=None, idle_timeout=None, text_out=sys.stdout, label="", spec_table=None, rule=None):
+    """
+    Packet loop of listen(), usable from any thread. Result packets go to the
+    ResultStitcher `results`, console text goes to `text_out` and messages
+    from the client are prefixed with `label`. The ROM's request for a spec
+    table is answered with `spec_table`, or with none to run its own. With a
+    StoppingRule (adaptive.py) `rule`, the console is told to stop each spec
+    as soon as the samples received so far meet it.
+    """
     # Attach packet stream
-    stream = PacketStream(dev)
+    stream = PacketStream(dev, idle_timeout)
+    # spec last asked to stop, so the request is sent once
+    stopped = None
 
     while True:
         # Wait for a message
-        recv = stream.get_pkt()
+        try:
+            recv = stream.get_pkt()
+        except (ConsoleIdle, EOFError) as e:
+            print(f"\n{label}{e}, stopping", file=sys.stderr)
+            return False
         if recv is None:
             # Assume powered off, exit
-            break
+            return False
 
         # Handle packet
 
@@ -248,37 +797,299 @@ def listen_spinloop(dev, tcp_port=411):
 
         if pkt_type == 0x01: # TEXT
             txt = data.decode("ASCII")
-            print(txt, end='')
+            # flushed so the log can be followed while the campaign runs
+            print(txt, end='', file=text_out, flush=True)
+            if results is not None:
+                results.text(txt)
             if "!!DONE!!" in txt:
                 # Quit when done signal arrives
-                return
+                return True
         elif pkt_type == 0x05: # HEARTBEAT
             pass
+        elif pkt_type == RESULTS_DATATYPE:
+            if results is not None:
+                results.write(data)
+                results.flush()
+                partial = results.partial
+                if rule is not None and partial is not None and partial.spec_id != stopped and \
+                   rule.should_stop(partial.counters):
+                    dev.send_packet(RESULTS_STOP_DATATYPE, RESULTS_STOP.pack(partial.spec_id, 0))
+                    stopped = partial.spec_id
+        elif pkt_type == SPEC_TABLE_DATATYPE:
+            version, = struct.unpack(">I", data)
+            if spec_table is not None and version != SPEC_TABLE_VERSION:
+                print(f"\n{label}The ROM takes spec table version {version}, not {SPEC_TABLE_VERSION}, "
+                      "it will run its own table", file=sys.stderr)
+                dev.send_packet(SPEC_TABLE_DATATYPE, b"")
+            else:
+                dev.send_packet(SPEC_TABLE_DATATYPE, spec_table or b"")
         else:
             # TODO others
-            print(f"\ngotpkt type={pkt_type} data=[{data}]")
+            print(f"\n{label}gotpkt type={pkt_type} data=[{data}]")
+
+def run_console(dev, rom_path, boot_args, results, idle_timeout=None, config=None, max_restarts=0,
+                text_out=sys.stdout, label="", spec_table=None, rule=None):
+    """
+    Boots the ROM on one console and handles its packets until the campaign
+    is done. When the console goes silent for `idle_timeout` seconds or
+    powers off, it is rebooted up to `max_restarts` times with `config`
+    (a RunConfig) set to resume after the last sample received, or after
+    the last spec a text build finished. Returns whether the campaign
+    finished.
+    """
+    restarts = 0
+    while True:
+        if config is not None:
+            config.start_spec, config.start_sample = results.resume_point()
+        results.boot(config)
+        try:
+            dev.boot_rom(rom_path, *boot_args, run_config=config)
+        except (RuntimeError, ValueError) as e:
+            print(f"{label}{e}", file=sys.stderr)
+            return False
+
+        try:
+            if handle_packets(dev, results, idle_timeout, text_out, label, spec_table, rule):
+                return True
+        except AssertionError as e:
+            # garbage on the link, e.g. from a cable glitch
+            print(f"\n{label}Bad packet: {e}", file=sys.stderr)
+
+        if restarts == max_restarts:
+            return False
+        restarts += 1
+
+        spec, sample = results.resume_point()
+        print(f"{label}Console stopped responding, restarting at spec {spec} sample {sample} "
+              f"(restart {restarts} of {max_restarts})", file=sys.stderr)
+        # a hung console has to be reset by hand before the flashcart answers again
+        if not dev.ping():
+            print(f"{label}Waiting for the flashcart, reset the console if it has hung", file=sys.stderr)
+            while not dev.ping():
+                pass
+
+def resume_results(results_path, stitcher, console=None):
+    """
+    Marks the specs already in a results file as done, for --resume
+    """
+    if not os.path.exists(results_path):
+        return
+    for res in load_results(results_path):
+        if console is None or res.console == console:
+            stitcher.finished(res.spec_id)
+
+class LockedWriter:
+    """
+    File shared between consoles of a farm, each write lands whole
+    """
+
+    def __init__(self, outfile, lock):
+        self.outfile = outfile
+        self.lock = lock
+
+    def write(self, data):
+        with self.lock:
+            self.outfile.write(data)
+
+    def flush(self):
+        with self.lock:
+            self.outfile.flush()
+
+class LabelledText:
+    """
+    Console text of one console of a farm, written to stdout a line at a time with the console's label
+    """
+
+    def __init__(self, label, lock):
+        self.label = label
+        self.lock = lock
+        self.pending = ""
+
+    def write(self, txt):
+        *lines, self.pending = (self.pending + txt).split("\n")
+        if len(lines) != 0:
+            with self.lock:
+                sys.stdout.write("".join(f"{self.label}{line}\n" for line in lines))
+
+    def flush(self):
+        with self.lock:
+            sys.stdout.flush()
+
+def run_farm(devs, rom_path, results_path=None, idle_timeout=None, block_size=None, verify=False, delta=False,
+             rom_cache_path=None, ref_spec=0, max_restarts=0, resume=False, spec_table=None, rule=None, max_runs=0):
+    """
+    Runs one campaign across several consoles. Each console runs every
+    len(devs)-th spec, plus `ref_spec` which all of them measure for
+    estimating per-console bias. Results from every console go to one file,
+    each packet carrying the console id. Returns whether all consoles finished.
+    """
+    results_out = None if results_path is None else open(results_path, "ab" if resume else "wb")
+    lock = threading.Lock()
+    done = [False] * len(devs)
+
+    def run(i):
+        dev = devs[i]
+        label = f"[console {i}] "
+        config = RunConfig(i, i, len(devs), None if ref_spec < 0 else ref_spec, max_runs=max_runs)
+        results = ResultStitcher(None if results_out is None else LockedWriter(results_out, lock))
+        if resume:
+            resume_results(results_path, results, i)
+        cache = RomCache(dev.ser.port, None if rom_cache_path is None else f"{rom_cache_path}.{i}")
+        done[i] = run_console(dev, rom_path, (block_size, verify, cache, delta), results, idle_timeout, config,
+                              max_restarts, LabelledText(label, lock), label, spec_table, rule)
+
+    for i,dev in enumerate(devs):
+        print(f"Console {i}: {dev.whoami()}, running specs {i} mod {len(devs)}" +
+              ("" if ref_spec < 0 else f" and reference spec {ref_spec}"))
+
+    def handle_sigint(signum, frame):
+        print("exit")
+        for dev in devs:
+            dev.close()
+        sys.exit(0)
+
+    signal.signal(signal.SIGINT, handle_sigint)
+
+    # uploads run concurrently too, the flashcarts are on separate ports
+    threads = [threading.Thread(target=run, args=(i,), daemon=True) for i in range(len(devs))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    if results_out is not None:
+        results_out.close()
+    for i in range(len(devs)):
+        if not done[i]:
+            print(f"Console {i} did not finish its specs", file=sys.stderr)
+    return all(done)
+
+def main(rom_path, keep_alive, ports=None, results_path=None, idle_timeout=None, block_size=None, verify=False,
+         delta=False, rom_cache_path=None, capture_path=None, replay_path=None, replay_speed=1.0, farm=False,
+         ref_spec=0, max_restarts=0, resume=False, specs_path=None, adaptive=None, adaptive_min=200, adaptive_max=0):
+    spec_table = None
+    if specs_path is not None:
+        # Specs to run in place of the table built into the ROM
+        try:
+            spec_table = load_spec_table(specs_path)
+        except (OSError, ValueError) as e:
+            print(e)
+            sys.exit(1)
+        print(f"Spec table {specs_path}: {len(decode_spec_table(spec_table))} specs")
+
+    rule = None
+    if adaptive is not None:
+        # Specs end once measured to within `adaptive` clocks, the ROM runs up to adaptive_max
+        from adaptive import StoppingRule
+        rule = StoppingRule(adaptive, min_samples=adaptive_min)
+
+    if farm:
+        # Every flashcart found takes a share of the spec table
+        devs = ExtDevice.try_detect_all(ports)
+        if len(devs) == 0:
+            print("No Device Found")
+            sys.exit(1)
+        done = run_farm(devs, rom_path, results_path, idle_timeout, block_size, verify, delta, rom_cache_path,
+                        ref_spec, max_restarts, resume, spec_table, rule, adaptive_max)
+        for dev in devs:
+            dev.close()
+        sys.exit(0 if done else 1)
+
+    if replay_path is not None:
+        # Console output from a capture log instead of a flashcart
+        dev = ReplayDevice(replay_path, replay_speed)
+        results_out = None if results_path is None else open(results_path, "wb")
+        try:
+            done = listen(dev, results_out, idle_timeout)
+        finally:
+            if results_out is not None:
+                results_out.close()
+        dev.close()
+        sys.exit(0 if done else 1)
 
-def main(rom_path, keep_alive):
     # Find flashcart device
-    dev = ExtDevice.try_detect()
+    dev = ExtDevice.try_detect(ports)
     if dev is None:
         print("No Device Found")
         sys.exit(1)
     print(dev.whoami())
+    cache = RomCache(dev.ser.port, rom_cache_path)
+
+    if not keep_alive:
+        # Boot ROM
+        try:
+            dev.boot_rom(rom_path, block_size, verify, cache, delta)
+        except (RuntimeError, ValueError) as e:
+            print(e)
+            dev.close()
+            sys.exit(1)
+        dev.close()
+        return
 
-    # Boot ROM
-    dev.boot_rom(rom_path)
+    if capture_path is not None:
+        dev = CaptureDevice(dev, capture_path)
 
-    # Await messages if keep alive
-    if keep_alive:
-        listen_spinloop(dev)
+    def handle_sigint(signum, frame):
+        print("exit")
+        dev.close()
+        sys.exit(0)
 
-    # Done
-    dev.close()
+    signal.signal(signal.SIGINT, handle_sigint)
+
+    # Boot ROM and await messages, restarting the console if asked to
+    results_out = None if results_path is None else open(results_path, "ab" if resume else "wb")
+    results = ResultStitcher(results_out)
+    if resume:
+        resume_results(results_path, results)
+    config = RunConfig(max_runs=adaptive_max) if max_restarts > 0 or resume or adaptive_max != 0 else None
+    try:
+        done = run_console(dev, rom_path, (block_size, verify, cache, delta), results, idle_timeout, config,
+                           max_restarts, spec_table=spec_table, rule=rule)
+    finally:
+        if results_out is not None:
+            results_out.close()
+        dev.close()
+    if not done:
+        sys.exit(1)
 
 if __name__ == '__main__':
     parser = argparse.ArgumentParser(description="Flashcart USB communication")
-    parser.add_argument("rom", help=".z64 rom file to run")
+    parser.add_argument("rom", nargs="?", help=".z64 rom file to run")
     parser.add_argument("--keep-alive", help="keep communication open during runtime", action="store_true")
+    parser.add_argument("--port", help="serial port of the flashcart, skips detection over all ports (repeatable with --farm)", action="append")
+    parser.add_argument("--results", help="file to write binary result packets to")
+    parser.add_argument("--idle-timeout", help="with --keep-alive, give up after this many seconds without data from the console, 0 to wait forever (default 60)", type=float, default=60)
+    parser.add_argument("--block-size", help=f"bytes per write during the ROM upload, a multiple of 512 (default {UPLOAD_BLOCK_SIZE})", type=lambda x: int(x, 0))
+    parser.add_argument("--verify", help="read the ROM back after uploading and check it before booting", action="store_true")
+    parser.add_argument("--delta", help="only upload the parts of the ROM that changed since the last upload to this flashcart", action="store_true")
+    parser.add_argument("--rom-cache", help="file recording the ROM last uploaded (default: per port, under ~/.cache/rdp_fill_timing)")
+    parser.add_argument("--capture", help="record every byte received from the console, with timestamps, to this file")
+    parser.add_argument("--replay", help="process a file recorded with --capture instead of talking to a flashcart")
+    parser.add_argument("--speed", help="with --replay, playback speed relative to the capture, 0 for as fast as possible (default 1)", type=float, default=1.0)
+    parser.add_argument("--farm", help="split the campaign across every flashcart found (or given with --port), merging the results", action="store_true")
+    parser.add_argument("--ref-spec", help="with --farm, spec run on every console to measure per-console bias, -1 for none (default 0)", type=int, default=0)
+    parser.add_argument("--max-restarts", help="reboot a console that stops responding up to this many times, resuming where it stopped (default 0)", type=int, default=0)
+    parser.add_argument("--resume", help="carry on the campaign in the --results file, skipping the specs it already holds", action="store_true")
+    parser.add_argument("--specs", help="spec table to run instead of the ROM's own, as text or compiled by spec_table.py")
+    parser.add_argument("--adaptive", help="stop each spec once the 95%% confidence interval of every counter's mean is within this many RDP clocks either side (binary builds)", type=float, metavar="CLOCKS")
+    parser.add_argument("--adaptive-min", help="with --adaptive, never stop a spec before this many samples (default 200)", type=int, default=200)
+    parser.add_argument("--adaptive-max", help="with --adaptive, run each spec at most this many times, replacing the ROM's run counts (default 2000, at most 4000)", type=int, default=2000)
     args = parser.parse_args()
-    main(args.rom, args.keep_alive)
+    if args.rom is None and args.replay is None:
+        parser.error("a rom is required unless replaying a capture")
+    if args.farm and (args.capture is not None or args.replay is not None):
+        parser.error("--capture and --replay work with a single console")
+    if args.resume and args.results is None:
+        parser.error("--resume needs the --results file to carry on")
+    if (args.max_restarts > 0 or args.resume) and not (args.keep_alive or args.farm):
+        parser.error("--max-restarts and --resume need --keep-alive")
+    if args.specs is not None and (args.replay is not None or not (args.keep_alive or args.farm)):
+        parser.error("--specs needs --keep-alive, the ROM asks for the table once it has booted")
+    if args.adaptive is not None and (args.replay is not None or not (args.keep_alive or args.farm)):
+        parser.error("--adaptive needs --keep-alive, the client stops specs as their results arrive")
+    if not 0 < args.adaptive_max <= 4000:
+        parser.error("--adaptive-max must be between 1 and 4000")
+    main(args.rom, args.keep_alive, args.port, args.results, args.idle_timeout or None, args.block_size, args.verify,
+         args.delta, args.rom_cache, args.capture, args.replay, args.speed, args.farm, args.ref_spec,
+         args.max_restarts, args.resume, args.specs, args.adaptive, args.adaptive_min,
+         0 if args.adaptive is None else args.adaptive_max)
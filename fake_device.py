@@ -0,0 +1,438 @@
+#!/usr/bin/env python3
+#
+#   Fake Everdrive 64 on a pty
+#
+#   Answers the flashcart command protocol used by client.py, accepts a ROM
+#   upload and then replays recorded result packets to the host as a console
+#   running rdp_fill_timing would. With --simulate it instead generates a
+#   campaign of any size from a chosen sample distribution, for load testing
+#   the host side. Run it, then point client.py --port at the printed pty path.
+#   Only the specs selected by the run configuration patched into the uploaded
+#   ROM are sent, so several instances can stand in for a farm of consoles.
+#   --hang-after makes the console stop responding part way through, to test
+#   restarting and resuming a campaign. A spec table sent by client.py --specs
+#   replaces the campaign's specs, by description when replaying. Requests from
+#   client.py --adaptive to stop a spec early are honoured at each checkpoint;
+#   --run-time paces the samples as the console would so they arrive in time.
+#
+
+import argparse, os, select, struct, sys, termios, time, tty
+
+from rdp_results import RESULTS_DATATYPE, RESULTS_STOP, RESULTS_STOP_DATATYPE, RunConfig, SpecResult, load_results, \
+                        encode_result
+from spec_table import SPEC_TABLE_DATATYPE, SPEC_TABLE_VERSION, SpecError, decode_spec_table
+
+DATATYPE_TEXT = 0x01
+
+# Samples per result packet, as CHECKPOINT_RUNS in src/test_main.c
+CHECKPOINT_RUNS = 100
+
+# Seconds to wait for a spec table, as SPEC_TABLE_TIMEOUT_MS in src/test_main.c
+SPEC_TABLE_TIMEOUT = 3
+
+# Host packets arrive padded to whole sectors
+SECTOR_SIZE = 512
+
+def frame_packet(pkt_type, data):
+    """
+    Frames a packet the way the UNFLoader USB library on the console does
+    """
+    out = bytearray(b'DMA@')
+    out.append(pkt_type)
+    out.extend(struct.pack(">I", len(data))[1:])
+    out.extend(data)
+    out.extend(b'CMPH')
+    if len(out) % 2 != 0:
+        out.append(0)
+    return bytes(out)
+
+def checkpoint_chunks(res, chunk):
+    """
+    Splits a result into the packets the ROM sends while it runs the spec,
+    breaking at every multiple of `chunk` samples
+    """
+    first = res.first_sample
+    end = first + res.num_samples
+    while first < end:
+        n = min(end, (first // chunk + 1) * chunk) - first
+        offset = first - res.first_sample
+        counters = { name : samples[offset:offset + n] for name,samples in res.counters.items() }
+        yield SpecResult(res.spec_id, res.desc, counters, res.console, first, res.total_samples)
+        first += n
+
+def campaign_packets(results, binary=True, chunk=CHECKPOINT_RUNS, stopped=None, run_time=0):
+    """
+    Produces the packet stream of a full campaign for the given results.
+    Binary results are sent in packets of `chunk` samples, 0 for whole specs.
+    Before each packet `stopped(spec_id)` is asked whether the host wants
+    the spec ended there, and `run_time` seconds per sample are spent as the
+    console would measuring them.
+    """
+    yield frame_packet(DATATYPE_TEXT, b"!!BEGIN!!\n")
+    for res in results:
+        yield frame_packet(DATATYPE_TEXT, f"{res.desc}\n".encode("ascii"))
+        if binary:
+            for part in (checkpoint_chunks(res, chunk) if chunk != 0 else (res,)):
+                if run_time > 0:
+                    time.sleep(part.num_samples * run_time)
+                if stopped is not None and stopped(res.spec_id):
+                    part.total_samples = part.first_sample + part.num_samples
+                yield frame_packet(RESULTS_DATATYPE, encode_result(part))
+                if part.first_sample + part.num_samples == part.total_samples:
+                    break
+        else:
+            for name,samples in res.counters.items():
+                txt = f"{name.upper()} = [\n    " + "".join(f"{v}, " for v in samples) + "\n]\n"
+                yield frame_packet(DATATYPE_TEXT, txt.encode("ascii"))
+    for _ in range(3):
+        yield frame_packet(DATATYPE_TEXT, b"!!DONE!!\n\n\n")
+
+ROM_BASE = 0x10000000
+
+class SampleModel:
+    """
+    Synthetic timing distributions for simulated campaigns. Each spec gets a
+    base time drawn from [lo, hi) cycles, its samples are spread around it
+    according to `dist`, and a fraction `outliers` are made 5-50% slower as
+    the occasional interrupted run is on hardware.
+    """
+
+    DISTRIBUTIONS = ("normal", "uniform", "bimodal")
+
+    def __init__(self, dist="normal", spread=150, gap=400, weight=0.3, outliers=0.005, lo=90000, hi=240000, seed=0):
+        assert dist in self.DISTRIBUTIONS , f"Unknown distribution {dist}"
+        self.dist = dist
+        self.spread = spread
+        self.gap = gap
+        self.weight = weight
+        self.outliers = outliers
+        self.lo = lo
+        self.hi = hi
+        self.seed = seed
+
+    def counter(self, rng, base, n):
+        import numpy as np
+
+        if self.dist == "uniform":
+            v = rng.uniform(base - self.spread, base + self.spread, n)
+        else:
+            v = rng.normal(base, self.spread, n)
+            if self.dist == "bimodal":
+                # a second mode `gap` cycles slower holding `weight` of the samples
+                v += self.gap * (rng.random(n) < self.weight)
+
+        slow = rng.random(n) < self.outliers
+        v[slow] = base * rng.uniform(1.05, 1.5, np.count_nonzero(slow))
+        return np.clip(np.rint(v), 0, 0xFFFFFFFF).astype(np.uint32).tolist()
+
+    def spec(self, spec_id, num_samples):
+        import numpy as np
+
+        # seeded per spec so any spec can be regenerated on its own
+        rng = np.random.default_rng([self.seed, spec_id])
+        base = rng.uniform(self.lo, self.hi)
+        return SpecResult(spec_id, f"Simulated spec {spec_id}, {self.dist}", {
+            "buf"   : self.counter(rng, base, num_samples),
+            "pipe"  : self.counter(rng, base, num_samples),
+            # fills load no textures, and the RDP runs a little longer than its units are busy
+            "tmem"  : [0] * num_samples,
+            "clock" : self.counter(rng, base + 60, num_samples),
+        })
+
+def simulated_results(model, num_specs, num_samples, spec_time=0, config=RunConfig(), specs=None):
+    """
+    Generates a campaign one spec at a time, taking `spec_time` seconds per
+    spec as the console would to run it. With a spec table from the host
+    its specs are generated instead, with their descriptions and run counts.
+    """
+    for spec_id in range(num_specs if specs is None else len(specs)):
+        if not config.selects(spec_id):
+            continue
+        if spec_time > 0:
+            time.sleep(spec_time)
+        if specs is None:
+            # spec ids are 16 bits in result packets
+            yield model.spec(spec_id & 0xFFFF, config.max_runs or num_samples)
+        else:
+            spec = specs[spec_id]
+            res = model.spec(spec_id, config.max_runs or spec.num_runs or num_samples)
+            res.desc = spec.desc
+            yield res
+
+def table_results(recorded, specs):
+    """
+    Recorded results in the order of a spec table from the host, matched by
+    description and cut to the table's run counts. Specs never recorded are
+    left out.
+    """
+    by_desc = { res.desc : res for res in recorded }
+    for spec_id,spec in enumerate(specs):
+        res = by_desc.get(spec.desc)
+        if res is None:
+            print(f"No recording of spec {spec_id} '{spec.desc}', leaving it out", file=sys.stderr)
+            continue
+        n = min(spec.num_runs or res.num_samples, res.num_samples)
+        yield SpecResult(spec_id, spec.desc, { name : samples[:n] for name,samples in res.counters.items() })
+
+class FakeED64:
+    """
+    `rate` limits how fast ROM data is accepted, in bytes per second, to
+    model the USB link. `corrupt` is a list of ROM offsets whose bytes are
+    flipped as they are written, to exercise upload verification.
+    """
+
+    def __init__(self, rate=None, corrupt=()):
+        self.master, self.slave = os.openpty()
+        # no echo or line discipline, the client sees exactly what we write
+        tty.setraw(self.slave)
+        tty.setraw(self.master)
+        self.rate = rate
+        self.corrupt = set(corrupt)
+        self.rom_mem = bytearray()
+        self.rom_size = 0
+
+    @property
+    def port(self):
+        return os.ttyname(self.slave)
+
+    def close(self):
+        os.close(self.master)
+        os.close(self.slave)
+
+    def read_exact(self, n):
+        buf = bytearray()
+        while len(buf) < n:
+            buf.extend(os.read(self.master, n - len(buf)))
+        return bytes(buf)
+
+    def write(self, data):
+        data = memoryview(data)
+        while len(data) != 0:
+            data = data[os.write(self.master, data):]
+
+    def rom_access(self, address, length):
+        offset = address - ROM_BASE
+        assert offset >= 0 , f"Address 0x{address:08X} is not in ROM"
+        if len(self.rom_mem) < offset + length:
+            self.rom_mem.extend(bytes(offset + length - len(self.rom_mem)))
+        return offset
+
+    def receive_rom(self, offset, length):
+        t = time.time()
+        received = 0
+        while received < length:
+            n = min(length - received, 64 * 1024)
+            self.rom_mem[offset + received:offset + received + n] = self.read_exact(n)
+            received += n
+            if self.rate is not None:
+                # hold back until the modelled link would have delivered this much
+                delay = t + received / self.rate - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+        for o in self.corrupt:
+            if offset <= o < offset + length:
+                self.rom_mem[o] ^= 0xFF
+
+    def serve_boot(self):
+        """
+        Handles commands until the ROM is started, returns the uploaded ROM
+        """
+        while True:
+            cmd = self.read_exact(16)
+            assert cmd[0:3] == b'cmd' , f"Not cmd? {cmd}"
+            op = chr(cmd[3])
+            address, length, arg = struct.unpack(">III", cmd[4:])
+            length *= 512
+
+            if op == 't':
+                self.write(b'cmdr' + bytes(12))
+            elif op == 'c':
+                offset = self.rom_access(address, length)
+                self.rom_mem[offset:offset + length] = bytes([arg & 0xFF]) * length
+            elif op == 'W':
+                offset = self.rom_access(address, length)
+                self.receive_rom(offset, length)
+                self.rom_size = max(self.rom_size, offset + length)
+            elif op == 'R':
+                offset = self.rom_access(address, length)
+                self.write(self.rom_mem[offset:offset + length])
+            elif op == 's':
+                # filename packet
+                self.read_exact(256)
+                return bytes(self.rom_mem[:self.rom_size])
+            else:
+                print(f"Unhandled command '{op}'", file=sys.stderr)
+
+    def read_packet(self, timeout=None):
+        """
+        Reads a packet sent by the host to the ROM, returns its type and data
+        or None if nothing arrives within `timeout` seconds
+        """
+        ready, _, _ = select.select([self.master], [], [], timeout)
+        if len(ready) == 0:
+            return None
+
+        header = self.read_exact(8)
+        assert header[0:4] == b'DMA@' , f"Not a packet? {header}"
+        type_length, = struct.unpack(">I", header[4:])
+        size = type_length & 0xFFFFFF
+        data = self.read_exact(size)
+        assert self.read_exact(4) == b'CMPH' , "Packet not terminated"
+        self.read_exact(-(len(header) + size + 4) % SECTOR_SIZE)
+        return type_length >> 24, data
+
+    def request_spec_table(self):
+        """
+        Asks the host for a spec table as the ROM does once booted, returning
+        its specs, or None to run the campaign's own
+        """
+        self.write(frame_packet(SPEC_TABLE_DATATYPE, struct.pack(">I", SPEC_TABLE_VERSION)))
+        pkt = self.read_packet(SPEC_TABLE_TIMEOUT)
+        if pkt is None:
+            print("No answer to the spec table request", file=sys.stderr)
+            return None
+        pkt_type, data = pkt
+        if pkt_type != SPEC_TABLE_DATATYPE or len(data) == 0:
+            return None
+        try:
+            return decode_spec_table(data)
+        except SpecError as e:
+            print(f"Bad spec table from the host, running the built-in table: {e}", file=sys.stderr)
+            return None
+
+    def stop_requested(self, spec_id):
+        """
+        Whether the host has asked to stop `spec_id`, as the ROM checks at each checkpoint
+        """
+        stop = False
+        while True:
+            pkt = self.read_packet(0)
+            if pkt is None:
+                break
+            pkt_type, data = pkt
+            if pkt_type == RESULTS_STOP_DATATYPE and RESULTS_STOP.unpack(data)[0] == spec_id:
+                stop = True
+        if stop:
+            print(f"Stopping spec {spec_id} early", file=sys.stderr)
+        return stop
+
+    def replay(self, packets, stream_rate=None, limit=None):
+        """
+        Sends packets to the host, at most `stream_rate` bytes per second if
+        given. Stops after `limit` packets if given, returning False.
+        """
+        total = 0
+        t = time.time()
+        for n,pkt in enumerate(packets):
+            if n == limit:
+                print(f"Hanging after {n} packets", file=sys.stderr)
+                return False
+            self.write(pkt)
+            total += len(pkt)
+            if stream_rate is not None:
+                delay = t + total / stream_rate - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+        # wait for the client to read everything so the rate reflects the host side
+        termios.tcdrain(self.master)
+        dt = time.time() - t
+        print(f"Replayed {total} bytes in {dt:.3f} seconds ({total / dt / 1e6:.2f} MB/s)", file=sys.stderr)
+        return True
+
+def console_results(results, config, bias=1.0):
+    """
+    The part of a campaign a console with the given run configuration sends,
+    with every sample scaled by `bias` to model a console that runs slow or fast
+    """
+    for res in results:
+        if not config.selects(res.spec_id):
+            continue
+        # a resumed console skips the samples it sent before, recordings have no more than they hold
+        first = config.start_sample if res.spec_id == config.start_spec else 0
+        end = res.num_samples if config.max_runs == 0 else min(res.num_samples, config.max_runs)
+        counters = { name : samples[first:end] for name,samples in res.counters.items() }
+        if bias != 1.0:
+            counters = { name : [round(v * bias) for v in samples] for name,samples in counters.items() }
+        yield SpecResult(res.spec_id, res.desc, counters, config.console_id, first, end)
+
+def main(results, text, rate=None, corrupt=(), rom_image=None, stream_rate=None, bias=1.0, chunk=CHECKPOINT_RUNS,
+         hang_after=None, run_time=0):
+    """
+    `results` is called with the run configuration found in the uploaded ROM
+    and the specs of the host's spec table (None without one), and returns
+    the campaign to send. With `hang_after` the first boot stops sending
+    after that many packets and waits to be booted again.
+    """
+    dev = FakeED64(rate, corrupt)
+    if rom_image is not None and os.path.exists(rom_image):
+        with open(rom_image, "rb") as infile:
+            dev.rom_mem[:] = infile.read()
+    print(dev.port, flush=True)
+
+    while True:
+        rom = dev.serve_boot()
+        print(f"Received ROM (0x{len(rom):X} bytes)", file=sys.stderr)
+        if rom_image is not None:
+            with open(rom_image, "wb") as outfile:
+                outfile.write(dev.rom_mem)
+
+        # ROMs without a run configuration block run the whole table
+        offset = RunConfig.find(rom)
+        config = RunConfig() if offset is None else RunConfig.unpack(rom, offset)
+
+        specs = dev.request_spec_table()
+        if specs is not None:
+            print(f"Received spec table ({len(specs)} specs)", file=sys.stderr)
+            dev.write(frame_packet(DATATYPE_TEXT, f"Running {len(specs)} specs from the host\n".encode("ascii")))
+
+        packets = campaign_packets(console_results(results(config, specs), config, bias), not text, chunk,
+                                   dev.stop_requested, run_time)
+        if dev.replay(packets, stream_rate, hang_after):
+            break
+        # reset by hand, back in the flashcart menu
+        hang_after = None
+
+    # Keep the pty alive until the client has drained it
+    time.sleep(1)
+    dev.close()
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Fake Everdrive 64 replaying recorded or simulated results over a pty")
+    parser.add_argument("results", nargs="?", help="binary result file or text log to replay")
+    parser.add_argument("--repeat", help="replay the results this many times", type=int, default=1)
+    parser.add_argument("--text", help="send debugf text rather than binary result packets", action="store_true")
+    parser.add_argument("--rate", help="accept ROM data at most this many MB/s, to model the USB link", type=float)
+    parser.add_argument("--corrupt", help="flip the ROM byte at this offset as it is written (repeatable)", type=lambda x: int(x, 0), action="append", default=[])
+    parser.add_argument("--rom-image", help="file holding the cart's ROM memory between runs, as the real cart keeps it")
+    parser.add_argument("--stream-rate", help="send results at most this many MB/s", type=float)
+    parser.add_argument("--bias", help="scale every sample by this factor, as a console running slow (default 1)", type=float, default=1.0)
+    parser.add_argument("--chunk", help=f"samples per result packet, 0 to send whole specs (default {CHECKPOINT_RUNS})", type=int, default=CHECKPOINT_RUNS)
+    parser.add_argument("--hang-after", help="stop responding after sending this many packets, until the ROM is booted again", type=int)
+    parser.add_argument("--run-time", help="milliseconds the console spends measuring each sample (default 0)", type=float, default=0)
+
+    sim = parser.add_argument_group("simulation", "generate a campaign instead of replaying one")
+    sim.add_argument("--simulate", help="number of specs to generate", type=int, metavar="SPECS")
+    sim.add_argument("--samples", help="samples per counter for each spec (default 1000)", type=int, default=1000)
+    sim.add_argument("--spec-time", help="seconds the console spends running each spec before sending it (default 0)", type=float, default=0)
+    sim.add_argument("--dist", help="sample distribution around each spec's base time (default normal)", choices=SampleModel.DISTRIBUTIONS, default="normal")
+    sim.add_argument("--spread", help="standard deviation, or half width for uniform, in cycles (default 150)", type=float, default=150)
+    sim.add_argument("--gap", help="bimodal: cycles between the two modes (default 400)", type=float, default=400)
+    sim.add_argument("--weight", help="bimodal: fraction of samples in the slower mode (default 0.3)", type=float, default=0.3)
+    sim.add_argument("--outliers", help="fraction of samples made 5-50%% slower (default 0.005)", type=float, default=0.005)
+    sim.add_argument("--seed", help="random seed (default 0)", type=int, default=0)
+    args = parser.parse_args()
+
+    if (args.results is None) == (args.simulate is None):
+        parser.error("give either a results file to replay or --simulate")
+
+    if args.simulate is not None:
+        model = SampleModel(args.dist, args.spread, args.gap, args.weight, args.outliers, seed=args.seed)
+        results = lambda config, specs: simulated_results(model, args.simulate * args.repeat, args.samples,
+                                                          args.spec_time, config, specs)
+    else:
+        recorded = load_results(args.results) * args.repeat
+        results = lambda config, specs: recorded if specs is None else table_results(recorded, specs)
+
+    main(results, args.text, None if args.rate is None else args.rate * 1e6, args.corrupt, args.rom_image,
+         None if args.stream_rate is None else args.stream_rate * 1e6, args.bias, args.chunk, args.hang_after,
+         args.run_time / 1000)
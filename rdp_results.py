@@ -0,0 +1,462 @@
+#
+#   Result formats emitted by rdp_fill_timing
+#
+#   Binary result packets follow the layout in src/results.h. Text logs are the
+#   debugf output produced when the ROM is built without RESULTS_BINARY. The
+#   run configuration block patched into the ROM follows src/run_config.h.
+#
+
+import struct, sys
+from array import array
+
+RESULTS_DATATYPE = 0x10
+
+RESULTS_MAGIC   = 0x52445052 # 'RDPR'
+RESULTS_VERSION = 3
+
+RESULTS_CTR_BUF   = (1 << 0)
+RESULTS_CTR_PIPE  = (1 << 1)
+RESULTS_CTR_TMEM  = (1 << 2)
+RESULTS_CTR_CLOCK = (1 << 3)
+
+COUNTER_NAMES = {
+    RESULTS_CTR_BUF   : "buf",
+    RESULTS_CTR_PIPE  : "pipe",
+    RESULTS_CTR_TMEM  : "tmem",
+    RESULTS_CTR_CLOCK : "clock",
+}
+
+RESULTS_HEADER = struct.Struct(">IHHHHI")
+# appended to the header from version 2: console_id, reserved
+RESULTS_HEADER_V2 = struct.Struct(">HH")
+# appended from version 3: first_sample, total_samples
+RESULTS_HEADER_V3 = struct.Struct(">II")
+
+# Host to console: stop the named spec early, see src/results.h. spec_id, reserved
+RESULTS_STOP_DATATYPE = 0x12
+RESULTS_STOP = struct.Struct(">HH")
+
+def results_header_size(version):
+    size = RESULTS_HEADER.size
+    if version >= 2:
+        size += RESULTS_HEADER_V2.size
+    if version >= 3:
+        size += RESULTS_HEADER_V3.size
+    return size
+
+RUN_CONFIG_MAGIC   = struct.pack(">II", 0x52554E43, 0x4F4E4647) # 'RUNCONFG'
+RUN_CONFIG_VERSION = 3
+RUN_CONFIG_NO_REF  = 0xFFFF
+RUN_CONFIG         = struct.Struct(">8sHHHHHHIHH")
+
+class RunConfig:
+    """
+    Which part of the spec table a console runs, see src/run_config.h
+    """
+
+    def __init__(self, console_id=0, shard=0, num_shards=1, ref_spec=None, start_spec=0, start_sample=0, max_runs=0):
+        self.console_id = console_id
+        self.shard = shard
+        self.num_shards = num_shards
+        self.ref_spec = ref_spec
+        self.start_spec = start_spec
+        self.start_sample = start_sample
+        # 0 runs each spec's own count
+        self.max_runs = max_runs
+
+    def selects(self, spec_id):
+        if spec_id < self.start_spec:
+            return False
+        return spec_id % self.num_shards == self.shard or spec_id == self.ref_spec
+
+    def pack(self):
+        return RUN_CONFIG.pack(RUN_CONFIG_MAGIC, RUN_CONFIG_VERSION, self.console_id, self.shard, self.num_shards,
+                               RUN_CONFIG_NO_REF if self.ref_spec is None else self.ref_spec,
+                               self.start_spec, self.start_sample, self.max_runs, 0)
+
+    @staticmethod
+    def find(image):
+        """
+        Offset of the run configuration block in a ROM image, None if the ROM has none
+        """
+        offset = image.find(RUN_CONFIG_MAGIC)
+        if offset < 0:
+            return None
+        assert image.find(RUN_CONFIG_MAGIC, offset + 1) < 0 , "ROM holds more than one run configuration block"
+        return offset
+
+    @staticmethod
+    def version(image, offset):
+        return struct.unpack_from(">H", image, offset + len(RUN_CONFIG_MAGIC))[0]
+
+    @staticmethod
+    def unpack(image, offset):
+        _, version, console_id, shard, num_shards, ref_spec, start_spec, start_sample, max_runs, _ = \
+            RUN_CONFIG.unpack_from(image, offset)
+        assert version == RUN_CONFIG_VERSION , f"Unsupported run configuration version {version}"
+        return RunConfig(console_id, shard, num_shards, None if ref_spec == RUN_CONFIG_NO_REF else ref_spec,
+                         start_spec, start_sample, max_runs)
+
+# Boolean fields of rdp_timing_spec_t, in declaration order
+SPEC_FIELDS = (
+    "two_cycle",
+    "color_read",
+    "depth_read",
+    "depth_write",
+    "depth_pass",
+    "zb_same_bank",
+    "alpha_compare",
+    "vi_on",
+    "vi_same_bank",
+)
+
+def spec_params_from_desc(desc):
+    """
+    Recovers the rdp_timing_spec_t fields from a description built by the GROUP
+    and AC_GROUP macros in src/test_main.c. Also accepts the comma-joined
+    headings of sample_results.txt. Returns None if the description is not
+    recognized.
+    """
+    parts = [part.strip() for part in desc.split(",")]
+
+    if "1-cycle" not in parts and "2-cycle" not in parts:
+        return None
+
+    params = {
+        "two_cycle"               : "2-cycle" in parts,
+        "color_read"              : "image_read on" in parts,
+        "alpha_compare"           : parts[0].startswith("Alpha Compare"),
+        "vi_on"                   : "VI" in parts,
+        "vi_same_bank"            : "FB + VI same" in parts or "FB + ZB + VI same" in parts,
+        "zb_same_bank"            : "FB + ZB same" in parts or "FB + ZB + VI same" in parts,
+    }
+
+    if params["alpha_compare"]:
+        # AC_GROUP: AC_ENABLED, depth read only with z_compare on, never writes
+        params["depth_read"] = "z_compare on" in parts
+        params["depth_write"] = False
+        params["depth_pass"] = False
+        params["alpha_compare_threshold"] = 128
+        params["rectangle_alpha"] = 96
+    else:
+        zb = {
+            "No ZB"         : (False, False),
+            "ZB Read-Only"  : (True,  False),
+            "ZB Write-Only" : (False, True),
+            "ZB Read/Write" : (True,  True),
+        }.get(parts[0])
+        if zb is None:
+            return None
+        params["depth_read"], params["depth_write"] = zb
+        # ZB_W always passes
+        params["depth_pass"] = "Z Pass" in parts or parts[0] == "ZB Write-Only"
+        params["alpha_compare_threshold"] = 128
+        params["rectangle_alpha"] = 255
+
+    return params
+
+def align4(n):
+    return (n + 3) & ~3
+
+class SpecResult:
+    """
+    Raw samples for a single timing spec, keyed by counter name
+    """
+
+    def __init__(self, spec_id, desc, counters, console=0, first_sample=0, total_samples=None):
+        self.spec_id = spec_id
+        self.desc = desc
+        self.counters = counters
+        # console of a farm that ran the spec
+        self.console = console
+        # a packet from the console may hold only part of the spec, see src/results.h
+        self.first_sample = first_sample
+        self.total_samples = first_sample + self.num_samples if total_samples is None else total_samples
+
+    @property
+    def num_samples(self):
+        return len(next(iter(self.counters.values())))
+
+    @property
+    def complete(self):
+        return self.first_sample == 0 and self.num_samples == self.total_samples
+
+    @property
+    def buf(self):
+        return self.counters["buf"]
+
+    @property
+    def pipe(self):
+        return self.counters["pipe"]
+
+    # Results from ROMs before these counters were sent have neither
+    @property
+    def tmem(self):
+        return self.counters.get("tmem")
+
+    @property
+    def clock(self):
+        return self.counters.get("clock")
+
+def _u32_be(data):
+    arr = array("I")
+    assert arr.itemsize == 4
+    arr.frombytes(data)
+    if sys.byteorder == "little":
+        arr.byteswap()
+    return arr
+
+def encode_result(res : SpecResult):
+    desc = res.desc.encode("ascii")
+    mask = 0
+    for bit,name in COUNTER_NAMES.items():
+        if name in res.counters:
+            mask |= bit
+    num_samples = res.num_samples
+
+    out = bytearray(RESULTS_HEADER.pack(RESULTS_MAGIC, RESULTS_VERSION, res.spec_id, mask, len(desc), num_samples))
+    out += RESULTS_HEADER_V2.pack(res.console, 0)
+    out += RESULTS_HEADER_V3.pack(res.first_sample, res.total_samples)
+    out += desc + b"\0" * (align4(len(desc)) - len(desc))
+    for bit,name in sorted(COUNTER_NAMES.items()):
+        if mask & bit:
+            samples = array("I", res.counters[name])
+            assert len(samples) == num_samples
+            if sys.byteorder == "little":
+                samples.byteswap()
+            out += samples.tobytes()
+    return bytes(out)
+
+def decode_result(data, offset=0):
+    """
+    Decodes one result packet starting at `offset`, returns the result and the offset just past it
+    """
+    magic, version, spec_id, mask, desc_len, num_samples = RESULTS_HEADER.unpack_from(data, offset)
+    assert magic == RESULTS_MAGIC , f"Bad result magic 0x{magic:08X} at offset {offset}"
+    assert 1 <= version <= RESULTS_VERSION , f"Unsupported result version {version}"
+    offset += RESULTS_HEADER.size
+    console = 0
+    first_sample, total_samples = 0, num_samples
+    if version >= 2:
+        console, _ = RESULTS_HEADER_V2.unpack_from(data, offset)
+        offset += RESULTS_HEADER_V2.size
+    if version >= 3:
+        first_sample, total_samples = RESULTS_HEADER_V3.unpack_from(data, offset)
+        offset += RESULTS_HEADER_V3.size
+
+    desc = bytes(data[offset:offset+desc_len]).decode("ascii")
+    offset += align4(desc_len)
+
+    counters = {}
+    for bit,name in sorted(COUNTER_NAMES.items()):
+        if mask & bit:
+            size = 4 * num_samples
+            counters[name] = _u32_be(data[offset:offset+size]).tolist()
+            offset += size
+
+    return SpecResult(spec_id, desc, counters, console, first_sample, total_samples), offset
+
+def decode_results(data):
+    """
+    Decodes a stream of concatenated result packets, as written by client.py --results
+    """
+    data = memoryview(data)
+    offset = 0
+    while offset < len(data):
+        res, offset = decode_result(data, offset)
+        yield res
+
+class TextLogParser:
+    """
+    Incremental parser for the debugf text log. Each spec is a description
+    followed by one block of samples per counter, in COUNTER_NAMES order.
+    A spec is produced as soon as its CLOCK block closes, or for logs from
+    ROMs that print only BUF and PIPE, when the next spec's first block or
+    the end fence shows no more blocks follow. A log can be consumed while it is still
+    being written, and may hold the restarts of a console that was rebooted.
+    """
+
+    BLOCKS = tuple(f"{name.upper()} = [" for name in COUNTER_NAMES.values())
+
+    def __init__(self):
+        self.pending = ""
+        self.seg = []
+        self.started = False
+        self.done = False
+        self.num_specs = 0
+        # line after a spec that may be done with BUF and PIPE, the next spec's description if its BUF follows
+        self.next_desc = None
+
+    def incomplete(self):
+        # a spec with all of BUF and PIPE is finished whether or not more blocks follow
+        waiting = len(self.seg) >= 7 and len(self.seg) % 3 == 1
+        return not self.done and ((len(self.seg) != 0 and not waiting) or self.pending.strip() != "")
+
+    def feed(self, text):
+        self.pending += text
+        *lines, self.pending = self.pending.split("\n")
+        out = []
+        for line in lines:
+            res = self._line(line.rstrip("\r"))
+            if res is not None:
+                out.append(res)
+        return out
+
+    def finish(self):
+        # an unterminated last line may have been cut off, so it is never trusted
+        out = []
+        if self.done:
+            return out
+        # a spec with BUF and PIPE may have been waiting for blocks that never came
+        if len(self.seg) >= 7 and len(self.seg) % 3 == 1:
+            out.append(self._spec())
+        return out
+
+    def _line(self, line):
+        if self.done:
+            return None
+        if not self.started:
+            self.started = "!!BEGIN!!" in line
+            return None
+
+        if "!!BEGIN!!" in line:
+            # the console was restarted (client.py --max-restarts) and runs the cut off spec again
+            self.seg = []
+            self.next_desc = None
+            return None
+
+        seg = self.seg
+        if len(seg) >= 7 and len(seg) % 3 == 1 and line != self.BLOCKS[(len(seg) - 1) // 3]:
+            # the spec so far has BUF and PIPE and no more blocks follow, it is finished once the next
+            # spec's first block or the end fence shows the line before was not the client's own output
+            if "!!DONE!!" in line:
+                self.done = True
+                return self._spec()
+            if line == self.BLOCKS[0] and self.next_desc is not None:
+                desc = self.next_desc
+                res = self._spec()
+                self.seg = [desc, line]
+                return res
+            if line.strip() != "":
+                self.next_desc = line
+            return None
+
+        if "!!DONE!!" in line:
+            self.done = True
+            return None
+        if len(seg) == 0 and line.strip() == "":
+            return None
+
+        seg.append(line)
+        if len(seg) == 1 + 3 * len(COUNTER_NAMES):
+            return self._spec()
+        return None
+
+    def _spec(self):
+        seg = self.seg
+        self.seg = []
+        self.next_desc = None
+
+        desc = seg[0]
+        counters = {}
+        for i,name in enumerate(COUNTER_NAMES.values()):
+            if 1 + 3 * i == len(seg):
+                break
+            assert seg[1 + 3 * i] == self.BLOCKS[i]
+            data = seg[2 + 3 * i].strip()
+            assert seg[3 + 3 * i] == "]"
+
+            assert data[-1] == ","
+            counters[name] = [int(v) for v in data[:-1].split(", ")]
+
+        assert all(len(samples) == len(counters["buf"]) for samples in counters.values())
+
+        res = SpecResult(self.num_specs, desc, counters)
+        self.num_specs += 1
+        return res
+
+class BinaryStreamParser:
+    """
+    Incremental parser for concatenated binary result packets
+    """
+
+    def __init__(self):
+        self.pending = bytearray()
+        self.done = False
+
+    def incomplete(self):
+        return len(self.pending) != 0
+
+    def feed(self, data):
+        self.pending += data
+        out = []
+        offset = 0
+        while len(self.pending) - offset >= RESULTS_HEADER.size:
+            _, version, _, mask, desc_len, num_samples = RESULTS_HEADER.unpack_from(self.pending, offset)
+            size = results_header_size(version) + align4(desc_len) + 4 * bin(mask).count("1") * num_samples
+            if len(self.pending) - offset < size:
+                break
+            res, offset = decode_result(self.pending, offset)
+            out.append(res)
+        del self.pending[:offset]
+        return out
+
+    def finish(self):
+        return []
+
+class ResultStreamParser:
+    """
+    Incremental parser for either result format, decided by the first bytes seen
+    """
+
+    def __init__(self):
+        self.head = b''
+        self.parser = None
+
+    @property
+    def done(self):
+        return self.parser is not None and self.parser.done
+
+    def incomplete(self):
+        return len(self.head) != 0 or (self.parser is not None and self.parser.incomplete())
+
+    def feed(self, data, final=False):
+        if self.parser is None:
+            self.head += data
+            if len(self.head) < 4 and not final:
+                return []
+            data, self.head = self.head, b''
+            if data[:4] == struct.pack(">I", RESULTS_MAGIC):
+                self.parser = BinaryStreamParser()
+            else:
+                self.parser = TextLogParser()
+
+        if isinstance(self.parser, TextLogParser):
+            data = data.decode("ascii")
+        return self.parser.feed(data)
+
+    def finish(self):
+        out = self.feed(b'', final=True)
+        return out + self.parser.finish()
+
+def parse_text_log(contents):
+    """
+    Parses the debugf text log between the !!BEGIN!! and !!DONE!! fences
+    """
+    parser = TextLogParser()
+    return parser.feed(contents) + parser.finish()
+
+def load_results(filename):
+    """
+    Loads results from either a binary result file or a text log. Specs that were
+    not finished (e.g. the console crashed mid-run) are skipped with a warning.
+    """
+    with open(filename, "rb") as infile:
+        contents = infile.read()
+
+    parser = ResultStreamParser()
+    results = parser.feed(contents) + parser.finish()
+    if parser.incomplete():
+        print(f"Warning: {filename} ends with an incomplete spec, using the {len(results)} finished specs",
+              file=sys.stderr)
+    return results
@@ -0,0 +1,404 @@
+#!/usr/bin/env python3
+#
+#   Columnar store of results across many campaigns
+#
+#   A store is a directory holding one .npy file per column with one row per
+#   spec per campaign, the raw samples of all campaigns appended to flat u32
+#   files, and an index from the spec parameters to rows:
+#
+#     meta.json               store version and per-campaign metadata
+#     columns/<name>.npy      typed columns, see COLUMNS
+#     <counter>.u32           raw samples of each of SAMPLE_COUNTERS, rows
+#                             reference them by sample_offset
+#     index/                  rows grouped by spec_key for parameter queries
+#
+#   spec_key packs the SPEC_FIELDS booleans one bit each, so a query on any
+#   subset of fields is a mask/compare over the few distinct keys followed by
+#   a gather of their rows.
+#
+#   Spec parameters of imported results come from the spec table the campaign
+#   ran (spec_table.py), by spec id, the ROM's built-in one unless given.
+#
+
+import argparse, datetime, json, os, sys, time
+import numpy as np
+
+from rdp_results import SPEC_FIELDS, load_results, spec_params_from_desc
+from analyze import prune_outliers, summarize
+from spec_table import SpecError, decode_spec_table, load_spec_table
+
+STORE_VERSION = 3
+
+# The table the ROM runs without one from the host
+DEFAULT_SPECS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "specs", "default.txt")
+
+COLUMNS = {
+    "campaign"                : np.uint16,
+    "spec_id"                 : np.uint16,
+    "spec_key"                : np.uint16,
+    **{ field : np.bool_ for field in SPEC_FIELDS },
+    "alpha_compare_threshold" : np.uint8,
+    "rectangle_alpha"         : np.uint8,
+    # as in the spec table: x1 = y1 = 0 is the full screen, 0 runs or addresses the ROM's default
+    "x0"                      : np.uint16,
+    "y0"                      : np.uint16,
+    "x1"                      : np.uint16,
+    "y1"                      : np.uint16,
+    "num_runs"                : np.uint16,
+    "fb_addr"                 : np.uint32,
+    "zb_addr"                 : np.uint32,
+    "vi_addr"                 : np.uint32,
+    "num_samples"             : np.uint32,
+    "sample_offset"           : np.int64,   # -1 when only summary statistics are known
+    "sample_counters"         : np.uint8,   # bit i set when the row has samples of SAMPLE_COUNTERS[i]
+    "buf_pruned"              : np.uint32,
+    "pipe_pruned"             : np.uint32,
+    "buf_min_ms"              : np.float64,
+    "buf_avg_ms"              : np.float64,
+    "buf_max_ms"              : np.float64,
+    "pipe_min_ms"             : np.float64,
+    "pipe_avg_ms"             : np.float64,
+    "pipe_max_ms"             : np.float64,
+    "desc"                    : "U128",
+}
+
+SAMPLE_COUNTERS = ("buf", "pipe", "tmem", "clock")
+
+# Stores before version 3 hold only BUF and PIPE
+COUNTERS_BUF_PIPE = 0b0011
+
+# Value of columns a store predates; the other spec fields' defaults are 0
+COLUMN_DEFAULTS = { "sample_counters" : COUNTERS_BUF_PIPE }
+
+def spec_key(params):
+    key = 0
+    for bit,field in enumerate(SPEC_FIELDS):
+        if params[field]:
+            key |= 1 << bit
+    return key
+
+def parse_sample_summary(contents):
+    """
+    Parses the layout of sample_results.txt: indented headings whose comma-joined
+    path forms the description, with "Buf:" and "Pipe:" min/avg/max lines in ms
+    under each leaf. Returns the preamble and a list of (desc, buf, pipe).
+    """
+    stack = []
+    entries = []
+    first_heading = None
+    leaf = None
+
+    lines = contents.split("\n")
+    for i,line in enumerate(lines):
+        text = line.strip()
+        if text == "":
+            continue
+        indent = len(line) - len(line.lstrip())
+
+        if text.startswith("Buf:") or text.startswith("Pipe:"):
+            name, values = text.split(":", 1)
+            values = tuple(float(v.strip().rstrip("ms")) for v in values.split(","))
+            assert len(values) == 3 , f"Expected min, avg, max on line {i + 1}"
+            if name == "Buf":
+                leaf = [", ".join(t for _,_,t in stack), values, None]
+                if first_heading is None:
+                    first_heading = stack[0][1]
+            else:
+                assert leaf is not None , f"Pipe without Buf on line {i + 1}"
+                leaf[2] = values
+                entries.append(tuple(leaf))
+                leaf = None
+            continue
+
+        while len(stack) != 0 and stack[-1][0] >= indent:
+            stack.pop()
+        stack.append((indent, i, text))
+
+    preamble = "\n".join(lines[:first_heading]).strip() if first_heading is not None else contents.strip()
+    return preamble, entries
+
+class ResultStore:
+
+    def __init__(self, path):
+        self.path = path
+        self.meta = { "version" : STORE_VERSION, "campaigns" : [] }
+        self.columns = { name : np.zeros(0, dtype) for name,dtype in COLUMNS.items() }
+        self.index = None
+
+        if os.path.exists(os.path.join(path, "meta.json")):
+            with open(os.path.join(path, "meta.json"), "r") as infile:
+                self.meta = json.load(infile)
+            assert 1 <= self.meta["version"] <= STORE_VERSION , f"Unsupported store version {self.meta['version']}"
+            for name in COLUMNS:
+                if os.path.exists(self._column_path(name)):
+                    self.columns[name] = np.load(self._column_path(name), mmap_mode="r")
+            # Columns added since the store was written read as their defaults until the next import saves them
+            for name,dtype in COLUMNS.items():
+                if not os.path.exists(self._column_path(name)):
+                    self.columns[name] = np.full(len(self.columns["campaign"]), COLUMN_DEFAULTS.get(name, 0), dtype)
+            self.index = {
+                name : np.load(os.path.join(path, "index", f"{name}.npy"), mmap_mode="r")
+                    for name in ("keys", "starts", "rows")
+            }
+
+    def _column_path(self, name):
+        return os.path.join(self.path, "columns", f"{name}.npy")
+
+    def _save_array(self, path, arr):
+        # write-then-rename so a crash never leaves a half-written column
+        tmp = path + ".tmp.npy"
+        np.save(tmp, arr)
+        os.replace(tmp, path)
+
+    def __len__(self):
+        return len(self.columns["campaign"])
+
+    @property
+    def campaigns(self):
+        return self.meta["campaigns"]
+
+    def campaign_id(self, name):
+        for campaign in self.campaigns:
+            if campaign["name"] == name:
+                return campaign["id"]
+        raise KeyError(f"No campaign named {name}")
+
+    def append_campaign(self, name, rows, samples=None, **metadata):
+        """
+        Appends a campaign. `rows` is a list of dicts with the non-derived columns
+        for each spec, `samples` optionally the matching {counter : list} raw samples.
+        Counters a spec has no samples of (None or left out) are marked absent.
+        """
+        assert all(c["name"] != name for c in self.campaigns) , f"Campaign {name} already exists"
+
+        os.makedirs(os.path.join(self.path, "columns"), exist_ok=True)
+        os.makedirs(os.path.join(self.path, "index"), exist_ok=True)
+
+        campaign_id = len(self.campaigns)
+        new = { name : [] for name in COLUMNS }
+
+        # Raw samples first, rows only become visible once meta.json references the campaign
+        sample_paths = { ctr : os.path.join(self.path, f"{ctr}.u32") for ctr in SAMPLE_COUNTERS }
+        offset = os.path.getsize(sample_paths["buf"]) // 4 if os.path.exists(sample_paths["buf"]) else 0
+        if samples is not None:
+            outs = { ctr : open(sample_paths[ctr], "ab") for ctr in SAMPLE_COUNTERS }
+            # Counters rows go without are only written up to where a later row has them
+            ends = { ctr : outs[ctr].tell() // 4 for ctr in SAMPLE_COUNTERS }
+
+        for i,row in enumerate(rows):
+            row = dict(row)
+            row["campaign"] = campaign_id
+            row["spec_key"] = spec_key(row)
+            if samples is not None:
+                row["sample_offset"] = offset
+                row["sample_counters"] = 0
+                for bit,ctr in enumerate(SAMPLE_COUNTERS):
+                    if samples[i].get(ctr) is None:
+                        continue
+                    data = np.asarray(samples[i][ctr], dtype="<u4")
+                    assert len(data) == row["num_samples"]
+                    outs[ctr].write(np.zeros(offset - ends[ctr], "<u4").tobytes())
+                    outs[ctr].write(data.tobytes())
+                    ends[ctr] = offset + len(data)
+                    row["sample_counters"] |= 1 << bit
+                assert row["sample_counters"] & COUNTERS_BUF_PIPE == COUNTERS_BUF_PIPE
+                offset += row["num_samples"]
+            else:
+                row["sample_offset"] = -1
+                row["sample_counters"] = 0
+            for col in COLUMNS:
+                new[col].append(row[col])
+
+        if samples is not None:
+            for out in outs.values():
+                out.close()
+
+        for col,dtype in COLUMNS.items():
+            self.columns[col] = np.concatenate([np.asarray(self.columns[col]), np.asarray(new[col], dtype=dtype)])
+            self._save_array(self._column_path(col), self.columns[col])
+        self._build_index()
+
+        campaign = { "id" : campaign_id, "name" : name, "num_specs" : len(rows),
+                     "imported" : datetime.datetime.now().isoformat(timespec="seconds") }
+        campaign.update({ k : v for k,v in metadata.items() if v is not None })
+        self.meta["campaigns"].append(campaign)
+        self.meta["version"] = STORE_VERSION
+        tmp = os.path.join(self.path, "meta.json.tmp")
+        with open(tmp, "w") as outfile:
+            json.dump(self.meta, outfile, indent=2)
+        os.replace(tmp, os.path.join(self.path, "meta.json"))
+        return campaign_id
+
+    def _build_index(self):
+        keys = np.asarray(self.columns["spec_key"])
+        rows = np.argsort(keys, kind="stable").astype(np.uint32)
+        uniq, starts = np.unique(keys[rows], return_index=True)
+        starts = np.append(starts, len(rows)).astype(np.uint32)
+        self.index = { "keys" : uniq, "starts" : starts, "rows" : rows }
+        for name,arr in self.index.items():
+            self._save_array(os.path.join(self.path, "index", f"{name}.npy"), arr)
+
+    def query(self, campaigns=None, **fields):
+        """
+        Returns the rows matching every given SPEC_FIELDS value, in row order
+        """
+        if len(self) == 0:
+            return np.zeros(0, np.uint32)
+
+        mask = want = 0
+        for field,value in fields.items():
+            bit = 1 << SPEC_FIELDS.index(field)
+            mask |= bit
+            if value:
+                want |= bit
+
+        keys = self.index["keys"]
+        starts = self.index["starts"]
+        matching = np.nonzero((keys & mask) == want)[0]
+        rows = np.sort(np.concatenate([self.index["rows"][starts[k]:starts[k + 1]] for k in matching] or
+                                      [np.zeros(0, np.uint32)]))
+
+        if campaigns is not None:
+            ids = [self.campaign_id(name) for name in campaigns]
+            rows = rows[np.isin(self.columns["campaign"][rows], ids)]
+        return rows
+
+    def samples(self, row, counter):
+        """
+        Raw samples of a row, or None if the row only has summary statistics
+        or its campaign did not record `counter`
+        """
+        offset = int(self.columns["sample_offset"][row])
+        if offset < 0 or not self.columns["sample_counters"][row] & (1 << SAMPLE_COUNTERS.index(counter)):
+            return None
+        n = int(self.columns["num_samples"][row])
+        data = np.memmap(os.path.join(self.path, f"{counter}.u32"), dtype="<u4", mode="r")
+        return data[offset:offset+n]
+
+def spec_params(spec):
+    """
+    Columns describing a spec_table.SpecEntry
+    """
+    params = { field : getattr(spec, field) for field in SPEC_FIELDS }
+    params["x0"], params["y0"], params["x1"], params["y1"] = spec.rect or (0, 0, 0, 0)
+    for name in ("alpha_compare_threshold", "rectangle_alpha", "num_runs", "fb_addr", "zb_addr", "vi_addr"):
+        params[name] = getattr(spec, name)
+    return params
+
+def rows_from_results(results, specs, specs_name="the spec table"):
+    """
+    Rows of `results`, their parameters taken from `specs` (a list of
+    SpecEntry, the table the campaign ran) by spec id
+    """
+    rows = []
+    samples = []
+    for res in results:
+        if res.spec_id >= len(specs) or specs[res.spec_id].desc != res.desc:
+            raise ValueError(f"Spec {res.spec_id} \"{res.desc}\" is not in {specs_name}, "
+                             f"import with the table the campaign ran (--specs)")
+
+        buf = prune_outliers(res.buf)
+        pipe = prune_outliers(res.pipe)
+        row = dict(spec_params(specs[res.spec_id]), spec_id=res.spec_id, desc=res.desc, num_samples=len(res.buf),
+                   buf_pruned=len(res.buf) - len(buf), pipe_pruned=len(res.pipe) - len(pipe))
+        row["buf_min_ms"], row["buf_avg_ms"], row["buf_max_ms"] = summarize(buf)
+        row["pipe_min_ms"], row["pipe_avg_ms"], row["pipe_max_ms"] = summarize(pipe)
+        rows.append(row)
+        samples.append({ ctr : res.counters.get(ctr) for ctr in SAMPLE_COUNTERS })
+    return rows, samples
+
+def rows_from_summary(entries):
+    rows = []
+    for spec_id,(desc,buf,pipe) in enumerate(entries):
+        params = spec_params_from_desc(desc)
+        if params is None:
+            raise ValueError(f"Unrecognized spec heading \"{desc}\"")
+        # summaries are of the built-in table, which keeps the default rectangle, runs and buffers
+        row = dict(params, spec_id=spec_id, desc=desc, num_samples=0, buf_pruned=0, pipe_pruned=0,
+                   x0=0, y0=0, x1=0, y1=0, num_runs=0, fb_addr=0, zb_addr=0, vi_addr=0)
+        row["buf_min_ms"], row["buf_avg_ms"], row["buf_max_ms"] = buf
+        row["pipe_min_ms"], row["pipe_avg_ms"], row["pipe_max_ms"] = pipe
+        rows.append(row)
+    return rows
+
+def cmd_import(store, args):
+    specs_path = args.specs or DEFAULT_SPECS
+    try:
+        specs = decode_spec_table(load_spec_table(specs_path))
+    except (OSError, SpecError, UnicodeDecodeError) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+    results = load_results(args.file)
+    try:
+        rows, samples = rows_from_results(results, specs, specs_path)
+    except ValueError as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+    store.append_campaign(args.name, rows, samples, kind="raw", source=os.path.abspath(args.file),
+                          specs=os.path.abspath(specs_path), console=args.console, notes=args.notes)
+    print(f"Imported {len(rows)} specs as campaign {args.name}")
+
+def cmd_import_summary(store, args):
+    with open(args.file, "r") as infile:
+        preamble, entries = parse_sample_summary(infile.read())
+    rows = rows_from_summary(entries)
+    store.append_campaign(args.name, rows, kind="summary", source=os.path.abspath(args.file),
+                          console=args.console, notes=args.notes or preamble)
+    print(f"Imported {len(rows)} spec summaries as campaign {args.name}")
+
+def cmd_campaigns(store, args):
+    for c in store.campaigns:
+        print(f"{c['id']:4d}  {c['name']:<24} {c['kind']:<8} {c['num_specs']:4d} specs  {c['imported']}  {c.get('console', '')}")
+
+def cmd_query(store, args):
+    fields = { field : getattr(args, field) for field in SPEC_FIELDS if getattr(args, field) is not None }
+
+    t = time.perf_counter()
+    rows = store.query(args.campaign, **fields)
+    dt = time.perf_counter() - t
+
+    names = { c["id"] : c["name"] for c in store.campaigns }
+    cols = store.columns
+    for row in rows:
+        print(f"{names[int(cols['campaign'][row])]:<16} {int(cols['spec_id'][row]):3d}  {cols['desc'][row]}")
+        print(f"    Buf result:  {cols['buf_min_ms'][row]:.07f}, {cols['buf_avg_ms'][row]:.07f}, {cols['buf_max_ms'][row]:.07f}")
+        print(f"    Pipe result: {cols['pipe_min_ms'][row]:.07f}, {cols['pipe_avg_ms'][row]:.07f}, {cols['pipe_max_ms'][row]:.07f}")
+        if args.samples:
+            for ctr in SAMPLE_COUNTERS:
+                data = store.samples(row, ctr)
+                if data is not None:
+                    print(f"    {ctr.upper()} = [{', '.join(str(v) for v in data)}]")
+    print(f"{len(rows)} rows in {dt * 1000:.3f} ms", file=sys.stderr)
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Columnar store of rdp_fill_timing results across campaigns")
+    parser.add_argument("store", help="store directory, created on first import")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("import", help="import a binary result file or text log")
+    p.add_argument("file")
+    p.add_argument("--name", required=True, help="campaign name")
+    p.add_argument("--specs", help="spec table the campaign ran (client.py --specs), default the ROM's built-in one")
+    p.add_argument("--console", help="console/flashcart the campaign ran on")
+    p.add_argument("--notes", help="free-form notes")
+    p.set_defaults(func=cmd_import)
+
+    p = sub.add_parser("import-summary", help="import min/avg/max summaries laid out as sample_results.txt")
+    p.add_argument("file")
+    p.add_argument("--name", required=True, help="campaign name")
+    p.add_argument("--console", help="console/flashcart the campaign ran on")
+    p.add_argument("--notes", help="free-form notes, defaults to the file's preamble")
+    p.set_defaults(func=cmd_import_summary)
+
+    p = sub.add_parser("campaigns", help="list campaigns")
+    p.set_defaults(func=cmd_campaigns)
+
+    p = sub.add_parser("query", help="find specs by parameters across campaigns")
+    for field in SPEC_FIELDS:
+        p.add_argument(f"--{field.replace('_', '-')}", dest=field, type=int, choices=(0, 1))
+    p.add_argument("--campaign", action="append", help="restrict to this campaign, may be repeated")
+    p.add_argument("--samples", action="store_true", help="also print raw samples")
+    p.set_defaults(func=cmd_query)
+
+    args = parser.parse_args()
+    args.func(ResultStore(args.store), args)
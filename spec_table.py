@@ -0,0 +1,331 @@
+#!/usr/bin/env python3
+#
+#   Spec table compiler
+#
+#   Turns a text description of the timing specs to run into the binary table
+#   the ROM asks the host for at startup (layout in src/spec_table.h), so new
+#   measurements need no ROM rebuild. client.py --specs accepts either the text
+#   or a compiled table. specs/default.txt describes the table built into the
+#   ROM and shows the format:
+#
+#     defaults key=value ...         settings for every later spec
+#     variants NAME                  a list of variations, as the GROUP macros
+#         "desc suffix" key=value ...
+#     end
+#     spec "desc" key=value ... [variants=NAME]
+#
+#   A spec naming a variant list expands to one spec per variant, with the
+#   variant's suffix appended to its description and its settings applied last.
+#
+
+import argparse, shlex, struct, sys
+
+from rdp_results import SPEC_FIELDS, align4
+
+SPEC_TABLE_DATATYPE = 0x11
+
+SPEC_TABLE_MAGIC   = 0x52445054 # 'RDPT'
+SPEC_TABLE_VERSION = 1
+
+SPEC_TABLE_MAX_SPECS = 1024
+SPEC_TABLE_MAX_SIZE  = 64 * 1024
+
+SPEC_TABLE_HEADER = struct.Struct(">IHH")
+SPEC_TABLE_ENTRY  = struct.Struct(">HBB4HHHIII")
+
+# Limits of the ROM, see src/test_main.c and src/results.h
+MAX_RUNS      = 4000
+DESC_MAX      = 128
+SCREEN_WIDTH  = 320
+SCREEN_HEIGHT = 240
+RDRAM_SIZE    = 0x800000
+# a 16-bit full screen, the most the ROM draws into or scans out of a buffer
+BUFFER_SIZE   = SCREEN_WIDTH * SCREEN_HEIGHT * 2
+
+class SpecError(ValueError):
+    pass
+
+class SpecEntry:
+    """
+    One spec of a table. Booleans are named as in SPEC_FIELDS, in flag bit
+    order. `rect` is (x0, y0, x1, y1) or None for the full screen, and zero
+    runs or addresses select the ROM's defaults.
+    """
+
+    def __init__(self, desc, **settings):
+        self.desc = desc
+        for field in SPEC_FIELDS:
+            setattr(self, field, False)
+        self.alpha_compare_threshold = 128
+        self.rectangle_alpha = 255
+        self.rect = None
+        self.num_runs = 0
+        self.fb_addr = 0
+        self.zb_addr = 0
+        self.vi_addr = 0
+        for name,value in settings.items():
+            setattr(self, name, value)
+
+    def __eq__(self, other):
+        return vars(self) == vars(other)
+
+    def __repr__(self):
+        return f"SpecEntry({self.desc!r}, {vars(self)})"
+
+def _bool(text):
+    if text in ("on", "true", "1"):
+        return True
+    if text in ("off", "false", "0"):
+        return False
+    raise SpecError(f"expected on or off, got '{text}'")
+
+def _int(lo, hi, align=1):
+    def parse(text):
+        try:
+            v = int(text, 0)
+        except ValueError:
+            raise SpecError(f"expected a number, got '{text}'")
+        if not lo <= v <= hi or v % align != 0:
+            raise SpecError(f"{v} is not in {lo}..{hi}" + (f" and a multiple of {align}" if align != 1 else ""))
+        return v
+    return parse
+
+def _choice(true_name, false_name):
+    def parse(text):
+        if text not in (true_name, false_name):
+            raise SpecError(f"expected {true_name} or {false_name}, got '{text}'")
+        return text == true_name
+    return parse
+
+def _rect(text):
+    parts = text.split(",")
+    if len(parts) != 4:
+        raise SpecError(f"expected x0,y0,x1,y1, got '{text}'")
+    x0, x1 = (_int(0, SCREEN_WIDTH)(parts[i]) for i in (0, 2))
+    y0, y1 = (_int(0, SCREEN_HEIGHT)(parts[i]) for i in (1, 3))
+    if x0 >= x1 or y0 >= y1:
+        raise SpecError(f"rectangle {text} is empty")
+    return (x0, y0, x1, y1)
+
+# Keys of the text format: the SpecEntry attribute each sets and how its value is parsed
+KEYS = {
+    "cycle"           : ("two_cycle",               _choice("2", "1")),
+    "image_read"      : ("color_read",              _bool),
+    "z_read"          : ("depth_read",              _bool),
+    "z_write"         : ("depth_write",             _bool),
+    "z_pass"          : ("depth_pass",              _bool),
+    "zb"              : ("zb_same_bank",            _choice("same", "separate")),
+    "alpha_compare"   : ("alpha_compare",           _bool),
+    "alpha_threshold" : ("alpha_compare_threshold", _int(0, 255)),
+    "alpha"           : ("rectangle_alpha",         _int(0, 255)),
+    "vi"              : ("vi_on",                   _bool),
+    "vi_bank"         : ("vi_same_bank",            _choice("same", "separate")),
+    "rect"            : ("rect",                    _rect),
+    "runs"            : ("num_runs",                _int(1, MAX_RUNS)),
+    # color and depth images must be 64-byte aligned, and a full screen must fit before the end of RDRAM
+    "fb_addr"         : ("fb_addr",                 _int(0, RDRAM_SIZE - BUFFER_SIZE, 64)),
+    "zb_addr"         : ("zb_addr",                 _int(0, RDRAM_SIZE - BUFFER_SIZE, 64)),
+    "vi_addr"         : ("vi_addr",                 _int(0, RDRAM_SIZE - BUFFER_SIZE, 64)),
+}
+
+def _settings(words):
+    out = {}
+    for word in words:
+        key, sep, value = word.partition("=")
+        if sep == "" or key not in KEYS:
+            raise SpecError(f"unknown setting '{word}'")
+        attr, parse = KEYS[key]
+        out[attr] = parse(value)
+    return out
+
+def compile_specs(text, filename="<specs>"):
+    """
+    Parses the text format into a list of SpecEntry
+    """
+    defaults = {}
+    variants = {}
+    current = None
+    specs = []
+
+    for lineno,line in enumerate(text.splitlines(), 1):
+        try:
+            try:
+                words = shlex.split(line, comments=True)
+            except ValueError as e:
+                raise SpecError(str(e))
+            if len(words) == 0:
+                continue
+
+            if current is not None:
+                if words == ["end"]:
+                    current = None
+                else:
+                    current.append((words[0], _settings(words[1:])))
+            elif words[0] == "defaults":
+                defaults.update(_settings(words[1:]))
+            elif words[0] == "variants":
+                if len(words) != 2:
+                    raise SpecError("expected 'variants NAME'")
+                current = variants[words[1]] = []
+            elif words[0] == "spec":
+                if len(words) < 2:
+                    raise SpecError("expected 'spec \"desc\" settings...'")
+                desc = words[1]
+                group = [("", {})]
+                rest = []
+                for word in words[2:]:
+                    if word.startswith("variants="):
+                        name = word[len("variants="):]
+                        if name not in variants:
+                            raise SpecError(f"no variant list named '{name}'")
+                        group = variants[name]
+                    else:
+                        rest.append(word)
+                settings = _settings(rest)
+                for suffix,extra in group:
+                    entry = SpecEntry(desc + suffix, **{ **defaults, **settings, **extra })
+                    if len(entry.desc) > DESC_MAX:
+                        raise SpecError(f"description longer than {DESC_MAX} characters: '{entry.desc}'")
+                    if not entry.desc.isascii():
+                        raise SpecError(f"description is not ASCII: '{entry.desc}'")
+                    specs.append(entry)
+            else:
+                raise SpecError(f"unknown statement '{words[0]}'")
+        except SpecError as e:
+            raise SpecError(f"{filename}:{lineno}: {e}") from None
+
+    if current is not None:
+        raise SpecError(f"{filename}: variant list not closed with 'end'")
+    if len(specs) == 0:
+        raise SpecError(f"{filename}: no specs")
+    if len(specs) > SPEC_TABLE_MAX_SPECS:
+        raise SpecError(f"{filename}: {len(specs)} specs, the ROM takes at most {SPEC_TABLE_MAX_SPECS}")
+    return specs
+
+def encode_spec_table(specs):
+    out = bytearray(SPEC_TABLE_HEADER.pack(SPEC_TABLE_MAGIC, SPEC_TABLE_VERSION, len(specs)))
+    for spec in specs:
+        flags = 0
+        for bit,field in enumerate(SPEC_FIELDS):
+            if getattr(spec, field):
+                flags |= 1 << bit
+        desc = spec.desc.encode("ascii")
+        out += SPEC_TABLE_ENTRY.pack(flags, spec.alpha_compare_threshold, spec.rectangle_alpha,
+                                     *(spec.rect or (0, 0, 0, 0)), spec.num_runs, len(desc),
+                                     spec.fb_addr, spec.zb_addr, spec.vi_addr)
+        out += desc + b"\0" * (align4(len(desc)) - len(desc))
+    if len(out) > SPEC_TABLE_MAX_SIZE:
+        raise SpecError(f"table is {len(out)} bytes, the ROM takes at most {SPEC_TABLE_MAX_SIZE}")
+    return bytes(out)
+
+def decode_spec_table(data):
+    """
+    Parses a compiled table into a list of SpecEntry, rejecting anything the
+    ROM would (spec_table_receive in src/test_main.c)
+    """
+    if len(data) > SPEC_TABLE_MAX_SIZE:
+        raise SpecError(f"table is {len(data)} bytes, the ROM takes at most {SPEC_TABLE_MAX_SIZE}")
+    if len(data) < SPEC_TABLE_HEADER.size:
+        raise SpecError("spec table cut short in its header")
+    magic, version, num_specs = SPEC_TABLE_HEADER.unpack_from(data)
+    if magic != SPEC_TABLE_MAGIC:
+        raise SpecError(f"bad spec table magic 0x{magic:08X}")
+    if version != SPEC_TABLE_VERSION:
+        raise SpecError(f"unsupported spec table version {version}")
+    if not 0 < num_specs <= SPEC_TABLE_MAX_SPECS:
+        raise SpecError(f"{num_specs} specs, the ROM takes 1 to {SPEC_TABLE_MAX_SPECS}")
+
+    specs = []
+    offset = SPEC_TABLE_HEADER.size
+    for i in range(num_specs):
+        if offset + SPEC_TABLE_ENTRY.size > len(data):
+            raise SpecError(f"spec table cut short in spec {i}")
+        flags, threshold, alpha, x0, y0, x1, y1, num_runs, desc_len, fb_addr, zb_addr, vi_addr = \
+            SPEC_TABLE_ENTRY.unpack_from(data, offset)
+        offset += SPEC_TABLE_ENTRY.size
+        if desc_len > DESC_MAX:
+            raise SpecError(f"spec {i}: description of {desc_len} bytes, at most {DESC_MAX}")
+        if offset + align4(desc_len) > len(data):
+            raise SpecError(f"spec table cut short in the description of spec {i}")
+        if num_runs > MAX_RUNS:
+            raise SpecError(f"spec {i}: {num_runs} runs, at most {MAX_RUNS}")
+        # zero x1, y1 is the full screen
+        full_rect = (x1, y1) == (0, 0)
+        if x1 > SCREEN_WIDTH or y1 > SCREEN_HEIGHT or (not full_rect and (x0 >= x1 or y0 >= y1)):
+            raise SpecError(f"spec {i}: bad rectangle {x0},{y0},{x1},{y1}")
+        # the ROM also refuses buffers overlapping its own image, which only it knows
+        for addr in (fb_addr, zb_addr, vi_addr):
+            if addr % 64 != 0 or addr > RDRAM_SIZE - BUFFER_SIZE:
+                raise SpecError(f"spec {i}: buffer at 0x{addr:X} is not 64-byte aligned or runs past RDRAM")
+        try:
+            desc = bytes(data[offset:offset + desc_len]).decode("ascii")
+        except UnicodeDecodeError:
+            raise SpecError(f"spec {i}: description is not ASCII") from None
+        offset += align4(desc_len)
+
+        entry = SpecEntry(desc, alpha_compare_threshold=threshold, rectangle_alpha=alpha, num_runs=num_runs,
+                          rect=None if full_rect else (x0, y0, x1, y1),
+                          fb_addr=fb_addr, zb_addr=zb_addr, vi_addr=vi_addr)
+        for bit,field in enumerate(SPEC_FIELDS):
+            setattr(entry, field, bool(flags & (1 << bit)))
+        specs.append(entry)
+    if offset != len(data):
+        raise SpecError(f"{len(data) - offset} bytes after the last spec")
+    return specs
+
+def format_spec(spec):
+    """
+    A spec line of the text format describing `spec` exactly
+    """
+    words = ["spec", shlex.quote(spec.desc)]
+    for key,(attr, parse) in KEYS.items():
+        value = getattr(spec, attr)
+        if value == getattr(SpecEntry(""), attr):
+            continue
+        if attr == "two_cycle":
+            text = "2"
+        elif attr in ("zb_same_bank", "vi_same_bank"):
+            text = "same"
+        elif isinstance(value, bool):
+            text = "on"
+        elif attr == "rect":
+            text = ",".join(str(v) for v in value)
+        elif attr.endswith("_addr"):
+            text = f"0x{value:X}"
+        else:
+            text = str(value)
+        words.append(f"{key}={text}")
+    return " ".join(words)
+
+def load_spec_table(path):
+    """
+    Reads a compiled table, or compiles a text description, returning the binary table
+    """
+    with open(path, "rb") as infile:
+        data = infile.read()
+    if data[:4] == struct.pack(">I", SPEC_TABLE_MAGIC):
+        decode_spec_table(data)
+        return data
+    return encode_spec_table(compile_specs(data.decode("ascii"), path))
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Compile a spec table description for the ROM, or list a compiled table")
+    parser.add_argument("specs", help="text description, or a compiled table with --dump")
+    parser.add_argument("-o", "--output", help="file to write the compiled table to")
+    parser.add_argument("--dump", help="print a compiled table (or a description) as one spec line per spec", action="store_true")
+    args = parser.parse_args()
+
+    try:
+        table = load_spec_table(args.specs)
+    except (SpecError, UnicodeDecodeError) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+
+    specs = decode_spec_table(table)
+    if args.dump:
+        for spec in specs:
+            print(format_spec(spec))
+    if args.output is not None:
+        with open(args.output, "wb") as outfile:
+            outfile.write(table)
+    print(f"{len(specs)} specs, {len(table)} bytes", file=sys.stderr)
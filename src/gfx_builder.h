@@ -0,0 +1,722 @@
+/**
+ * Range-checked C++ counterparts of the gs* macros of rdp.h
+ *
+ * gs::DPSetColorImage(...) builds the same Gfx as gsDPSetColorImage(...), but
+ * a field that does not fit is an error instead of being masked: a compile
+ * error where the command is built in a constant expression, GS_RANGE_ERROR at
+ * run time. Commands of several Gfx are gs::list<N>, and gs::make_list joins
+ * commands into one list, so a static display list is encoded entirely by the
+ * compiler:
+ *
+ *     static constexpr auto dl = gs::make_list(gs::DPPipeSync(), gs::DPSetPrimDepth(0x7FFF, 0), ...);
+ *
+ * Dynamic lists go through a gs::arena, which never writes past the buffer it
+ * was given.
+ */
+#ifndef GFX_BUILDER_H_
+#define GFX_BUILDER_H_
+
+#ifndef __cplusplus
+#error "gfx_builder.h is C++ only, C code uses the gs* macros"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#if defined(__cpp_exceptions)
+#include <stdexcept>
+#endif
+
+#include "rdp.h"
+
+// What a field out of range does at run time, e.g. in a build without exceptions
+#ifndef GS_RANGE_ERROR
+#if defined(__cpp_exceptions)
+#define GS_RANGE_ERROR(what)    throw std::out_of_range(what)
+#else
+#define GS_RANGE_ERROR(what)    __builtin_trap()
+#endif
+#endif
+
+// For what the compiler would not inline on its own, at a cost in dynamic
+// lists larger than that of the range checks
+#define GS_INLINE   __attribute__((always_inline))
+
+namespace gs {
+
+// Every argument is taken this wide so nothing is truncated before it is checked
+typedef int64_t arg_t;
+
+// Not constexpr, so reaching it during constant evaluation fails the build
+[[noreturn]] __attribute__((cold)) inline void
+range_error (const char* what)
+{
+    GS_RANGE_ERROR(what);
+    __builtin_unreachable();
+}
+
+/*
+ * Fields: unsigned values in [0, 2^n), signed values in [-2^(n-1), 2^(n-1)),
+ * and raw fields that take either
+ */
+
+constexpr uint32_t
+mask (unsigned n)
+{
+    return (n >= 32) ? ~0u : (1u << n) - 1;
+}
+
+constexpr uint32_t
+uF (arg_t v, unsigned n, unsigned s, const char* what)
+{
+    if (v < 0 || v > (arg_t)mask(n))
+        range_error(what);
+    return ((uint32_t)v & mask(n)) << s;
+}
+
+constexpr uint32_t
+sF (arg_t v, unsigned n, unsigned s, const char* what)
+{
+    if (v < -((arg_t)1 << (n - 1)) || v >= ((arg_t)1 << (n - 1)))
+        range_error(what);
+    return ((uint32_t)v & mask(n)) << s;
+}
+
+constexpr uint32_t
+xF (arg_t v, unsigned n, unsigned s, const char* what)
+{
+    if (v < -((arg_t)1 << (n - 1)) || v > (arg_t)mask(n))
+        range_error(what);
+    return ((uint32_t)v & mask(n)) << s;
+}
+
+constexpr Gfx
+gO (unsigned opc, uint32_t hi, uint32_t lo)
+{
+    return Gfx{ (uint32_t)opc << 24 | hi, lo };
+}
+
+/**
+ * Commands of several Gfx, and whole display lists
+ */
+template <size_t N>
+struct list {
+    Gfx gfx[N] = {};
+
+    static constexpr size_t size () { return N; }
+    constexpr const Gfx& operator[] (size_t i) const { return gfx[i]; }
+    constexpr Gfx& operator[] (size_t i) { return gfx[i]; }
+    const Gfx* data () const { return gfx; }
+};
+
+template <size_t A, size_t B>
+constexpr list<A + B>
+operator+ (const list<A>& a, const list<B>& b)
+{
+    list<A + B> out;
+    for (size_t i = 0; i < A; i++)
+        out[i] = a[i];
+    for (size_t i = 0; i < B; i++)
+        out[A + i] = b[i];
+    return out;
+}
+
+constexpr list<1>
+to_list (const Gfx& g)
+{
+    list<1> out;
+    out[0] = g;
+    return out;
+}
+
+template <size_t N>
+constexpr const list<N>&
+to_list (const list<N>& l)
+{
+    return l;
+}
+
+template <typename... C>
+constexpr auto
+make_list (const C&... cmds)
+{
+    return (to_list(cmds) + ...);
+}
+
+/*
+ * Colors
+ */
+
+constexpr uint32_t
+PackRGBA5551 (arg_t r, arg_t g, arg_t b, arg_t a)
+{
+    return uF(r, 5, 11, "RGBA5551 r") | uF(g, 5, 6, "RGBA5551 g") | uF(b, 5, 1, "RGBA5551 b") |
+           uF(a, 1, 0, "RGBA5551 a");
+}
+
+constexpr uint32_t
+PackRGBA8888 (arg_t r, arg_t g, arg_t b, arg_t a)
+{
+    return uF(r, 8, 24, "RGBA8888 r") | uF(g, 8, 16, "RGBA8888 g") | uF(b, 8, 8, "RGBA8888 b") |
+           uF(a, 8, 0, "RGBA8888 a");
+}
+
+constexpr uint32_t
+PackRGB24A8 (arg_t rgb, arg_t a)
+{
+    return uF(rgb, 24, 8, "RGB24A8 rgb") | uF(a, 8, 0, "RGB24A8 a");
+}
+
+constexpr uint32_t
+PackZDZ (arg_t z, arg_t dz)
+{
+    return uF(z, 14, 2, "ZDZ z") | uF(dz, 2, 0, "ZDZ dz");
+}
+
+/*
+ * Triangles
+ */
+
+GS_INLINE constexpr list<4>
+TriBase (unsigned cmd, arg_t lft, arg_t level, arg_t tile,
+         arg_t xl, arg_t yl, arg_t dxldy,
+         arg_t xm, arg_t ym, arg_t dxmdy,
+         arg_t xh, arg_t yh, arg_t dxhdy)
+{
+    if (cmd < G_TRI_FILL || cmd > G_TRI_SHADE_TXTR_ZBUFF)
+        range_error("triangle command");
+    list<4> out;
+    out[0] = gO(cmd, uF(lft, 1, 23, "lft") | uF(level, 3, 19, "level") | uF(tile, 3, 16, "tile") |
+                     sF(yl, 14, 0, "yl"),
+                sF(ym, 14, 16, "ym") | sF(yh, 14, 0, "yh"));
+    out[1] = gO(0, xF(xl, 32, 0, "xl"), xF(dxldy, 32, 0, "dxldy"));
+    out[2] = gO(0, xF(xh, 32, 0, "xh"), xF(dxhdy, 32, 0, "dxhdy"));
+    out[3] = gO(0, xF(xm, 32, 0, "xm"), xF(dxmdy, 32, 0, "dxmdy"));
+    return out;
+}
+
+// Shade and texture coefficients share a layout: per channel the value, d/dx,
+// d/de and d/dy, each as 16 integer and 16 fraction bits, four channels a Gfx
+constexpr list<8>
+coeffs (const arg_t (&c)[4][8], const char* what)
+{
+    // Arguments come as v_i, v_f, dx_i, dx_f, de_i, de_f, dy_i, dy_f
+    constexpr unsigned order[8] = { 0, 2, 1, 3, 4, 6, 5, 7 };
+    list<8> out;
+    for (unsigned k = 0; k < 8; k++) {
+        unsigned i = order[k];
+        out[k] = gO(0, xF(c[0][i], 16, 16, what) | xF(c[1][i], 16, 0, what),
+                    xF(c[2][i], 16, 16, what) | xF(c[3][i], 16, 0, what));
+    }
+    return out;
+}
+
+constexpr list<8>
+TriShadeCoeffs (arg_t r_i, arg_t r_f, arg_t drdx_i, arg_t drdx_f, arg_t drde_i, arg_t drde_f, arg_t drdy_i, arg_t drdy_f,
+                arg_t g_i, arg_t g_f, arg_t dgdx_i, arg_t dgdx_f, arg_t dgde_i, arg_t dgde_f, arg_t dgdy_i, arg_t dgdy_f,
+                arg_t b_i, arg_t b_f, arg_t dbdx_i, arg_t dbdx_f, arg_t dbde_i, arg_t dbde_f, arg_t dbdy_i, arg_t dbdy_f,
+                arg_t a_i, arg_t a_f, arg_t dadx_i, arg_t dadx_f, arg_t dade_i, arg_t dade_f, arg_t dady_i, arg_t dady_f)
+{
+    const arg_t c[4][8] = {
+        { r_i, r_f, drdx_i, drdx_f, drde_i, drde_f, drdy_i, drdy_f },
+        { g_i, g_f, dgdx_i, dgdx_f, dgde_i, dgde_f, dgdy_i, dgdy_f },
+        { b_i, b_f, dbdx_i, dbdx_f, dbde_i, dbde_f, dbdy_i, dbdy_f },
+        { a_i, a_f, dadx_i, dadx_f, dade_i, dade_f, dady_i, dady_f },
+    };
+    return coeffs(c, "shade coefficient");
+}
+
+constexpr list<8>
+TriTexCoeffs (arg_t s_i, arg_t s_f, arg_t dsdx_i, arg_t dsdx_f, arg_t dsde_i, arg_t dsde_f, arg_t dsdy_i, arg_t dsdy_f,
+              arg_t t_i, arg_t t_f, arg_t dtdx_i, arg_t dtdx_f, arg_t dtde_i, arg_t dtde_f, arg_t dtdy_i, arg_t dtdy_f,
+              arg_t w_i, arg_t w_f, arg_t dwdx_i, arg_t dwdx_f, arg_t dwde_i, arg_t dwde_f, arg_t dwdy_i, arg_t dwdy_f)
+{
+    const arg_t c[4][8] = {
+        { s_i, s_f, dsdx_i, dsdx_f, dsde_i, dsde_f, dsdy_i, dsdy_f },
+        { t_i, t_f, dtdx_i, dtdx_f, dtde_i, dtde_f, dtdy_i, dtdy_f },
+        { w_i, w_f, dwdx_i, dwdx_f, dwde_i, dwde_f, dwdy_i, dwdy_f },
+        { 0, 0, 0, 0, 0, 0, 0, 0 },
+    };
+    return coeffs(c, "texture coefficient");
+}
+
+constexpr list<2>
+TriDepthCoeffs (arg_t z, arg_t dzdx, arg_t dzde, arg_t dzdy)
+{
+    list<2> out;
+    out[0] = gO(0, xF(z, 32, 0, "z"), xF(dzdx, 32, 0, "dzdx"));
+    out[1] = gO(0, xF(dzde, 32, 0, "dzde"), xF(dzdy, 32, 0, "dzdy"));
+    return out;
+}
+
+/*
+ * The gsDPTriFill variants take the edge arguments, then 32 shade, 24
+ * texture and 4 depth arguments as their letters say, in the macros' order
+ */
+
+#define GS_TRI_ARGS     arg_t lft, arg_t level, arg_t tile,     \
+                        arg_t xl, arg_t yl, arg_t dxldy,        \
+                        arg_t xm, arg_t ym, arg_t dxmdy,        \
+                        arg_t xh, arg_t yh, arg_t dxhdy
+#define GS_TRI_BASE(cmd) TriBase(cmd, lft, level, tile, xl, yl, dxldy, xm, ym, dxmdy, xh, yh, dxhdy)
+
+template <size_t Take, size_t Skip = 0, typename... A>
+constexpr void
+pick (arg_t (&out)[Take], const A&... args)
+{
+    const arg_t all[] = { (arg_t)args... };
+    for (size_t i = 0; i < Take; i++)
+        out[i] = all[Skip + i];
+}
+
+constexpr list<8>
+shade_from (const arg_t (&v)[32])
+{
+    return TriShadeCoeffs(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10], v[11], v[12], v[13],
+                          v[14], v[15], v[16], v[17], v[18], v[19], v[20], v[21], v[22], v[23], v[24], v[25], v[26],
+                          v[27], v[28], v[29], v[30], v[31]);
+}
+
+constexpr list<8>
+tex_from (const arg_t (&v)[24])
+{
+    return TriTexCoeffs(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10], v[11], v[12], v[13],
+                        v[14], v[15], v[16], v[17], v[18], v[19], v[20], v[21], v[22], v[23]);
+}
+
+constexpr list<2>
+depth_from (const arg_t (&v)[4])
+{
+    return TriDepthCoeffs(v[0], v[1], v[2], v[3]);
+}
+
+constexpr list<4>
+DPTriFill (GS_TRI_ARGS)
+{
+    return GS_TRI_BASE(G_TRI_FILL);
+}
+
+constexpr list<6>
+DPTriFill_Z (GS_TRI_ARGS, arg_t z, arg_t dzdx, arg_t dzde, arg_t dzdy)
+{
+    return GS_TRI_BASE(G_TRI_FILL_ZBUFF) + TriDepthCoeffs(z, dzdx, dzde, dzdy);
+}
+
+template <typename... A>
+constexpr list<12>
+DPTriFill_S (GS_TRI_ARGS, const A&... c)
+{
+    static_assert(sizeof...(A) == 32, "gs::DPTriFill_S takes 32 shade arguments");
+    arg_t s[32] = {};
+    pick<32>(s, c...);
+    return GS_TRI_BASE(G_TRI_SHADE) + shade_from(s);
+}
+
+template <typename... A>
+constexpr list<12>
+DPTriFill_T (GS_TRI_ARGS, const A&... c)
+{
+    static_assert(sizeof...(A) == 24, "gs::DPTriFill_T takes 24 texture arguments");
+    arg_t t[24] = {};
+    pick<24>(t, c...);
+    return GS_TRI_BASE(G_TRI_TXTR) + tex_from(t);
+}
+
+template <typename... A>
+constexpr list<20>
+DPTriFill_ST (GS_TRI_ARGS, const A&... c)
+{
+    static_assert(sizeof...(A) == 56, "gs::DPTriFill_ST takes 32 shade and 24 texture arguments");
+    arg_t s[32] = {}, t[24] = {};
+    pick<32>(s, c...);
+    pick<24, 32>(t, c...);
+    return GS_TRI_BASE(G_TRI_SHADE_TXTR) + shade_from(s) + tex_from(t);
+}
+
+template <typename... A>
+constexpr list<14>
+DPTriFill_SZ (GS_TRI_ARGS, const A&... c)
+{
+    static_assert(sizeof...(A) == 36, "gs::DPTriFill_SZ takes 32 shade and 4 depth arguments");
+    arg_t s[32] = {}, z[4] = {};
+    pick<32>(s, c...);
+    pick<4, 32>(z, c...);
+    return GS_TRI_BASE(G_TRI_SHADE_ZBUFF) + shade_from(s) + depth_from(z);
+}
+
+template <typename... A>
+constexpr list<14>
+DPTriFill_TZ (GS_TRI_ARGS, const A&... c)
+{
+    static_assert(sizeof...(A) == 28, "gs::DPTriFill_TZ takes 24 texture and 4 depth arguments");
+    arg_t t[24] = {}, z[4] = {};
+    pick<24>(t, c...);
+    pick<4, 24>(z, c...);
+    return GS_TRI_BASE(G_TRI_TXTR_ZBUFF) + tex_from(t) + depth_from(z);
+}
+
+template <typename... A>
+constexpr list<22>
+DPTriFill_STZ (GS_TRI_ARGS, const A&... c)
+{
+    static_assert(sizeof...(A) == 60, "gs::DPTriFill_STZ takes 32 shade, 24 texture and 4 depth arguments");
+    arg_t s[32] = {}, t[24] = {}, z[4] = {};
+    pick<32>(s, c...);
+    pick<24, 32>(t, c...);
+    pick<4, 56>(z, c...);
+    return GS_TRI_BASE(G_TRI_SHADE_TXTR_ZBUFF) + shade_from(s) + tex_from(t) + depth_from(z);
+}
+
+#undef GS_TRI_ARGS
+#undef GS_TRI_BASE
+
+/*
+ * Images, combiner and colors
+ */
+
+constexpr Gfx
+DPSetColorImage (arg_t fmt, arg_t siz, arg_t width, arg_t img)
+{
+    return gO(G_SETCIMG, uF(fmt, 3, 21, "image format") | uF(siz, 2, 19, "image size") |
+                         uF(width - 1, 12, 0, "image width"),
+              uF(img, 32, 0, "image address"));
+}
+
+constexpr Gfx
+DPSetDepthImage (arg_t img)
+{
+    return gO(G_SETZIMG, 0, uF(img, 32, 0, "image address"));
+}
+
+constexpr Gfx
+DPSetTextureImage (arg_t fmt, arg_t siz, arg_t width, arg_t img)
+{
+    return gO(G_SETTIMG, uF(fmt, 3, 21, "image format") | uF(siz, 2, 19, "image size") |
+                         uF(width - 1, 12, 0, "image width"),
+              uF(img, 32, 0, "image address"));
+}
+
+// Combiner inputs fit their field, except G_CCMUX_0 which the field's width truncates to its zero
+constexpr uint32_t
+ccmux (arg_t v, unsigned n, unsigned s)
+{
+    return (v == G_CCMUX_0) ? mask(n) << s : uF(v, n, s, "color combiner input");
+}
+
+constexpr uint32_t
+acmux (arg_t v, unsigned s)
+{
+    return uF(v, 3, s, "alpha combiner input");
+}
+
+/**
+ * Takes the G_CCMUX_ and G_ACMUX_ values the macro pastes from its arguments
+ */
+constexpr Gfx
+DPSetCombineLERP (arg_t a0, arg_t b0, arg_t c0, arg_t d0,
+                  arg_t Aa0, arg_t Ab0, arg_t Ac0, arg_t Ad0,
+                  arg_t a1, arg_t b1, arg_t c1, arg_t d1,
+                  arg_t Aa1, arg_t Ab1, arg_t Ac1, arg_t Ad1)
+{
+    return gO(G_SETCOMBINE,
+              ccmux(a0, 4, 20) | ccmux(c0, 5, 15) | acmux(Aa0, 12) | acmux(Ac0, 9) | ccmux(a1, 4, 5) |
+              ccmux(c1, 5, 0),
+              ccmux(b0, 4, 28) | ccmux(b1, 4, 24) | acmux(Aa1, 21) | acmux(Ac1, 18) | ccmux(d0, 3, 15) |
+              acmux(Ab0, 12) | acmux(Ad0, 9) | ccmux(d1, 3, 6) | acmux(Ab1, 3) | acmux(Ad1, 0));
+}
+
+constexpr uint32_t
+rgba (arg_t r, arg_t g, arg_t b, arg_t a)
+{
+    return uF(r, 8, 24, "color r") | uF(g, 8, 16, "color g") | uF(b, 8, 8, "color b") | uF(a, 8, 0, "color a");
+}
+
+constexpr Gfx
+DPSetEnvColor (arg_t r, arg_t g, arg_t b, arg_t a)
+{
+    return gO(G_SETENVCOLOR, 0, rgba(r, g, b, a));
+}
+
+constexpr Gfx
+DPSetPrimColor (arg_t m, arg_t l, arg_t r, arg_t g, arg_t b, arg_t a)
+{
+    return gO(G_SETPRIMCOLOR, uF(m, 8, 8, "prim min level") | uF(l, 8, 0, "prim LOD fraction"), rgba(r, g, b, a));
+}
+
+constexpr Gfx
+DPSetBlendColor (arg_t r, arg_t g, arg_t b, arg_t a)
+{
+    return gO(G_SETBLENDCOLOR, 0, rgba(r, g, b, a));
+}
+
+constexpr Gfx
+DPSetFogColor (arg_t r, arg_t g, arg_t b, arg_t a)
+{
+    return gO(G_SETFOGCOLOR, 0, rgba(r, g, b, a));
+}
+
+constexpr Gfx
+DPSetFillColor (arg_t c)
+{
+    return gO(G_SETFILLCOLOR, 0, uF(c, 32, 0, "fill color"));
+}
+
+/*
+ * Rectangles and tiles
+ */
+
+constexpr Gfx
+DPFillRectangle (arg_t ulx, arg_t uly, arg_t lrx, arg_t lry)
+{
+    return gO(G_FILLRECT, uF(lrx, 10, 14, "rectangle lrx") | uF(lry, 10, 2, "rectangle lry"),
+              uF(ulx, 10, 14, "rectangle ulx") | uF(uly, 10, 2, "rectangle uly"));
+}
+
+constexpr Gfx
+DPSetTile (arg_t fmt, arg_t siz, arg_t line, arg_t tmem, arg_t tile, arg_t palette,
+           arg_t cmt, arg_t maskt, arg_t shiftt, arg_t cms, arg_t masks, arg_t shifts)
+{
+    return gO(G_SETTILE, uF(fmt, 3, 21, "tile format") | uF(siz, 2, 19, "tile size") | uF(line, 9, 9, "tile line") |
+                         uF(tmem, 9, 0, "tile TMEM address"),
+              uF(tile, 3, 24, "tile") | uF(palette, 4, 20, "tile palette") | uF(cmt, 2, 18, "tile cmt") |
+              uF(maskt, 4, 14, "tile maskt") | uF(shiftt, 4, 10, "tile shiftt") | uF(cms, 2, 8, "tile cms") |
+              uF(masks, 4, 4, "tile masks") | uF(shifts, 4, 0, "tile shifts"));
+}
+
+constexpr Gfx
+tile_rect (unsigned opc, arg_t tile, arg_t uls, arg_t ult, arg_t lrs, arg_t lrt)
+{
+    return gO(opc, uF(uls, 12, 12, "tile uls") | uF(ult, 12, 0, "tile ult"),
+              uF(tile, 3, 24, "tile") | uF(lrs, 12, 12, "tile lrs") | uF(lrt, 12, 0, "tile lrt"));
+}
+
+constexpr Gfx
+DPLoadTile (arg_t tile, arg_t uls, arg_t ult, arg_t lrs, arg_t lrt)
+{
+    return tile_rect(G_LOADTILE, tile, uls, ult, lrs, lrt);
+}
+
+constexpr Gfx
+DPLoadBlock (arg_t tile, arg_t uls, arg_t ult, arg_t lrs, arg_t dxt)
+{
+    return tile_rect(G_LOADBLOCK, tile, uls, ult, lrs, dxt);
+}
+
+constexpr Gfx
+DPSetTileSize (arg_t tile, arg_t uls, arg_t ult, arg_t lrs, arg_t lrt)
+{
+    return tile_rect(G_SETTILESIZE, tile, uls, ult, lrs, lrt);
+}
+
+constexpr Gfx
+DPLoadTLUTCmd (arg_t tile, arg_t count)
+{
+    return gO(G_LOADTLUT, 0, uF(tile, 3, 24, "tile") | uF(count, 10, 14, "TLUT count"));
+}
+
+/*
+ * Modes
+ */
+
+constexpr Gfx
+DPSetOtherMode (arg_t mode0, arg_t mode1)
+{
+    return gO(G_RDPSETOTHERMODE, uF(mode0, 24, 0, "othermode high word"), uF(mode1, 32, 0, "othermode low word"));
+}
+
+constexpr Gfx
+DPSetPrimDepth (arg_t z, arg_t dz)
+{
+    return gO(G_SETPRIMDEPTH, 0, xF(z, 16, 16, "prim depth z") | xF(dz, 16, 0, "prim depth dz"));
+}
+
+constexpr Gfx
+DPSetScissorFrac (arg_t mode, arg_t ulx, arg_t uly, arg_t lrx, arg_t lry)
+{
+    return gO(G_SETSCISSOR, uF(ulx, 12, 12, "scissor ulx") | uF(uly, 12, 0, "scissor uly"),
+              uF(mode, 2, 24, "scissor mode") | uF(lrx, 12, 12, "scissor lrx") | uF(lry, 12, 0, "scissor lry"));
+}
+
+constexpr Gfx
+DPSetConvert (arg_t k0, arg_t k1, arg_t k2, arg_t k3, arg_t k4, arg_t k5)
+{
+    // K2 is split between the words, its top 4 bits in w0
+    uint32_t k2_bits = xF(k2, 9, 0, "convert k2");
+    return gO(G_SETCONVERT, xF(k0, 9, 13, "convert k0") | xF(k1, 9, 4, "convert k1") | (k2_bits >> 5),
+              (k2_bits & 0x1F) << 27 | xF(k3, 9, 18, "convert k3") | xF(k4, 9, 9, "convert k4") |
+              xF(k5, 9, 0, "convert k5"));
+}
+
+constexpr Gfx
+DPSetKeyR (arg_t cR, arg_t sR, arg_t wR)
+{
+    return gO(G_SETKEYR, 0, uF(wR, 12, 16, "key width") | uF(cR, 8, 8, "key center") | uF(sR, 8, 0, "key scale"));
+}
+
+constexpr Gfx
+DPSetKeyGB (arg_t cG, arg_t sG, arg_t wG, arg_t cB, arg_t sB, arg_t wB)
+{
+    return gO(G_SETKEYGB, uF(wG, 12, 12, "key width") | uF(wB, 12, 0, "key width"),
+              uF(cG, 8, 24, "key center") | uF(sG, 8, 16, "key scale") | uF(cB, 8, 8, "key center") |
+              uF(sB, 8, 0, "key scale"));
+}
+
+/*
+ * Syncs and texture rectangles
+ */
+
+constexpr Gfx DPFullSync () { return gO(G_RDPFULLSYNC, 0, 0); }
+constexpr Gfx DPTileSync () { return gO(G_RDPTILESYNC, 0, 0); }
+constexpr Gfx DPPipeSync () { return gO(G_RDPPIPESYNC, 0, 0); }
+constexpr Gfx DPLoadSync () { return gO(G_RDPLOADSYNC, 0, 0); }
+constexpr Gfx DPNoOp () { return gO(G_NOOP, 0, 0); }
+
+constexpr list<2>
+tex_rect (unsigned opc, arg_t ulx, arg_t uly, arg_t lrx, arg_t lry, arg_t tile, arg_t s, arg_t t, arg_t dsdx, arg_t dtdy)
+{
+    list<2> out;
+    out[0] = gO(opc, uF(lrx, 12, 12, "rectangle lrx") | uF(lry, 12, 0, "rectangle lry"),
+                uF(tile, 3, 24, "tile") | uF(ulx, 12, 12, "rectangle ulx") | uF(uly, 12, 0, "rectangle uly"));
+    out[1] = gO(0, xF(s, 16, 16, "rectangle s") | xF(t, 16, 0, "rectangle t"),
+                xF(dsdx, 16, 16, "rectangle dsdx") | xF(dtdy, 16, 0, "rectangle dtdy"));
+    return out;
+}
+
+constexpr list<2>
+TexRect (arg_t ulx, arg_t uly, arg_t lrx, arg_t lry, arg_t tile, arg_t s, arg_t t, arg_t dsdx, arg_t dtdy)
+{
+    return tex_rect(G_TEXRECT, ulx, uly, lrx, lry, tile, s, t, dsdx, dtdy);
+}
+
+constexpr list<2>
+TexRectFlip (arg_t ulx, arg_t uly, arg_t lrx, arg_t lry, arg_t tile, arg_t s, arg_t t, arg_t dsdx, arg_t dtdy)
+{
+    return tex_rect(G_TEXRECTFLIP, ulx, uly, lrx, lry, tile, s, t, dsdx, dtdy);
+}
+
+/*
+ * Compound commands
+ */
+
+constexpr list<6>
+DPLoadTLUT (arg_t count, arg_t tmemaddr, arg_t dram, arg_t loadtile)
+{
+    return make_list(DPSetTextureImage(G_IM_FMT_RGBA, G_IM_SIZ_16b, 1, dram),
+                     DPTileSync(),
+                     DPSetTile(0, 0, 0, tmemaddr, loadtile, 0, 0, 0, 0, 0, 0, 0),
+                     DPLoadSync(),
+                     DPLoadTLUTCmd(loadtile, count - 1),
+                     DPPipeSync());
+}
+
+constexpr list<6>
+DPLoadTLUT_pal16 (arg_t pal, arg_t dram, arg_t loadtile)
+{
+    return DPLoadTLUT(16, 0x100 + uF(pal, 4, 0, "palette") * 0x10, dram, loadtile);
+}
+
+constexpr list<6>
+DPLoadTLUT_pal256 (arg_t dram, arg_t loadtile)
+{
+    return DPLoadTLUT(256, 0x000, dram, loadtile);
+}
+
+/**
+ * Appends commands to a buffer it does not own. A command that does not fit
+ * is not written at all and marks the arena overflowed, after which nothing
+ * more is appended until clear(), so a list can be built without checking
+ * every step and checked once before it is run.
+ */
+class arena {
+public:
+    arena (Gfx* buffer, size_t capacity)
+        : buf_(buffer), cap_(capacity)
+    {
+    }
+
+    template <size_t N>
+    explicit arena (Gfx (&buffer)[N])
+        : buf_(buffer), cap_(N)
+    {
+    }
+
+    bool push (const Gfx& g)
+    {
+        if (overflowed_ || used_ == cap_) {
+            overflowed_ = true;
+            return false;
+        }
+        buf_[used_++] = g;
+        return true;
+    }
+
+    template <size_t N>
+    bool push (const list<N>& l)
+    {
+        if (overflowed_ || N > cap_ - used_) {
+            overflowed_ = true;
+            return false;
+        }
+        for (size_t i = 0; i < N; i++)
+            buf_[used_ + i] = l[i];
+        used_ += N;
+        return true;
+    }
+
+    // Appends all the commands or, if they do not all fit, none of them
+    template <typename... C>
+    bool put (const C&... cmds)
+    {
+        constexpr size_t n = (length<C>::value + ...);
+        if (overflowed_ || n > cap_ - used_) {
+            overflowed_ = true;
+            return false;
+        }
+        Gfx* out = buf_ + used_;
+        (write(out, cmds), ...);
+        used_ += n;
+        return true;
+    }
+
+    void clear () { used_ = 0; overflowed_ = false; }
+
+    const Gfx* data () const { return buf_; }
+    size_t size () const { return used_; }
+    size_t bytes () const { return used_ * sizeof(Gfx); }
+    size_t capacity () const { return cap_; }
+    bool overflowed () const { return overflowed_; }
+
+private:
+    template <typename C>
+    struct length;
+
+    static void write (Gfx*& out, const Gfx& g)
+    {
+        *out++ = g;
+    }
+
+    template <size_t N>
+    static void write (Gfx*& out, const list<N>& l)
+    {
+        for (size_t i = 0; i < N; i++)
+            *out++ = l[i];
+    }
+
+    Gfx* buf_;
+    size_t cap_;
+    size_t used_ = 0;
+    bool overflowed_ = false;
+};
+
+template <>
+struct arena::length<Gfx> {
+    static constexpr size_t value = 1;
+};
+
+template <size_t N>
+struct arena::length<list<N>> {
+    static constexpr size_t value = N;
+};
+
+}
+
+#endif
@@ -168,9 +168,9 @@ typedef struct __attribute__((aligned(8))) {
     gO_(cmd, gF_(lft,    1, 23) |   \
              gF_(level,  3, 19) |   \
              gF_(tile,   3, 16) |   \
-             gF_(yh,    14,  0),    \
+             gF_(yl,    14,  0),    \
              gF_(ym,    14, 16) |   \
-             gF_(yl,    14,  0)),   \
+             gF_(yh,    14,  0)),   \
     gO_(0, xl, dxldy),              \
     gO_(0, xh, dxhdy),              \
     gO_(0, xm, dxmdy)
@@ -764,7 +764,7 @@ typedef struct __attribute__((aligned(8))) {
 
 #define gsDPLoadSync()  gO_(G_RDPLOADSYNC, 0, 0)
 
-#define gsTexRectFlip(ulx, uly, lrx, lry, tile, s, t, dsdx, dtdylrs) \
+#define gsTexRectFlip(ulx, uly, lrx, lry, tile, s, t, dsdx, dtdy) \
     gO_(G_TEXRECTFLIP,      \
         gF_(lrx,  12, 12) | \
         gF_(lry,  12,  0),  \
@@ -0,0 +1,70 @@
+/**
+ * Binary result packet layout, shared between the ROM and host tools
+ */
+#ifndef RESULTS_H_
+#define RESULTS_H_
+
+#include <stdint.h>
+
+// UNFLoader datatype for result packets, kept clear of the standard types (TEXT=0x01 .. HEARTBEAT=0x05)
+#define RESULTS_DATATYPE    0x10
+
+#define RESULTS_MAGIC       0x52445052 // 'RDPR'
+#define RESULTS_VERSION     3
+
+// Longest description carried in a packet, longer descriptions are truncated
+#define RESULTS_DESC_MAX    128
+
+/*
+ * Counter set: one u32 array per set bit follows the header, lowest bit first
+ */
+#define RESULTS_CTR_BUF     (1 << 0)
+#define RESULTS_CTR_PIPE    (1 << 1)
+#define RESULTS_CTR_TMEM    (1 << 2)
+#define RESULTS_CTR_CLOCK   (1 << 3)
+
+/*
+ * All fields are big-endian (native on the console). The header is followed by
+ * desc_len bytes of description NUL-padded to a 4-byte boundary, then by one
+ * u32[num_samples] array for each counter in counter_mask. Samples already have
+ * the fullsync baseline subtracted.
+ *
+ * A packet may carry only part of a spec's samples: num_samples of them
+ * starting at first_sample, out of total_samples. client.py joins the parts
+ * back together, so result files hold whole specs.
+ *
+ * Version 1 headers end at num_samples, version 2 headers at reserved.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t spec_id;
+    uint16_t counter_mask;
+    uint16_t desc_len;
+    uint32_t num_samples;
+    // Version 2: console_id from the run configuration (src/run_config.h)
+    uint16_t console_id;
+    uint16_t reserved;
+    // Version 3
+    uint32_t first_sample;
+    uint32_t total_samples;
+} results_header_t;
+
+#define RESULTS_HEADER_SIZE_V1  16
+#define RESULTS_HEADER_SIZE_V2  20
+
+/*
+ * Sent by the host to end a spec early once it has enough samples. The ROM
+ * checks for it at each checkpoint and, if it names the spec being run,
+ * sends the samples so far with total_samples cut to match and moves on.
+ */
+#define RESULTS_STOP_DATATYPE   0x12
+
+typedef struct {
+    uint16_t spec_id;
+    uint16_t reserved;
+} results_stop_t;
+
+#define RESULTS_ALIGN4(n)   (((n) + 3) & ~3)
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * Per-console run configuration, patched into the ROM image by client.py
+ * before it is uploaded
+ */
+#ifndef RUN_CONFIG_H_
+#define RUN_CONFIG_H_
+
+#include <stdint.h>
+
+// Two words so the host cannot mistake other ROM data for the block
+#define RUN_CONFIG_MAGIC0   0x52554E43 // 'RUNC'
+#define RUN_CONFIG_MAGIC1   0x4F4E4647 // 'ONFG'
+#define RUN_CONFIG_VERSION  3
+
+#define RUN_CONFIG_NO_REF   0xFFFF
+
+/*
+ * All fields are big-endian. A console runs spec i when
+ * i % num_shards == shard, and also runs ref_spec so that every console of a
+ * farm measures one spec in common for estimating per-console bias. The
+ * defaults built into the ROM run the whole table as console 0.
+ *
+ * Specs before start_spec are skipped and start_spec itself begins at sample
+ * start_sample, for resuming a campaign after the console hung or was reset.
+ *
+ * A nonzero max_runs replaces every spec's run count, for hosts that stop
+ * specs early (RESULTS_STOP_DATATYPE) once they are measured precisely enough.
+ */
+typedef struct {
+    uint32_t magic[2];
+    uint16_t version;
+    uint16_t console_id;
+    uint16_t shard;
+    uint16_t num_shards;
+    uint16_t ref_spec;
+    uint16_t start_spec;
+    uint32_t start_sample;
+    // Version 3
+    uint16_t max_runs;
+    uint16_t reserved;
+} run_config_t;
+
+#define RUN_CONFIG_DEFAULT  { { RUN_CONFIG_MAGIC0, RUN_CONFIG_MAGIC1 }, RUN_CONFIG_VERSION, 0, 0, 1, RUN_CONFIG_NO_REF, 0, 0, 0, 0 }
+
+static inline int
+run_config_selects (const volatile run_config_t* config, unsigned spec_id)
+{
+    if (spec_id < config->start_spec)
+        return 0;
+    return spec_id % config->num_shards == config->shard || spec_id == config->ref_spec;
+}
+
+#endif
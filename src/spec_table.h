@@ -0,0 +1,61 @@
+/**
+ * Spec tables sent by the host at startup, in place of the table compiled
+ * into the ROM. Built by spec_table.py from a text description.
+ */
+#ifndef SPEC_TABLE_H_
+#define SPEC_TABLE_H_
+
+#include <stdint.h>
+
+/*
+ * The ROM sends an empty packet of this type to ask for a table and the host
+ * answers with one of the same type, empty to keep the compiled-in table
+ */
+#define SPEC_TABLE_DATATYPE     0x11
+
+#define SPEC_TABLE_MAGIC        0x52445054 // 'RDPT'
+#define SPEC_TABLE_VERSION      1
+
+// Largest table the ROM accepts
+#define SPEC_TABLE_MAX_SPECS    1024
+#define SPEC_TABLE_MAX_SIZE     (64 * 1024)
+
+/*
+ * rdp_timing_spec_t booleans, one bit each
+ */
+#define SPEC_TWO_CYCLE          (1 << 0)
+#define SPEC_COLOR_READ         (1 << 1)
+#define SPEC_DEPTH_READ         (1 << 2)
+#define SPEC_DEPTH_WRITE        (1 << 3)
+#define SPEC_DEPTH_PASS         (1 << 4)
+#define SPEC_ZB_SAME_BANK       (1 << 5)
+#define SPEC_ALPHA_COMPARE      (1 << 6)
+#define SPEC_VI_ON              (1 << 7)
+#define SPEC_VI_SAME_BANK       (1 << 8)
+
+/*
+ * All fields are big-endian. The header is followed by num_specs entries,
+ * each followed by desc_len bytes of description NUL-padded to a 4-byte
+ * boundary. Zero in rect, num_runs or the addresses selects the default:
+ * the full screen, TOTAL_RUNS, and the buffers picked by the bank flags.
+ * Addresses are physical.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_specs;
+} spec_table_header_t;
+
+typedef struct {
+    uint16_t flags;
+    uint8_t alpha_compare_threshold;
+    uint8_t rectangle_alpha;
+    uint16_t rect[4]; // x0, y0, x1, y1
+    uint16_t num_runs;
+    uint16_t desc_len;
+    uint32_t fb_addr;
+    uint32_t zb_addr;
+    uint32_t vi_addr;
+} spec_table_entry_t;
+
+#endif
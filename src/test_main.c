@@ -4,14 +4,25 @@
 #define WIDTH 320
 #define HEIGHT 240
 #define TOTAL_RUNS 1000
+// Most runs a spec from the host's table may ask for
+#define MAX_RUNS 4000
+// Send results as binary packets rather than decimal text
+#define RESULTS_BINARY 1
+// Binary builds send the samples of a spec in packets of this many, so a campaign can resume part way through a spec
+#define CHECKPOINT_RUNS 100
 
 // Test
 
 #include <stdlib.h>
+#include <string.h>
 #include <malloc.h>
 #include <libdragon.h>
+#include <usb.h>
 
 #include "rdp.h"
+#include "results.h"
+#include "run_config.h"
+#include "spec_table.h"
 #include "vi.h"
 
 #define ARRLEN(arr) (sizeof(arr) / (sizeof((arr)[0])))
@@ -49,8 +60,30 @@ typedef struct {
     uint32_t buf;
     uint32_t pipe;
     uint32_t tmem;
+    uint32_t clock;
 } rdp_times_t;
 
+// Number of counters in rdp_times_t, in the order of the RESULTS_CTR_ bits
+#define NUM_COUNTERS 4
+
+// A counter with the spec's fullsync baseline removed, 0 where it never advanced past it (TMEM in fill mode)
+static inline uint32_t
+counter_delta (uint32_t value, uint32_t baseline)
+{
+    return (value > baseline) ? value - baseline - 1 : 0;
+}
+
+static inline uint32_t
+counter_sample (const rdp_times_t* t, const rdp_times_t* baseline, size_t counter)
+{
+    switch (counter) {
+        case 0:  return counter_delta(t->buf, baseline->buf);
+        case 1:  return counter_delta(t->pipe, baseline->pipe);
+        case 2:  return counter_delta(t->tmem, baseline->tmem);
+        default: return counter_delta(t->clock, baseline->clock);
+    }
+}
+
 static void
 rdp_exec (rdp_times_t* out, Gfx* dl, size_t length)
 {
@@ -78,6 +111,7 @@ rdp_exec (rdp_times_t* out, Gfx* dl, size_t length)
         out->buf = IO_READ(DPC_BUFBUSY_REG);
         out->pipe = IO_READ(DPC_PIPEBUSY_REG);
         out->tmem = IO_READ(DPC_TMEM_REG);
+        out->clock = IO_READ(DPC_CLOCK_REG);
     }
 }
 
@@ -100,6 +134,14 @@ typedef struct {
     bool vi_same_bank;
     // desc
     const char *desc;
+    // rect, 0 for the full screen
+    uint16_t x0, y0, x1, y1;
+    // runs, 0 for TOTAL_RUNS
+    uint16_t num_runs;
+    // buffers, NULL to pick them by the bank flags above
+    void* fb_addr;
+    void* zb_addr;
+    void* vi_addr;
 } rdp_timing_spec_t;
 
 // Reserve a full MB for RDRAM banking purposes
@@ -111,8 +153,20 @@ __attribute__((aligned(0x100000))) static uint8_t fb_region[0x100000];
 #define ZB_ADDR_DIFF ((void*)(0xA0400000 + 0 * 0x100000))
 #define VI_ADDR_DIFF ((void*)(0xA0400000 + 1 * 0x100000))
 
+// Which specs to run, patched per console by the host. Volatile so the defaults are never folded into the code.
+__attribute__((used)) static volatile run_config_t run_config = RUN_CONFIG_DEFAULT;
+
+#if RESULTS_BINARY
 static void
-exec_timing (rdp_times_t* fullsync_out, rdp_times_t* out, rdp_timing_spec_t *spec)
+results_send (size_t spec_id, const char* desc, rdp_times_t* fullsync_time, rdp_times_t* all_times,
+              size_t first, size_t end, size_t total);
+static bool
+results_stop_requested (size_t spec_id);
+#endif
+
+// Returns the number of runs measured, fewer than asked for when the host stops the spec early
+static size_t
+exec_timing (rdp_times_t* fullsync_out, rdp_times_t* out, rdp_timing_spec_t *spec, size_t spec_id, size_t first_run)
 {
     static Gfx gfx_fullsync[] = {
         gsDPFullSync(),
@@ -122,6 +176,21 @@ exec_timing (rdp_times_t* fullsync_out, rdp_times_t* out, rdp_timing_spec_t *spe
     void* fb_addr = FB_ADDR;
     void* zb_addr = (spec->zb_same_bank) ? ZB_ADDR_SAME : ZB_ADDR_DIFF;
     void* vi_addr = (spec->vi_same_bank) ? VI_ADDR_SAME : VI_ADDR_DIFF;
+    if (spec->fb_addr != NULL)
+        fb_addr = spec->fb_addr;
+    if (spec->zb_addr != NULL)
+        zb_addr = spec->zb_addr;
+    if (spec->vi_addr != NULL)
+        vi_addr = spec->vi_addr;
+
+    size_t num_runs = (spec->num_runs != 0) ? spec->num_runs : TOTAL_RUNS;
+    if (run_config.max_runs != 0)
+        num_runs = (run_config.max_runs < MAX_RUNS) ? run_config.max_runs : MAX_RUNS;
+    bool full_rect = spec->x1 == 0 && spec->y1 == 0;
+    uint16_t x0 = full_rect ? 0 : spec->x0;
+    uint16_t y0 = full_rect ? 0 : spec->y0;
+    uint16_t x1 = full_rect ? WIDTH : spec->x1;
+    uint16_t y1 = full_rect ? HEIGHT : spec->y1;
 
     if (spec->vi_on) {
         // Switch on the VI for NTSC video
@@ -215,10 +284,11 @@ exec_timing (rdp_times_t* fullsync_out, rdp_times_t* out, rdp_timing_spec_t *spe
     rdp_exec(fullsync_out, gfx_fullsync, sizeof(gfx_fullsync));
 
     // Run fillrects, vary depth from far -> closer
-    for (size_t i = 0; i < TOTAL_RUNS; i++) {
+    size_t checkpoint = first_run;
+    for (size_t i = first_run; i < num_runs; i++) {
         // debugf("%u\n", i);
         Gfx gfx_run[3] = {
-            gsDPFillRectangle(0, 0, WIDTH, HEIGHT),
+            gsDPFillRectangle(x0, y0, x1, y1),
             gsDPSetPrimDepth(0x7FFF - i, 0),
             gsDPFullSync(),
         };
@@ -226,7 +296,22 @@ exec_timing (rdp_times_t* fullsync_out, rdp_times_t* out, rdp_timing_spec_t *spe
         // Random wait to try and break up phase patterns
         wait_ms((rand() >> 28) & 0xF);
         rdp_exec(&out[i], gfx_run, sizeof(gfx_run));
+
+#if RESULTS_BINARY
+        // Send finished samples while the next random wait hides the transfer
+        if ((i + 1) % CHECKPOINT_RUNS == 0 || i + 1 == num_runs) {
+            // The host may have seen enough of this spec, the samples so far are then all of it
+            if (results_stop_requested(spec_id))
+                num_runs = i + 1;
+            results_send(spec_id, spec->desc, fullsync_out, out, checkpoint, i + 1, num_runs);
+            checkpoint = i + 1;
+        }
+#else
+        (void)spec_id;
+        (void)checkpoint;
+#endif
     }
+    return num_runs;
 }
 
 #define CYC1    false
@@ -340,6 +425,185 @@ static rdp_timing_spec_t timing_specs[] = {
     AC_GROUP(true,  true,  ZB_DIFF, "Alpha Compare, image_read on,  z_compare on,  FB + ZB separate"),
 };
 
+// How long to wait for the host to answer a spec table request
+#define SPEC_TABLE_TIMEOUT_MS 3000
+
+// End of the ROM's code, data and bss, from libdragon's linker script
+extern char __bss_end[];
+
+/*
+ * Whether a buffer address from the host (physical, 0 for the default) is
+ * 64-byte aligned and leaves room for a full screen past the ROM image and
+ * before the end of RDRAM
+ */
+static bool
+spec_buffer_ok (uint32_t addr)
+{
+    if (addr == 0)
+        return true;
+    uint32_t size = WIDTH * HEIGHT * 2;
+    return addr % 64 == 0 && addr >= PhysicalAddr(__bss_end) && size <= get_memory_size() &&
+           addr <= get_memory_size() - size;
+}
+
+/*
+ * Asks the host for a spec table (src/spec_table.h), returning the number of
+ * specs placed in *specs_out, or 0 to run the compiled-in table
+ */
+static size_t
+spec_table_receive (rdp_timing_spec_t** specs_out)
+{
+    static uint8_t blob[SPEC_TABLE_MAX_SIZE] __attribute__((aligned(8)));
+    rdp_timing_spec_t* specs = NULL;
+    size_t i = 0;
+
+    uint32_t version = SPEC_TABLE_VERSION;
+    usb_write(SPEC_TABLE_DATATYPE, &version, sizeof(version));
+
+    // Hosts that predate spec tables never answer
+    uint32_t header;
+    unsigned long start = get_ticks_ms();
+    while ((header = usb_poll()) == 0) {
+        if (get_ticks_ms() - start > SPEC_TABLE_TIMEOUT_MS)
+            return 0;
+    }
+
+    size_t size = USBHEADER_GETSIZE(header);
+    if (USBHEADER_GETTYPE(header) != SPEC_TABLE_DATATYPE || size == 0 || size > sizeof(blob)) {
+        usb_purge();
+        return 0;
+    }
+    usb_read(blob, size);
+
+    // Fields are big-endian, as is the console
+    const spec_table_header_t* hdr = (const spec_table_header_t*)blob;
+    if (size < sizeof(*hdr) || hdr->magic != SPEC_TABLE_MAGIC || hdr->version != SPEC_TABLE_VERSION ||
+        hdr->num_specs == 0 || hdr->num_specs > SPEC_TABLE_MAX_SPECS)
+        goto bad;
+
+    specs = calloc(hdr->num_specs, sizeof(*specs));
+    if (specs == NULL)
+        goto bad;
+    size_t offset = sizeof(*hdr);
+    for (i = 0; i < hdr->num_specs; i++) {
+        const spec_table_entry_t* entry = (const spec_table_entry_t*)&blob[offset];
+        if (offset + sizeof(*entry) > size)
+            goto bad;
+        offset += sizeof(*entry);
+        if (offset + RESULTS_ALIGN4(entry->desc_len) > size || entry->desc_len > RESULTS_DESC_MAX ||
+            entry->num_runs > MAX_RUNS || entry->rect[2] > WIDTH || entry->rect[3] > HEIGHT)
+            goto bad;
+        // A zero x1, y1 is the full screen, anything else must not be empty
+        bool full_rect = entry->rect[2] == 0 && entry->rect[3] == 0;
+        if (!full_rect && (entry->rect[0] >= entry->rect[2] || entry->rect[1] >= entry->rect[3]))
+            goto bad;
+        if (!spec_buffer_ok(entry->fb_addr) || !spec_buffer_ok(entry->zb_addr) || !spec_buffer_ok(entry->vi_addr))
+            goto bad;
+
+        rdp_timing_spec_t* spec = &specs[i];
+        spec->two_cycle = entry->flags & SPEC_TWO_CYCLE;
+        spec->color_read = entry->flags & SPEC_COLOR_READ;
+        spec->depth_read = entry->flags & SPEC_DEPTH_READ;
+        spec->depth_write = entry->flags & SPEC_DEPTH_WRITE;
+        spec->depth_pass = entry->flags & SPEC_DEPTH_PASS;
+        spec->zb_same_bank = entry->flags & SPEC_ZB_SAME_BANK;
+        spec->alpha_compare = entry->flags & SPEC_ALPHA_COMPARE;
+        spec->alpha_compare_threshold = entry->alpha_compare_threshold;
+        spec->rectangle_alpha = entry->rectangle_alpha;
+        spec->vi_on = entry->flags & SPEC_VI_ON;
+        spec->vi_same_bank = entry->flags & SPEC_VI_SAME_BANK;
+        spec->x0 = entry->rect[0];
+        spec->y0 = entry->rect[1];
+        spec->x1 = entry->rect[2];
+        spec->y1 = entry->rect[3];
+        spec->num_runs = entry->num_runs;
+        spec->fb_addr = (entry->fb_addr != 0) ? (void*)(0xA0000000 | entry->fb_addr) : NULL;
+        spec->zb_addr = (entry->zb_addr != 0) ? (void*)(0xA0000000 | entry->zb_addr) : NULL;
+        spec->vi_addr = (entry->vi_addr != 0) ? (void*)(0xA0000000 | entry->vi_addr) : NULL;
+
+        char* desc = malloc(entry->desc_len + 1);
+        if (desc == NULL)
+            goto bad;
+        memcpy(desc, &blob[offset], entry->desc_len);
+        desc[entry->desc_len] = '\0';
+        spec->desc = desc;
+        offset += RESULTS_ALIGN4(entry->desc_len);
+    }
+
+    *specs_out = specs;
+    return hdr->num_specs;
+
+bad:
+    if (specs != NULL) {
+        while (i-- > 0)
+            free((char*)specs[i].desc);
+        free(specs);
+    }
+    debugf("Bad spec table from the host, running the built-in table\n");
+    return 0;
+}
+
+#if RESULTS_BINARY
+
+// Sends samples [first, end) of a spec's `total`
+static void
+results_send (size_t spec_id, const char* desc, rdp_times_t* fullsync_time, rdp_times_t* all_times,
+              size_t first, size_t end, size_t total)
+{
+    static uint32_t pkt[(sizeof(results_header_t) + RESULTS_DESC_MAX) / sizeof(uint32_t) + NUM_COUNTERS * CHECKPOINT_RUNS];
+
+    size_t desc_len = strlen(desc);
+    if (desc_len > RESULTS_DESC_MAX)
+        desc_len = RESULTS_DESC_MAX;
+
+    results_header_t* hdr = (results_header_t*)pkt;
+    hdr->magic = RESULTS_MAGIC;
+    hdr->version = RESULTS_VERSION;
+    hdr->spec_id = spec_id;
+    hdr->counter_mask = RESULTS_CTR_BUF | RESULTS_CTR_PIPE | RESULTS_CTR_TMEM | RESULTS_CTR_CLOCK;
+    hdr->desc_len = desc_len;
+    hdr->num_samples = end - first;
+    hdr->console_id = run_config.console_id;
+    hdr->reserved = 0;
+    hdr->first_sample = first;
+    hdr->total_samples = total;
+
+    uint8_t* desc_out = (uint8_t*)(hdr + 1);
+    memset(desc_out, 0, RESULTS_ALIGN4(desc_len));
+    memcpy(desc_out, desc, desc_len);
+
+    uint32_t* samples = (uint32_t*)(desc_out + RESULTS_ALIGN4(desc_len));
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        for (size_t j = first; j < end; j++)
+            *samples++ = counter_sample(&all_times[j], fullsync_time, c);
+    }
+
+    usb_write(RESULTS_DATATYPE, pkt, (uintptr_t)samples - (uintptr_t)pkt);
+}
+
+// Whether the host has asked to stop spec_id, without waiting
+static bool
+results_stop_requested (size_t spec_id)
+{
+    bool stop = false;
+    uint32_t header;
+    while ((header = usb_poll()) != 0) {
+        if (USBHEADER_GETTYPE(header) != RESULTS_STOP_DATATYPE ||
+            USBHEADER_GETSIZE(header) != sizeof(results_stop_t)) {
+            usb_purge();
+            break;
+        }
+        // Requests that arrive after a spec finished are for specs already done
+        results_stop_t req;
+        usb_read(&req, sizeof(req));
+        if (req.spec_id == spec_id)
+            stop = true;
+    }
+    return stop;
+}
+
+#endif
+
 static void
 reset_callback (void)
 {
@@ -357,29 +621,49 @@ main ()
     set_SI_interrupt(0);
     rdp_init_();
 
+    // A table from the host replaces the compiled-in one
+    rdp_timing_spec_t* specs;
+    size_t num_specs = spec_table_receive(&specs);
+    if (num_specs != 0) {
+        debugf("Running %u specs from the host\n", (unsigned)num_specs);
+    } else {
+        specs = timing_specs;
+        num_specs = ARRLEN(timing_specs);
+    }
+
     // Fence for analysis script
     debugf("!!BEGIN!!\n");
 
-    for (size_t i = 0; i < ARRLEN(timing_specs); i++) {
-        static rdp_times_t all_times[TOTAL_RUNS];
+    for (size_t i = 0; i < num_specs; i++) {
+        static rdp_times_t all_times[MAX_RUNS];
         static rdp_times_t fullsync_time;
 
-        debugf("%s\n", timing_specs[i].desc);
+        // Other consoles of a farm run the rest of the table
+        if (!run_config_selects(&run_config, i))
+            continue;
+
+        debugf("%s\n", specs[i].desc);
+
+        // Samples sent before the console was last reset are not run again. Text builds always run whole specs.
+        size_t first_run = (RESULTS_BINARY && i == run_config.start_spec) ? run_config.start_sample : 0;
 
         // Ensure PI idle
         dma_wait();
-        // Run timing for this spec
-        exec_timing(&fullsync_time, all_times, &timing_specs[i]);
-
-        debugf("BUF = [\n    ");
-        for (size_t j = 0; j < TOTAL_RUNS; j++)
-            debugf("%lu, ", all_times[j].buf - fullsync_time.buf - 1);
-        debugf("\n]\n");
-
-        debugf("PIPE = [\n    ");
-        for (size_t j = 0; j < TOTAL_RUNS; j++)
-            debugf("%lu, ", all_times[j].pipe - fullsync_time.pipe - 1);
-        debugf("\n]\n");
+        // Run timing for this spec, binary builds send the samples as they go
+        size_t num_runs = exec_timing(&fullsync_time, all_times, &specs[i], i, first_run);
+
+#if !RESULTS_BINARY
+        static const char* counter_names[NUM_COUNTERS] = { "BUF", "PIPE", "TMEM", "CLOCK" };
+
+        for (size_t c = 0; c < NUM_COUNTERS; c++) {
+            debugf("%s = [\n    ", counter_names[c]);
+            for (size_t j = 0; j < num_runs; j++)
+                debugf("%lu, ", counter_sample(&all_times[j], &fullsync_time, c));
+            debugf("\n]\n");
+        }
+#else
+        (void)num_runs;
+#endif
     }
 
     // Multiple times incase the first isn't flushed properly
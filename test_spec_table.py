@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+#
+#   Tests of the spec table compiler, encoder and decoder
+#
+#   Runs on the host: python3 -m unittest test_spec_table. The built-in table
+#   is taken from src/test_main.c by compiling its timing_specs[] with the host
+#   C compiler, so specs/default.txt is checked against the ROM itself.
+#
+
+import os, shutil, subprocess, tempfile, unittest
+
+from rdp_results import SPEC_FIELDS
+from spec_table import (DESC_MAX, MAX_RUNS, SCREEN_HEIGHT, SCREEN_WIDTH, SPEC_TABLE_ENTRY, SPEC_TABLE_HEADER,
+                        SPEC_TABLE_MAGIC, SPEC_TABLE_MAX_SPECS, SPEC_TABLE_VERSION, SpecEntry, SpecError,
+                        compile_specs, decode_spec_table, encode_spec_table, format_spec)
+
+ROOT = os.path.dirname(os.path.abspath(__file__))
+
+# Prints the fields of every timing_specs[] entry, one line each, description last
+HARNESS_MAIN = r"""
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(timing_specs) / sizeof(timing_specs[0]); i++) {
+        const rdp_timing_spec_t* s = &timing_specs[i];
+        printf("%d %d %d %d %d %d %d %d %d %d %d %u %u %u %u %u %lu %lu %lu %s\n",
+               s->two_cycle, s->color_read, s->depth_read, s->depth_write, s->depth_pass, s->zb_same_bank,
+               s->alpha_compare, s->alpha_compare_threshold, s->rectangle_alpha, s->vi_on, s->vi_same_bank,
+               s->x0, s->y0, s->x1, s->y1, s->num_runs, (unsigned long)(uintptr_t)s->fb_addr,
+               (unsigned long)(uintptr_t)s->zb_addr, (unsigned long)(uintptr_t)s->vi_addr, s->desc);
+    }
+    return 0;
+}
+"""
+
+def builtin_specs():
+    """
+    The ROM's timing_specs[] as SpecEntry, or None without a host C compiler
+    """
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        return None
+    with open(os.path.join(ROOT, "src", "test_main.c")) as infile:
+        source = infile.read()
+
+    # The spec struct, and the macros and table that fill it in
+    end = source.index("} rdp_timing_spec_t;") + len("} rdp_timing_spec_t;")
+    struct_def = source[source.rindex("typedef struct {", 0, end):end]
+    start = source.index("#define CYC1")
+    table = source[start:source.index("};", source.index("timing_specs[]", start)) + 2]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        c_path, exe_path = os.path.join(tmp, "specs.c"), os.path.join(tmp, "specs")
+        with open(c_path, "w") as outfile:
+            outfile.write("#include <stdbool.h>\n#include <stddef.h>\n#include <stdint.h>\n#include <stdio.h>\n\n")
+            outfile.write(struct_def + "\n\n" + table + "\n" + HARNESS_MAIN)
+        subprocess.run([cc, "-std=gnu99", "-o", exe_path, c_path], check=True)
+        lines = subprocess.run([exe_path], check=True, capture_output=True, text=True).stdout.splitlines()
+
+    specs = []
+    for line in lines:
+        fields = line.split(" ", 19)
+        values = [int(v) for v in fields[:19]]
+        entry = SpecEntry(fields[19])
+        for i,name in enumerate(SPEC_FIELDS):
+            setattr(entry, name, bool(values[(0, 1, 2, 3, 4, 5, 6, 9, 10)[i]]))
+        entry.alpha_compare_threshold, entry.rectangle_alpha = values[7], values[8]
+        x0, y0, x1, y1 = values[11:15]
+        entry.rect = None if (x1, y1) == (0, 0) else (x0, y0, x1, y1)
+        entry.num_runs = values[15]
+        entry.fb_addr, entry.zb_addr, entry.vi_addr = values[16:19]
+        specs.append(entry)
+    return specs
+
+def entry_bytes(flags=0, threshold=128, alpha=255, rect=(0, 0, 0, 0), num_runs=0, desc=b"spec",
+                desc_len=None, addrs=(0, 0, 0)):
+    if desc_len is None:
+        desc_len = len(desc)
+    return SPEC_TABLE_ENTRY.pack(flags, threshold, alpha, *rect, num_runs, desc_len, *addrs) + \
+           desc + b"\0" * (-len(desc) % 4)
+
+def table_bytes(*entries, magic=SPEC_TABLE_MAGIC, version=SPEC_TABLE_VERSION, num_specs=None):
+    if num_specs is None:
+        num_specs = len(entries)
+    return SPEC_TABLE_HEADER.pack(magic, version, num_specs) + b"".join(entries)
+
+class DefaultTableTest(unittest.TestCase):
+    def test_default_matches_rom(self):
+        builtin = builtin_specs()
+        if builtin is None:
+            self.skipTest("no host C compiler")
+        with open(os.path.join(ROOT, "specs", "default.txt")) as infile:
+            compiled = compile_specs(infile.read(), "specs/default.txt")
+        self.assertEqual(len(compiled), len(builtin))
+        for i,(got, want) in enumerate(zip(compiled, builtin)):
+            self.assertEqual(got, want, f"spec {i}")
+        self.assertEqual(decode_spec_table(encode_spec_table(compiled)), builtin)
+
+class RoundTripTest(unittest.TestCase):
+    def test_every_setting(self):
+        specs = [
+            SpecEntry("plain"),
+            SpecEntry("all flags", **{ name : True for name in SPEC_FIELDS }),
+            SpecEntry("x" * DESC_MAX, alpha_compare_threshold=0, rectangle_alpha=96, num_runs=MAX_RUNS),
+            SpecEntry("rect", rect=(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT)),
+            SpecEntry("small", rect=(10, 20, 11, 21), num_runs=1),
+            SpecEntry("addrs", fb_addr=0x100000, zb_addr=0x400040, vi_addr=0x7DA800),
+            SpecEntry("", two_cycle=True),
+        ]
+        self.assertEqual(decode_spec_table(encode_spec_table(specs)), specs)
+
+    def test_text_round_trip(self):
+        text = "\n".join([
+            'spec "a b" cycle=2 image_read=on rect=1,2,3,4 runs=7 fb_addr=0x40',
+            'spec "c" alpha_compare=on alpha_threshold=5 alpha=6 vi=on vi_bank=same zb=same',
+        ])
+        specs = compile_specs(text)
+        self.assertEqual(compile_specs("\n".join(format_spec(s) for s in specs)), specs)
+        self.assertEqual(decode_spec_table(encode_spec_table(specs)), specs)
+
+    def test_max_specs(self):
+        specs = [SpecEntry(str(i)) for i in range(SPEC_TABLE_MAX_SPECS)]
+        self.assertEqual(decode_spec_table(encode_spec_table(specs)), specs)
+
+class DecodeRejectTest(unittest.TestCase):
+    def assertRejected(self, data):
+        with self.assertRaises(SpecError):
+            decode_spec_table(data)
+
+    def test_valid(self):
+        self.assertEqual(len(decode_spec_table(table_bytes(entry_bytes(), entry_bytes(rect=(1, 2, 3, 4))))), 2)
+
+    def test_bad_magic(self):
+        self.assertRejected(table_bytes(entry_bytes(), magic=SPEC_TABLE_MAGIC ^ 1))
+
+    def test_bad_version(self):
+        self.assertRejected(table_bytes(entry_bytes(), version=SPEC_TABLE_VERSION + 1))
+
+    def test_num_specs(self):
+        self.assertRejected(table_bytes())
+        self.assertRejected(table_bytes(entry_bytes(), num_specs=2))
+        self.assertRejected(table_bytes(entry_bytes(), num_specs=SPEC_TABLE_MAX_SPECS + 1))
+
+    def test_truncated(self):
+        data = table_bytes(entry_bytes(), entry_bytes(desc=b"longer description"))
+        for n in range(len(data)):
+            self.assertRejected(data[:n])
+
+    def test_trailing_bytes(self):
+        self.assertRejected(table_bytes(entry_bytes()) + b"\0" * 4)
+
+    def test_desc_len(self):
+        self.assertRejected(table_bytes(entry_bytes(desc=b"x" * (DESC_MAX + 4), desc_len=DESC_MAX + 1)))
+        self.assertRejected(table_bytes(entry_bytes(desc=b"abcd", desc_len=0xFFFF)))
+        self.assertRejected(table_bytes(entry_bytes(desc=b"\xff")))
+
+    def test_num_runs(self):
+        decode_spec_table(table_bytes(entry_bytes(num_runs=MAX_RUNS)))
+        self.assertRejected(table_bytes(entry_bytes(num_runs=MAX_RUNS + 1)))
+
+    def test_rect(self):
+        for rect in ((0, 0, SCREEN_WIDTH + 1, 10), (0, 0, 10, SCREEN_HEIGHT + 1),
+                     (5, 0, 5, 10), (6, 0, 5, 10), (0, 5, 10, 5), (0, 6, 10, 5), (0, 0, 0, 10), (0, 0, 10, 0)):
+            self.assertRejected(table_bytes(entry_bytes(rect=rect)))
+
+    def test_buffer_addrs(self):
+        decode_spec_table(table_bytes(entry_bytes(addrs=(0x400000, 0x7DA800, 0))))
+        for addrs in ((0x20, 0, 0), (0, 0x7DA840, 0), (0, 0, 0x7FFFC0), (0xFFFFFFC0, 0, 0)):
+            self.assertRejected(table_bytes(entry_bytes(addrs=addrs)))
+
+class CompileRejectTest(unittest.TestCase):
+    def test_bad_settings(self):
+        for line in ('spec "a" rect=5,0,5,10', 'spec "a" rect=0,0,321,10', 'spec "a" runs=0',
+                     f'spec "a" runs={MAX_RUNS + 1}', 'spec "a" fb_addr=0x20', 'spec "a" vi_addr=0x7DA840', 'spec "a" cycle=3',
+                     'spec "a" unknown=1', 'spec "a" variants=none', f'spec "{"x" * (DESC_MAX + 1)}"',
+                     'variants v', 'frobnicate'):
+            with self.assertRaises(SpecError, msg=line):
+                compile_specs(line)
+
+    def test_too_many_specs(self):
+        with self.assertRaises(SpecError):
+            compile_specs("\n".join(f'spec "{i}"' for i in range(SPEC_TABLE_MAX_SPECS + 1)))
+
+if __name__ == '__main__':
+    unittest.main()
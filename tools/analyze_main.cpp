@@ -0,0 +1,226 @@
+/**
+ * Native equivalent of analyze.py: collects min/average/max timings for each
+ * test from a results file, producing identical output, including the
+ * per-console bias report and correction of --bias and --correct-bias.
+ */
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include "results_io.h"
+#include "stats.h"
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [RESULTS]\n"
+            "\n"
+            "Options:\n"
+            "  -b          Report each console's bias on the specs measured by several consoles of a farm\n"
+            "  -c          Scale each console's samples by its bias before summarizing\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+struct console_bias_t {
+    double buf;
+    double pipe;
+    size_t num_specs;
+};
+
+/**
+ * Per-console scale factors relative to the lowest numbered console, from the
+ * specs (matched by description) measured on more than one console, as
+ * console_bias in analyze.py. Consoles sharing no spec with the first are left out.
+ */
+static std::map<unsigned, console_bias_t>
+console_bias (const std::vector<spec_result_t>& results)
+{
+    // Pruned means per description and console, in the order they first appear
+    struct spec_means_t {
+        std::vector<unsigned> consoles;
+        std::vector<std::pair<double, double>> means;
+    };
+    std::vector<spec_means_t> specs;
+    std::unordered_map<std::string, size_t> index;
+    std::vector<uint32_t> scratch;
+    std::map<unsigned, std::vector<std::pair<double, double>>> logs;
+    for (const spec_result_t& res : results) {
+        auto it = index.emplace(res.desc, specs.size()).first;
+        if (it->second == specs.size())
+            specs.emplace_back();
+        spec_means_t& spec = specs[it->second];
+        std::pair<double, double> m(prune_outliers(res.buf, scratch).avg(), prune_outliers(res.pipe, scratch).avg());
+        size_t i = 0;
+        while (i < spec.consoles.size() && spec.consoles[i] != res.console)
+            i++;
+        if (i == spec.consoles.size()) {
+            spec.consoles.push_back(res.console);
+            spec.means.push_back(m);
+        } else {
+            spec.means[i] = m;
+        }
+        logs[res.console];
+    }
+
+    std::map<unsigned, console_bias_t> bias;
+    if (logs.empty())
+        return bias;
+    unsigned ref = logs.begin()->first;
+
+    // Geometric mean of the ratios, so no single spec's size dominates
+    for (const spec_means_t& spec : specs) {
+        size_t r = 0;
+        while (r < spec.consoles.size() && spec.consoles[r] != ref)
+            r++;
+        if (r == spec.consoles.size() || spec.consoles.size() < 2)
+            continue;
+        for (size_t i = 0; i < spec.consoles.size(); i++)
+            logs[spec.consoles[i]].emplace_back(log(spec.means[i].first / spec.means[r].first),
+                                                log(spec.means[i].second / spec.means[r].second));
+    }
+
+    for (const auto& [console, l] : logs) {
+        if (l.empty())
+            continue;
+        double buf = 0, pipe = 0;
+        for (const auto& [b, p] : l) {
+            buf += b;
+            pipe += p;
+        }
+        bias[console] = { exp(buf / l.size()), exp(pipe / l.size()), l.size() };
+    }
+    return bias;
+}
+
+static void
+print_bias (const std::map<unsigned, console_bias_t>& bias)
+{
+    if (bias.empty())
+        printf("Console bias relative to console -\n");
+    else
+        printf("Console bias relative to console %u\n", bias.begin()->first);
+    for (const auto& [console, b] : bias)
+        printf("    Console %u: buf %+.3f%%, pipe %+.3f%% over %zu shared specs\n", console, 100 * (b.buf - 1),
+               100 * (b.pipe - 1), b.num_specs);
+}
+
+// Divides each console's samples by its scale factor, rounding halves to even as Python's round()
+static void
+correct_bias (std::vector<spec_result_t>& results, const std::map<unsigned, console_bias_t>& bias)
+{
+    for (spec_result_t& res : results) {
+        auto it = bias.find(res.console);
+        if (it == bias.end()) {
+            fprintf(stderr, "Warning: no bias estimate for console %u, left uncorrected\n", res.console);
+            continue;
+        }
+        for (uint32_t& v : res.buf)
+            v = (uint32_t)nearbyint(v / it->second.buf);
+        for (uint32_t& v : res.pipe)
+            v = (uint32_t)nearbyint(v / it->second.pipe);
+    }
+}
+
+static void
+print_result (std::string& out, const spec_result_t& res, bool label_console, std::vector<uint32_t>& scratch)
+{
+    // TMEM and CLOCK are reported after BUF and PIPE when the ROM sent them
+    size_t num_counters = 0;
+    prune_summary_t summary[RESULTS_NUM_COUNTERS];
+    std::string label[RESULTS_NUM_COUNTERS];
+    for (size_t c = 0; c < RESULTS_NUM_COUNTERS; c++) {
+        if (c >= 2 && res.counter(c).empty())
+            break;
+        summary[c] = prune_outliers(res.counter(c), scratch);
+        if (summary[c].num == 0)
+            fatal("All samples pruned for \"%s\"", res.desc.c_str());
+        label[c] = results_counter_names[c];
+        label[c][0] = toupper(label[c][0]);
+        num_counters++;
+    }
+
+    char line[256];
+
+    out += res.desc;
+    if (label_console)
+        out += " [console " + std::to_string(res.console) + "]";
+    out += '\n';
+    for (size_t c = 0; c < num_counters; c++) {
+        snprintf(line, sizeof(line), "    %-5s pruned %zu outliers\n", (label[c] + ":").c_str(),
+                 summary[c].orig_num - summary[c].num);
+        out += line;
+    }
+    for (size_t c = 0; c < num_counters; c++) {
+        const prune_summary_t& s = summary[c];
+        snprintf(line, sizeof(line), "    %-12s %.7f, %.7f, %.7f\n", (label[c] + " result:").c_str(),
+                 rdp_clk_to_ms(s.min), rdp_clk_to_ms(s.avg()), rdp_clk_to_ms(s.max));
+        out += line;
+    }
+
+    // How much of the time the RDP was running each unit was busy, the rest is stalls
+    if (num_counters == RESULTS_NUM_COUNTERS && summary[3].avg() > 0) {
+        out += "    Busy share of clock:";
+        for (size_t c = 0; c < 3; c++) {
+            snprintf(line, sizeof(line), "%s %s %.1f%%", (c == 0) ? "" : ",", results_counter_names[c],
+                     100 * summary[c].avg() / summary[3].avg());
+            out += line;
+        }
+        out += '\n';
+    }
+}
+
+int
+main (int argc, char** argv)
+{
+    bool report_bias = false, correct = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "bc")) != -1) {
+        switch (opt) {
+            case 'b':
+                report_bias = true;
+                break;
+            case 'c':
+                correct = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind > 1)
+        usage(argv[0]);
+
+    const char* filename = (access("results.bin", F_OK) == 0) ? "results.bin" : "results.txt";
+    if (optind < argc)
+        filename = argv[optind];
+
+    std::vector<spec_result_t> results = results_load(filename);
+
+    if (report_bias || correct) {
+        std::map<unsigned, console_bias_t> bias = console_bias(results);
+        print_bias(bias);
+        if (correct)
+            correct_bias(results, bias);
+    }
+
+    // Results merged from a farm are labelled with the console that ran them
+    bool multi_console = false;
+    for (const spec_result_t& res : results)
+        multi_console |= res.console != results[0].console;
+
+    std::string out;
+    std::vector<uint32_t> scratch;
+    for (const spec_result_t& res : results)
+        print_result(out, res, multi_console, scratch);
+
+    fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
+}
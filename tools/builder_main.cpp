@@ -0,0 +1,506 @@
+/**
+ * Measures how fast gfx_builder.h generates dynamic display lists, against
+ * the gD* and gs* macros of rdp.h, and checks that both give the same words.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gfx_builder.h"
+#include "rdp.h"
+
+// Random argument sets per command checked against the macro
+#define FUZZ_ROUNDS     20000
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "       %s -V\n"
+            "\n"
+            "Options:\n"
+            "  -n COUNT    Commands to generate (default 20000000)\n"
+            "  -b COUNT    Gfx per display list before starting over (default 4096)\n"
+            "  -V          Check that the builder gives the same words as the macros, and\n"
+            "              rejects every argument they would mask, then exit\n",
+            prog, prog);
+    exit(EXIT_FAILURE);
+}
+
+using gs::arg_t;
+
+static std::vector<Gfx>
+gfx_vector (const Gfx& g)
+{
+    return { g };
+}
+
+template <size_t N>
+static std::vector<Gfx>
+gfx_vector (const gs::list<N>& l)
+{
+    return std::vector<Gfx>(l.data(), l.data() + N);
+}
+
+/*
+ * The setup list of exec_timing(), encoded by the compiler. The alpha of the
+ * fill color is 1 here: the 255 the ROM passes is masked to the same bit by
+ * GPACK_RGBA5551, and the builder does not accept it.
+ */
+
+#define SETUP_WIDTH     320
+#define SETUP_HEIGHT    240
+#define SETUP_FB        0x00100000
+#define SETUP_ZB        0x00200000
+
+static constexpr auto setup_list = gs::make_list(
+    gs::DPSetScissorFrac(G_SC_NON_INTERLACE, qu102(0), qu102(0), qu102(SETUP_WIDTH), qu102(SETUP_HEIGHT)),
+    gs::DPSetOtherMode(G_CYC_FILL, 0),
+    gs::DPSetColorImage(G_IM_FMT_RGBA, G_IM_SIZ_16b, SETUP_WIDTH, SETUP_FB),
+    gs::DPSetFillColor(gs::PackRGBA5551(0, 0, 0, 1) << 16 | gs::PackRGBA5551(0, 0, 0, 1)),
+    gs::DPFillRectangle(0, 0, SETUP_WIDTH, SETUP_HEIGHT),
+    gs::DPPipeSync(),
+    gs::DPSetColorImage(G_IM_FMT_RGBA, G_IM_SIZ_16b, SETUP_WIDTH, SETUP_ZB),
+    gs::DPSetFillColor(gs::PackZDZ(G_MAXFBZ, 0) << 16 | gs::PackZDZ(G_MAXFBZ, 0)),
+    gs::DPFillRectangle(0, 0, SETUP_WIDTH, SETUP_HEIGHT),
+    gs::DPPipeSync(),
+    gs::DPSetColorImage(G_IM_FMT_RGBA, G_IM_SIZ_16b, SETUP_WIDTH, SETUP_FB),
+    gs::DPSetDepthImage(SETUP_ZB),
+    gs::DPSetCombineLERP(G_CCMUX_0, G_CCMUX_0, G_CCMUX_0, G_CCMUX_PRIMITIVE,
+                         G_ACMUX_0, G_ACMUX_0, G_ACMUX_0, G_ACMUX_PRIMITIVE,
+                         G_CCMUX_0, G_CCMUX_0, G_CCMUX_0, G_CCMUX_PRIMITIVE,
+                         G_ACMUX_0, G_ACMUX_0, G_ACMUX_0, G_ACMUX_PRIMITIVE),
+    gs::DPSetOtherMode(G_CYC_1CYCLE | G_PM_NPRIMITIVE, G_ZS_PRIM | Z_CMP | Z_UPD),
+    gs::DPSetPrimDepth(0x7FFF, 0),
+    gs::DPLoadTLUT_pal16(3, 0x00300000, 7),
+    gs::TexRect(qu102(10), qu102(20), qu102(42), qu102(52.5), 0, qs105(0), qs105(-0.5), qs510(1), qs510(-1)),
+    gs::DPTriFill_Z(1, 0, 0,
+                    qs1616(10.5), qs132(40.25), qs1616(-0.25),
+                    qs1616(20), qs132(20.75), qs1616(1.5),
+                    qs1616(10.5), qs132(-10), qs1616(0.0078125),
+                    qs1616(1.5), qs1616(-0.125), qs1616(3), qs1616(-1234.0625)),
+    gs::DPFullSync());
+
+// Built by the compiler, or these would not compile
+static_assert(setup_list.size() == 30, "setup list length");
+static_assert(setup_list[0].w0 == 0xED000000 && setup_list[0].w1 == 0x005003C0, "scissor");
+static_assert(setup_list[29].w0 == (uint32_t)G_RDPFULLSYNC << 24, "full sync");
+
+static const Gfx setup_macros[] = {
+    gsDPSetScissorFrac(G_SC_NON_INTERLACE, qu102(0), qu102(0), qu102(SETUP_WIDTH), qu102(SETUP_HEIGHT)),
+    gsDPSetOtherMode(G_CYC_FILL, 0),
+    gsDPSetColorImage(G_IM_FMT_RGBA, G_IM_SIZ_16b, SETUP_WIDTH, SETUP_FB),
+    gsDPSetFillColor((GPACK_RGBA5551(0, 0, 0, 255) << 16) | GPACK_RGBA5551(0, 0, 0, 255)),
+    gsDPFillRectangle(0, 0, SETUP_WIDTH, SETUP_HEIGHT),
+    gsDPPipeSync(),
+    gsDPSetColorImage(G_IM_FMT_RGBA, G_IM_SIZ_16b, SETUP_WIDTH, SETUP_ZB),
+    gsDPSetFillColor((GPACK_ZDZ(G_MAXFBZ, 0) << 16) | GPACK_ZDZ(G_MAXFBZ, 0)),
+    gsDPFillRectangle(0, 0, SETUP_WIDTH, SETUP_HEIGHT),
+    gsDPPipeSync(),
+    gsDPSetColorImage(G_IM_FMT_RGBA, G_IM_SIZ_16b, SETUP_WIDTH, SETUP_FB),
+    gsDPSetDepthImage(SETUP_ZB),
+    gsDPSetCombineLERP(0, 0, 0, PRIMITIVE, 0, 0, 0, PRIMITIVE,
+                       0, 0, 0, PRIMITIVE, 0, 0, 0, PRIMITIVE),
+    gsDPSetOtherMode(G_CYC_1CYCLE | G_PM_NPRIMITIVE, G_ZS_PRIM | Z_CMP | Z_UPD),
+    gsDPSetPrimDepth(0x7FFF, 0),
+    gsDPLoadTLUT_pal16(3, 0x00300000, 7),
+    gsTexRect(qu102(10), qu102(20), qu102(42), qu102(52.5), 0, qs105(0), qs105(-0.5), qs510(1), qs510(-1)),
+    gsDPTriFill_Z(1, 0, 0,
+                  qs1616(10.5), qs132(40.25), qs1616(-0.25),
+                  qs1616(20), qs132(20.75), qs1616(1.5),
+                  qs1616(10.5), qs132(-10), qs1616(0.0078125),
+                  qs1616(1.5), qs1616(-0.125), qs1616(3), qs1616(-1234.0625)),
+    gsDPFullSync(),
+};
+
+/*
+ * Combiner inputs are names the macro pastes onto G_CCMUX_ and G_ACMUX_, so
+ * they are checked with fixed cases rather than random values
+ */
+
+struct fixed_case_t {
+    std::vector<Gfx> builder;
+    std::vector<Gfx> macro;
+    const char* source;
+};
+
+#define COMBINE(a0, b0, c0, d0, Aa0, Ab0, Ac0, Ad0, a1, b1, c1, d1, Aa1, Ab1, Ac1, Ad1)             \
+    { gfx_vector(gs::DPSetCombineLERP(G_CCMUX_##a0, G_CCMUX_##b0, G_CCMUX_##c0, G_CCMUX_##d0,       \
+                                      G_ACMUX_##Aa0, G_ACMUX_##Ab0, G_ACMUX_##Ac0, G_ACMUX_##Ad0,   \
+                                      G_CCMUX_##a1, G_CCMUX_##b1, G_CCMUX_##c1, G_CCMUX_##d1,       \
+                                      G_ACMUX_##Aa1, G_ACMUX_##Ab1, G_ACMUX_##Ac1, G_ACMUX_##Ad1)), \
+      { gsDPSetCombineLERP(a0, b0, c0, d0, Aa0, Ab0, Ac0, Ad0, a1, b1, c1, d1, Aa1, Ab1, Ac1, Ad1) },  \
+      "gsDPSetCombineLERP(" #a0 ", " #b0 ", " #c0 ", " #d0 ", ...)" }
+
+static const fixed_case_t fixed_cases[] = {
+    COMBINE(0, 0, 0, PRIMITIVE, 0, 0, 0, PRIMITIVE, 0, 0, 0, PRIMITIVE, 0, 0, 0, PRIMITIVE),
+    COMBINE(TEXEL0, K4, SHADE_ALPHA, ENVIRONMENT, LOD_FRACTION, 1, PRIM_LOD_FRAC, 0,
+            NOISE, CENTER, K5, 1, COMBINED, TEXEL1, SHADE, 1),
+    COMBINE(1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1),
+    COMBINE(COMBINED, 0, COMBINED_ALPHA, 0, COMBINED, 0, 0, COMBINED,
+            PRIMITIVE, ENVIRONMENT, TEXEL0, SHADE, TEXEL0, ENVIRONMENT, PRIMITIVE, SHADE),
+    { gfx_vector(gs::DPLoadTLUT_pal256(0x80123440, 7)), { gsDPLoadTLUT_pal256(0x80123440, 7) },
+      "gsDPLoadTLUT_pal256(0x80123440, 7)" },
+    { gfx_vector(gs::DPSetFillColor(gs::PackRGBA8888(255, 128, 1, 0))),
+      { gsDPSetFillColor(GPACK_RGBA8888(255, 128, 1, 0)) }, "GPACK_RGBA8888(255, 128, 1, 0)" },
+    { gfx_vector(gs::DPSetFillColor(gs::PackRGB24A8(0xABCDEF, 0x12))),
+      { gsDPSetFillColor(GPACK_RGB24A8(0xABCDEF, 0x12)) }, "GPACK_RGB24A8(0xABCDEF, 0x12)" },
+};
+
+/*
+ * Every other command is checked with random arguments across the range of
+ * each field, its ends included, and with each argument just outside it
+ */
+
+struct range_t {
+    arg_t lo, hi;
+};
+
+static const range_t B1 = { 0, 1 }, B2 = { 0, 3 }, B3 = { 0, 7 }, B4 = { 0, 15 }, B8 = { 0, 255 };
+static const range_t B9 = { 0, 511 }, B10 = { 0, 1023 }, B12 = { 0, 4095 }, B24 = { 0, 0xFFFFFF };
+static const range_t B32 = { 0, 0xFFFFFFFF };
+static const range_t S9 = { -256, 511 }, S14 = { -8192, 8191 }, S16 = { -32768, 65535 };
+static const range_t S32 = { INT32_MIN, 0xFFFFFFFF };
+static const range_t WIDTH = { 1, 4096 }, TLUT_COUNT = { 1, 1024 };
+
+typedef void (*encode_fn)(const arg_t* a, std::vector<Gfx>& builder, std::vector<Gfx>& macro);
+
+struct fuzz_case_t {
+    const char* name;
+    std::vector<range_t> args;
+    encode_fn encode;
+};
+
+#define ENCODE(cmd, ...)                                                        \
+    [] (const arg_t* a, std::vector<Gfx>& builder, std::vector<Gfx>& macro) {   \
+        (void)a;                                                                \
+        builder = gfx_vector(gs::cmd(__VA_ARGS__));                             \
+        macro = { gs##cmd(__VA_ARGS__) };                                       \
+    }
+
+#define A4      a[0], a[1], a[2], a[3]
+#define A5      A4, a[4]
+#define A6      A5, a[5]
+#define A9      A6, a[6], a[7], a[8]
+#define A12     A9, a[9], a[10], a[11]
+
+// Triangle edges, then the coefficient blocks in the order the variant takes them
+#define TRI_RANGES      B1, B3, B3, S32, S14, S32, S32, S14, S32, S32, S14, S32
+#define SHADE_RANGES    S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, \
+                        S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16
+#define TEX_RANGES      S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, \
+                        S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16, S16
+#define DEPTH_RANGES    S32, S32, S32, S32
+#define A16_AT(i)       a[i], a[i + 1], a[i + 2], a[i + 3], a[i + 4], a[i + 5], a[i + 6], a[i + 7], \
+                        a[i + 8], a[i + 9], a[i + 10], a[i + 11], a[i + 12], a[i + 13], a[i + 14], a[i + 15]
+#define A4_AT(i)        a[i], a[i + 1], a[i + 2], a[i + 3]
+#define SHADE_AT(i)     A16_AT(i), A16_AT(i + 16)
+#define TEX_AT(i)       A16_AT(i), A4_AT(i + 16), A4_AT(i + 20)
+
+static const fuzz_case_t fuzz_cases[] = {
+    { "DPSetColorImage", { B3, B2, WIDTH, B32 }, ENCODE(DPSetColorImage, A4) },
+    { "DPSetDepthImage", { B32 }, ENCODE(DPSetDepthImage, a[0]) },
+    { "DPSetTextureImage", { B3, B2, WIDTH, B32 }, ENCODE(DPSetTextureImage, A4) },
+    { "DPSetEnvColor", { B8, B8, B8, B8 }, ENCODE(DPSetEnvColor, A4) },
+    { "DPSetPrimColor", { B8, B8, B8, B8, B8, B8 }, ENCODE(DPSetPrimColor, A6) },
+    { "DPSetBlendColor", { B8, B8, B8, B8 }, ENCODE(DPSetBlendColor, A4) },
+    { "DPSetFogColor", { B8, B8, B8, B8 }, ENCODE(DPSetFogColor, A4) },
+    { "DPSetFillColor", { B32 }, ENCODE(DPSetFillColor, a[0]) },
+    { "DPFillRectangle", { B10, B10, B10, B10 }, ENCODE(DPFillRectangle, A4) },
+    { "DPSetTile", { B3, B2, B9, B9, B3, B4, B2, B4, B4, B2, B4, B4 }, ENCODE(DPSetTile, A12) },
+    { "DPLoadTile", { B3, B12, B12, B12, B12 }, ENCODE(DPLoadTile, A5) },
+    { "DPLoadBlock", { B3, B12, B12, B12, B12 }, ENCODE(DPLoadBlock, A5) },
+    { "DPSetTileSize", { B3, B12, B12, B12, B12 }, ENCODE(DPSetTileSize, A5) },
+    { "DPLoadTLUTCmd", { B3, B10 }, ENCODE(DPLoadTLUTCmd, a[0], a[1]) },
+    { "DPLoadTLUT", { TLUT_COUNT, B9, B32, B3 }, ENCODE(DPLoadTLUT, A4) },
+    { "DPLoadTLUT_pal16", { B4, B32, B3 }, ENCODE(DPLoadTLUT_pal16, a[0], a[1], a[2]) },
+    { "DPSetOtherMode", { B24, B32 }, ENCODE(DPSetOtherMode, a[0], a[1]) },
+    { "DPSetPrimDepth", { S16, S16 }, ENCODE(DPSetPrimDepth, a[0], a[1]) },
+    { "DPSetScissorFrac", { B2, B12, B12, B12, B12 }, ENCODE(DPSetScissorFrac, A5) },
+    { "DPSetConvert", { S9, S9, S9, S9, S9, S9 }, ENCODE(DPSetConvert, A6) },
+    { "DPSetKeyR", { B8, B8, B12 }, ENCODE(DPSetKeyR, a[0], a[1], a[2]) },
+    { "DPSetKeyGB", { B8, B8, B12, B8, B8, B12 }, ENCODE(DPSetKeyGB, A6) },
+    { "DPFullSync", {}, ENCODE(DPFullSync) },
+    { "DPTileSync", {}, ENCODE(DPTileSync) },
+    { "DPPipeSync", {}, ENCODE(DPPipeSync) },
+    { "DPLoadSync", {}, ENCODE(DPLoadSync) },
+    { "DPNoOp", {}, ENCODE(DPNoOp) },
+    { "TexRect", { B12, B12, B12, B12, B3, S16, S16, S16, S16 }, ENCODE(TexRect, A9) },
+    { "TexRectFlip", { B12, B12, B12, B12, B3, S16, S16, S16, S16 }, ENCODE(TexRectFlip, A9) },
+    { "DPTriFill", { TRI_RANGES }, ENCODE(DPTriFill, A12) },
+    { "DPTriFill_Z", { TRI_RANGES, DEPTH_RANGES }, ENCODE(DPTriFill_Z, A12, A4_AT(12)) },
+    { "DPTriFill_S", { TRI_RANGES, SHADE_RANGES }, ENCODE(DPTriFill_S, A12, SHADE_AT(12)) },
+    { "DPTriFill_T", { TRI_RANGES, TEX_RANGES }, ENCODE(DPTriFill_T, A12, TEX_AT(12)) },
+    { "DPTriFill_ST", { TRI_RANGES, SHADE_RANGES, TEX_RANGES }, ENCODE(DPTriFill_ST, A12, SHADE_AT(12), TEX_AT(44)) },
+    { "DPTriFill_SZ", { TRI_RANGES, SHADE_RANGES, DEPTH_RANGES },
+      ENCODE(DPTriFill_SZ, A12, SHADE_AT(12), A4_AT(44)) },
+    { "DPTriFill_TZ", { TRI_RANGES, TEX_RANGES, DEPTH_RANGES }, ENCODE(DPTriFill_TZ, A12, TEX_AT(12), A4_AT(36)) },
+    { "DPTriFill_STZ", { TRI_RANGES, SHADE_RANGES, TEX_RANGES, DEPTH_RANGES },
+      ENCODE(DPTriFill_STZ, A12, SHADE_AT(12), TEX_AT(44), A4_AT(68)) },
+};
+
+static bool
+same_words (const std::vector<Gfx>& a, const std::vector<Gfx>& b)
+{
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(Gfx)) == 0;
+}
+
+static bool
+rejects (const fuzz_case_t& c, const arg_t* a)
+{
+    std::vector<Gfx> builder, macro;
+    try {
+        c.encode(a, builder, macro);
+    } catch (const std::out_of_range&) {
+        return true;
+    }
+    return false;
+}
+
+static int
+verify (void)
+{
+    size_t failed = 0, checked = 0;
+
+    checked++;
+    if (!same_words(gfx_vector(setup_list), std::vector<Gfx>(std::begin(setup_macros), std::end(setup_macros)))) {
+        printf("FAIL the constexpr setup list differs from the macros\n");
+        failed++;
+    }
+
+    for (const fixed_case_t& c : fixed_cases) {
+        checked++;
+        if (!same_words(c.builder, c.macro)) {
+            printf("FAIL %s\n", c.source);
+            failed++;
+        }
+    }
+
+    std::mt19937_64 rng(1);
+    for (const fuzz_case_t& c : fuzz_cases) {
+        size_t n = c.args.size();
+        std::vector<arg_t> a(n);
+        bool ok = true;
+
+        for (unsigned round = 0; round < FUZZ_ROUNDS && ok; round++) {
+            // A quarter of the arguments at the ends of their range
+            for (size_t i = 0; i < n; i++) {
+                const range_t& r = c.args[i];
+                switch (rng() % 8) {
+                    case 0:
+                        a[i] = r.lo;
+                        break;
+                    case 1:
+                        a[i] = r.hi;
+                        break;
+                    default:
+                        a[i] = r.lo + (arg_t)(rng() % (uint64_t)(r.hi - r.lo + 1));
+                }
+            }
+            std::vector<Gfx> builder, macro;
+            c.encode(a.data(), builder, macro);
+            checked++;
+            if (!same_words(builder, macro)) {
+                printf("FAIL %s differs from gs%s, args", c.name, c.name);
+                for (arg_t v : a)
+                    printf(" %lld", (long long)v);
+                printf("\n");
+                failed++;
+                ok = false;
+            }
+        }
+
+        for (size_t i = 0; i < n && ok; i++) {
+            arg_t saved = a[i];
+            for (arg_t outside : { c.args[i].lo - 1, c.args[i].hi + 1 }) {
+                a[i] = outside;
+                checked++;
+                if (!rejects(c, a.data())) {
+                    printf("FAIL %s accepts %lld as argument %zu\n", c.name, (long long)outside, i + 1);
+                    failed++;
+                }
+            }
+            a[i] = saved;
+        }
+    }
+
+    // A command that does not fit is not written, and nothing after it is
+    Gfx buffer[5];
+    memset(buffer, 0xAA, sizeof(buffer));
+    gs::arena dl(buffer, 4);
+    bool fits = dl.put(gs::DPPipeSync(), gs::TexRect(0, 0, 4, 4, 0, 0, 0, 1 << 10, 1 << 10));
+    bool overflows = !dl.push(gs::DPTriFill_Z(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+    bool stopped = !dl.push(gs::DPFullSync());
+    Gfx untouched;
+    memset(&untouched, 0xAA, sizeof(untouched));
+    checked++;
+    if (!fits || !overflows || !stopped || !dl.overflowed() || dl.size() != 3 ||
+        memcmp(&buffer[3], &untouched, sizeof(untouched)) != 0 || memcmp(&buffer[4], &untouched, sizeof(untouched)) != 0) {
+        printf("FAIL arena overflow\n");
+        failed++;
+    }
+    dl.clear();
+    checked++;
+    if (!dl.push(gs::DPFullSync()) || dl.overflowed() || dl.size() != 1) {
+        printf("FAIL arena clear\n");
+        failed++;
+    }
+
+    printf("%zu checks, %zu failed\n", checked, failed);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Benchmark: the kind of list a frame builds at run time, per object a color,
+ * a depth, a rectangle, a depth-buffered triangle and a sync, from arguments
+ * drawn beforehand so only the encoding is timed
+ */
+
+#define OBJECT_COMMANDS 5
+#define OBJECT_GFX      10
+
+struct object_t {
+    arg_t r, g, b, z;
+    arg_t ulx, uly, lrx, lry;
+    arg_t xl, yl, dxldy, xm, ym, dxmdy, xh, yh, dxhdy;
+    arg_t tz, dzdx, dzde, dzdy;
+};
+
+static std::vector<object_t>
+random_objects (size_t count)
+{
+    std::mt19937 rng(2);
+    std::vector<object_t> objects(count);
+    for (object_t& o : objects) {
+        o.r = rng() & 0xFF;
+        o.g = rng() & 0xFF;
+        o.b = rng() & 0xFF;
+        o.z = rng() & 0x7FFF;
+        o.ulx = rng() % 320;
+        o.uly = rng() % 240;
+        o.lrx = std::min<arg_t>(o.ulx + rng() % 64, 1023);
+        o.lry = std::min<arg_t>(o.uly + rng() % 64, 1023);
+        o.yh = (arg_t)(rng() % 960);
+        o.ym = o.yh + (arg_t)(rng() % 64);
+        o.yl = o.ym + (arg_t)(rng() % 64);
+        o.xh = o.xm = (arg_t)(rng() % (320 << 16));
+        o.xl = o.xh + (arg_t)(rng() % (32 << 16));
+        o.dxhdy = (arg_t)(rng() % (4 << 16)) - (2 << 16);
+        o.dxmdy = (arg_t)(rng() % (4 << 16)) - (2 << 16);
+        o.dxldy = (arg_t)(rng() % (4 << 16)) - (2 << 16);
+        o.tz = (arg_t)(rng() & 0x7FFFFFFF);
+        o.dzdx = (int32_t)rng();
+        o.dzde = (int32_t)rng();
+        o.dzdy = (int32_t)rng();
+    }
+    return objects;
+}
+
+static volatile uint32_t sink;
+
+static size_t
+build_with_arena (const std::vector<object_t>& objects, size_t num_objects, Gfx* buffer, size_t batch)
+{
+    gs::arena dl(buffer, batch);
+    size_t lists = 0;
+    for (size_t i = 0; i < num_objects; i++) {
+        const object_t& o = objects[i % objects.size()];
+        if (dl.size() + OBJECT_GFX > dl.capacity()) {
+            sink = dl.data()[dl.size() - 1].w1;
+            dl.clear();
+            lists++;
+        }
+        dl.put(gs::DPSetPrimColor(0, 0, o.r, o.g, o.b, 0xFF),
+               gs::DPSetPrimDepth(o.z, 0),
+               gs::DPFillRectangle(o.ulx, o.uly, o.lrx, o.lry),
+               gs::DPTriFill_Z(1, 0, 0, o.xl, o.yl, o.dxldy, o.xm, o.ym, o.dxmdy, o.xh, o.yh, o.dxhdy,
+                               o.tz, o.dzdx, o.dzde, o.dzdy),
+               gs::DPPipeSync());
+    }
+    if (dl.overflowed())
+        fprintf(stderr, "The builder's list overflowed\n");
+    return dl.size();
+}
+
+static size_t
+build_with_macros (const std::vector<object_t>& objects, size_t num_objects, Gfx* buffer, size_t batch)
+{
+    Gfx* gdl = buffer;
+    for (size_t i = 0; i < num_objects; i++) {
+        const object_t& o = objects[i % objects.size()];
+        if ((size_t)(gdl - buffer) + OBJECT_GFX > batch) {
+            sink = gdl[-1].w1;
+            gdl = buffer;
+        }
+        gDPSetPrimColor(gdl++, 0, 0, o.r, o.g, o.b, 0xFF);
+        gDPSetPrimDepth(gdl++, o.z, 0);
+        gDPFillRectangle(gdl++, o.ulx, o.uly, o.lrx, o.lry);
+        // gDisplayListPut puts every Gfx of a command at the same place, so triangles are copied
+        Gfx tri[] = { gsDPTriFill_Z(1, 0, 0, o.xl, o.yl, o.dxldy, o.xm, o.ym, o.dxmdy, o.xh, o.yh, o.dxhdy,
+                                    o.tz, o.dzdx, o.dzde, o.dzdy) };
+        memcpy(gdl, tri, sizeof(tri));
+        gdl += sizeof(tri) / sizeof(tri[0]);
+        gDPPipeSync(gdl++);
+    }
+    return gdl - buffer;
+}
+
+int
+main (int argc, char** argv)
+{
+    size_t num_commands = 20000000;
+    size_t batch = 4096;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:V")) != -1) {
+        switch (opt) {
+            case 'n':
+                num_commands = strtoull(optarg, nullptr, 0);
+                break;
+            case 'b':
+                batch = strtoull(optarg, nullptr, 0);
+                break;
+            case 'V':
+                return verify();
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc)
+        usage(argv[0]);
+    if (batch < OBJECT_GFX)
+        batch = OBJECT_GFX;
+
+    size_t num_objects = num_commands / OBJECT_COMMANDS;
+    std::vector<object_t> objects = random_objects(std::min<size_t>(num_objects, 65536) + 1);
+    std::vector<Gfx> builder_out(batch), macro_out(batch);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t builder_len = build_with_arena(objects, num_objects, builder_out.data(), batch);
+    auto mid = std::chrono::steady_clock::now();
+    size_t macro_len = build_with_macros(objects, num_objects, macro_out.data(), batch);
+    auto end = std::chrono::steady_clock::now();
+
+    double builder_s = std::chrono::duration<double>(mid - start).count();
+    double macro_s = std::chrono::duration<double>(end - mid).count();
+    size_t commands = num_objects * OBJECT_COMMANDS;
+
+    printf("%-10s  %12s  %10s  %14s  %12s\n", "", "Commands", "ms", "Commands/s", "Bytes/s");
+    printf("%-10s  %12zu  %10.1f  %14.0f  %12.0f\n", "gs::arena", commands, 1000 * builder_s,
+           commands / builder_s, num_objects * OBJECT_GFX * sizeof(Gfx) / builder_s);
+    printf("%-10s  %12zu  %10.1f  %14.0f  %12.0f\n", "gD*", commands, 1000 * macro_s,
+           commands / macro_s, num_objects * OBJECT_GFX * sizeof(Gfx) / macro_s);
+
+    if (builder_len != macro_len || memcmp(builder_out.data(), macro_out.data(), builder_len * sizeof(Gfx)) != 0)
+        fprintf(stderr, "The last lists differ\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * Compares two campaigns spec by spec and reports statistically significant
+ * timing changes. Each spec's pruned BUF and PIPE distributions are compared
+ * with a Mann-Whitney U test and a bootstrap confidence interval of the
+ * difference in means, with Benjamini-Hochberg correction across all tests.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include "parallel.h"
+#include "results_io.h"
+#include "stats.h"
+
+struct comparison_t {
+    const spec_result_t* base;
+    const spec_result_t* cand;
+    const char* counter;
+    bool pipe;
+
+    size_t base_n;
+    size_t cand_n;
+    double base_avg;
+    double cand_avg;
+    double p;
+    double q;
+    bootstrap_ci_t ci;
+
+    double delta () const { return cand_avg - base_avg; }
+    bool significant (double alpha) const { return q < alpha && (ci.lo > 0 || ci.hi < 0); }
+};
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] BASELINE CANDIDATE\n"
+            "\n"
+            "Options:\n"
+            "  -a ALPHA    False discovery rate for significance (default 0.05)\n"
+            "  -b N        Bootstrap resamples per test (default 2000)\n"
+            "  -c LEVEL    Bootstrap confidence level (default 0.95)\n"
+            "  -s SEED     Bootstrap seed (default 1)\n"
+            "  -j N        Worker threads (default: all cores)\n"
+            "  -A          List every spec, not only significant changes\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+static void
+compare (comparison_t& c, unsigned num_resamples, double level, uint64_t seed, size_t task)
+{
+    std::vector<uint32_t> a = pruned_samples(c.pipe ? c.base->pipe : c.base->buf);
+    std::vector<uint32_t> b = pruned_samples(c.pipe ? c.cand->pipe : c.cand->buf);
+    if (a.empty() || b.empty())
+        fatal("All samples pruned for \"%s\"", c.base->desc.c_str());
+
+    c.base_n = a.size();
+    c.cand_n = b.size();
+    c.base_avg = mean(a);
+    c.cand_avg = mean(b);
+    c.p = mann_whitney_u(a, b);
+
+    // Seeded per task so the result does not depend on the thread count
+    rng_t rng(seed ^ (task * 0xD1B54A32D192ED03ull));
+    c.ci = bootstrap_mean_diff(a, b, num_resamples, level, rng);
+}
+
+int
+main (int argc, char** argv)
+{
+    double alpha = 0.05;
+    double level = 0.95;
+    unsigned num_resamples = 2000;
+    uint64_t seed = 1;
+    unsigned num_threads = default_num_threads();
+    bool show_all = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:b:c:s:j:A")) != -1) {
+        switch (opt) {
+            case 'a':
+                alpha = atof(optarg);
+                break;
+            case 'b':
+                num_resamples = std::max(1, atoi(optarg));
+                break;
+            case 'c':
+                level = atof(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, nullptr, 0);
+                break;
+            case 'j':
+                num_threads = std::max(1, atoi(optarg));
+                break;
+            case 'A':
+                show_all = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2)
+        usage(argv[0]);
+
+    const char* base_path = argv[optind];
+    const char* cand_path = argv[optind + 1];
+    std::vector<spec_result_t> base = results_load(base_path);
+    std::vector<spec_result_t> cand = results_load(cand_path);
+
+    // Specs are matched by description so campaigns with reordered or partial tables still line up
+    std::unordered_map<std::string, const spec_result_t*> cand_by_desc;
+    for (const spec_result_t& res : cand)
+        cand_by_desc.emplace(res.desc, &res);
+
+    std::vector<comparison_t> comparisons;
+    size_t unmatched = 0;
+    for (const spec_result_t& res : base) {
+        auto it = cand_by_desc.find(res.desc);
+        if (it == cand_by_desc.end()) {
+            unmatched++;
+            continue;
+        }
+        comparison_t c = {};
+        c.base = &res;
+        c.cand = it->second;
+        c.counter = "BUF";
+        c.pipe = false;
+        comparisons.push_back(c);
+        c.counter = "PIPE";
+        c.pipe = true;
+        comparisons.push_back(c);
+    }
+    if (unmatched != 0)
+        fprintf(stderr, "Warning: %zu specs in %s have no match in %s\n", unmatched, base_path, cand_path);
+
+    parallel_for(comparisons.size(), num_threads, [&] (size_t i) {
+        compare(comparisons[i], num_resamples, level, seed, i);
+    });
+
+    std::vector<double> p(comparisons.size());
+    for (size_t i = 0; i < comparisons.size(); i++)
+        p[i] = comparisons[i].p;
+    std::vector<double> q = benjamini_hochberg(p);
+    for (size_t i = 0; i < comparisons.size(); i++)
+        comparisons[i].q = q[i];
+
+    // Largest absolute change first
+    std::vector<const comparison_t*> ranked;
+    for (const comparison_t& c : comparisons) {
+        if (show_all || c.significant(alpha))
+            ranked.push_back(&c);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [] (const comparison_t* x, const comparison_t* y) {
+        return std::fabs(x->delta()) > std::fabs(y->delta());
+    });
+
+    size_t num_significant = 0;
+    for (const comparison_t& c : comparisons)
+        num_significant += c.significant(alpha);
+
+    printf("%zu of %zu comparisons significant (FDR %g, %g%% bootstrap CI, %u resamples)\n",
+           num_significant, comparisons.size(), alpha, level * 100, num_resamples);
+    if (ranked.empty())
+        return 0;
+
+    printf("\n%-4s  %-4s  %12s  %12s  %11s  %12s  %25s  %9s  %9s  %s\n",
+           "Sig", "Ctr", "Base clk", "Cand clk", "Delta clk", "Delta ms", "CI clk", "%", "q", "Spec");
+    for (const comparison_t* c : ranked) {
+        char ci[64];
+        snprintf(ci, sizeof(ci), "[%.1f, %.1f]", c->ci.lo, c->ci.hi);
+        printf("%-4s  %-4s  %12.1f  %12.1f  %+11.1f  %+12.7f  %25s  %+8.2f%%  %9.2e  %s\n",
+               c->significant(alpha) ? "*" : "", c->counter, c->base_avg, c->cand_avg, c->delta(),
+               rdp_clk_to_ms(c->delta()), ci, 100.0 * c->delta() / c->base_avg, c->q, c->base->desc.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,450 @@
+/**
+ * Disassembles RDP display lists, as big-endian Gfx from RDRAM, a ROM image or
+ * a capture, into the gs* macros of src/rdp.h that would rebuild them. The
+ * output is a listing with offsets and raw words, or with -q a C initializer.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gfx_disasm.h"
+#include "parallel.h"
+#include "rdp.h"
+#include "results_io.h"
+
+// Commands formatted per task
+#define CHUNK_COMMANDS  4096
+
+// Offset and raw words before each command of the listing
+#define LISTING_INDENT  "                                 "
+
+struct options_t {
+    size_t offset = 0;
+    size_t max_commands = SIZE_MAX;
+    bool quiet = false;
+};
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] DISPLAYLIST\n"
+            "       %s -V\n"
+            "\n"
+            "Options:\n"
+            "  -s OFFSET   Start at this byte offset of the file (default 0)\n"
+            "  -n COUNT    Decode at most COUNT commands\n"
+            "  -q          Print only the macro calls, as a C initializer\n"
+            "  -j N        Worker threads (default: all cores)\n"
+            "  -V          Check that the disassembly of the rdp.h macros compiled into this\n"
+            "              tool gives back their source and words, then exit\n",
+            prog, prog);
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * Round trip check: each case is a macro call from rdp.h, compiled here, and
+ * the source text it was written as. Disassembling the compiled words must
+ * give back the same call (ignoring whitespace and comments) and re-encode
+ * to the same words. Every command of the tables needs a case.
+ */
+
+struct verify_case_t {
+    std::vector<Gfx> gfx;
+    const char* source;
+};
+
+#define CASE(...)   { { __VA_ARGS__ }, #__VA_ARGS__ }
+
+static const verify_case_t verify_cases[] = {
+    CASE(gsDPNoOp()),
+    CASE(gsDPSetColorImage(G_IM_FMT_RGBA, G_IM_SIZ_16b, 320, 0x00100000)),
+    CASE(gsDPSetColorImage(G_IM_FMT_I, G_IM_SIZ_32b, 4096, 0xFFFFFFC0)),
+    CASE(gsDPSetDepthImage(0x00200000)),
+    CASE(gsDPSetTextureImage(G_IM_FMT_CI, G_IM_SIZ_8b, 64, 0x80123440)),
+    CASE(gsDPSetCombineLERP(0, 0, 0, PRIMITIVE,
+                            0, 0, 0, PRIMITIVE,
+                            0, 0, 0, PRIMITIVE,
+                            0, 0, 0, PRIMITIVE)),
+    CASE(gsDPSetCombineLERP(TEXEL0, K4, SHADE_ALPHA, ENVIRONMENT,
+                            TEXEL1, 1, PRIM_LOD_FRAC, 0,
+                            NOISE, CENTER, K5, 1,
+                            COMBINED, SHADE, LOD_FRACTION, ENVIRONMENT)),
+    CASE(gsDPSetEnvColor(1, 2, 3, 4)),
+    CASE(gsDPSetPrimColor(0, 0, 0, 255, 0, 128)),
+    CASE(gsDPSetPrimColor(31, 200, 255, 0, 0, 255)),
+    CASE(gsDPSetBlendColor(0, 0, 0, 128)),
+    CASE(gsDPSetFogColor(255, 128, 64, 32)),
+    CASE(gsDPSetFillColor(0x00010001)),
+    CASE(gsDPSetFillColor(0xFFFCFFFC)),
+    CASE(gsDPFillRectangle(0, 0, 320, 240)),
+    CASE(gsDPFillRectangle(17, 3, 1023, 1000)),
+    CASE(gsDPSetTile(G_IM_FMT_RGBA, G_IM_SIZ_16b, 8, 0x000, 7, 0, 0, 5, 0, 2, 5, 15)),
+    CASE(gsDPSetTile(G_IM_FMT_IA, G_IM_SIZ_4b, 511, 0x1FF, 3, 15, 3, 15, 15, 1, 0, 10)),
+    CASE(gsDPLoadTile(7, qu102(0), qu102(0), qu102(31), qu102(31.5))),
+    CASE(gsDPLoadBlock(7, 0, 0, 1023, 0x100)),
+    CASE(gsDPSetTileSize(0, qu102(0.25), qu102(0), qu102(1023.75), qu102(31))),
+    CASE(gsDPLoadTLUTCmd(7, 255)),
+    // The ROM's fill mode, then its 2-cycle alpha compare mode with every depth option
+    CASE(gsDPSetOtherMode(G_PM_NPRIMITIVE | G_CYC_FILL | G_TP_NONE | G_TD_CLAMP | G_TL_TILE | G_TT_NONE |
+                          G_TF_POINT | G_TC_CONV | G_CK_NONE | G_CD_MAGICSQ | G_AD_PATTERN,
+                          G_AC_NONE | G_ZS_PIXEL | CVG_DST_CLAMP | ZMODE_OPA |
+                          GBL_c1(G_BL_CLR_IN, G_BL_A_IN, G_BL_CLR_IN, G_BL_1MA) |
+                          GBL_c2(G_BL_CLR_IN, G_BL_A_IN, G_BL_CLR_IN, G_BL_1MA))),
+    CASE(gsDPSetOtherMode(G_PM_NPRIMITIVE | G_CYC_2CYCLE | G_TP_NONE | G_TD_CLAMP | G_TL_TILE | G_TT_NONE |
+                          G_TF_POINT | G_TC_FILT | G_CK_NONE | G_CD_DISABLE | G_AD_DISABLE,
+                          G_AC_THRESHOLD | G_ZS_PRIM | Z_CMP | Z_UPD | IM_RD | CVG_DST_FULL | ZMODE_OPA |
+                          GBL_c1(G_BL_CLR_IN, G_BL_A_IN, G_BL_CLR_IN, G_BL_1MA) |
+                          GBL_c2(G_BL_CLR_IN, G_BL_A_IN, G_BL_CLR_IN, G_BL_1MA))),
+    CASE(gsDPSetOtherMode(G_PM_1PRIMITIVE | (1 << G_MDSFT_COLORDITHER) | G_CYC_COPY | G_TP_PERSP | G_TD_DETAIL |
+                          G_TL_LOD | (1 << G_MDSFT_TEXTLUT) | G_TF_AVERAGE | G_TC_FILTCONV | G_CK_KEY |
+                          G_CD_NOISE | G_AD_NOTPATTERN | (3 << G_MDSFT_BLENDMASK),
+                          (2 << G_MDSFT_ALPHACOMPARE) | G_ZS_PIXEL | AA_EN | Z_CMP | Z_UPD | IM_RD | CLR_ON_CVG |
+                          CVG_DST_SAVE | ZMODE_DEC | CVG_X_ALPHA | ALPHA_CVG_SEL | FORCE_BL | 0x8000 |
+                          GBL_c1(G_BL_CLR_FOG, G_BL_A_SHADE, G_BL_CLR_MEM, G_BL_A_MEM) |
+                          GBL_c2(G_BL_CLR_BL, G_BL_0, G_BL_CLR_IN, G_BL_1))),
+    CASE(gsDPSetPrimDepth(0x7FFF, 0x0000)),
+    CASE(gsDPSetScissorFrac(G_SC_NON_INTERLACE, qu102(0), qu102(0), qu102(320), qu102(240))),
+    CASE(gsDPSetScissorFrac(G_SC_ODD_INTERLACE, qu102(0.75), qu102(1.5), qu102(1023.25), qu102(2))),
+    CASE(gsDPSetConvert(175, -43, -89, 222, 114, 42)),
+    CASE(gsDPSetConvert(-256, 255, 255, -1, 0, -256)),
+    CASE(gsDPSetKeyR(128, 16, 2048)),
+    CASE(gsDPSetKeyGB(1, 2, 3, 4, 5, 4095)),
+    CASE(gsDPFullSync()),
+    CASE(gsDPTileSync()),
+    CASE(gsDPPipeSync()),
+    CASE(gsDPLoadSync()),
+    CASE(gsTexRect(qu102(10), qu102(20), qu102(42), qu102(52.5), 0, qs105(0), qs105(-0.5), qs510(1), qs510(-1))),
+    CASE(gsTexRectFlip(qu102(0), qu102(0), qu102(1023.75), qu102(1023.75), 7, qs105(1023.96875), qs105(-1024),
+                       qs510(31.9990234375), qs510(-32))),
+    CASE(gsDPTriFill(0, 0, 0,
+              qs1616(10.5), qs132(40.25), qs1616(-0.25),
+              qs1616(20), qs132(20.75), qs1616(1.5),
+              qs1616(10.5), qs132(-10), qs1616(0.0078125))),
+    CASE(gsDPTriFill_Z(1, 1, 1,
+              qs1616(11.5), qs132(40.25), qs1616(-0.25),
+              qs1616(20), qs132(20.75), qs1616(0.5),
+              qs1616(11.5), qs132(-9), qs1616(0.0078125),
+              qs1616(1.5), qs1616(-0.125), qs1616(3), qs1616(-1234.0625))),
+    CASE(gsDPTriFill_T(0, 2, 2,
+              qs1616(12.5), qs132(40.25), qs1616(-0.25),
+              qs1616(20), qs132(20.75), qs1616(-0.5),
+              qs1616(12.5), qs132(-8), qs1616(0.0078125),
+              0xA5CD, 0x4D3C,
+              0xCA26, 0x18B8,
+              0x2516, 0x3031,
+              0xBB3B, 0x1DB2,
+              0x6DEC, 0x1332,
+              0x2C01, 0xDE06,
+              0xD61A, 0x23C4,
+              0x7B38, 0x2E71,
+              0xD95A, 0x1E43,
+              0x3F62, 0x724C,
+              0x1FAC, 0xCB19,
+              0x1963, 0x7131)),
+    CASE(gsDPTriFill_TZ(1, 3, 3,
+              qs1616(13.5), qs132(40.25), qs1616(-0.25),
+              qs1616(20), qs132(20.75), qs1616(-1.5),
+              qs1616(13.5), qs132(-7), qs1616(0.0078125),
+              0x17D9, 0x442F,
+              0x9447, 0xD699,
+              0x49DB, 0x3C4F,
+              0x9DF1, 0x5C88,
+              0x34C3, 0x6030,
+              0xBEAA, 0x31E2,
+              0x2025, 0x1E84,
+              0x6973, 0xFE2A,
+              0xDAED, 0xA0D7,
+              0xEE63, 0xE807,
+              0xB921, 0x997B,
+              0x7F31, 0x5C0A,
+              qs1616(3.5), qs1616(-0.125), qs1616(3), qs1616(-1234.0625))),
+    CASE(gsDPTriFill_S(0, 4, 4,
+              qs1616(14.5), qs132(40.25), qs1616(-0.25),
+              qs1616(20), qs132(20.75), qs1616(-2.5),
+              qs1616(14.5), qs132(-6), qs1616(0.0078125),
+              0x7CFA, 0x29E8,
+              0x99BA, 0xFD7F,
+              0xAFDC, 0xE5CD,
+              0x936C, 0x257A,
+              0x3C73, 0xD614,
+              0x5475, 0xAF21,
+              0x4DD0, 0xFA59,
+              0xD7E8, 0x1412,
+              0x27BD, 0xA0A3,
+              0xAE24, 0xB34A,
+              0xFE4C, 0xE993,
+              0x2334, 0x2FEB,
+              0x8A35, 0xF2BD,
+              0x2147, 0x1F10,
+              0x9E84, 0xE42B,
+              0x91B6, 0xC586)),
+    CASE(gsDPTriFill_SZ(1, 0, 5,
+              qs1616(15.5), qs132(40.25), qs1616(-0.25),
+              qs1616(20), qs132(20.75), qs1616(-3.5),
+              qs1616(15.5), qs132(-5), qs1616(0.0078125),
+              0xB1AA, 0x0B8D,
+              0xEC63, 0xB5FF,
+              0x560A, 0x3BF3,
+              0xFCC5, 0x1E2F,
+              0x6FB8, 0x932A,
+              0x4238, 0x7EC7,
+              0xCBB9, 0xC82A,
+              0xFE36, 0x2941,
+              0x552D, 0xE5FB,
+              0xCDA4, 0x8E40,
+              0x461B, 0xDC6D,
+              0x8E8D, 0xD4A1,
+              0xB7B0, 0xC2C9,
+              0x7625, 0x4D45,
+              0x2A7C, 0x5A39,
+              0x4D76, 0x76C3,
+              qs1616(5.5), qs1616(-0.125), qs1616(3), qs1616(-1234.0625))),
+    CASE(gsDPTriFill_ST(0, 1, 6,
+              qs1616(16.5), qs132(40.25), qs1616(-0.25),
+              qs1616(20), qs132(20.75), qs1616(-4.5),
+              qs1616(16.5), qs132(-4), qs1616(0.0078125),
+              0x7777, 0x062D,
+              0xF84D, 0x5D5C,
+              0x8686, 0x9059,
+              0x0218, 0x4A96,
+              0xD680, 0xBD0E,
+              0xA321, 0x4040,
+              0x1BA4, 0xE9CD,
+              0xC8E5, 0xCBCF,
+              0xCC46, 0xC9CA,
+              0x3502, 0xF68A,
+              0xCD06, 0x1FDE,
+              0x6197, 0x227B,
+              0x6AE3, 0xE199,
+              0x5319, 0x3848,
+              0xAE1B, 0x1AEB,
+              0x346B, 0x001E,
+              0x4D72, 0x33F3,
+              0xBA2B, 0x0D0E,
+              0x2400, 0x6A78,
+              0xC0A1, 0x4C0E,
+              0x8127, 0xB1DD,
+              0xBA73, 0xF2C3,
+              0x3EE5, 0x3B0F,
+              0xF9E4, 0xEE96,
+              0xF5F6, 0xF7B9,
+              0x9FAB, 0x2BF9,
+              0x49C9, 0x3451,
+              0xAF6D, 0x878E)),
+    CASE(gsDPTriFill_STZ(1, 2, 7,
+              qs1616(17.5), qs132(40.25), qs1616(-0.25),
+              qs1616(20), qs132(20.75), qs1616(-5.5),
+              qs1616(17.5), qs132(-3), qs1616(0.0078125),
+              0xF50D, 0x52A8,
+              0x0BD3, 0x6911,
+              0xB937, 0x4B0F,
+              0x0DD8, 0x989F,
+              0x2E98, 0x85B0,
+              0xBBC0, 0x5586,
+              0xB61D, 0x7211,
+              0xA8C9, 0x7232,
+              0x63EA, 0x7A91,
+              0xCD26, 0x7417,
+              0x665B, 0xFC4D,
+              0xB60C, 0x0ED6,
+              0x0E4D, 0x8F0F,
+              0xF1C9, 0x84B2,
+              0x6325, 0xB045,
+              0xE4FB, 0xB2F4,
+              0xBAB1, 0x293C,
+              0x70E0, 0x344D,
+              0x7425, 0xF0AE,
+              0x64B6, 0xACEB,
+              0x68A3, 0xF71E,
+              0x00FA, 0xF57D,
+              0xB021, 0x2B68,
+              0x3D64, 0xC6EE,
+              0x660D, 0xF4C0,
+              0x5B67, 0xDE2B,
+              0xAA3F, 0x2C6A,
+              0xCAAB, 0xED23,
+              qs1616(7.5), qs1616(-0.125), qs1616(3), qs1616(-1234.0625))),
+};
+
+#define NUM_VERIFY_CASES    (sizeof(verify_cases) / sizeof(verify_cases[0]))
+
+// Drops comments and whitespace
+static std::string
+normalize (const std::string& s)
+{
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s.compare(i, 2, "//") == 0) {
+            i = s.find('\n', i);
+            if (i == std::string::npos)
+                break;
+        } else if (!isspace((unsigned char)s[i])) {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+static int
+verify (void)
+{
+    size_t failed = 0;
+    bool covered[64] = {};
+    std::vector<uint32_t> stream;
+
+    for (const verify_case_t& c : verify_cases) {
+        const uint32_t* words = (const uint32_t*)c.gfx.data();
+        std::string text;
+        size_t length = gfx_disasm(words, c.gfx.size(), text);
+
+        std::vector<uint32_t> rebuilt(2 * c.gfx.size());
+        gfx_reencode(words, rebuilt.data());
+
+        const char* problem = nullptr;
+        if (length != c.gfx.size())
+            problem = "wrong length";
+        else if (normalize(text) != normalize(std::string(c.source) + ","))
+            problem = "wrong disassembly";
+        else if (memcmp(rebuilt.data(), words, 8 * length) != 0)
+            problem = "re-encodes differently";
+        if (problem != nullptr) {
+            printf("FAIL %s\n    %s\n    got %s\n", problem, c.source, text.c_str());
+            failed++;
+        }
+
+        covered[words[0] >> 24 & 0x3F] = true;
+        stream.insert(stream.end(), words, words + 2 * c.gfx.size());
+    }
+
+    for (unsigned op = 0; op < 64; op++) {
+        const char* name = gfx_command_name(op << 24);
+        if (name != nullptr && !covered[op]) {
+            printf("FAIL no case for %s\n", name);
+            failed++;
+        }
+    }
+
+    // All the cases back to back must split into the same commands
+    size_t num_commands = 0;
+    std::string text;
+    for (size_t i = 0; i < stream.size() / 2; num_commands++) {
+        size_t length = gfx_disasm(&stream[2 * i], stream.size() / 2 - i, text);
+        if (length == 0)
+            break;
+        i += length;
+    }
+    if (num_commands != NUM_VERIFY_CASES) {
+        printf("FAIL %zu commands in the stream of %zu cases\n", num_commands, NUM_VERIFY_CASES);
+        failed++;
+    }
+
+    printf("%zu cases, %zu failed\n", NUM_VERIFY_CASES, failed);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static inline uint32_t
+read_be32 (const char* p)
+{
+    const unsigned char* u = (const unsigned char*)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+}
+
+static void
+append_word (std::string& out, uint32_t v)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    for (int i = 7; i >= 0; i--)
+        out += hex[(v >> (4 * i)) & 0xF];
+}
+
+int
+main (int argc, char** argv)
+{
+    options_t opts;
+    unsigned num_threads = default_num_threads();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:qj:V")) != -1) {
+        switch (opt) {
+            case 's':
+                opts.offset = strtoull(optarg, nullptr, 0);
+                break;
+            case 'n':
+                opts.max_commands = strtoull(optarg, nullptr, 0);
+                break;
+            case 'q':
+                opts.quiet = true;
+                break;
+            case 'j':
+                num_threads = std::max(1, atoi(optarg));
+                break;
+            case 'V':
+                return verify();
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    mapped_file_t file(argv[optind]);
+    if (opts.offset > file.size())
+        fatal("Offset 0x%zX is past the end of %s", opts.offset, argv[optind]);
+    size_t num_gfx = (file.size() - opts.offset) / 8;
+    if ((file.size() - opts.offset) % 8 != 0)
+        fprintf(stderr, "Warning: ignoring %zu bytes after the last whole Gfx\n", (file.size() - opts.offset) % 8);
+
+    std::vector<uint32_t> words(2 * num_gfx);
+    const char* p = file.begin() + opts.offset;
+    for (size_t i = 0; i < words.size(); i++)
+        words[i] = read_be32(p + 4 * i);
+
+    // Commands vary in length, so find where each starts before splitting the work
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < num_gfx && starts.size() < opts.max_commands; i += gfx_command_length(words[2 * i]))
+        starts.push_back(i);
+
+    size_t num_chunks = (starts.size() + CHUNK_COMMANDS - 1) / CHUNK_COMMANDS;
+    std::vector<std::string> chunks(num_chunks);
+    std::vector<size_t> truncated(num_chunks, 0);
+    parallel_for(num_chunks, num_threads, [&] (size_t c) {
+        std::string& out = chunks[c];
+        size_t last = std::min(starts.size(), (c + 1) * CHUNK_COMMANDS);
+        for (size_t k = c * CHUNK_COMMANDS; k < last; k++) {
+            size_t i = starts[k];
+            if (!opts.quiet) {
+                append_word(out, (uint32_t)(opts.offset + 8 * i));
+                out += ": ";
+                append_word(out, words[2 * i]);
+                out += ' ';
+                append_word(out, words[2 * i + 1]);
+                out += "  ";
+            }
+            size_t length = gfx_disasm(&words[2 * i], num_gfx - i, out, opts.quiet ? "    " : LISTING_INDENT "    ");
+            if (length == 0) {
+                truncated[c] = num_gfx - i;
+                out += "// truncated ";
+                out += gfx_command_name(words[2 * i]);
+            }
+            out += '\n';
+        }
+    });
+
+    for (const std::string& out : chunks)
+        fwrite(out.data(), 1, out.size(), stdout);
+
+    size_t num_commands = starts.size();
+    for (size_t t : truncated) {
+        if (t != 0) {
+            fprintf(stderr, "Warning: the last command is cut short, only %zu of its Gfx are there\n", t);
+            num_commands--;
+        }
+    }
+    fprintf(stderr, "%zu commands\n", num_commands);
+    return 0;
+}
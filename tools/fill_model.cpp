@@ -0,0 +1,460 @@
+/**
+ * Analytical model of RDP fill timing, calibrated on measured specs
+ */
+#include "fill_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+#include "parallel.h"
+#include "results_io.h"
+#include "stats.h"
+
+const char* const fill_param_names[FILL_NUM_PARAMS] = {
+    "pipe_1cycle",
+    "pipe_2cycle",
+    "span_overhead",
+    "read",
+    "write",
+    "write_setup",
+    "turnaround",
+    "row_miss_read",
+    "row_miss_write",
+    "color_stall_1cycle",
+    "color_stall_2cycle",
+    "depth_stall_1cycle",
+    "depth_stall_2cycle",
+    "vi_fetch",
+    "pipe_tail",
+    "pipe_tail_write",
+    "pipe_tail_vi",
+};
+
+fill_params_t
+fill_params_default (void)
+{
+    fill_params_t params;
+    double* p = params.p;
+    p[FILL_PIPE_1CYCLE] = 0.819;
+    p[FILL_PIPE_2CYCLE] = 1.800;
+    p[FILL_SPAN_OVERHEAD] = 63.56;
+    p[FILL_READ] = 5.047;
+    p[FILL_WRITE] = 6.564;
+    p[FILL_WRITE_SETUP] = 0.0;
+    p[FILL_TURNAROUND] = 1.214;
+    p[FILL_ROW_MISS_READ] = 1.304;
+    p[FILL_ROW_MISS_WRITE] = 2.693;
+    p[FILL_COLOR_STALL_1CYCLE] = 2.674;
+    p[FILL_COLOR_STALL_2CYCLE] = 1.133;
+    p[FILL_DEPTH_STALL_1CYCLE] = 2.722;
+    p[FILL_DEPTH_STALL_2CYCLE] = 2.434;
+    p[FILL_VI_FETCH] = 12.28;
+    p[FILL_PIPE_TAIL] = 3.503;
+    p[FILL_PIPE_TAIL_WRITE] = 23.02;
+    p[FILL_PIPE_TAIL_VI] = 15.77;
+    return params;
+}
+
+fill_estimate_t
+fill_model_predict (const fill_config_t& cfg, const fill_params_t& params, const fill_span_t* spans, size_t num_spans)
+{
+    // Negative values only come up while fitting and have no meaning
+    double p[FILL_NUM_PARAMS];
+    for (size_t i = 0; i < FILL_NUM_PARAMS; i++)
+        p[i] = std::max(0.0, params.p[i]);
+
+    // Fill and copy modes never read and only write color
+    bool color_read = cfg.color_read && !cfg.fill_mode;
+    bool depth_read = cfg.depth_read && !cfg.fill_mode;
+    bool color_write = cfg.color_write() || cfg.fill_mode;
+    bool depth_write = cfg.depth_writes() && !cfg.fill_mode;
+    unsigned num_writes = color_write + depth_write;
+
+    double pipe_per_pixel = cfg.fill_mode ? FILL_MODE_PIXEL_CLOCKS : p[cfg.two_cycle ? FILL_PIPE_2CYCLE : FILL_PIPE_1CYCLE];
+    double stall = (color_read ? p[cfg.two_cycle ? FILL_COLOR_STALL_2CYCLE : FILL_COLOR_STALL_1CYCLE] : 0) +
+                   (depth_read ? p[cfg.two_cycle ? FILL_DEPTH_STALL_2CYCLE : FILL_DEPTH_STALL_1CYCLE] : 0);
+    double read = p[FILL_READ];
+    double write = p[FILL_WRITE];
+    double miss_read = p[FILL_ROW_MISS_READ];
+    double miss_write = p[FILL_ROW_MISS_WRITE];
+    double write_setup = (num_writes != 0) ? p[FILL_WRITE_SETUP] : 0;
+    if (num_writes != 0 && (color_read || depth_read))
+        write_setup += p[FILL_TURNAROUND];
+
+    // VI scanout as src/test_main.c sets it up
+    rdram_vi_t vi;
+    vi.on = cfg.vi_on;
+    vi.addr = cfg.vi_addr;
+    rdram_vi_scan_t scan(vi);
+
+    fill_estimate_t est = {};
+    rdram_banks_t banks;
+    double t = 0;
+
+    for (size_t i = 0; i < num_spans; i++) {
+        const fill_span_t& span = spans[i];
+        if (span.x1 <= span.x0)
+            continue;
+        t += p[FILL_SPAN_OVERHEAD];
+        uint32_t line = span.y * cfg.width * 2;
+
+        for (unsigned sx = span.x0 & ~(FILL_SEGMENT_PIXELS - 1); sx < span.x1; sx += FILL_SEGMENT_PIXELS) {
+            unsigned num_pixels = std::min(sx + FILL_SEGMENT_PIXELS, span.x1) - std::max(sx, span.x0);
+            uint32_t offset = line + sx * 2;
+            double mem = write_setup;
+
+            // VI fetches that came due take the bus first
+            while (scan.next() <= t) {
+                if (banks.access(scan.fetch(), RDRAM_VI))
+                    mem += miss_read;
+                mem += p[FILL_VI_FETCH];
+                est.vi_fetches++;
+            }
+
+            if (color_read)
+                mem += read + (banks.access(cfg.fb_addr + offset, RDRAM_COLOR_READ) ? miss_read : 0);
+            if (depth_read)
+                mem += read + (banks.access(cfg.zb_addr + offset, RDRAM_DEPTH_READ) ? miss_read : 0);
+            if (color_write)
+                mem += write + (banks.access(cfg.fb_addr + offset, RDRAM_COLOR_WRITE) ? miss_write : 0);
+            if (depth_write)
+                mem += write + (banks.access(cfg.zb_addr + offset, RDRAM_DEPTH_WRITE) ? miss_write : 0);
+
+            t += stall + std::max(num_pixels * pipe_per_pixel, mem);
+            est.segments++;
+        }
+    }
+
+    est.buf = t;
+    est.pipe = t + params.p[FILL_PIPE_TAIL] + params.p[FILL_PIPE_TAIL_WRITE] * num_writes +
+               (cfg.vi_on ? params.p[FILL_PIPE_TAIL_VI] : 0);
+    est.row_misses = banks.row_opens();
+    return est;
+}
+
+fill_estimate_t
+fill_model_predict (const fill_config_t& cfg, const fill_params_t& params)
+{
+    std::vector<fill_span_t> spans;
+    spans.reserve(cfg.y1 - cfg.y0);
+    for (unsigned y = cfg.y0; y < cfg.y1; y++)
+        spans.push_back({ y, cfg.x0, cfg.x1 });
+    return fill_model_predict(cfg, params, spans.data(), spans.size());
+}
+
+bool
+fill_modes_parse (const char* modes, fill_config_t& cfg)
+{
+    std::string list(modes);
+    for (size_t start = 0; start <= list.size(); ) {
+        size_t comma = std::min(list.find(',', start), list.size());
+        std::string mode = list.substr(start, comma - start);
+        start = comma + 1;
+
+        if (mode == "2cycle")
+            cfg.two_cycle = true;
+        else if (mode == "im_rd")
+            cfg.color_read = true;
+        else if (mode == "z_cmp")
+            cfg.depth_read = true;
+        else if (mode == "z_upd")
+            cfg.depth_write = true;
+        else if (mode == "z_fail")
+            cfg.depth_pass = false;
+        else if (mode == "ac_fail")
+            cfg.alpha_pass = false;
+        else if (mode == "vi")
+            cfg.vi_on = true;
+        else if (!mode.empty())
+            return false;
+    }
+    return true;
+}
+
+static std::string
+trim (const std::string& s)
+{
+    size_t b = s.find_first_not_of(" \t\r");
+    size_t e = s.find_last_not_of(" \t\r");
+    return (b == std::string::npos) ? std::string() : s.substr(b, e - b + 1);
+}
+
+bool
+fill_config_from_desc (const std::string& desc, fill_config_t& cfg)
+{
+    std::vector<std::string> parts;
+    for (size_t start = 0;;) {
+        size_t comma = desc.find(',', start);
+        parts.push_back(trim(desc.substr(start, comma - start)));
+        if (comma == std::string::npos)
+            break;
+        start = comma + 1;
+    }
+    auto has = [&] (const char* part) { return std::find(parts.begin(), parts.end(), part) != parts.end(); };
+
+    if (!has("1-cycle") && !has("2-cycle"))
+        return false;
+
+    cfg = fill_config_t();
+    cfg.two_cycle = has("2-cycle");
+    cfg.color_read = has("image_read on");
+    cfg.vi_on = has("VI");
+    bool vi_same = has("FB + VI same") || has("FB + ZB + VI same");
+    bool zb_same = has("FB + ZB same") || has("FB + ZB + VI same");
+    cfg.zb_addr = zb_same ? FILL_ZB_ADDR_SAME : FILL_ZB_ADDR_DIFF;
+    cfg.vi_addr = vi_same ? FILL_VI_ADDR_SAME : FILL_VI_ADDR_DIFF;
+
+    if (parts[0].compare(0, 13, "Alpha Compare") == 0) {
+        // AC_GROUP: every pixel fails, depth read only with z_compare on, never writes
+        cfg.alpha_pass = false;
+        cfg.depth_read = has("z_compare on");
+        cfg.depth_write = false;
+        cfg.depth_pass = false;
+    } else {
+        if (parts[0] == "No ZB") {
+            cfg.depth_read = false;
+            cfg.depth_write = false;
+        } else if (parts[0] == "ZB Read-Only") {
+            cfg.depth_read = true;
+            cfg.depth_write = false;
+        } else if (parts[0] == "ZB Write-Only") {
+            cfg.depth_read = false;
+            cfg.depth_write = true;
+        } else if (parts[0] == "ZB Read/Write") {
+            cfg.depth_read = true;
+            cfg.depth_write = true;
+        } else {
+            return false;
+        }
+        // ZB_W always passes
+        cfg.depth_pass = has("Z Pass") || parts[0] == "ZB Write-Only";
+    }
+    return true;
+}
+
+static bool
+parse_summary_values (const std::string& text, double& avg)
+{
+    double lo, hi;
+    return sscanf(text.c_str(), "%*[^:]: %lfms, %lfms, %lfms", &lo, &avg, &hi) == 3;
+}
+
+/*
+ * The layout of sample_results.txt, as parse_sample_summary in results_store.py
+ */
+static void
+parse_summary (const char* start, const char* end, std::vector<fill_sample_t>& out)
+{
+    std::vector<std::pair<size_t, std::string>> stack;
+    std::string leaf_desc;
+    double leaf_buf = -1;
+    unsigned line_num = 0;
+
+    for (const char* p = start; p < end; ) {
+        const char* eol = std::find(p, end, '\n');
+        std::string line(p, eol);
+        p = (eol == end) ? end : eol + 1;
+        line_num++;
+
+        std::string text = trim(line);
+        if (text.empty())
+            continue;
+        size_t indent = line.find_first_not_of(" \t");
+
+        bool buf = text.compare(0, 4, "Buf:") == 0;
+        if (buf || text.compare(0, 5, "Pipe:") == 0) {
+            double avg;
+            if (!parse_summary_values(text, avg))
+                fatal("Expected min, avg, max on line %u", line_num);
+            if (buf) {
+                leaf_desc.clear();
+                for (const auto& heading : stack)
+                    leaf_desc += (leaf_desc.empty() ? "" : ", ") + heading.second;
+                leaf_buf = avg;
+            } else {
+                if (leaf_buf < 0)
+                    fatal("Pipe without Buf on line %u", line_num);
+                fill_sample_t s;
+                s.desc = leaf_desc;
+                s.buf = leaf_buf * RDP_CLK_PER_MS;
+                s.pipe = avg * RDP_CLK_PER_MS;
+                if (fill_config_from_desc(s.desc, s.cfg))
+                    out.push_back(s);
+                leaf_buf = -1;
+            }
+            continue;
+        }
+
+        while (!stack.empty() && stack.back().first >= indent)
+            stack.pop_back();
+        stack.emplace_back(indent, text);
+    }
+}
+
+static bool
+is_summary (const char* path)
+{
+    // Neither a binary result file nor a text log
+    static const char begin[] = "!!BEGIN!!";
+    mapped_file_t file(path);
+    return file.size() >= 4 && memcmp(file.begin(), "RDPR", 4) != 0 &&
+           std::search(file.begin(), file.end(), begin, begin + sizeof(begin) - 1) == file.end();
+}
+
+static void
+summarize (const std::vector<uint32_t>& samples, std::vector<uint32_t>& scratch, const std::string& desc,
+           double& avg, double& se)
+{
+    prune_summary_t s = prune_outliers(samples, scratch);
+    if (s.num == 0)
+        fatal("All samples pruned for \"%s\"", desc.c_str());
+    avg = s.avg();
+
+    double ss = 0;
+    for (uint32_t v : samples) {
+        if (v >= s.min && v <= s.max)
+            ss += (v - avg) * (v - avg);
+    }
+    se = (s.num > 1) ? sqrt(ss / (s.num - 1) / s.num) : 0;
+}
+
+std::vector<fill_sample_t>
+fill_samples_load (const std::vector<const char*>& paths, unsigned num_threads)
+{
+    std::vector<std::vector<fill_sample_t>> summaries(paths.size());
+    std::vector<std::vector<spec_result_t>> results(paths.size());
+    parallel_for(paths.size(), num_threads, [&] (size_t i) {
+        if (is_summary(paths[i])) {
+            mapped_file_t file(paths[i]);
+            parse_summary(file.begin(), file.end(), summaries[i]);
+        } else {
+            results[i] = results_load(paths[i]);
+        }
+    });
+
+    // Samples of the same spec from every campaign are pooled, in the order of the paths
+    std::vector<fill_sample_t> out;
+    std::vector<std::vector<uint32_t>> buf, pipe;
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < paths.size(); i++) {
+        out.insert(out.end(), summaries[i].begin(), summaries[i].end());
+        for (spec_result_t& res : results[i]) {
+            fill_config_t cfg;
+            if (!fill_config_from_desc(res.desc, cfg))
+                continue;
+            auto it = index.emplace(res.desc, out.size());
+            if (it.second) {
+                fill_sample_t s;
+                s.desc = res.desc;
+                s.cfg = cfg;
+                out.push_back(s);
+                buf.resize(out.size());
+                pipe.resize(out.size());
+            }
+            size_t k = it.first->second;
+            buf[k].insert(buf[k].end(), res.buf.begin(), res.buf.end());
+            pipe[k].insert(pipe[k].end(), res.pipe.begin(), res.pipe.end());
+            std::vector<uint32_t>().swap(res.buf);
+            std::vector<uint32_t>().swap(res.pipe);
+        }
+        results[i].clear();
+    }
+    buf.resize(out.size());
+    pipe.resize(out.size());
+
+    parallel_for(out.size(), num_threads, [&] (size_t k) {
+        if (buf[k].empty())
+            return;
+        std::vector<uint32_t> scratch;
+        fill_sample_t& s = out[k];
+        s.num_samples = buf[k].size();
+        summarize(buf[k], scratch, s.desc, s.buf, s.buf_se);
+        summarize(pipe[k], scratch, s.desc, s.pipe, s.pipe_se);
+    });
+    return out;
+}
+
+std::vector<fill_sample_t>
+fill_samples_load (const char* path)
+{
+    return fill_samples_load(std::vector<const char*>{ path }, 1);
+}
+
+/*
+ * Parameters 0 .. FILL_NUM_FITTED - 1 are clocks and cannot be negative, the
+ * PIPEBUSY tail can
+ */
+lsq_problem_t
+fill_model_problem (const std::vector<fill_sample_t>& samples)
+{
+    lsq_problem_t problem;
+    problem.num_params = FILL_NUM_PARAMS;
+    problem.num_residuals = 2 * samples.size();
+    problem.groups.resize(problem.num_residuals);
+    for (size_t i = 0; i < samples.size(); i++) {
+        problem.groups[2 * i] = 0;
+        problem.groups[2 * i + 1] = 1;
+    }
+    problem.lower.assign(FILL_NUM_PARAMS, -INFINITY);
+    std::fill(problem.lower.begin(), problem.lower.begin() + FILL_NUM_FITTED, 0.0);
+
+    const std::vector<fill_sample_t>* s = &samples;
+    problem.residuals = [s] (const double* p, double* r) {
+        fill_params_t params;
+        std::copy(p, p + FILL_NUM_PARAMS, params.p);
+        for (size_t i = 0; i < s->size(); i++) {
+            const fill_sample_t& sample = (*s)[i];
+            fill_estimate_t est = fill_model_predict(sample.cfg, params);
+            r[2 * i] = (est.buf - sample.buf) / sample.buf;
+            r[2 * i + 1] = ((est.pipe - est.buf) - (sample.pipe - sample.buf)) / sample.buf;
+        }
+    };
+    return problem;
+}
+
+lsq_result_t
+fill_model_fit (const std::vector<fill_sample_t>& samples, fill_params_t& params, const lsq_options_t& options)
+{
+    std::vector<double> initial(params.p, params.p + FILL_NUM_PARAMS);
+    lsq_result_t res = lsq_fit(fill_model_problem(samples), initial, options);
+    std::copy(res.params.begin(), res.params.end(), params.p);
+    return res;
+}
+
+void
+fill_params_save (const char* path, const fill_params_t& params)
+{
+    FILE* f = fopen(path, "w");
+    if (f == nullptr)
+        fatal("Could not open %s for writing", path);
+    for (size_t i = 0; i < FILL_NUM_PARAMS; i++)
+        fprintf(f, "%s %.17g\n", fill_param_names[i], params.p[i]);
+    if (fclose(f) != 0)
+        fatal("Could not write %s", path);
+}
+
+fill_params_t
+fill_params_load (const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f == nullptr)
+        fatal("Could not open %s", path);
+
+    fill_params_t params = fill_params_default();
+    char name[64];
+    double value;
+    while (fscanf(f, "%63s %lf", name, &value) == 2) {
+        size_t i = 0;
+        while (i < FILL_NUM_PARAMS && strcmp(name, fill_param_names[i]) != 0)
+            i++;
+        if (i == FILL_NUM_PARAMS)
+            fatal("Unknown parameter \"%s\" in %s", name, path);
+        params.p[i] = value;
+    }
+    fclose(f);
+    return params;
+}
@@ -0,0 +1,198 @@
+/**
+ * Analytical model of RDP fill timing, calibrated on measured specs
+ */
+#ifndef FILL_MODEL_H_
+#define FILL_MODEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "lsq_fit.h"
+#include "rdram_sim.h"
+
+// rgba16 pixels the span buffer holds, one memory transaction each way per segment
+#define FILL_SEGMENT_PIXELS 8
+
+// Pipeline clocks per pixel in fill and copy modes, 4 rgba16 pixels per clock; not calibrated
+#define FILL_MODE_PIXEL_CLOCKS  0.25
+
+// Placements used by src/test_main.c. fb_region is 1 MB aligned; which of the
+// low banks it lands in makes no difference as ZB/VI_ADDR_DIFF are in their own.
+#define FILL_FB_REGION      0x100000
+#define FILL_FB_ADDR        (FILL_FB_REGION + 0 * 320 * 240 * 2)
+#define FILL_ZB_ADDR_SAME   (FILL_FB_REGION + 1 * 320 * 240 * 2)
+#define FILL_VI_ADDR_SAME   (FILL_FB_REGION + 2 * 320 * 240 * 2)
+#define FILL_ZB_ADDR_DIFF   0x400000
+#define FILL_VI_ADDR_DIFF   0x500000
+
+/**
+ * A fill primitive and the othermode and buffers it is drawn with
+ */
+struct fill_config_t {
+    // Rectangle in pixels, [x0, x1) x [y0, y1), in a color image `width` pixels wide
+    unsigned x0 = 0, y0 = 0, x1 = 320, y1 = 240;
+    unsigned width = 320;
+
+    bool two_cycle = false;
+    bool fill_mode = false;     // G_CYC_FILL or G_CYC_COPY
+    bool color_read = false;    // IM_RD
+    bool depth_read = false;    // Z_CMP
+    bool depth_write = false;   // Z_UPD
+    bool depth_pass = true;     // outcome of the depth compare when Z_CMP is on
+    bool alpha_pass = true;     // outcome of the alpha compare, false when every pixel fails
+    bool vi_on = false;
+
+    // Physical RDRAM addresses
+    uint32_t fb_addr = FILL_FB_ADDR;
+    uint32_t zb_addr = FILL_ZB_ADDR_DIFF;
+    uint32_t vi_addr = FILL_VI_ADDR_DIFF;
+
+    bool color_write () const { return alpha_pass && (!depth_read || depth_pass); }
+    bool depth_writes () const { return depth_write && color_write(); }
+};
+
+/**
+ * Applies comma-separated modes to `cfg`: 2cycle, im_rd, z_cmp, z_upd, z_fail,
+ * ac_fail and vi. Returns false on an unknown mode.
+ */
+bool
+fill_modes_parse (const char* modes, fill_config_t& cfg);
+
+/**
+ * Model parameters in RDP clocks. Each 8 pixel segment costs
+ *
+ *     stalls + max(pipe, memory)
+ *
+ * where the stalls are the span overhead at the start of each scanline and
+ * the part of each read the pipeline waits for, pipe is the per-pixel cost of
+ * the cycle type and memory is the transactions in order (color read, depth
+ * read, color write, depth write) with a penalty whenever a transaction's row
+ * is not the open one in its bank, plus any VI fetches that fall in the
+ * segment. PIPEBUSY is BUFBUSY plus a tail linear in the writes per segment.
+ */
+enum fill_param_t {
+    FILL_PIPE_1CYCLE,       // per pixel
+    FILL_PIPE_2CYCLE,
+    FILL_SPAN_OVERHEAD,     // per scanline
+    FILL_READ,              // per read transaction
+    FILL_WRITE,             // per write transaction
+    FILL_WRITE_SETUP,       // per segment that writes
+    FILL_TURNAROUND,        // per segment that both reads and writes
+    FILL_ROW_MISS_READ,
+    FILL_ROW_MISS_WRITE,
+    FILL_COLOR_STALL_1CYCLE,
+    FILL_COLOR_STALL_2CYCLE,
+    FILL_DEPTH_STALL_1CYCLE,
+    FILL_DEPTH_STALL_2CYCLE,
+    FILL_VI_FETCH,          // per VI fetch
+    FILL_NUM_FITTED,
+
+    // PIPEBUSY - BUFBUSY
+    FILL_PIPE_TAIL = FILL_NUM_FITTED,
+    FILL_PIPE_TAIL_WRITE,   // per write transaction per segment
+    FILL_PIPE_TAIL_VI,
+    FILL_NUM_PARAMS
+};
+
+extern const char* const fill_param_names[FILL_NUM_PARAMS];
+
+struct fill_params_t {
+    double p[FILL_NUM_PARAMS];
+};
+
+/**
+ * Parameters fitted to sample_results.txt, the starting point for fitting
+ */
+fill_params_t
+fill_params_default (void);
+
+struct fill_estimate_t {
+    double buf;     // clocks
+    double pipe;
+    size_t segments;
+    size_t row_misses;
+    size_t vi_fetches;
+};
+
+/**
+ * Pixels [x0, x1) of scanline y
+ */
+struct fill_span_t {
+    unsigned y;
+    unsigned x0, x1;
+};
+
+/**
+ * Estimate for the rectangle of `cfg`
+ */
+fill_estimate_t
+fill_model_predict (const fill_config_t& cfg, const fill_params_t& params);
+
+/**
+ * Estimate for any primitive given as spans in drawing order, the rectangle of `cfg` is ignored
+ */
+fill_estimate_t
+fill_model_predict (const fill_config_t& cfg, const fill_params_t& params, const fill_span_t* spans, size_t num_spans);
+
+/**
+ * A measured spec with its configuration recovered from the description
+ */
+struct fill_sample_t {
+    std::string desc;
+    fill_config_t cfg;
+    double buf;     // average clocks
+    double pipe;
+    // Pooled raw samples behind the averages, 0 for summaries
+    size_t num_samples = 0;
+    double buf_se = 0;  // standard errors of the averages
+    double pipe_se = 0;
+};
+
+/**
+ * Recovers the configuration of a spec from a description built by the GROUP
+ * and AC_GROUP macros in src/test_main.c or from the comma-joined headings of
+ * sample_results.txt, as spec_params_from_desc in rdp_results.py. Returns
+ * false if the description is not recognized.
+ */
+bool
+fill_config_from_desc (const std::string& desc, fill_config_t& cfg);
+
+/**
+ * Loads measured averages, either from the indented Buf:/Pipe: summary layout
+ * of sample_results.txt or from results files. The raw samples of a spec from
+ * every results file are pooled and reduced to their pruned mean, so the fit
+ * costs the same however many campaigns go in. Files are read in parallel.
+ * Specs with unrecognized descriptions are skipped.
+ */
+std::vector<fill_sample_t>
+fill_samples_load (const std::vector<const char*>& paths, unsigned num_threads);
+
+std::vector<fill_sample_t>
+fill_samples_load (const char* path);
+
+/**
+ * The least squares problem of fitting the model: for each sample, the BUFBUSY
+ * error (group 0) and the PIPEBUSY - BUFBUSY error (group 1), both relative
+ * to the measured BUFBUSY
+ */
+lsq_problem_t
+fill_model_problem (const std::vector<fill_sample_t>& samples);
+
+/**
+ * Fits the parameters to the samples starting from `params`
+ */
+lsq_result_t
+fill_model_fit (const std::vector<fill_sample_t>& samples, fill_params_t& params, const lsq_options_t& options);
+
+/**
+ * Parameter files hold one "name value" line per parameter
+ */
+void
+fill_params_save (const char* path, const fill_params_t& params);
+
+fill_params_t
+fill_params_load (const char* path);
+
+#endif
@@ -0,0 +1,140 @@
+/**
+ * Fits the fill timing model to the raw samples of any number of campaigns
+ * with multi-start Levenberg-Marquardt over all cores, and reports the
+ * parameters with their standard errors and the residual of every spec.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fill_model.h"
+#include "lsq_fit.h"
+#include "parallel.h"
+#include "results_io.h"
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] RESULTS...\n"
+            "\n"
+            "Options:\n"
+            "  -s N        Starting points (default: 2 per thread, at least 8)\n"
+            "  -i N        Iterations per start (default 100)\n"
+            "  -x F        Starts scale each initial parameter by up to F either way (default 3)\n"
+            "  -S SEED     Seed for the starting points (default 1)\n"
+            "  -l FILE     Initial parameters (default: built in)\n"
+            "  -o FILE     Save the fitted parameters\n"
+            "  -j N        Worker threads (default: all cores)\n"
+            "  -q          Parameters only, no residuals per spec\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+static void
+print_residuals (const std::vector<fill_sample_t>& samples, const lsq_result_t& res)
+{
+    printf("\n%8s  %10s  %8s  %10s  %8s  %8s  %10s  %8s  %s\n", "Samples", "Buf clk", "SE", "Model", "Error",
+           "SEs", "Tail clk", "Error", "Spec");
+    for (size_t i = 0; i < samples.size(); i++) {
+        const fill_sample_t& s = samples[i];
+        double buf_err = res.residuals[2 * i] * s.buf;
+        double tail_err = res.residuals[2 * i + 1] * s.buf;
+        char ses[32] = "-";
+        if (s.buf_se > 0)
+            snprintf(ses, sizeof(ses), "%+.1f", buf_err / s.buf_se);
+        printf("%8zu  %10.1f  %8.2f  %10.1f  %+7.2f%%  %8s  %10.1f  %+8.1f  %s\n", s.num_samples, s.buf, s.buf_se,
+               s.buf + buf_err, 100 * res.residuals[2 * i], ses, s.pipe - s.buf, tail_err, s.desc.c_str());
+    }
+}
+
+int
+main (int argc, char** argv)
+{
+    lsq_options_t options;
+    options.num_threads = default_num_threads();
+    options.num_starts = 0;
+    const char* load_path = nullptr;
+    const char* save_path = nullptr;
+    bool quiet = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:i:x:S:l:o:j:q")) != -1) {
+        switch (opt) {
+            case 's':
+                options.num_starts = std::max(1, atoi(optarg));
+                break;
+            case 'i':
+                options.max_iterations = std::max(1, atoi(optarg));
+                break;
+            case 'x':
+                options.spread = atof(optarg);
+                if (!(options.spread >= 1))
+                    fatal("Spread must be at least 1");
+                break;
+            case 'S':
+                options.seed = strtoull(optarg, nullptr, 0);
+                break;
+            case 'l':
+                load_path = optarg;
+                break;
+            case 'o':
+                save_path = optarg;
+                break;
+            case 'j':
+                options.num_threads = std::max(1, atoi(optarg));
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind == argc)
+        usage(argv[0]);
+    if (options.num_starts == 0)
+        options.num_starts = std::max(8u, 2 * options.num_threads);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<const char*> paths(argv + optind, argv + argc);
+    std::vector<fill_sample_t> samples = fill_samples_load(paths, options.num_threads);
+    if (samples.empty())
+        fatal("No specs with a recognized description");
+    size_t num_raw = 0;
+    for (const fill_sample_t& s : samples)
+        num_raw += 2 * s.num_samples;
+    double load_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "Loaded %zu specs (%zu raw BUF/PIPE samples) from %zu files in %.2f s\n", samples.size(),
+            num_raw, paths.size(), load_s);
+
+    fill_params_t params = (load_path != nullptr) ? fill_params_load(load_path) : fill_params_default();
+    start = std::chrono::steady_clock::now();
+    lsq_result_t res = fill_model_fit(samples, params, options);
+    double fit_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (save_path != nullptr)
+        fill_params_save(save_path, params);
+
+    double ss = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+        ss += res.residuals[2 * i] * res.residuals[2 * i];
+    fprintf(stderr, "%u starts in %.1f s, %u reached the best cost (start %u, %u iterations)\n",
+            options.num_starts, fit_s, res.starts_at_best, res.best_start, res.iterations);
+    fprintf(stderr, "RMS relative buf error %.3f%%\n", 100 * sqrt(ss / samples.size()));
+
+    printf("%-20s  %12s  %12s\n", "Parameter", "Value", "Std error");
+    for (size_t i = 0; i < FILL_NUM_PARAMS; i++) {
+        if (std::isnan(res.sigma[i]))
+            printf("%-20s  %12.4f  %12s\n", fill_param_names[i], params.p[i], "-");
+        else
+            printf("%-20s  %12.4f  %12.4f\n", fill_param_names[i], params.p[i], res.sigma[i]);
+    }
+    if (!quiet)
+        print_residuals(samples, res);
+    return 0;
+}
@@ -0,0 +1,777 @@
+/**
+ * Table-driven disassembly of RDP display lists back into the gs* macros of src/rdp.h
+ *
+ * Every command is described by the fields its macro packs, in the macro's
+ * argument order, so decoding, printing and re-encoding all walk the same
+ * tables. Triangles are an edge block followed by optional shade, texture and
+ * depth blocks selected by the low opcode bits.
+ */
+#include "gfx_disasm.h"
+
+#include <array>
+#include <cstring>
+
+#include "rdp.h"
+
+enum field_format_t : uint8_t {
+    FMT_DEC,        // unsigned decimal
+    FMT_SDEC,       // signed decimal of a two's complement field
+    FMT_HEX,        // hex, as many digits as the field needs
+    FMT_PLUS1,      // stored minus one, e.g. image widths
+    FMT_NAME,       // names[value]
+    FMT_FRAC,       // hex fraction half of an s15.16 coefficient, following its integer half
+    FMT_QU102,      // fixed point values as the conversion macros of rdp.h
+    FMT_QS105,
+    FMT_QS510,
+    FMT_QS132,
+    FMT_QS1616,
+    FMT_MODE_H,     // G_RDPSETOTHERMODE halves
+    FMT_MODE_L,
+};
+
+struct gfx_field_t {
+    const char* name;
+    uint8_t word;                       // 32-bit word of the block, 0 and 1 being w0 and w1 of its first Gfx
+    uint8_t shift;
+    uint8_t bits;
+    uint8_t format;
+    const char* const* names = nullptr; // FMT_NAME: one per value, nullptr for values printed as numbers
+    bool new_line = false;              // starts a new line of the macro call
+    // Low bits of a value split across two words (k2 of G_SETCONVERT)
+    uint8_t lo_word = 0;
+    uint8_t lo_shift = 0;
+    uint8_t lo_bits = 0;
+};
+
+struct gfx_block_t {
+    const gfx_field_t* fields;
+    size_t num_fields;
+    size_t length;                      // in Gfx
+};
+
+struct gfx_command_t {
+    uint8_t opcode;
+    const char* macro;
+    const gfx_block_t* blocks[4];       // in order, unused ones nullptr
+};
+
+#define BLOCK(fields, length)   { fields, sizeof(fields) / sizeof(fields[0]), length }
+
+/*
+ * Value names
+ */
+
+static const char* const im_fmt_names[8] = {
+    "G_IM_FMT_RGBA", "G_IM_FMT_YUV", "G_IM_FMT_CI", "G_IM_FMT_IA", "G_IM_FMT_I", nullptr, nullptr, nullptr
+};
+static const char* const im_siz_names[4] = {
+    "G_IM_SIZ_4b", "G_IM_SIZ_8b", "G_IM_SIZ_16b", "G_IM_SIZ_32b"
+};
+static const char* const sc_names[4] = {
+    "G_SC_NON_INTERLACE", nullptr, "G_SC_EVEN_INTERLACE", "G_SC_ODD_INTERLACE"
+};
+
+// Combiner inputs, as the suffixes gsDPSetCombineLERP pastes onto G_CCMUX_ and G_ACMUX_
+static const char* const cc_a_names[16] = {
+    "COMBINED", "TEXEL0", "TEXEL1", "PRIMITIVE", "SHADE", "ENVIRONMENT", "1", "NOISE",
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "0"
+};
+static const char* const cc_b_names[16] = {
+    "COMBINED", "TEXEL0", "TEXEL1", "PRIMITIVE", "SHADE", "ENVIRONMENT", "CENTER", "K4",
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "0"
+};
+static const char* const cc_c_names[32] = {
+    "COMBINED", "TEXEL0", "TEXEL1", "PRIMITIVE", "SHADE", "ENVIRONMENT", "SCALE", "COMBINED_ALPHA",
+    "TEXEL0_ALPHA", "TEXEL1_ALPHA", "PRIMITIVE_ALPHA", "SHADE_ALPHA", "ENV_ALPHA", "LOD_FRACTION", "PRIM_LOD_FRAC", "K5",
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "0"
+};
+static const char* const cc_d_names[8] = {
+    "COMBINED", "TEXEL0", "TEXEL1", "PRIMITIVE", "SHADE", "ENVIRONMENT", "1", "0"
+};
+static const char* const ac_abd_names[8] = {
+    "COMBINED", "TEXEL0", "TEXEL1", "PRIMITIVE", "SHADE", "ENVIRONMENT", "1", "0"
+};
+static const char* const ac_c_names[8] = {
+    "LOD_FRACTION", "TEXEL0", "TEXEL1", "PRIMITIVE", "SHADE", "ENVIRONMENT", "PRIM_LOD_FRAC", "0"
+};
+
+/*
+ * Command fields, in the argument order of each macro
+ */
+
+static const gfx_field_t image_fields[] = {
+    { "fmt",    0, 21,  3, FMT_NAME,  im_fmt_names },
+    { "siz",    0, 19,  2, FMT_NAME,  im_siz_names },
+    { "width",  0,  0, 12, FMT_PLUS1 },
+    { "img",    1,  0, 32, FMT_HEX },
+};
+static const gfx_field_t depth_image_fields[] = {
+    { "img",    1,  0, 32, FMT_HEX },
+};
+static const gfx_field_t combine_fields[] = {
+    { "a0",     0, 20,  4, FMT_NAME, cc_a_names },
+    { "b0",     1, 28,  4, FMT_NAME, cc_b_names },
+    { "c0",     0, 15,  5, FMT_NAME, cc_c_names },
+    { "d0",     1, 15,  3, FMT_NAME, cc_d_names },
+    { "Aa0",    0, 12,  3, FMT_NAME, ac_abd_names, true },
+    { "Ab0",    1, 12,  3, FMT_NAME, ac_abd_names },
+    { "Ac0",    0,  9,  3, FMT_NAME, ac_c_names },
+    { "Ad0",    1,  9,  3, FMT_NAME, ac_abd_names },
+    { "a1",     0,  5,  4, FMT_NAME, cc_a_names, true },
+    { "b1",     1, 24,  4, FMT_NAME, cc_b_names },
+    { "c1",     0,  0,  5, FMT_NAME, cc_c_names },
+    { "d1",     1,  6,  3, FMT_NAME, cc_d_names },
+    { "Aa1",    1, 21,  3, FMT_NAME, ac_abd_names, true },
+    { "Ab1",    1,  3,  3, FMT_NAME, ac_abd_names },
+    { "Ac1",    1, 18,  3, FMT_NAME, ac_c_names },
+    { "Ad1",    1,  0,  3, FMT_NAME, ac_abd_names },
+};
+static const gfx_field_t color_fields[] = {
+    { "r",      1, 24,  8, FMT_DEC },
+    { "g",      1, 16,  8, FMT_DEC },
+    { "b",      1,  8,  8, FMT_DEC },
+    { "a",      1,  0,  8, FMT_DEC },
+};
+static const gfx_field_t prim_color_fields[] = {
+    { "m",      0,  8,  8, FMT_DEC },
+    { "l",      0,  0,  8, FMT_DEC },
+    { "r",      1, 24,  8, FMT_DEC },
+    { "g",      1, 16,  8, FMT_DEC },
+    { "b",      1,  8,  8, FMT_DEC },
+    { "a",      1,  0,  8, FMT_DEC },
+};
+static const gfx_field_t fill_color_fields[] = {
+    { "c",      1,  0, 32, FMT_HEX },
+};
+static const gfx_field_t fill_rect_fields[] = {
+    { "ulx",    1, 14, 10, FMT_DEC },
+    { "uly",    1,  2, 10, FMT_DEC },
+    { "lrx",    0, 14, 10, FMT_DEC },
+    { "lry",    0,  2, 10, FMT_DEC },
+};
+static const gfx_field_t tile_fields[] = {
+    { "fmt",    0, 21,  3, FMT_NAME, im_fmt_names },
+    { "siz",    0, 19,  2, FMT_NAME, im_siz_names },
+    { "line",   0,  9,  9, FMT_DEC },
+    { "tmem",   0,  0,  9, FMT_HEX },
+    { "tile",   1, 24,  3, FMT_DEC },
+    { "palette",1, 20,  4, FMT_DEC },
+    { "cmt",    1, 18,  2, FMT_DEC },
+    { "maskt",  1, 14,  4, FMT_DEC },
+    { "shiftt", 1, 10,  4, FMT_DEC },
+    { "cms",    1,  8,  2, FMT_DEC },
+    { "masks",  1,  4,  4, FMT_DEC },
+    { "shifts", 1,  0,  4, FMT_DEC },
+};
+// gsDPLoadTile and gsDPSetTileSize
+static const gfx_field_t tile_size_fields[] = {
+    { "tile",   1, 24,  3, FMT_DEC },
+    { "uls",    0, 12, 12, FMT_QU102 },
+    { "ult",    0,  0, 12, FMT_QU102 },
+    { "lrs",    1, 12, 12, FMT_QU102 },
+    { "lrt",    1,  0, 12, FMT_QU102 },
+};
+static const gfx_field_t load_block_fields[] = {
+    { "tile",   1, 24,  3, FMT_DEC },
+    { "uls",    0, 12, 12, FMT_DEC },
+    { "ult",    0,  0, 12, FMT_DEC },
+    { "lrs",    1, 12, 12, FMT_DEC },
+    { "dxt",    1,  0, 12, FMT_HEX },
+};
+static const gfx_field_t load_tlut_fields[] = {
+    { "tile",   1, 24,  3, FMT_DEC },
+    { "count",  1, 14, 10, FMT_DEC },
+};
+static const gfx_field_t other_mode_fields[] = {
+    { "mode0",  0,  0, 24, FMT_MODE_H },
+    { "mode1",  1,  0, 32, FMT_MODE_L },
+};
+static const gfx_field_t prim_depth_fields[] = {
+    { "z",      1, 16, 16, FMT_HEX },
+    { "dz",     1,  0, 16, FMT_HEX },
+};
+static const gfx_field_t scissor_fields[] = {
+    { "mode",   1, 24,  2, FMT_NAME, sc_names },
+    { "ulx",    0, 12, 12, FMT_QU102 },
+    { "uly",    0,  0, 12, FMT_QU102 },
+    { "lrx",    1, 12, 12, FMT_QU102 },
+    { "lry",    1,  0, 12, FMT_QU102 },
+};
+static const gfx_field_t convert_fields[] = {
+    { "k0",     0, 13,  9, FMT_SDEC },
+    { "k1",     0,  4,  9, FMT_SDEC },
+    { "k2",     0,  0,  4, FMT_SDEC, nullptr, false, 1, 27, 5 },
+    { "k3",     1, 18,  9, FMT_SDEC },
+    { "k4",     1,  9,  9, FMT_SDEC },
+    { "k5",     1,  0,  9, FMT_SDEC },
+};
+static const gfx_field_t key_r_fields[] = {
+    { "cR",     1,  8,  8, FMT_DEC },
+    { "sR",     1,  0,  8, FMT_DEC },
+    { "wR",     1, 16, 12, FMT_DEC },
+};
+static const gfx_field_t key_gb_fields[] = {
+    { "cG",     1, 24,  8, FMT_DEC },
+    { "sG",     1, 16,  8, FMT_DEC },
+    { "wG",     0, 12, 12, FMT_DEC },
+    { "cB",     1,  8,  8, FMT_DEC },
+    { "sB",     1,  0,  8, FMT_DEC },
+    { "wB",     0,  0, 12, FMT_DEC },
+};
+static const gfx_field_t tex_rect_fields[] = {
+    { "ulx",    1, 12, 12, FMT_QU102 },
+    { "uly",    1,  0, 12, FMT_QU102 },
+    { "lrx",    0, 12, 12, FMT_QU102 },
+    { "lry",    0,  0, 12, FMT_QU102 },
+    { "tile",   1, 24,  3, FMT_DEC },
+    { "s",      2, 16, 16, FMT_QS105 },
+    { "t",      2,  0, 16, FMT_QS105 },
+    { "dsdx",   3, 16, 16, FMT_QS510 },
+    { "dtdy",   3,  0, 16, FMT_QS510 },
+};
+
+/*
+ * Triangle blocks
+ */
+
+static const gfx_field_t tri_edge_fields[] = {
+    { "lft",    0, 23,  1, FMT_DEC },
+    { "level",  0, 19,  3, FMT_DEC },
+    { "tile",   0, 16,  3, FMT_DEC },
+    { "xl",     2,  0, 32, FMT_QS1616, nullptr, true },
+    { "yl",     0,  0, 14, FMT_QS132 },
+    { "dxldy",  3,  0, 32, FMT_QS1616 },
+    { "xm",     6,  0, 32, FMT_QS1616, nullptr, true },
+    { "ym",     1, 16, 14, FMT_QS132 },
+    { "dxmdy",  7,  0, 32, FMT_QS1616 },
+    { "xh",     4,  0, 32, FMT_QS1616, nullptr, true },
+    { "yh",     1,  0, 14, FMT_QS132 },
+    { "dxhdy",  5,  0, 32, FMT_QS1616 },
+};
+
+// Integer and fraction halves of an s15.16 coefficient, one pair per line
+#define COEFF(name, word_i, shift, word_f)                             \
+    { name "_i", word_i, shift, 16, FMT_HEX, nullptr, true },          \
+    { name "_f", word_f, shift, 16, FMT_FRAC }
+
+// A value and its derivatives along x, the major edge and y
+#define COEFFS(name, word, shift)                                       \
+    COEFF(name,             (word) + 0,  shift, (word) + 4),           \
+    COEFF("d" name "dx",    (word) + 2,  shift, (word) + 6),           \
+    COEFF("d" name "de",    (word) + 8,  shift, (word) + 12),          \
+    COEFF("d" name "dy",    (word) + 10, shift, (word) + 14)
+
+static const gfx_field_t tri_shade_fields[] = {
+    COEFFS("r", 0, 16),
+    COEFFS("g", 0,  0),
+    COEFFS("b", 1, 16),
+    COEFFS("a", 1,  0),
+};
+static const gfx_field_t tri_tex_fields[] = {
+    COEFFS("s", 0, 16),
+    COEFFS("t", 0,  0),
+    COEFFS("w", 1, 16),
+};
+static const gfx_field_t tri_depth_fields[] = {
+    { "z",      0,  0, 32, FMT_QS1616, nullptr, true },
+    { "dzdx",   1,  0, 32, FMT_QS1616 },
+    { "dzde",   2,  0, 32, FMT_QS1616 },
+    { "dzdy",   3,  0, 32, FMT_QS1616 },
+};
+
+/*
+ * Commands
+ */
+
+static const gfx_block_t no_fields = { nullptr, 0, 1 };
+
+static const gfx_block_t image_block = BLOCK(image_fields, 1);
+static const gfx_block_t depth_image_block = BLOCK(depth_image_fields, 1);
+static const gfx_block_t combine_block = BLOCK(combine_fields, 1);
+static const gfx_block_t color_block = BLOCK(color_fields, 1);
+static const gfx_block_t prim_color_block = BLOCK(prim_color_fields, 1);
+static const gfx_block_t fill_color_block = BLOCK(fill_color_fields, 1);
+static const gfx_block_t fill_rect_block = BLOCK(fill_rect_fields, 1);
+static const gfx_block_t tile_block = BLOCK(tile_fields, 1);
+static const gfx_block_t tile_size_block = BLOCK(tile_size_fields, 1);
+static const gfx_block_t load_block_block = BLOCK(load_block_fields, 1);
+static const gfx_block_t load_tlut_block = BLOCK(load_tlut_fields, 1);
+static const gfx_block_t other_mode_block = BLOCK(other_mode_fields, 1);
+static const gfx_block_t prim_depth_block = BLOCK(prim_depth_fields, 1);
+static const gfx_block_t scissor_block = BLOCK(scissor_fields, 1);
+static const gfx_block_t convert_block = BLOCK(convert_fields, 1);
+static const gfx_block_t key_r_block = BLOCK(key_r_fields, 1);
+static const gfx_block_t key_gb_block = BLOCK(key_gb_fields, 1);
+static const gfx_block_t tex_rect_block = BLOCK(tex_rect_fields, 2);
+
+static const gfx_block_t tri_edge_block = BLOCK(tri_edge_fields, 4);
+static const gfx_block_t tri_shade_block = BLOCK(tri_shade_fields, 8);
+static const gfx_block_t tri_tex_block = BLOCK(tri_tex_fields, 8);
+static const gfx_block_t tri_depth_block = BLOCK(tri_depth_fields, 2);
+
+static const gfx_command_t commands[] = {
+    { G_NOOP,                   "gsDPNoOp",             { &no_fields } },
+    { G_SETCIMG,                "gsDPSetColorImage",    { &image_block } },
+    { G_SETZIMG,                "gsDPSetDepthImage",    { &depth_image_block } },
+    { G_SETTIMG,                "gsDPSetTextureImage",  { &image_block } },
+    { G_SETCOMBINE,             "gsDPSetCombineLERP",   { &combine_block } },
+    { G_SETENVCOLOR,            "gsDPSetEnvColor",      { &color_block } },
+    { G_SETPRIMCOLOR,           "gsDPSetPrimColor",     { &prim_color_block } },
+    { G_SETBLENDCOLOR,          "gsDPSetBlendColor",    { &color_block } },
+    { G_SETFOGCOLOR,            "gsDPSetFogColor",      { &color_block } },
+    { G_SETFILLCOLOR,           "gsDPSetFillColor",     { &fill_color_block } },
+    { G_FILLRECT,               "gsDPFillRectangle",    { &fill_rect_block } },
+    { G_SETTILE,                "gsDPSetTile",          { &tile_block } },
+    { G_LOADTILE,               "gsDPLoadTile",         { &tile_size_block } },
+    { G_LOADBLOCK,              "gsDPLoadBlock",        { &load_block_block } },
+    { G_SETTILESIZE,            "gsDPSetTileSize",      { &tile_size_block } },
+    { G_LOADTLUT,               "gsDPLoadTLUTCmd",      { &load_tlut_block } },
+    { G_RDPSETOTHERMODE,        "gsDPSetOtherMode",     { &other_mode_block } },
+    { G_SETPRIMDEPTH,           "gsDPSetPrimDepth",     { &prim_depth_block } },
+    { G_SETSCISSOR,             "gsDPSetScissorFrac",   { &scissor_block } },
+    { G_SETCONVERT,             "gsDPSetConvert",       { &convert_block } },
+    { G_SETKEYR,                "gsDPSetKeyR",          { &key_r_block } },
+    { G_SETKEYGB,               "gsDPSetKeyGB",         { &key_gb_block } },
+    { G_RDPFULLSYNC,            "gsDPFullSync",         { &no_fields } },
+    { G_RDPTILESYNC,            "gsDPTileSync",         { &no_fields } },
+    { G_RDPPIPESYNC,            "gsDPPipeSync",         { &no_fields } },
+    { G_RDPLOADSYNC,            "gsDPLoadSync",         { &no_fields } },
+    { G_TEXRECTFLIP,            "gsTexRectFlip",        { &tex_rect_block } },
+    { G_TEXRECT,                "gsTexRect",            { &tex_rect_block } },
+    { G_TRI_FILL,               "gsDPTriFill",          { &tri_edge_block } },
+    { G_TRI_FILL_ZBUFF,         "gsDPTriFill_Z",        { &tri_edge_block, &tri_depth_block } },
+    { G_TRI_TXTR,               "gsDPTriFill_T",        { &tri_edge_block, &tri_tex_block } },
+    { G_TRI_TXTR_ZBUFF,         "gsDPTriFill_TZ",       { &tri_edge_block, &tri_tex_block, &tri_depth_block } },
+    { G_TRI_SHADE,              "gsDPTriFill_S",        { &tri_edge_block, &tri_shade_block } },
+    { G_TRI_SHADE_ZBUFF,        "gsDPTriFill_SZ",       { &tri_edge_block, &tri_shade_block, &tri_depth_block } },
+    { G_TRI_SHADE_TXTR,         "gsDPTriFill_ST",       { &tri_edge_block, &tri_shade_block, &tri_tex_block } },
+    { G_TRI_SHADE_TXTR_ZBUFF,   "gsDPTriFill_STZ",      { &tri_edge_block, &tri_shade_block, &tri_tex_block,
+                                                          &tri_depth_block } },
+};
+
+// Longest command, a shaded, textured, z-buffered triangle
+#define MAX_COMMAND_GFX     22
+
+// The RDP decodes 6 opcode bits, the top two are ignored
+static const gfx_command_t*
+find_command (uint32_t w0)
+{
+    static const std::array<const gfx_command_t*, 64> index = [] () {
+        std::array<const gfx_command_t*, 64> out {};
+        for (const gfx_command_t& cmd : commands)
+            out[cmd.opcode & 0x3F] = &cmd;
+        return out;
+    }();
+    return index[(w0 >> 24) & 0x3F];
+}
+
+static size_t
+command_length (const gfx_command_t* cmd)
+{
+    size_t length = 0;
+    for (const gfx_block_t* block : cmd->blocks) {
+        if (block != nullptr)
+            length += block->length;
+    }
+    return length;
+}
+
+size_t
+gfx_command_length (uint32_t w0)
+{
+    const gfx_command_t* cmd = find_command(w0);
+    return (cmd == nullptr) ? 1 : command_length(cmd);
+}
+
+unsigned
+gfx_opcode (uint32_t w0)
+{
+    const gfx_command_t* cmd = find_command(w0);
+    return (cmd == nullptr) ? (w0 >> 24) & 0x3F : cmd->opcode;
+}
+
+const char*
+gfx_command_name (uint32_t w0)
+{
+    const gfx_command_t* cmd = find_command(w0);
+    return (cmd == nullptr) ? nullptr : cmd->macro;
+}
+
+/*
+ * Field access
+ */
+
+static inline uint32_t
+field_mask (unsigned bits)
+{
+    return (bits >= 32) ? ~0u : (1u << bits) - 1;
+}
+
+static inline int32_t
+sign_extend (uint32_t v, unsigned bits)
+{
+    return (bits >= 32) ? (int32_t)v : (int32_t)(v << (32 - bits)) >> (32 - bits);
+}
+
+static inline uint32_t
+field_value (const uint32_t* words, const gfx_field_t& f)
+{
+    uint32_t v = (words[f.word] >> f.shift) & field_mask(f.bits);
+    if (f.lo_bits != 0)
+        v = (v << f.lo_bits) | ((words[f.lo_word] >> f.lo_shift) & field_mask(f.lo_bits));
+    return v;
+}
+
+static inline void
+field_store (uint32_t* words, const gfx_field_t& f, uint32_t v)
+{
+    if (f.lo_bits != 0) {
+        words[f.lo_word] |= (v & field_mask(f.lo_bits)) << f.lo_shift;
+        v >>= f.lo_bits;
+    }
+    words[f.word] |= (v & field_mask(f.bits)) << f.shift;
+}
+
+/*
+ * Number formatting, by hand as snprintf dominates the time on large lists
+ */
+
+static void
+append_dec (std::string& out, uint64_t v)
+{
+    char buf[20];
+    size_t n = 0;
+    do {
+        buf[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    while (n != 0)
+        out += buf[--n];
+}
+
+static void
+append_sdec (std::string& out, int64_t v)
+{
+    if (v < 0) {
+        out += '-';
+        v = -v;
+    }
+    append_dec(out, (uint64_t)v);
+}
+
+static void
+append_hex (std::string& out, uint32_t v, unsigned digits)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    out += "0x";
+    for (unsigned i = digits; i-- != 0; )
+        out += hex[(v >> (4 * i)) & 0xF];
+}
+
+// Exact decimal of value / 2^frac_bits
+static void
+append_fixed (std::string& out, int64_t value, unsigned frac_bits)
+{
+    if (value < 0) {
+        out += '-';
+        value = -value;
+    }
+    uint64_t mask = (1ull << frac_bits) - 1;
+    append_dec(out, (uint64_t)value >> frac_bits);
+    uint64_t frac = (uint64_t)value & mask;
+    if (frac != 0) {
+        out += '.';
+        while (frac != 0) {
+            frac *= 10;
+            out += '0' + (char)(frac >> frac_bits);
+            frac &= mask;
+        }
+    }
+}
+
+static void
+append_fixed_macro (std::string& out, const char* macro, int64_t value, unsigned frac_bits)
+{
+    out += macro;
+    out += '(';
+    append_fixed(out, value, frac_bits);
+    out += ')';
+}
+
+/*
+ * Othermode
+ */
+
+struct mode_field_t {
+    uint8_t shift;
+    uint8_t bits;
+    const char* const* names;   // one per value, nullptr for values without a name (left out when 0)
+    const char* shift_name;     // G_MDSFT_ constant unnamed values are shifted by, else they are printed in hex
+};
+
+#define FLAG_NAMES(flag)    static const char* const flag##_names[2] = { nullptr, #flag };
+FLAG_NAMES(AA_EN)
+FLAG_NAMES(Z_CMP)
+FLAG_NAMES(Z_UPD)
+FLAG_NAMES(IM_RD)
+FLAG_NAMES(CLR_ON_CVG)
+FLAG_NAMES(CVG_X_ALPHA)
+FLAG_NAMES(ALPHA_CVG_SEL)
+FLAG_NAMES(FORCE_BL)
+
+static const char* const pm_names[2] = { "G_PM_NPRIMITIVE", "G_PM_1PRIMITIVE" };
+static const char* const cyc_names[4] = { "G_CYC_1CYCLE", "G_CYC_2CYCLE", "G_CYC_COPY", "G_CYC_FILL" };
+static const char* const tp_names[2] = { "G_TP_NONE", "G_TP_PERSP" };
+static const char* const td_names[4] = { "G_TD_CLAMP", "G_TD_SHARPEN", "G_TD_DETAIL", nullptr };
+static const char* const tl_names[2] = { "G_TL_TILE", "G_TL_LOD" };
+static const char* const tt_names[4] = { "G_TT_NONE", nullptr, "G_TT_RGBA16", "G_TT_IA16" };
+static const char* const tf_names[4] = { "G_TF_POINT", nullptr, "G_TF_BILERP", "G_TF_AVERAGE" };
+static const char* const tc_names[8] = {
+    "G_TC_CONV", nullptr, nullptr, nullptr, nullptr, "G_TC_FILTCONV", "G_TC_FILT", nullptr
+};
+static const char* const ck_names[2] = { "G_CK_NONE", "G_CK_KEY" };
+static const char* const cd_names[4] = { "G_CD_MAGICSQ", "G_CD_BAYER", "G_CD_NOISE", "G_CD_DISABLE" };
+static const char* const ad_names[4] = { "G_AD_PATTERN", "G_AD_NOTPATTERN", "G_AD_NOISE", "G_AD_DISABLE" };
+
+static const char* const ac_names[4] = { "G_AC_NONE", "G_AC_THRESHOLD", nullptr, "G_AC_DITHER" };
+static const char* const zs_names[2] = { "G_ZS_PIXEL", "G_ZS_PRIM" };
+static const char* const cvg_dst_names[4] = { "CVG_DST_CLAMP", "CVG_DST_WRAP", "CVG_DST_FULL", "CVG_DST_SAVE" };
+static const char* const zmode_names[4] = { "ZMODE_OPA", "ZMODE_INTER", "ZMODE_XLU", "ZMODE_DEC" };
+
+static const mode_field_t mode_h_fields[] = {
+    { G_MDSFT_PIPELINE,     1, pm_names,    "G_MDSFT_PIPELINE" },
+    { G_MDSFT_COLORDITHER,  1, nullptr,     "G_MDSFT_COLORDITHER" },
+    { G_MDSFT_CYCLETYPE,    2, cyc_names,   "G_MDSFT_CYCLETYPE" },
+    { G_MDSFT_TEXTPERSP,    1, tp_names,    "G_MDSFT_TEXTPERSP" },
+    { G_MDSFT_TEXTDETAIL,   2, td_names,    "G_MDSFT_TEXTDETAIL" },
+    { G_MDSFT_TEXTLOD,      1, tl_names,    "G_MDSFT_TEXTLOD" },
+    { G_MDSFT_TEXTLUT,      2, tt_names,    "G_MDSFT_TEXTLUT" },
+    { G_MDSFT_TEXTFILT,     2, tf_names,    "G_MDSFT_TEXTFILT" },
+    { G_MDSFT_TEXTCONV,     3, tc_names,    "G_MDSFT_TEXTCONV" },
+    { G_MDSFT_COMBKEY,      1, ck_names,    "G_MDSFT_COMBKEY" },
+    { G_MDSFT_RGBDITHER,    2, cd_names,    "G_MDSFT_RGBDITHER" },
+    { G_MDSFT_ALPHADITHER,  2, ad_names,    "G_MDSFT_ALPHADITHER" },
+    { G_MDSFT_BLENDMASK,    4, nullptr,     "G_MDSFT_BLENDMASK" },
+};
+
+// The render mode flags in the order the RM_ macros list them, the blender follows
+static const mode_field_t mode_l_fields[] = {
+    { G_MDSFT_ALPHACOMPARE, 2, ac_names,    "G_MDSFT_ALPHACOMPARE" },
+    { G_MDSFT_ZSRCSEL,      1, zs_names,    "G_MDSFT_ZSRCSEL" },
+    {  3, 1, AA_EN_names,           nullptr },
+    {  4, 1, Z_CMP_names,           nullptr },
+    {  5, 1, Z_UPD_names,           nullptr },
+    {  6, 1, IM_RD_names,           nullptr },
+    {  7, 1, CLR_ON_CVG_names,      nullptr },
+    {  8, 2, cvg_dst_names,         nullptr },
+    { 10, 2, zmode_names,           nullptr },
+    { 12, 1, CVG_X_ALPHA_names,     nullptr },
+    { 13, 1, ALPHA_CVG_SEL_names,   nullptr },
+    { 14, 1, FORCE_BL_names,        nullptr },
+    { 15, 1, nullptr,               nullptr },  // was TEX_EDGE
+};
+
+// Blender inputs of GBL_c1 and GBL_c2: 1st and 2nd color, 1st and 2nd alpha
+static const char* const bl_clr_names[4] = { "G_BL_CLR_IN", "G_BL_CLR_MEM", "G_BL_CLR_BL", "G_BL_CLR_FOG" };
+static const char* const bl_a_names[4] = { "G_BL_A_IN", "G_BL_A_FOG", "G_BL_A_SHADE", "G_BL_0" };
+static const char* const bl_b_names[4] = { "G_BL_1MA", "G_BL_A_MEM", "G_BL_1", "G_BL_0" };
+
+static void
+append_mode (std::string& out, uint32_t mode, const mode_field_t* fields, size_t num_fields)
+{
+    size_t start = out.size();
+    for (size_t i = 0; i < num_fields; i++) {
+        const mode_field_t& f = fields[i];
+        uint32_t v = (mode >> f.shift) & field_mask(f.bits);
+        const char* name = (f.names != nullptr) ? f.names[v] : nullptr;
+        if (name == nullptr && v == 0)
+            continue;
+
+        if (out.size() != start)
+            out += " | ";
+        if (name != nullptr) {
+            out += name;
+        } else if (f.shift_name != nullptr) {
+            out += '(';
+            append_dec(out, v);
+            out += " << ";
+            out += f.shift_name;
+            out += ')';
+        } else {
+            append_hex(out, v << f.shift, 4);
+        }
+    }
+    if (out.size() == start)
+        out += '0';
+}
+
+static void
+append_mode_l (std::string& out, uint32_t mode)
+{
+    append_mode(out, mode, mode_l_fields, sizeof(mode_l_fields) / sizeof(mode_l_fields[0]));
+
+    // GBL_c1 packs its inputs at 30, 26, 22, 18 and GBL_c2 at 28, 24, 20, 16
+    static const char* const* const inputs[4] = { bl_clr_names, bl_a_names, bl_clr_names, bl_b_names };
+    for (unsigned cycle = 1; cycle <= 2; cycle++) {
+        out += (cycle == 1) ? " | GBL_c1(" : " | GBL_c2(";
+        for (unsigned i = 0; i < 4; i++) {
+            if (i != 0)
+                out += ", ";
+            out += inputs[i][(mode >> (32 - 2 * cycle - 4 * i)) & 3];
+        }
+        out += ')';
+    }
+}
+
+static void
+append_field (std::string& out, const gfx_field_t& f, uint32_t v, uint32_t prev, std::string& comment)
+{
+    switch (f.format) {
+        case FMT_DEC:
+            append_dec(out, v);
+            break;
+        case FMT_SDEC:
+            append_sdec(out, sign_extend(v, f.bits + f.lo_bits));
+            break;
+        case FMT_HEX:
+            append_hex(out, v, (f.bits + f.lo_bits + 3) / 4);
+            break;
+        case FMT_PLUS1:
+            append_dec(out, (uint64_t)v + 1);
+            break;
+        case FMT_NAME:
+            if (f.names[v] != nullptr)
+                out += f.names[v];
+            else
+                append_dec(out, v);
+            break;
+        case FMT_FRAC:
+            append_hex(out, v, 4);
+            // The value of the pair, named without the _f
+            comment.append(f.name, strlen(f.name) - 2);
+            comment += ' ';
+            append_fixed(comment, (int32_t)((prev << 16) | v), 16);
+            break;
+        case FMT_QU102:
+            append_fixed_macro(out, "qu102", v, 2);
+            break;
+        case FMT_QS105:
+            append_fixed_macro(out, "qs105", sign_extend(v, 16), 5);
+            break;
+        case FMT_QS510:
+            append_fixed_macro(out, "qs510", sign_extend(v, 16), 10);
+            break;
+        case FMT_QS132:
+            append_fixed_macro(out, "qs132", sign_extend(v, f.bits), 2);
+            break;
+        case FMT_QS1616:
+            append_fixed_macro(out, "qs1616", sign_extend(v, 32), 16);
+            break;
+        case FMT_MODE_H:
+            append_mode(out, v, mode_h_fields, sizeof(mode_h_fields) / sizeof(mode_h_fields[0]));
+            break;
+        case FMT_MODE_L:
+            append_mode_l(out, v);
+            break;
+    }
+}
+
+void
+gfx_reencode (const uint32_t* words, uint32_t* out)
+{
+    const gfx_command_t* cmd = find_command(words[0]);
+    if (cmd == nullptr) {
+        out[0] = words[0];
+        out[1] = words[1];
+        return;
+    }
+
+    memset(out, 0, 8 * command_length(cmd));
+    out[0] = (uint32_t)cmd->opcode << 24;
+    size_t base = 0;
+    for (const gfx_block_t* block : cmd->blocks) {
+        if (block == nullptr)
+            break;
+        for (size_t i = 0; i < block->num_fields; i++)
+            field_store(out + base, block->fields[i], field_value(words + base, block->fields[i]));
+        base += 2 * block->length;
+    }
+}
+
+size_t
+gfx_disasm (const uint32_t* words, size_t num_gfx, std::string& out, const char* indent)
+{
+    if (num_gfx == 0)
+        return 0;
+
+    const gfx_command_t* cmd = find_command(words[0]);
+    if (cmd == nullptr) {
+        // A raw initializer still reproduces it
+        out += "{ ";
+        append_hex(out, words[0], 8);
+        out += ", ";
+        append_hex(out, words[1], 8);
+        out += " }, // unknown command ";
+        append_hex(out, words[0] >> 24, 2);
+        return 1;
+    }
+
+    size_t length = command_length(cmd);
+    if (length > num_gfx)
+        return 0;
+
+    out += cmd->macro;
+    out += '(';
+    std::string comment;
+    bool first = true;
+    uint32_t prev = 0;
+    size_t base = 0;
+    for (const gfx_block_t* block : cmd->blocks) {
+        if (block == nullptr)
+            break;
+        for (size_t i = 0; i < block->num_fields; i++) {
+            const gfx_field_t& f = block->fields[i];
+            if (!first)
+                out += ',';
+            if (f.new_line) {
+                if (!comment.empty()) {
+                    out += " // ";
+                    out += comment;
+                    comment.clear();
+                }
+                out += '\n';
+                out += indent;
+            } else if (!first) {
+                out += ' ';
+            }
+            first = false;
+
+            uint32_t v = field_value(words + base, f);
+            append_field(out, f, v, prev, comment);
+            prev = v;
+        }
+        base += 2 * block->length;
+    }
+    out += "),";
+
+    // Bits outside every field, which the macro cannot reproduce
+    uint32_t rebuilt[2 * MAX_COMMAND_GFX];
+    gfx_reencode(words, rebuilt);
+    for (size_t i = 0; i < 2 * length; i++) {
+        if (rebuilt[i] == words[i])
+            continue;
+        if (!comment.empty())
+            comment += ", ";
+        comment += "bits ";
+        append_hex(comment, rebuilt[i] ^ words[i], 8);
+        comment += " of word ";
+        append_dec(comment, i);
+        comment += " not reproduced";
+    }
+    if (!comment.empty()) {
+        out += " // ";
+        out += comment;
+    }
+    return length;
+}
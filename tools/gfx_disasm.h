@@ -0,0 +1,48 @@
+/**
+ * Table-driven disassembly of RDP display lists back into the gs* macros of src/rdp.h
+ */
+#ifndef GFX_DISASM_H_
+#define GFX_DISASM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Length in Gfx (64-bit commands) of the command whose first word is w0
+ */
+size_t
+gfx_command_length (uint32_t w0);
+
+/**
+ * Opcode of the command whose first word is w0 as the G_ constant of src/rdp.h,
+ * whichever top two bits it was written with, or its 6 opcode bits if unknown
+ */
+unsigned
+gfx_opcode (uint32_t w0);
+
+/**
+ * Macro name of the command whose first word is w0, nullptr if unknown
+ */
+const char*
+gfx_command_name (uint32_t w0);
+
+/**
+ * Appends the gs* macro call that reproduces the command at `words` (w0, w1
+ * pairs in host byte order, `num_gfx` Gfx available), followed by a comma.
+ * Long calls continue on new lines starting with `indent`. Returns the number
+ * of Gfx the command takes, or 0 without appending anything if the command
+ * runs past the end.
+ */
+size_t
+gfx_disasm (const uint32_t* words, size_t num_gfx, std::string& out, const char* indent = "    ");
+
+/**
+ * Rebuilds the command at `words` from the fields the disassembly shows,
+ * writing gfx_command_length Gfx to `out`. Bits that differ from the input are
+ * ones no macro argument sets.
+ */
+void
+gfx_reencode (const uint32_t* words, uint32_t* out);
+
+#endif
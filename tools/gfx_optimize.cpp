@@ -0,0 +1,392 @@
+/**
+ * Removal of state changes and syncs a display list does not need
+ */
+#include "gfx_optimize.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "gfx_disasm.h"
+#include "gfx_state.h"
+#include "rdp.h"
+
+const char* const gfx_removal_names[GFX_NUM_REMOVALS] = {
+    "kept",
+    "redundant set",
+    "dead set",
+    "pipe sync",
+    "tile sync",
+    "load sync",
+};
+
+/*
+ * Commands sort into state sets, each writing one slot of the state, the
+ * commands that use the state (primitives and TMEM loads) and syncs
+ */
+
+enum kind_t {
+    KIND_OTHER,         // unknown, uses and changes everything
+    KIND_NOOP,
+    KIND_SET,
+    KIND_PRIMITIVE,
+    KIND_LOAD,
+    KIND_PIPE_SYNC,
+    KIND_TILE_SYNC,
+    KIND_LOAD_SYNC,
+    KIND_FULL_SYNC,
+};
+
+// Sync a state set needs after a primitive
+enum set_sync_t {
+    SET_SYNC_NONE,
+    SET_SYNC_PIPE,
+    SET_SYNC_TILE,
+};
+
+enum slot_t {
+    SLOT_CIMG,
+    SLOT_ZIMG,
+    SLOT_TIMG,
+    SLOT_COMBINE,
+    SLOT_ENVCOLOR,
+    SLOT_PRIMCOLOR,
+    SLOT_BLENDCOLOR,
+    SLOT_FOGCOLOR,
+    SLOT_FILLCOLOR,
+    SLOT_OTHERMODE,
+    SLOT_PRIMDEPTH,
+    SLOT_SCISSOR,
+    SLOT_CONVERT,
+    SLOT_KEYR,
+    SLOT_KEYGB,
+    SLOT_TILE,                      // 8 tile descriptors
+    SLOT_TILESIZE = SLOT_TILE + 8,  // and their sizes
+    NUM_SLOTS = SLOT_TILESIZE + 8
+};
+
+static const char* const slot_names[SLOT_TILE] = {
+    "color image",
+    "depth image",
+    "texture image",
+    "combine",
+    "env color",
+    "prim color",
+    "blend color",
+    "fog color",
+    "fill color",
+    "othermode",
+    "prim depth",
+    "scissor",
+    "convert",
+    "key R",
+    "key GB",
+};
+
+static std::string
+slot_name (int slot)
+{
+    if (slot < SLOT_TILE)
+        return slot_names[slot];
+    return std::string((slot < SLOT_TILESIZE) ? "tile " : "tile size ") + std::to_string((slot - SLOT_TILE) % 8);
+}
+
+struct command_info_t {
+    kind_t kind;
+    int slot;           // KIND_SET's slot, KIND_LOAD's tile size slot
+    set_sync_t sync;
+};
+
+static command_info_t
+classify (uint32_t w0, uint32_t w1)
+{
+    unsigned tile = (w1 >> 24) & 7;
+    switch (gfx_opcode(w0)) {
+        case G_NOOP:            return { KIND_NOOP, -1, SET_SYNC_NONE };
+        case G_SETCIMG:         return { KIND_SET, SLOT_CIMG, SET_SYNC_PIPE };
+        case G_SETZIMG:         return { KIND_SET, SLOT_ZIMG, SET_SYNC_PIPE };
+        case G_SETTIMG:         return { KIND_SET, SLOT_TIMG, SET_SYNC_NONE };
+        case G_SETCOMBINE:      return { KIND_SET, SLOT_COMBINE, SET_SYNC_PIPE };
+        case G_SETENVCOLOR:     return { KIND_SET, SLOT_ENVCOLOR, SET_SYNC_PIPE };
+        case G_SETPRIMCOLOR:    return { KIND_SET, SLOT_PRIMCOLOR, SET_SYNC_PIPE };
+        case G_SETBLENDCOLOR:   return { KIND_SET, SLOT_BLENDCOLOR, SET_SYNC_PIPE };
+        case G_SETFOGCOLOR:     return { KIND_SET, SLOT_FOGCOLOR, SET_SYNC_PIPE };
+        case G_SETFILLCOLOR:    return { KIND_SET, SLOT_FILLCOLOR, SET_SYNC_PIPE };
+        case G_RDPSETOTHERMODE: return { KIND_SET, SLOT_OTHERMODE, SET_SYNC_PIPE };
+        case G_SETPRIMDEPTH:    return { KIND_SET, SLOT_PRIMDEPTH, SET_SYNC_PIPE };
+        case G_SETSCISSOR:      return { KIND_SET, SLOT_SCISSOR, SET_SYNC_PIPE };
+        case G_SETCONVERT:      return { KIND_SET, SLOT_CONVERT, SET_SYNC_PIPE };
+        case G_SETKEYR:         return { KIND_SET, SLOT_KEYR, SET_SYNC_PIPE };
+        case G_SETKEYGB:        return { KIND_SET, SLOT_KEYGB, SET_SYNC_PIPE };
+        case G_SETTILE:         return { KIND_SET, (int)(SLOT_TILE + tile), SET_SYNC_TILE };
+        case G_SETTILESIZE:     return { KIND_SET, (int)(SLOT_TILESIZE + tile), SET_SYNC_TILE };
+        case G_LOADTILE:
+        case G_LOADBLOCK:
+        case G_LOADTLUT:        return { KIND_LOAD, (int)(SLOT_TILESIZE + tile), SET_SYNC_TILE };
+        case G_RDPPIPESYNC:     return { KIND_PIPE_SYNC, -1, SET_SYNC_NONE };
+        case G_RDPTILESYNC:     return { KIND_TILE_SYNC, -1, SET_SYNC_NONE };
+        case G_RDPLOADSYNC:     return { KIND_LOAD_SYNC, -1, SET_SYNC_NONE };
+        case G_RDPFULLSYNC:     return { KIND_FULL_SYNC, -1, SET_SYNC_NONE };
+        default:
+            if (gfx_is_primitive(w0))
+                return { KIND_PRIMITIVE, -1, SET_SYNC_NONE };
+            return { KIND_OTHER, -1, SET_SYNC_NONE };
+    }
+}
+
+static inline bool
+uses_state (kind_t kind)
+{
+    return kind == KIND_PRIMITIVE || kind == KIND_LOAD || kind == KIND_FULL_SYNC || kind == KIND_OTHER;
+}
+
+/*
+ * Syncs still waiting for a primitive: a state set of each class after a
+ * primitive needs its sync in between, and a load needs a load sync
+ */
+struct sync_tracker_t {
+    bool pipe = true, tile = true, load = true;
+    size_t hazards = 0;
+
+    void step (const command_info_t& c)
+    {
+        switch (c.kind) {
+            case KIND_PRIMITIVE:
+                pipe = tile = load = true;
+                break;
+            case KIND_SET:
+                hazards += (c.sync == SET_SYNC_PIPE && pipe) || (c.sync == SET_SYNC_TILE && tile);
+                break;
+            case KIND_LOAD:
+                hazards += load;
+                break;
+            case KIND_PIPE_SYNC:
+                pipe = false;
+                break;
+            case KIND_TILE_SYNC:
+                tile = false;
+                break;
+            case KIND_LOAD_SYNC:
+                load = false;
+                break;
+            case KIND_FULL_SYNC:
+                pipe = tile = load = false;
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+gfx_optimized_t
+gfx_optimize (const uint32_t* words, size_t num_gfx)
+{
+    gfx_optimized_t out;
+    std::vector<command_info_t> info;
+    size_t tail = num_gfx;      // start of a command cut short at the end, kept as is
+    for (size_t i = 0; i < num_gfx; ) {
+        size_t length = gfx_command_length(words[2 * i]);
+        if (i + length > num_gfx) {
+            tail = i;
+            break;
+        }
+        out.starts.push_back(i);
+        info.push_back(classify(words[2 * i], words[2 * i + 1]));
+        i += length;
+    }
+    size_t n = info.size();
+    out.removal.assign(n, GFX_KEPT);
+
+    // Dead sets, from the end: a set is dead if its slot is set again before anything uses it
+    bool live[NUM_SLOTS];
+    std::fill(live, live + NUM_SLOTS, true);
+    for (size_t k = n; k-- > 0; ) {
+        const command_info_t& c = info[k];
+        if (c.kind == KIND_SET) {
+            if (!live[c.slot])
+                out.removal[k] = GFX_DEAD_SET;
+            live[c.slot] = false;
+        } else if (uses_state(c.kind)) {
+            std::fill(live, live + NUM_SLOTS, true);
+        }
+    }
+
+    // Redundant sets among the rest, from the start
+    uint32_t value[NUM_SLOTS][2];
+    bool known[NUM_SLOTS] = {};
+    for (size_t k = 0; k < n; k++) {
+        const command_info_t& c = info[k];
+        const uint32_t* w = &words[2 * out.starts[k]];
+        if (out.removal[k] != GFX_KEPT)
+            continue;
+        if (c.kind == KIND_SET) {
+            if (known[c.slot] && value[c.slot][0] == w[0] && value[c.slot][1] == w[1]) {
+                out.removal[k] = GFX_REDUNDANT_SET;
+                continue;
+            }
+            value[c.slot][0] = w[0];
+            value[c.slot][1] = w[1];
+            known[c.slot] = true;
+        } else if (c.kind == KIND_LOAD) {
+            known[c.slot] = false;
+        } else if (c.kind == KIND_OTHER) {
+            std::fill(known, known + NUM_SLOTS, false);
+        }
+    }
+
+    // Whether a primitive comes after each command before anything its kind of sync protects
+    std::vector<uint8_t> prim_next(n);
+    bool pipe_prim = false, tile_prim = false, load_prim = false;
+    for (size_t k = n; k-- > 0; ) {
+        const command_info_t& c = info[k];
+        switch (c.kind) {
+            case KIND_PIPE_SYNC:
+                prim_next[k] = pipe_prim;
+                break;
+            case KIND_TILE_SYNC:
+                prim_next[k] = tile_prim;
+                break;
+            case KIND_LOAD_SYNC:
+                prim_next[k] = load_prim;
+                break;
+            default:
+                break;
+        }
+        if (out.removal[k] != GFX_KEPT)
+            continue;
+        if (c.kind == KIND_PRIMITIVE) {
+            pipe_prim = tile_prim = load_prim = true;
+        } else if (c.kind == KIND_OTHER || c.kind == KIND_FULL_SYNC) {
+            pipe_prim = tile_prim = load_prim = false;
+        } else if (c.kind == KIND_SET) {
+            pipe_prim &= c.sync != SET_SYNC_PIPE;
+            tile_prim &= c.sync != SET_SYNC_TILE;
+        } else if (c.kind == KIND_LOAD) {
+            tile_prim = load_prim = false;
+        }
+    }
+
+    sync_tracker_t pending;
+    for (size_t k = 0; k < n; k++) {
+        const command_info_t& c = info[k];
+        if (out.removal[k] != GFX_KEPT)
+            continue;
+        if (c.kind == KIND_PIPE_SYNC && (!pending.pipe || prim_next[k]))
+            out.removal[k] = GFX_PIPE_SYNC;
+        else if (c.kind == KIND_TILE_SYNC && (!pending.tile || prim_next[k]))
+            out.removal[k] = GFX_TILE_SYNC;
+        else if (c.kind == KIND_LOAD_SYNC && (!pending.load || prim_next[k]))
+            out.removal[k] = GFX_LOAD_SYNC;
+        else
+            pending.step(c);
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        if (out.removal[k] != GFX_KEPT)
+            continue;
+        size_t first = out.starts[k];
+        size_t last = (k + 1 < n) ? out.starts[k + 1] : tail;
+        out.words.insert(out.words.end(), &words[2 * first], &words[2 * last]);
+    }
+    out.words.insert(out.words.end(), &words[2 * tail], &words[2 * num_gfx]);
+    return out;
+}
+
+/*
+ * Walks a list from one command that uses the state to the next, keeping the
+ * value of every slot
+ */
+class state_cursor_t {
+public:
+    state_cursor_t (const uint32_t* words, size_t num_gfx)
+        : words_(words), num_gfx_(num_gfx)
+    {
+        memset(value_, 0, sizeof(value_));
+    }
+
+    // Next primitive, load, full sync or unknown command, nullptr at the end
+    const uint32_t* next (size_t& length)
+    {
+        while (i_ < num_gfx_) {
+            const uint32_t* w = &words_[2 * i_];
+            length = std::min(gfx_command_length(w[0]), num_gfx_ - i_);
+            i_ += length;
+            command_info_t c = classify(w[0], w[1]);
+            syncs.step(c);
+            if (c.kind == KIND_SET) {
+                value_[c.slot][0] = w[0];
+                value_[c.slot][1] = w[1];
+            } else if (uses_state(c.kind)) {
+                if (c.kind == KIND_LOAD) {
+                    value_[c.slot][0] = w[0];
+                    value_[c.slot][1] = w[1];
+                }
+                return w;
+            }
+        }
+        return nullptr;
+    }
+
+    bool same_state (const state_cursor_t& other, int& slot) const
+    {
+        for (slot = 0; slot < NUM_SLOTS; slot++)
+            if (value_[slot][0] != other.value_[slot][0] || value_[slot][1] != other.value_[slot][1])
+                return false;
+        return true;
+    }
+
+    size_t offset () const { return 8 * i_; }
+
+    sync_tracker_t syncs;
+
+private:
+    const uint32_t* words_;
+    size_t num_gfx_;
+    size_t i_ = 0;
+    uint32_t value_[NUM_SLOTS][2];
+};
+
+gfx_state_check_t
+gfx_compare_state (const uint32_t* a, size_t num_a, const uint32_t* b, size_t num_b)
+{
+    gfx_state_check_t res;
+    state_cursor_t ca(a, num_a), cb(b, num_b);
+    char text[200];
+
+    for (;;) {
+        size_t len_a = 0, len_b = 0;
+        const uint32_t* wa = ca.next(len_a);
+        const uint32_t* wb = cb.next(len_b);
+        if (wa == nullptr || wb == nullptr) {
+            if (wa != wb) {
+                snprintf(text, sizeof(text), "the %s list has more primitives, after %zu",
+                         (wa != nullptr) ? "first" : "second", res.primitives);
+                res.error = text;
+            }
+            break;
+        }
+        if (len_a != len_b || memcmp(wa, wb, 8 * len_a) != 0) {
+            snprintf(text, sizeof(text), "command %zu differs, at 0x%zX and 0x%zX",
+                     res.primitives, ca.offset() - 8 * len_a, cb.offset() - 8 * len_b);
+            res.error = text;
+            break;
+        }
+        int slot;
+        if (!ca.same_state(cb, slot)) {
+            snprintf(text, sizeof(text), "%s differs at %s, at 0x%zX and 0x%zX", slot_name(slot).c_str(),
+                     gfx_command_name(wa[0]) ? gfx_command_name(wa[0]) : "an unknown command",
+                     ca.offset() - 8 * len_a, cb.offset() - 8 * len_b);
+            res.error = text;
+            break;
+        }
+        res.primitives++;
+    }
+
+    int slot;
+    if (res.error.empty() && !ca.same_state(cb, slot)) {
+        snprintf(text, sizeof(text), "%s differs at the end", slot_name(slot).c_str());
+        res.error = text;
+    }
+    res.hazards_before = ca.syncs.hazards;
+    res.hazards_after = cb.syncs.hazards;
+    return res;
+}
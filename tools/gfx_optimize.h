@@ -0,0 +1,59 @@
+/**
+ * Removal of state changes and syncs a display list does not need
+ */
+#ifndef GFX_OPTIMIZE_H_
+#define GFX_OPTIMIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * What happens to each command of the list
+ */
+enum gfx_removal_t {
+    GFX_KEPT,
+    GFX_REDUNDANT_SET,      // sets the value the state already has
+    GFX_DEAD_SET,           // overwritten before anything uses it
+    GFX_PIPE_SYNC,
+    GFX_TILE_SYNC,
+    GFX_LOAD_SYNC,
+    GFX_NUM_REMOVALS
+};
+
+extern const char* const gfx_removal_names[GFX_NUM_REMOVALS];
+
+struct gfx_optimized_t {
+    std::vector<size_t> starts;         // Gfx index of each command of the input
+    std::vector<uint8_t> removal;       // gfx_removal_t of each command
+    std::vector<uint32_t> words;        // the kept commands, w0 and w1 of each Gfx
+};
+
+/**
+ * Drops state sets that are redundant or dead, which also leaves only the last
+ * of consecutive writes to the same state, then syncs that have no primitive
+ * to wait for or no state change after them to protect. The state at the end
+ * of the list counts as used and the list is assumed to start right after
+ * primitives, so lists can still be chained. Commands this does not know are
+ * kept and treated as using and changing everything.
+ */
+gfx_optimized_t
+gfx_optimize (const uint32_t* words, size_t num_gfx);
+
+struct gfx_state_check_t {
+    size_t primitives = 0;      // primitives and loads compared
+    size_t hazards_before = 0;  // state changes after a primitive without their sync
+    size_t hazards_after = 0;
+    std::string error;          // empty if the lists are equivalent
+};
+
+/**
+ * Decodes both lists and compares the primitives and loads they issue and the
+ * whole RDP state at each of them and at the end, and counts the state changes
+ * each makes without the sync they need
+ */
+gfx_state_check_t
+gfx_compare_state (const uint32_t* a, size_t num_a, const uint32_t* b, size_t num_b);
+
+#endif
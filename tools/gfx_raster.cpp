@@ -0,0 +1,219 @@
+/**
+ * Coverage of triangles and rectangles under the RDP's edge rules
+ *
+ * The edge walker steps the major edge (XH) and the minor edges (XM until YM,
+ * then XL) a quarter scanline at a time, with positions and steps cut to even
+ * 1/65536ths. On each subscanline inside [YH, YL) and the scissor, an edge is
+ * taken to a quarter pixel plus a sticky bit for any finer fraction, and
+ * clamped to the scissor; a subscanline whose edges cross at that precision
+ * is dropped, and so is a line whose subscanlines are all left or all right of
+ * the scissor. The span walker then goes from the leftmost to the rightmost
+ * pixel any subscanline reaches, and a pixel gets coverage if one of the two
+ * samples its subscanlines have in it, at alternating quarter pixel columns,
+ * lies between the edges. Fill and copy mode draw every pixel of the span, the
+ * pixel the right edge is in included, up to the scissor.
+ *
+ * The four subscanlines of a scanline are the lanes of one vector (GCC vector
+ * extensions, SSE2 or NEON code), so a scanline costs a few vector operations
+ * and a merge of at most four intervals.
+ */
+#include "gfx_raster.h"
+
+#include <algorithm>
+#include <climits>
+
+#include "gfx_disasm.h"
+#include "rdp.h"
+#include "rdram_sim.h"
+
+typedef int32_t v4i __attribute__((vector_size(16)));
+typedef uint32_t v4u __attribute__((vector_size(16)));
+
+static inline int32_t
+sign_extend (uint32_t v, unsigned bits)
+{
+    return (int32_t)(v << (32 - bits)) >> (32 - bits);
+}
+
+bool
+gfx_edges_decode (const gfx_state_t& state, const uint32_t* words, gfx_edges_t& edges)
+{
+    unsigned op = gfx_opcode(words[0]);
+    edges = gfx_edges_t();
+    edges.whole_pixels = state.fill_or_copy();
+
+    if (op == G_FILLRECT || op == G_TEXRECT || op == G_TEXRECTFLIP) {
+        // A rectangle is a left-major triangle with vertical edges, fill and
+        // copy mode reaching the last subscanline of the lower edge's line
+        unsigned lrx = (words[0] >> 12) & 0xFFF, lry = words[0] & 0xFFF;
+        unsigned ulx = (words[1] >> 12) & 0xFFF, uly = words[1] & 0xFFF;
+        edges.left_major = true;
+        edges.yh = uly;
+        edges.ym = edges.yl = lry | (edges.whole_pixels ? 3 : 0);
+        edges.xh = ulx << 14;
+        edges.xm = edges.xl = lrx << 14;
+        return true;
+    }
+    if (op < G_TRI_FILL || op > G_TRI_SHADE_TXTR_ZBUFF)
+        return false;
+
+    edges.left_major = (words[0] >> 23) & 1;
+    edges.yl = sign_extend(words[0], 14);
+    edges.ym = sign_extend(words[1] >> 16, 14);
+    edges.yh = sign_extend(words[1], 14);
+    edges.xl = (int32_t)words[2];
+    edges.dxldy = (int32_t)words[3];
+    edges.xh = (int32_t)words[4];
+    edges.dxhdy = (int32_t)words[5];
+    edges.xm = (int32_t)words[6];
+    edges.dxmdy = (int32_t)words[7];
+    return true;
+}
+
+static inline v4i
+select (v4i mask, v4i a, v4i b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+// Edge positions in eighths of a pixel: whole quarters, and the sticky bit
+static inline v4i
+eighths (v4i x)
+{
+    return (x >> 14) * 2 - ((x & 0x3FFE) != 0);
+}
+
+// Whether every lane of `lanes` has `mask` set
+static inline bool
+all_of (v4i mask, v4i lanes)
+{
+    v4i miss = lanes & ~mask;
+    return (miss[0] | miss[1] | miss[2] | miss[3]) == 0;
+}
+
+// RDRAM rows of the pixels [x0, x1) that start `pixel` pixels into an image of G_IM_SIZ_ `siz` at `base`
+static inline uint64_t
+rows_touched (uint32_t base, uint64_t pixel, unsigned x0, unsigned x1, unsigned siz)
+{
+    uint64_t first = base + (((pixel + x0) << siz) >> 1);
+    uint64_t last = base + ((((pixel + x1) << siz) + 1) >> 1) - 1;
+    return (last >> RDRAM_ROW_SHIFT) - (first >> RDRAM_ROW_SHIFT) + 1;
+}
+
+gfx_raster_t
+gfx_rasterize (const gfx_state_t& state, const gfx_edges_t& e, std::vector<fill_span_t>* spans)
+{
+    gfx_raster_t r;
+    bool depth = !e.whole_pixels && (state.mode_lo & (Z_CMP | Z_UPD)) != 0;
+
+    auto emit = [&] (unsigned y, unsigned x0, unsigned x1, unsigned pixels) {
+        if (r.spans == 0) {
+            r.x0 = x0;
+            r.x1 = x1;
+            r.y0 = y;
+        }
+        r.x0 = std::min(r.x0, x0);
+        r.x1 = std::max(r.x1, x1);
+        r.y1 = y + 1;
+        r.spans++;
+        r.pixels += pixels;
+        r.segments += (x1 - 1) / FILL_SEGMENT_PIXELS - x0 / FILL_SEGMENT_PIXELS + 1;
+        uint64_t line = (uint64_t)y * state.cimg_width;
+        r.color_rows += rows_touched(state.cimg_addr, line, x0, x1, state.cimg_siz);
+        if (depth)
+            r.depth_rows += rows_touched(state.zimg_addr, line, x0, x1, G_IM_SIZ_16b);
+        if (spans != nullptr)
+            spans->push_back({ y, x0, x1 });
+    };
+
+    // Scissor in eighths of a pixel and quarter scanlines
+    int32_t clip_l = 2 * state.sc_ulx, clip_r = 2 * state.sc_lrx;
+    int32_t ky0 = std::max<int32_t>(e.yh, state.sc_uly), ky1 = std::min<int32_t>(e.yl, state.sc_lry);
+    if (ky1 <= ky0 || clip_r <= clip_l)
+        return r;
+
+    // The walk starts on the first subscanline of YH's line, XL takes over at YM
+    int32_t top = e.yh & ~3;
+    uint32_t step_h = (uint32_t)((e.dxhdy >> 2) & ~1);
+    uint32_t step_m = (uint32_t)((e.dxmdy >> 2) & ~1);
+    uint32_t step_l = (uint32_t)((e.dxldy >> 2) & ~1);
+    v4i low_edge = (e.ym >= top) ? v4i{ -1, -1, -1, -1 } : v4i{};
+
+    int32_t first = ky0 >> 2, last = (ky1 - 1) >> 2;
+    v4i k = 4 * first + v4i{ 0, 1, 2, 3 };
+    v4u major = (uint32_t)(e.xh & ~1) + (v4u)(k - top) * step_h;
+    v4u mid = (uint32_t)(e.xm & ~1) + (v4u)(k - top) * step_m;
+    v4u low = (uint32_t)(e.xl & ~1) + (v4u)(k - e.ym) * step_l;
+
+    for (int32_t y = first; y <= last; y++, k += 4, major += 4 * step_h, mid += 4 * step_m, low += 4 * step_l) {
+        v4i in_y = (k >= ky0) & (k < ky1);
+        v4i xj = (v4i)major;
+        v4i xn = select((k >= e.ym) & low_edge, (v4i)low, (v4i)mid);
+
+        v4i crossed = e.left_major ? ((xn >> 14) < (xj >> 14)) : ((xn >> 14) > (xj >> 14));
+        v4i ok = in_y & ~crossed;
+        v4i xj8 = eighths(xj), xn8 = eighths(xn);
+        if (all_of((xj8 >= clip_r) & (xn8 >= clip_r), in_y) || all_of((xj8 < clip_l) & (xn8 < clip_l), in_y))
+            continue;
+        xj8 = select(xj8 < clip_l, v4i{} + clip_l, select(xj8 >= clip_r, v4i{} + clip_r, xj8));
+        xn8 = select(xn8 < clip_l, v4i{} + clip_l, select(xn8 >= clip_r, v4i{} + clip_r, xn8));
+        v4i left = e.left_major ? xj8 : xn8, right = e.left_major ? xn8 : xj8;
+
+        // Pixels the span walker goes over, and the first and last with a sample between the edges
+        v4i walk_l = select(ok, left >> 3, v4i{} + INT32_MAX);
+        v4i walk_r = select(ok, right >> 3, v4i{} + INT32_MIN);
+        // a and b are the pixels whose sample at eighth `column` or `column + 4` is inside
+        v4i column = (k & 1) * 2;
+        v4i a_l = (left - column + 7) >> 3, a_r = (right - column - 1) >> 3;
+        v4i b_l = (left - column + 3) >> 3, b_r = (right - column - 5) >> 3;
+        v4i has_a = a_l <= a_r, has_b = b_l <= b_r;
+        v4i cov_l = select(has_b, b_l, a_l), cov_r = select(has_a, a_r, b_r);
+        v4i covered = ok & (has_a | has_b);
+
+        int32_t lx = std::min(std::min(walk_l[0], walk_l[1]), std::min(walk_l[2], walk_l[3]));
+        int32_t rx = std::max(std::max(walk_r[0], walk_r[1]), std::max(walk_r[2], walk_r[3]));
+        if (lx > rx)
+            continue;
+
+        if (e.whole_pixels) {
+            int32_t end = std::min(rx + 1, clip_r >> 3);
+            if (end > lx) {
+                r.processed += end - lx;
+                emit(y, lx, end, end - lx);
+            }
+            continue;
+        }
+        r.processed += rx - lx + 1;
+
+        // Union of the subscanlines' covered pixels, sorted by their first
+        int32_t from[4], to[4];
+        int n = 0;
+        for (int i = 0; i < 4; i++) {
+            if (!covered[i])
+                continue;
+            int j = n++;
+            for (; j > 0 && from[j - 1] > cov_l[i]; j--) {
+                from[j] = from[j - 1];
+                to[j] = to[j - 1];
+            }
+            from[j] = cov_l[i];
+            to[j] = cov_r[i];
+        }
+        if (n == 0)
+            continue;
+        int32_t pixels = 0, run_from = from[0], run_to = to[0], hull_to = to[0];
+        for (int i = 1; i < n; i++) {
+            if (from[i] > run_to + 1) {
+                pixels += run_to - run_from + 1;
+                run_from = from[i];
+                run_to = to[i];
+            } else {
+                run_to = std::max(run_to, to[i]);
+            }
+            hull_to = std::max(hull_to, to[i]);
+        }
+        pixels += run_to - run_from + 1;
+        emit(y, from[0], hull_to + 1, pixels);
+    }
+    return r;
+}
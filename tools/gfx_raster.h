@@ -0,0 +1,69 @@
+/**
+ * Coverage of triangles and rectangles under the RDP's edge rules
+ */
+#ifndef GFX_RASTER_H_
+#define GFX_RASTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fill_model.h"
+#include "gfx_state.h"
+
+/**
+ * What the edge walker starts from: the fields of a triangle command, or
+ * those the RDP makes up for a rectangle
+ */
+struct gfx_edges_t {
+    bool left_major = false;    // lft, the major edge XH is on the left
+    bool whole_pixels = false;  // fill and copy mode: every pixel of the span, lower right edge included
+    int32_t yh = 0, ym = 0, yl = 0;                 // s11.2, quarter scanlines
+    int32_t xh = 0, xm = 0, xl = 0;                 // s15.16
+    int32_t dxhdy = 0, dxmdy = 0, dxldy = 0;        // s15.16 per scanline
+};
+
+/**
+ * Edges of the triangle or rectangle at `words` (w0, w1 pairs in host byte
+ * order): YL in w0, YM and YH in w1, as the RDP reads them. Returns false if
+ * the command is not a primitive.
+ */
+bool
+gfx_edges_decode (const gfx_state_t& state, const uint32_t* words, gfx_edges_t& edges);
+
+/**
+ * What rasterizing a primitive touches. Spans are the pixels that get
+ * coverage on each line; the walker also steps over the partly covered pixel
+ * at the end of the span, which `processed` counts. Row touches are, per span,
+ * the 0x800 byte RDRAM rows its pixels are in.
+ */
+struct gfx_raster_t {
+    uint64_t spans = 0;
+    uint64_t pixels = 0;
+    uint64_t processed = 0;
+    uint64_t segments = 0;      // FILL_SEGMENT_PIXELS aligned groups a span touches
+    uint64_t color_rows = 0;
+    uint64_t depth_rows = 0;    // with a depth compare or update
+    // Bounding box of the spans, [x0, x1) x [y0, y1), empty without spans
+    unsigned x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+    void add (const gfx_raster_t& other)
+    {
+        spans += other.spans;
+        pixels += other.pixels;
+        processed += other.processed;
+        segments += other.segments;
+        color_rows += other.color_rows;
+        depth_rows += other.depth_rows;
+    }
+};
+
+/**
+ * Walks `edges` in the scissor of `state` a scanline at a time, its four
+ * subscanlines together as vector lanes, and counts what the spans touch.
+ * Spans are appended to `spans` unless it is null.
+ */
+gfx_raster_t
+gfx_rasterize (const gfx_state_t& state, const gfx_edges_t& edges, std::vector<fill_span_t>* spans);
+
+#endif
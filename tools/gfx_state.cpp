@@ -0,0 +1,132 @@
+/**
+ * RDP state tracking over a display list and the pixels each primitive covers
+ */
+#include "gfx_state.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "gfx_disasm.h"
+#include "gfx_raster.h"
+#include "rdp.h"
+#include "results_io.h"
+
+std::vector<uint32_t>
+gfx_load (const char* path, size_t offset)
+{
+    mapped_file_t file(path);
+    if (offset > file.size())
+        fatal("Offset 0x%zX is past the end of %s", offset, path);
+    size_t num_gfx = (file.size() - offset) / 8;
+    if ((file.size() - offset) % 8 != 0)
+        fprintf(stderr, "Warning: ignoring %zu bytes after the last whole Gfx\n", (file.size() - offset) % 8);
+
+    std::vector<uint32_t> words(2 * num_gfx);
+    const unsigned char* p = (const unsigned char*)file.begin() + offset;
+    for (size_t i = 0; i < words.size(); i++, p += 4)
+        words[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    return words;
+}
+
+bool
+gfx_state_apply (gfx_state_t& state, const uint32_t* words)
+{
+    uint32_t w0 = words[0], w1 = words[1];
+    switch (gfx_opcode(w0)) {
+        case G_SETCIMG:
+            state.cimg_siz = (w0 >> 19) & 3;
+            state.cimg_width = (w0 & 0xFFF) + 1;
+            state.cimg_addr = w1;
+            return true;
+        case G_SETZIMG:
+            state.zimg_addr = w1;
+            return true;
+        case G_RDPSETOTHERMODE:
+            state.mode_hi = w0 & 0xFFFFFF;
+            state.mode_lo = w1;
+            return true;
+        case G_SETPRIMDEPTH:
+            state.prim_z = w1 >> 16;
+            return true;
+        case G_SETSCISSOR:
+            state.sc_ulx = (w0 >> 12) & 0xFFF;
+            state.sc_uly = w0 & 0xFFF;
+            state.sc_lrx = (w1 >> 12) & 0xFFF;
+            state.sc_lry = w1 & 0xFFF;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool
+gfx_is_primitive (uint32_t w0)
+{
+    unsigned op = gfx_opcode(w0);
+    return op == G_FILLRECT || op == G_TEXRECT || op == G_TEXRECTFLIP || (op >= G_TRI_FILL && op <= G_TRI_SHADE_TXTR_ZBUFF);
+}
+
+// Depth at the three vertices of the triangle at `words`, from its depth coefficients
+static void
+triangle_depth (const uint32_t* words, const gfx_edges_t& e, gfx_prim_t& prim)
+{
+    double yh = e.yh / 4.0, ym = e.ym / 4.0, yl = e.yl / 4.0;
+    double xl = e.xl / 65536.0, dxldy = e.dxldy / 65536.0;
+    double xh = e.xh / 65536.0, dxhdy = e.dxhdy / 65536.0;
+    double xm = e.xm / 65536.0, dxmdy = e.dxmdy / 65536.0;
+
+    // XH and XM are given at the top of the scanline YH is on, XL at YM
+    double top = floor(yh);
+    auto major = [&] (double y) { return xh + dxhdy * (y - top); };
+    auto minor = [&] (double y) { return (y < ym) ? xm + dxmdy * (y - top) : xl + dxldy * (y - ym); };
+
+    // Depth coefficients are the last two Gfx
+    const uint32_t* zc = words + 2 * (gfx_command_length(words[0]) - 2);
+    double z = (int32_t)zc[0], dzdx = (int32_t)zc[1], dzde = (int32_t)zc[2];
+    auto depth = [&] (double x, double y) { return z + dzde * (y - top) + dzdx * (x - major(y)); };
+    double zt = depth(major(yh), yh), zm = depth(minor(ym), ym), zb = depth(major(yl), yl);
+    prim.has_z = true;
+    prim.z_min = std::min({ zt, zm, zb });
+    prim.z_max = std::max({ zt, zm, zb });
+}
+
+void
+gfx_prim_decode (const gfx_state_t& state, const uint32_t* words, gfx_prim_t& prim)
+{
+    prim = gfx_prim_t();
+    gfx_edges_t edges;
+    if (!gfx_edges_decode(state, words, edges))
+        return;
+
+    gfx_raster_t raster = gfx_rasterize(state, edges, &prim.spans);
+    prim.pixels = raster.pixels;
+    prim.x0 = raster.x0;
+    prim.y0 = raster.y0;
+    prim.x1 = raster.x1;
+    prim.y1 = raster.y1;
+
+    unsigned op = gfx_opcode(words[0]);
+    bool rect = op == G_FILLRECT || op == G_TEXRECT || op == G_TEXRECTFLIP;
+    if (rect || (state.mode_lo & G_ZS_PRIM)) {
+        prim.has_z = true;
+        prim.z_min = prim.z_max = (double)state.prim_z * 65536;
+    } else if (words[0] & (1 << 24)) {
+        triangle_depth(words, edges, prim);
+    }
+}
+
+fill_config_t
+gfx_fill_config (const gfx_state_t& state)
+{
+    fill_config_t cfg;
+    cfg.width = state.cimg_width;
+    cfg.fb_addr = state.cimg_addr;
+    cfg.zb_addr = state.zimg_addr;
+    cfg.two_cycle = state.cycle_type() == 1;
+    cfg.fill_mode = state.fill_or_copy();
+    cfg.color_read = (state.mode_lo & IM_RD) != 0;
+    cfg.depth_read = (state.mode_lo & Z_CMP) != 0;
+    cfg.depth_write = (state.mode_lo & Z_UPD) != 0;
+    return cfg;
+}
@@ -0,0 +1,79 @@
+/**
+ * RDP state tracking over a display list and the pixels each primitive covers
+ */
+#ifndef GFX_STATE_H_
+#define GFX_STATE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fill_model.h"
+
+/**
+ * State the display list sets that affects how primitives are drawn
+ */
+struct gfx_state_t {
+    uint32_t cimg_addr = 0;
+    unsigned cimg_width = 320;
+    unsigned cimg_siz = 2;          // G_IM_SIZ_16b
+    uint32_t zimg_addr = 0;
+    uint32_t mode_hi = 0;           // othermode bits 55..32
+    uint32_t mode_lo = 0;
+    uint16_t prim_z = 0;
+    // 10.2 fixed point, [ul, lr)
+    unsigned sc_ulx = 0, sc_uly = 0, sc_lrx = 4 * 1024, sc_lry = 4 * 1024;
+
+    unsigned cycle_type () const { return (mode_hi >> 20) & 3; }
+    bool fill_or_copy () const { return cycle_type() >= 2; }
+};
+
+/**
+ * Big-endian Gfx from byte `offset` of the file at `path` as host order
+ * words, w0 and w1 of each. Bytes after the last whole Gfx are left out with a
+ * warning.
+ */
+std::vector<uint32_t>
+gfx_load (const char* path, size_t offset);
+
+/**
+ * Updates `state` for the command at `words` (w0, w1 pairs in host byte
+ * order). Returns false if the command is not one of the tracked ones.
+ */
+bool
+gfx_state_apply (gfx_state_t& state, const uint32_t* words);
+
+/**
+ * Whether the command whose first word is w0 draws pixels
+ */
+bool
+gfx_is_primitive (uint32_t w0);
+
+/**
+ * Pixels the primitive at `words` covers in `state`
+ */
+struct gfx_prim_t {
+    std::vector<fill_span_t> spans;
+    uint64_t pixels = 0;
+    // Bounding box in pixels, [x0, x1) x [y0, y1)
+    unsigned x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    // Depth range over the primitive as 15.16, valid if has_z
+    bool has_z = false;
+    double z_min = 0, z_max = 0;
+};
+
+/**
+ * Spans of the primitive at `words` in the scissor, as gfx_rasterize() finds
+ * them
+ */
+void
+gfx_prim_decode (const gfx_state_t& state, const uint32_t* words, gfx_prim_t& prim);
+
+/**
+ * Fill model configuration for drawing with `state`, addresses and all, minus
+ * the primitive's pixels
+ */
+fill_config_t
+gfx_fill_config (const gfx_state_t& state);
+
+#endif
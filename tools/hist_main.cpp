@@ -0,0 +1,186 @@
+/**
+ * Exact per-cycle histograms of the BUF and PIPE counters for every spec of
+ * one or more results files, reporting the modes of each distribution and
+ * their weights. Multimodal timings (e.g. from VI interference) are hidden
+ * by the min/average/max summary of analyze.py.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "histogram.h"
+#include "parallel.h"
+#include "results_io.h"
+#include "stats.h"
+
+struct options_t {
+    mode_params_t mode_params;
+    unsigned text_width = 64;
+    const char* png_dir = nullptr;
+    unsigned png_width = 640;
+    unsigned png_height = 160;
+    bool raw = false;
+    bool multimodal_only = false;
+};
+
+struct task_t {
+    size_t file;
+    const spec_result_t* res;
+    std::string out;
+    bool multimodal;
+};
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] RESULTS...\n"
+            "\n"
+            "Options:\n"
+            "  -b CYCLES   Smoothing bandwidth for mode detection (default: from the data)\n"
+            "  -w WEIGHT   Smallest fraction of samples reported as a separate mode (default 0.02)\n"
+            "  -d DIP      Merge peaks unless the density between them falls below DIP of the\n"
+            "              smaller peak (default 0.8)\n"
+            "  -t WIDTH    Width of the text histogram, 0 to disable (default 64)\n"
+            "  -p DIR      Also write a PNG histogram for each spec and counter into DIR\n"
+            "  -r          Use all samples instead of pruning outliers as analyze.py does\n"
+            "  -m          Only list specs with a multimodal counter\n"
+            "  -j N        Worker threads (default: all cores)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+// File name without directories or extension, for naming PNGs
+static std::string
+file_stem (const char* path)
+{
+    std::string s(path);
+    size_t slash = s.find_last_of('/');
+    if (slash != std::string::npos)
+        s.erase(0, slash + 1);
+    size_t dot = s.find_last_of('.');
+    if (dot != std::string::npos && dot != 0)
+        s.erase(dot);
+    return s;
+}
+
+static bool
+describe_counter (std::string& out, const char* name, const std::vector<uint32_t>& samples,
+                  const options_t& opts, const std::string& png_path)
+{
+    std::vector<uint32_t> kept = opts.raw ? samples : pruned_samples(samples);
+    histogram_t hist = histogram_build(kept);
+    std::vector<hist_mode_t> modes = histogram_modes(hist, opts.mode_params);
+
+    char line[256];
+    if (hist.empty()) {
+        snprintf(line, sizeof(line), "    %-5s no samples\n", name);
+        out += line;
+        return false;
+    }
+
+    snprintf(line, sizeof(line), "    %-5s %zu mode%s, %zu distinct values over %u..%u:",
+             name, modes.size(), (modes.size() == 1) ? "" : "s", hist.values.size(), hist.lo(), hist.hi());
+    out += line;
+    for (const hist_mode_t& mode : modes) {
+        snprintf(line, sizeof(line), " %u (%.1f%%, %.7f ms, %u..%u)",
+                 mode.peak, 100.0 * mode.weight, rdp_clk_to_ms(mode.mean), mode.lo, mode.hi);
+        out += line;
+    }
+    out += '\n';
+
+    if (opts.text_width != 0) {
+        out += "          |";
+        out += histogram_sparkline(hist, opts.text_width);
+        out += "|\n";
+    }
+
+    if (!png_path.empty() && !histogram_write_png(png_path.c_str(), hist, modes, opts.png_width, opts.png_height))
+        fatal("Could not write %s", png_path.c_str());
+
+    return modes.size() > 1;
+}
+
+int
+main (int argc, char** argv)
+{
+    options_t opts;
+    unsigned num_threads = default_num_threads();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:w:d:t:p:rmj:")) != -1) {
+        switch (opt) {
+            case 'b':
+                opts.mode_params.bandwidth = atof(optarg);
+                break;
+            case 'w':
+                opts.mode_params.min_weight = atof(optarg);
+                break;
+            case 'd':
+                opts.mode_params.max_dip = atof(optarg);
+                break;
+            case 't':
+                opts.text_width = atoi(optarg);
+                break;
+            case 'p':
+                opts.png_dir = optarg;
+                break;
+            case 'r':
+                opts.raw = true;
+                break;
+            case 'm':
+                opts.multimodal_only = true;
+                break;
+            case 'j':
+                num_threads = std::max(1, atoi(optarg));
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind == argc)
+        usage(argv[0]);
+
+    if (opts.png_dir != nullptr)
+        mkdir(opts.png_dir, 0777);
+
+    std::vector<const char*> paths(argv + optind, argv + argc);
+    std::vector<std::vector<spec_result_t>> files;
+    std::vector<task_t> tasks;
+    for (const char* path : paths)
+        files.push_back(results_load(path));
+    for (size_t f = 0; f < files.size(); f++) {
+        for (const spec_result_t& res : files[f])
+            tasks.push_back(task_t{ f, &res, std::string(), false });
+    }
+
+    parallel_for(tasks.size(), num_threads, [&] (size_t i) {
+        task_t& task = tasks[i];
+        std::string png_buf, png_pipe;
+        if (opts.png_dir != nullptr) {
+            std::string base = std::string(opts.png_dir) + "/" + file_stem(paths[task.file]) +
+                               "_spec" + std::to_string(task.res->spec_id);
+            png_buf = base + "_buf.png";
+            png_pipe = base + "_pipe.png";
+        }
+
+        task.out = task.res->desc + '\n';
+        task.multimodal = describe_counter(task.out, "Buf:", task.res->buf, opts, png_buf);
+        task.multimodal |= describe_counter(task.out, "Pipe:", task.res->pipe, opts, png_pipe);
+    });
+
+    size_t num_multimodal = 0;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        if (paths.size() > 1 && (i == 0 || tasks[i - 1].file != tasks[i].file))
+            printf("%s== %s ==\n", (i == 0) ? "" : "\n", paths[tasks[i].file]);
+        num_multimodal += tasks[i].multimodal;
+        if (!opts.multimodal_only || tasks[i].multimodal)
+            fputs(tasks[i].out.c_str(), stdout);
+    }
+    fprintf(stderr, "%zu of %zu specs have a multimodal counter\n", num_multimodal, tasks.size());
+    return 0;
+}
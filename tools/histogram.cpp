@@ -0,0 +1,258 @@
+/**
+ * Exact cycle-count histograms and mode detection
+ */
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "png.h"
+
+histogram_t
+histogram_build (const std::vector<uint32_t>& samples)
+{
+    std::vector<uint32_t> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    histogram_t hist;
+    hist.total = sorted.size();
+    for (size_t i = 0; i < sorted.size(); ) {
+        size_t j = i;
+        while (j < sorted.size() && sorted[j] == sorted[i])
+            j++;
+        hist.values.push_back(sorted[i]);
+        hist.counts.push_back(j - i);
+        i = j;
+    }
+    return hist;
+}
+
+// Value at rank `k` (0-based) of the samples the histogram was built from
+static uint32_t
+histogram_rank (const histogram_t& hist, size_t k)
+{
+    for (size_t i = 0; i < hist.values.size(); i++) {
+        if (k < hist.counts[i])
+            return hist.values[i];
+        k -= hist.counts[i];
+    }
+    return hist.hi();
+}
+
+// Silverman's rule of thumb, never narrower than one cycle
+static double
+default_bandwidth (const histogram_t& hist)
+{
+    double n = hist.total;
+    double sum = 0, sum_sq = 0;
+    for (size_t i = 0; i < hist.values.size(); i++) {
+        double v = hist.values[i] - (double)hist.lo();
+        sum += v * hist.counts[i];
+        sum_sq += v * v * hist.counts[i];
+    }
+    double mean = sum / n;
+    double sd = std::sqrt(std::max(0.0, sum_sq / n - mean * mean));
+    double iqr = (double)histogram_rank(hist, hist.total * 3 / 4) - histogram_rank(hist, hist.total / 4);
+
+    double spread = (iqr > 0) ? std::min(sd, iqr / 1.34) : sd;
+    return std::max(1.0, 0.9 * spread * std::pow(n, -0.2));
+}
+
+// The density is evaluated on a grid of at most this many points
+#define MODE_GRID_MAX   (1 << 20)
+
+std::vector<hist_mode_t>
+histogram_modes (const histogram_t& hist, const mode_params_t& params)
+{
+    std::vector<hist_mode_t> modes;
+    if (hist.empty())
+        return modes;
+
+    double h = (params.bandwidth > 0) ? params.bandwidth : default_bandwidth(hist);
+
+    // A grid a quarter of the bandwidth apart resolves the density's shape; exact peak values come from the histogram
+    uint64_t range = (uint64_t)hist.hi() - hist.lo() + 1;
+    uint64_t step = std::max<uint64_t>((range + MODE_GRID_MAX - 1) / MODE_GRID_MAX, (uint64_t)(h / 4));
+    size_t grid_n = (range + step - 1) / step;
+    auto cell = [&] (uint32_t v) { return (size_t)((v - hist.lo()) / step); };
+
+    std::vector<size_t> cell_counts(grid_n, 0);
+    for (size_t i = 0; i < hist.values.size(); i++)
+        cell_counts[cell(hist.values[i])] += hist.counts[i];
+
+    // Gaussian kernel density by direct convolution with a tabulated kernel
+    long reach = (long)std::ceil(4 * h / step);
+    std::vector<double> kernel(reach + 1);
+    for (long d = 0; d <= reach; d++) {
+        double u = (double)d * step / h;
+        kernel[d] = std::exp(-0.5 * u * u);
+    }
+    std::vector<double> density(grid_n, 0.0);
+    for (size_t c = 0; c < grid_n; c++) {
+        if (cell_counts[c] == 0)
+            continue;
+        long first = std::max(0L, (long)c - reach);
+        long last = std::min((long)grid_n - 1, (long)c + reach);
+        for (long g = first; g <= last; g++)
+            density[g] += cell_counts[c] * kernel[std::labs(g - (long)c)];
+    }
+
+    // Local maxima, treating a plateau as one peak at its centre
+    std::vector<size_t> peaks;
+    for (size_t g = 0; g < grid_n; ) {
+        size_t end = g;
+        while (end + 1 < grid_n && density[end + 1] == density[g])
+            end++;
+        bool rising = (g == 0) || density[g - 1] < density[g];
+        bool falling = (end + 1 == grid_n) || density[end + 1] < density[g];
+        if (rising && falling)
+            peaks.push_back((g + end) / 2);
+        g = end + 1;
+    }
+
+    // Deepest point between each pair of neighbouring peaks
+    std::vector<size_t> valleys;
+    for (size_t k = 0; k + 1 < peaks.size(); k++)
+        valleys.push_back(std::min_element(&density[peaks[k]], &density[peaks[k + 1]]) - &density[0]);
+
+    auto merge = [&] (size_t k) {
+        // Joins the modes either side of valley k, keeping the higher peak
+        if (density[peaks[k + 1]] > density[peaks[k]])
+            peaks[k] = peaks[k + 1];
+        peaks.erase(peaks.begin() + k + 1);
+        valleys.erase(valleys.begin() + k);
+    };
+    auto dip = [&] (size_t k) {
+        return density[valleys[k]] / std::min(density[peaks[k]], density[peaks[k + 1]]);
+    };
+
+    // Peaks not separated by a real dip are noise on one mode
+    while (!valleys.empty()) {
+        size_t k = 0;
+        for (size_t i = 1; i < valleys.size(); i++) {
+            if (dip(i) > dip(k))
+                k = i;
+        }
+        if (dip(k) <= params.max_dip)
+            break;
+        merge(k);
+    }
+
+    // Samples in or below a valley's grid cell belong to the mode on its left
+    auto build = [&] () {
+        modes.assign(peaks.size(), hist_mode_t{});
+        size_t m = 0;
+        for (size_t i = 0; i < hist.values.size(); i++) {
+            while (m < valleys.size() && cell(hist.values[i]) > valleys[m])
+                m++;
+            hist_mode_t& mode = modes[m];
+            if (mode.count == 0)
+                mode.lo = hist.values[i];
+            mode.hi = hist.values[i];
+            mode.mean += (double)hist.values[i] * hist.counts[i];
+            mode.count += hist.counts[i];
+        }
+    };
+    build();
+
+    // Fold small modes into the neighbour across the shallower valley
+    while (modes.size() > 1) {
+        size_t smallest = 0;
+        for (size_t i = 1; i < modes.size(); i++) {
+            if (modes[i].count < modes[smallest].count)
+                smallest = i;
+        }
+        if (modes[smallest].count != 0 && (double)modes[smallest].count / hist.total >= params.min_weight)
+            break;
+
+        size_t k;
+        if (smallest == 0)
+            k = 0;
+        else if (smallest == modes.size() - 1)
+            k = smallest - 1;
+        else
+            k = (density[valleys[smallest - 1]] > density[valleys[smallest]]) ? smallest - 1 : smallest;
+        merge(k);
+        build();
+    }
+
+    // Exact peak values and final statistics
+    size_t m = 0;
+    std::vector<uint32_t> peak_counts(modes.size(), 0);
+    for (size_t i = 0; i < hist.values.size(); i++) {
+        while (hist.values[i] > modes[m].hi)
+            m++;
+        if (hist.counts[i] > peak_counts[m]) {
+            peak_counts[m] = hist.counts[i];
+            modes[m].peak = hist.values[i];
+        }
+    }
+    for (hist_mode_t& mode : modes) {
+        mode.mean /= mode.count;
+        mode.weight = (double)mode.count / hist.total;
+    }
+    return modes;
+}
+
+std::vector<size_t>
+histogram_bins (const histogram_t& hist, uint32_t lo, uint32_t hi, unsigned num_bins)
+{
+    std::vector<size_t> bins(num_bins, 0);
+    double scale = (double)num_bins / ((double)hi - lo + 1);
+    for (size_t i = 0; i < hist.values.size(); i++) {
+        if (hist.values[i] < lo || hist.values[i] > hi)
+            continue;
+        unsigned b = std::min<unsigned>(num_bins - 1, (unsigned)((hist.values[i] - lo) * scale));
+        bins[b] += hist.counts[i];
+    }
+    return bins;
+}
+
+std::string
+histogram_sparkline (const histogram_t& hist, unsigned width)
+{
+    static const char ramp[] = " .:-=+*#%@";
+    const unsigned levels = sizeof(ramp) - 2;
+
+    if (hist.empty())
+        return std::string();
+
+    // Never wider than one character per cycle
+    width = (unsigned)std::min<uint64_t>(width, (uint64_t)hist.hi() - hist.lo() + 1);
+    std::vector<size_t> bins = histogram_bins(hist, hist.lo(), hist.hi(), width);
+    size_t max = *std::max_element(bins.begin(), bins.end());
+
+    std::string out;
+    for (size_t count : bins) {
+        // Any non-empty bin is visible
+        unsigned level = (count == 0) ? 0 : 1 + (unsigned)((double)count * (levels - 1) / max);
+        out += ramp[std::min(level, levels)];
+    }
+    return out;
+}
+
+bool
+histogram_write_png (const char* path, const histogram_t& hist, const std::vector<hist_mode_t>& modes,
+                     unsigned width, unsigned height)
+{
+    std::vector<uint8_t> pixels((size_t)width * height, 255);
+    if (!hist.empty()) {
+        std::vector<size_t> bins = histogram_bins(hist, hist.lo(), hist.hi(), width);
+        size_t max = *std::max_element(bins.begin(), bins.end());
+        double cycles_per_px = ((double)hist.hi() - hist.lo() + 1) / width;
+
+        for (unsigned x = 0; x < width; x++) {
+            // Alternate the background shade per mode so the split points are visible
+            double cycle = hist.lo() + x * cycles_per_px;
+            uint8_t shade = 255;
+            for (size_t m = 0; m < modes.size(); m++) {
+                if (cycle >= modes[m].lo && cycle <= (double)modes[m].hi + 1)
+                    shade = (m & 1) ? 215 : 235;
+            }
+            unsigned bar = (unsigned)std::ceil((double)bins[x] * height / max);
+            for (unsigned y = 0; y < height; y++)
+                pixels[(size_t)y * width + x] = (height - y <= bar) ? 40 : shade;
+        }
+    }
+    return png_write_gray(path, pixels.data(), width, height);
+}
@@ -0,0 +1,76 @@
+/**
+ * Exact cycle-count histograms and mode detection
+ */
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Count of each distinct cycle value, with no binning
+ */
+struct histogram_t {
+    std::vector<uint32_t> values; // distinct values, ascending
+    std::vector<uint32_t> counts; // occurrences of each value
+    size_t total = 0;
+
+    uint32_t lo () const { return values.front(); }
+    uint32_t hi () const { return values.back(); }
+    bool empty () const { return values.empty(); }
+};
+
+histogram_t
+histogram_build (const std::vector<uint32_t>& samples);
+
+/**
+ * One peak of a distribution and the range of cycles attributed to it
+ */
+struct hist_mode_t {
+    uint32_t peak;  // most frequent exact value within the mode
+    uint32_t lo;
+    uint32_t hi;
+    size_t count;
+    double mean;
+    double weight;  // fraction of all samples
+};
+
+struct mode_params_t {
+    // Gaussian smoothing bandwidth in cycles, 0 picks one from the data (Silverman's rule)
+    double bandwidth = 0;
+    // Modes holding less than this fraction of the samples are merged into a neighbour
+    double min_weight = 0.02;
+    // Neighbouring peaks are merged unless the density dips below this fraction of the smaller peak between them
+    double max_dip = 0.8;
+};
+
+/**
+ * Finds the modes of a histogram by smoothing it with a Gaussian kernel and
+ * splitting at the density minima between peaks. Modes are in ascending order.
+ */
+std::vector<hist_mode_t>
+histogram_modes (const histogram_t& hist, const mode_params_t& params);
+
+/**
+ * Counts per bin when [lo, hi] is divided into `num_bins` equal bins
+ */
+std::vector<size_t>
+histogram_bins (const histogram_t& hist, uint32_t lo, uint32_t hi, unsigned num_bins);
+
+/**
+ * One-line ASCII rendering of the histogram, `width` characters wide
+ */
+std::string
+histogram_sparkline (const histogram_t& hist, unsigned width);
+
+/**
+ * Renders the histogram as a grayscale bar chart with the modes shaded.
+ * Returns false if the file could not be written.
+ */
+bool
+histogram_write_png (const char* path, const histogram_t& hist, const std::vector<hist_mode_t>& modes,
+                     unsigned width, unsigned height);
+
+#endif
@@ -0,0 +1,366 @@
+/**
+ * Estimates the RDP clocks of every primitive of a display list with the fill
+ * timing model and flags state that costs time for nothing, each finding with
+ * the clocks the model predicts fixing it would save.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fill_model.h"
+#include "gfx_disasm.h"
+#include "gfx_state.h"
+#include "parallel.h"
+#include "rdp.h"
+#include "results_io.h"
+#include "stats.h"
+
+// Earlier depth-updating primitives each one is checked against for drawing order
+#define LINT_ORDER_WINDOW   16
+
+enum lint_rule_t {
+    LINT_ZB_BANK,       // color and depth images in the same RDRAM bank
+    LINT_IM_RD,         // memory color read that the blender never uses
+    LINT_Z_ORDER,       // depth-tested primitives drawn far to near
+    LINT_NUM_RULES
+};
+
+static const char* const lint_rule_names[LINT_NUM_RULES] = {
+    "zb-bank",
+    "im-rd",
+    "z-order",
+};
+
+static const char* const lint_rule_descs[LINT_NUM_RULES] = {
+    "Color and depth images in the same bank",
+    "Image read the blender does not use",
+    "Depth-tested primitives drawn far to near",
+};
+
+struct options_t {
+    size_t offset = 0;
+    size_t max_commands = SIZE_MAX;
+    bool list = false;
+    size_t num_listed = 20;
+    bool vi_on = false;
+    uint32_t vi_addr = 0;
+};
+
+struct primitive_t {
+    size_t index;           // Gfx index of the command
+    gfx_state_t state;
+    // Filled in by evaluate()
+    uint64_t pixels = 0;
+    unsigned x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    bool has_z = false;
+    double z_min = 0, z_max = 0;
+    double clocks = 0;
+    double fail_clocks = 0;         // with every pixel failing the depth test
+    double savings[LINT_NUM_RULES] = {};
+    uint32_t alt_zb = 0;            // depth image address for LINT_ZB_BANK
+    double occluded = 0;            // fraction later nearer primitives cover
+};
+
+struct finding_t {
+    size_t prim;
+    lint_rule_t rule;
+};
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] DISPLAYLIST\n"
+            "\n"
+            "Options:\n"
+            "  -s OFFSET   Start at this byte offset of the file (default 0)\n"
+            "  -n COUNT    Check at most COUNT commands\n"
+            "  -l FILE     Model parameters from rdp_model or rdp_fit (default: built in)\n"
+            "  -v ADDR     VI scans out the image at ADDR while the list runs\n"
+            "  -a          List every primitive with its estimate\n"
+            "  -t N        Findings listed, largest savings first (default 20, 0 for all)\n"
+            "  -j N        Worker threads (default: all cores)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+static inline unsigned
+bank_of (uint32_t addr)
+{
+    return (addr >> RDRAM_BANK_SHIFT) % RDRAM_NUM_BANKS;
+}
+
+/*
+ * Whether the blender can use the memory color in `state`: it runs on every
+ * pixel with FORCE_BL and on edge pixels with AA_EN, and reads memory through
+ * the CLR_MEM color or A_MEM weight of a cycle it runs. Coverage modes that
+ * keep the memory coverage need the read too.
+ */
+static bool
+uses_memory_color (const gfx_state_t& state)
+{
+    uint32_t lo = state.mode_lo;
+    if ((lo & CVG_DST_SAVE) == CVG_DST_WRAP || (lo & CVG_DST_SAVE) == CVG_DST_SAVE)
+        return true;
+    if ((lo & Z_CMP) && (lo & ZMODE_DEC) != ZMODE_OPA)
+        return true;
+    if (!(lo & (AA_EN | FORCE_BL)))
+        return false;
+
+    // 1-cycle mode is set up with the same settings in both halves, so check both
+    for (unsigned c = 0; c < 2; c++) {
+        unsigned shift = c ? 16 : 18;
+        unsigned p = (lo >> (shift + 12)) & 3, m = (lo >> (shift + 4)) & 3, b = (lo >> shift) & 3;
+        if (p == G_BL_CLR_MEM || m == G_BL_CLR_MEM || b == G_BL_A_MEM)
+            return true;
+    }
+    return false;
+}
+
+static void
+evaluate (primitive_t& prim, const uint32_t* words, const fill_params_t& params, const options_t& opts)
+{
+    const gfx_state_t& s = prim.state;
+    gfx_prim_t shape;
+    gfx_prim_decode(s, words, shape);
+    prim.pixels = shape.pixels;
+    prim.x0 = shape.x0;
+    prim.y0 = shape.y0;
+    prim.x1 = shape.x1;
+    prim.y1 = shape.y1;
+    prim.has_z = shape.has_z;
+    prim.z_min = shape.z_min;
+    prim.z_max = shape.z_max;
+    if (shape.spans.empty())
+        return;
+
+    fill_config_t cfg = gfx_fill_config(s);
+    cfg.vi_on = opts.vi_on;
+    cfg.vi_addr = opts.vi_addr;
+    auto predict = [&] (const fill_config_t& c) {
+        return fill_model_predict(c, params, shape.spans.data(), shape.spans.size()).buf;
+    };
+    prim.clocks = predict(cfg);
+    if (s.fill_or_copy())
+        return;
+
+    bool uses_depth = cfg.depth_read || cfg.depth_write;
+    if (uses_depth && bank_of(cfg.fb_addr) == bank_of(cfg.zb_addr)) {
+        unsigned bank = 0;
+        while (bank == bank_of(cfg.fb_addr) || (opts.vi_on && bank == bank_of(opts.vi_addr)))
+            bank++;
+        fill_config_t moved = cfg;
+        moved.zb_addr = (cfg.zb_addr & ~((uint32_t)(RDRAM_NUM_BANKS - 1) << RDRAM_BANK_SHIFT)) |
+                        (bank << RDRAM_BANK_SHIFT);
+        prim.alt_zb = moved.zb_addr;
+        prim.savings[LINT_ZB_BANK] = std::max(0.0, prim.clocks - predict(moved));
+    }
+
+    if (cfg.color_read && !uses_memory_color(s)) {
+        fill_config_t no_read = cfg;
+        no_read.color_read = false;
+        prim.savings[LINT_IM_RD] = std::max(0.0, prim.clocks - predict(no_read));
+    }
+
+    if (cfg.depth_read && cfg.depth_write && prim.has_z) {
+        fill_config_t fail = cfg;
+        fail.depth_pass = false;
+        prim.fail_clocks = predict(fail);
+    }
+}
+
+/*
+ * Each depth-tested primitive drawn entirely in front of an earlier one that
+ * updated depth would have made the overlap fail the depth test, had it been
+ * drawn first. The overlap is taken from the bounding boxes.
+ */
+static void
+check_order (std::vector<primitive_t>& prims)
+{
+    std::vector<size_t> window;
+    for (size_t q = 0; q < prims.size(); q++) {
+        const primitive_t& near = prims[q];
+        const gfx_state_t& s = near.state;
+        if (s.fill_or_copy() || !(s.mode_lo & Z_CMP) || !near.has_z || near.pixels == 0)
+            continue;
+
+        for (size_t p : window) {
+            primitive_t& far = prims[p];
+            if (far.state.zimg_addr != s.zimg_addr || far.z_min <= near.z_max)
+                continue;
+            unsigned x0 = std::max(far.x0, near.x0), x1 = std::min(far.x1, near.x1);
+            unsigned y0 = std::max(far.y0, near.y0), y1 = std::min(far.y1, near.y1);
+            if (x0 >= x1 || y0 >= y1)
+                continue;
+            double area = (double)(far.x1 - far.x0) * (far.y1 - far.y0);
+            far.occluded = std::max(far.occluded, (double)(x1 - x0) * (y1 - y0) / area);
+        }
+
+        if ((s.mode_lo & Z_UPD) && near.fail_clocks > 0) {
+            window.push_back(q);
+            if (window.size() > LINT_ORDER_WINDOW)
+                window.erase(window.begin());
+        }
+    }
+
+    for (primitive_t& p : prims)
+        if (p.occluded > 0)
+            p.savings[LINT_Z_ORDER] = std::max(0.0, p.occluded * (p.clocks - p.fail_clocks));
+}
+
+static std::string
+describe (const primitive_t& p, lint_rule_t rule)
+{
+    char text[160];
+    const gfx_state_t& s = p.state;
+    switch (rule) {
+        case LINT_ZB_BANK:
+            snprintf(text, sizeof(text), "depth image 0x%08X in bank %u with the color image, 0x%08X would not be",
+                     s.zimg_addr, bank_of(s.zimg_addr), p.alt_zb);
+            break;
+        case LINT_IM_RD:
+            snprintf(text, sizeof(text), "IM_RD without AA_EN or a blender reading memory, render mode 0x%08X",
+                     s.mode_lo);
+            break;
+        default:
+            snprintf(text, sizeof(text), "%.1f%% of its box is later drawn in front of it", 100 * p.occluded);
+            break;
+    }
+    return text;
+}
+
+int
+main (int argc, char** argv)
+{
+    options_t opts;
+    const char* params_path = nullptr;
+    unsigned num_threads = default_num_threads();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:l:v:at:j:")) != -1) {
+        switch (opt) {
+            case 's':
+                opts.offset = strtoull(optarg, nullptr, 0);
+                break;
+            case 'n':
+                opts.max_commands = strtoull(optarg, nullptr, 0);
+                break;
+            case 'l':
+                params_path = optarg;
+                break;
+            case 'v':
+                opts.vi_on = true;
+                opts.vi_addr = strtoul(optarg, nullptr, 0);
+                break;
+            case 'a':
+                opts.list = true;
+                break;
+            case 't':
+                opts.num_listed = strtoull(optarg, nullptr, 0);
+                break;
+            case 'j':
+                num_threads = std::max(1, atoi(optarg));
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    fill_params_t params = (params_path != nullptr) ? fill_params_load(params_path) : fill_params_default();
+    std::vector<uint32_t> words = gfx_load(argv[optind], opts.offset);
+    size_t num_gfx = words.size() / 2;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // State is sequential, so collect the primitives with theirs before estimating them in parallel
+    gfx_state_t state;
+    std::vector<primitive_t> prims;
+    size_t num_commands = 0;
+    for (size_t i = 0; i < num_gfx && num_commands < opts.max_commands; num_commands++) {
+        size_t length = gfx_command_length(words[2 * i]);
+        if (i + length > num_gfx) {
+            fprintf(stderr, "Warning: the last command is cut short, only %zu of its Gfx are there\n", num_gfx - i);
+            break;
+        }
+        if (gfx_is_primitive(words[2 * i])) {
+            primitive_t p;
+            p.index = i;
+            p.state = state;
+            prims.push_back(p);
+        } else {
+            gfx_state_apply(state, &words[2 * i]);
+        }
+        i += length;
+    }
+
+    parallel_for(prims.size(), num_threads, [&] (size_t k) {
+        evaluate(prims[k], &words[2 * prims[k].index], params, opts);
+    });
+    check_order(prims);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    double total = 0;
+    uint64_t total_pixels = 0;
+    size_t rule_count[LINT_NUM_RULES] = {};
+    double rule_savings[LINT_NUM_RULES] = {};
+    std::vector<finding_t> findings;
+    for (size_t k = 0; k < prims.size(); k++) {
+        const primitive_t& p = prims[k];
+        total += p.clocks;
+        total_pixels += p.pixels;
+        for (unsigned r = 0; r < LINT_NUM_RULES; r++) {
+            if (p.savings[r] > 0) {
+                rule_count[r]++;
+                rule_savings[r] += p.savings[r];
+                findings.push_back({ k, (lint_rule_t)r });
+            }
+        }
+    }
+
+    if (opts.list) {
+        printf("%-8s  %-24s  %9s  %10s  %s\n", "Offset", "Command", "Pixels", "Clocks", "Findings");
+        for (const primitive_t& p : prims) {
+            std::string flags;
+            for (unsigned r = 0; r < LINT_NUM_RULES; r++) {
+                if (p.savings[r] > 0) {
+                    flags += flags.empty() ? "" : ",";
+                    flags += lint_rule_names[r];
+                }
+            }
+            printf("%08zX  %-24s  %9llu  %10.1f  %s\n", opts.offset + 8 * p.index,
+                   gfx_command_name(words[2 * p.index]), (unsigned long long)p.pixels, p.clocks, flags.c_str());
+        }
+        printf("\n");
+    }
+
+    printf("%zu commands, %zu primitives, %llu pixels, estimated %.0f clocks (%.3f ms)\n\n", num_commands,
+           prims.size(), (unsigned long long)total_pixels, total, rdp_clk_to_ms(total));
+    printf("%-8s  %10s  %12s  %8s  %s\n", "Rule", "Primitives", "Saves (clk)", "Share", "Pattern");
+    for (unsigned r = 0; r < LINT_NUM_RULES; r++)
+        printf("%-8s  %10zu  %12.0f  %7.2f%%  %s\n", lint_rule_names[r], rule_count[r], rule_savings[r],
+               (total > 0) ? 100 * rule_savings[r] / total : 0.0, lint_rule_descs[r]);
+
+    std::stable_sort(findings.begin(), findings.end(), [&] (const finding_t& a, const finding_t& b) {
+        return prims[a.prim].savings[a.rule] > prims[b.prim].savings[b.rule];
+    });
+    size_t num_listed = (opts.num_listed == 0) ? findings.size() : std::min(opts.num_listed, findings.size());
+    if (num_listed != 0) {
+        printf("\n%-8s  %-8s  %10s  %s\n", "Offset", "Rule", "Saves (clk)", "Detail");
+        for (size_t f = 0; f < num_listed; f++) {
+            const primitive_t& p = prims[findings[f].prim];
+            printf("%08zX  %-8s  %10.1f  %s\n", opts.offset + 8 * p.index, lint_rule_names[findings[f].rule],
+                   p.savings[findings[f].rule], describe(p, findings[f].rule).c_str());
+        }
+    }
+
+    fprintf(stderr, "%zu primitives in %.1f ms\n", prims.size(), ms);
+    return 0;
+}
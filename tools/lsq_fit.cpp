@@ -0,0 +1,285 @@
+/**
+ * Bounded non-linear least squares with multi-start global search
+ */
+#include "lsq_fit.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "parallel.h"
+#include "stats.h"
+
+static double
+sum_squares (const std::vector<double>& r)
+{
+    double sum = 0;
+    for (double v : r)
+        sum += v * v;
+    return sum;
+}
+
+static double
+clamp_param (const lsq_problem_t& problem, size_t j, double v)
+{
+    if (!problem.lower.empty())
+        v = std::max(v, problem.lower[j]);
+    if (!problem.upper.empty())
+        v = std::min(v, problem.upper[j]);
+    return v;
+}
+
+/*
+ * Cholesky factorization of the n x n matrix `a` in place, false if it is not positive definite
+ */
+static bool
+cholesky (std::vector<double>& a, size_t n)
+{
+    for (size_t j = 0; j < n; j++) {
+        double d = a[j * n + j];
+        for (size_t k = 0; k < j; k++)
+            d -= a[j * n + k] * a[j * n + k];
+        if (!(d > 0))
+            return false;
+        d = sqrt(d);
+        a[j * n + j] = d;
+        for (size_t i = j + 1; i < n; i++) {
+            double v = a[i * n + j];
+            for (size_t k = 0; k < j; k++)
+                v -= a[i * n + k] * a[j * n + k];
+            a[i * n + j] = v / d;
+        }
+    }
+    return true;
+}
+
+// Solves L L^T x = b for a factor from cholesky()
+static void
+cholesky_solve (const std::vector<double>& l, size_t n, std::vector<double>& x)
+{
+    for (size_t i = 0; i < n; i++) {
+        for (size_t k = 0; k < i; k++)
+            x[i] -= l[i * n + k] * x[k];
+        x[i] /= l[i * n + i];
+    }
+    for (size_t i = n; i-- > 0; ) {
+        for (size_t k = i + 1; k < n; k++)
+            x[i] -= l[k * n + i] * x[k];
+        x[i] /= l[i * n + i];
+    }
+}
+
+/*
+ * Forward difference Jacobian, column j at jac[j * m], backward where a bound is in the way
+ */
+static void
+jacobian (const lsq_problem_t& problem, const std::vector<double>& p, const std::vector<double>& r,
+          std::vector<double>& jac, unsigned num_threads)
+{
+    size_t n = problem.num_params;
+    size_t m = problem.num_residuals;
+    parallel_for(n, num_threads, [&] (size_t j) {
+        std::vector<double> q = p;
+        double h = 1e-5 * std::max(fabs(p[j]), 1.0);
+        if (clamp_param(problem, j, p[j] + h) != p[j] + h)
+            h = -h;
+        q[j] = p[j] + h;
+        std::vector<double> rq(m);
+        problem.residuals(q.data(), rq.data());
+        for (size_t i = 0; i < m; i++)
+            jac[j * m + i] = (rq[i] - r[i]) / h;
+    });
+}
+
+struct lm_result_t {
+    std::vector<double> params;
+    double cost;
+    unsigned iterations;
+};
+
+static lm_result_t
+levenberg_marquardt (const lsq_problem_t& problem, std::vector<double> p, unsigned max_iterations,
+                     unsigned num_threads)
+{
+    size_t n = problem.num_params;
+    size_t m = problem.num_residuals;
+
+    std::vector<double> r(m), r_trial(m), jac(n * m), a(n * n), g(n), step(n), trial(n);
+    problem.residuals(p.data(), r.data());
+    double cost = sum_squares(r);
+    double lambda = 1e-3;
+    unsigned it = 0;
+
+    for (; it < max_iterations; it++) {
+        jacobian(problem, p, r, jac, num_threads);
+        for (size_t j = 0; j < n; j++) {
+            const double* cj = &jac[j * m];
+            double gj = 0;
+            for (size_t i = 0; i < m; i++)
+                gj += cj[i] * r[i];
+            g[j] = gj;
+            for (size_t k = 0; k <= j; k++) {
+                const double* ck = &jac[k * m];
+                double v = 0;
+                for (size_t i = 0; i < m; i++)
+                    v += cj[i] * ck[i];
+                a[j * n + k] = a[k * n + j] = v;
+            }
+        }
+
+        bool improved = false;
+        double new_cost = cost;
+        while (lambda < 1e12) {
+            std::vector<double> damped = a;
+            for (size_t j = 0; j < n; j++)
+                damped[j * n + j] += lambda * std::max(a[j * n + j], 1e-12);
+            if (cholesky(damped, n)) {
+                for (size_t j = 0; j < n; j++)
+                    step[j] = -g[j];
+                cholesky_solve(damped, n, step);
+                for (size_t j = 0; j < n; j++)
+                    trial[j] = clamp_param(problem, j, p[j] + step[j]);
+                problem.residuals(trial.data(), r_trial.data());
+                new_cost = sum_squares(r_trial);
+                if (new_cost < cost) {
+                    improved = true;
+                    break;
+                }
+            }
+            lambda *= 4;
+        }
+        if (!improved)
+            break;
+
+        double moved = 0;
+        for (size_t j = 0; j < n; j++)
+            moved = std::max(moved, fabs(trial[j] - p[j]) / std::max(fabs(p[j]), 1e-8));
+        double gain = (cost - new_cost) / std::max(cost, std::numeric_limits<double>::min());
+
+        p.swap(trial);
+        r.swap(r_trial);
+        cost = new_cost;
+        lambda = std::max(lambda / 3, 1e-12);
+        if (gain < 1e-10 || moved < 1e-10) {
+            it++;
+            break;
+        }
+    }
+    return { p, cost, it };
+}
+
+/*
+ * Standard errors from the Jacobian at the fit, each residual group scaled by
+ * its own residual variance. Parameters at a bound or with no effect on the
+ * residuals are left out and get NaN.
+ */
+static std::vector<double>
+standard_errors (const lsq_problem_t& problem, const std::vector<double>& p, const std::vector<double>& r,
+                 unsigned num_threads)
+{
+    size_t n = problem.num_params;
+    size_t m = problem.num_residuals;
+    std::vector<double> sigma(n, NAN);
+
+    std::vector<double> jac(n * m);
+    jacobian(problem, p, r, jac, num_threads);
+
+    unsigned num_groups = 1;
+    for (unsigned g : problem.groups)
+        num_groups = std::max(num_groups, g + 1);
+    std::vector<double> ssr(num_groups, 0.0);
+    std::vector<size_t> count(num_groups, 0);
+    for (size_t i = 0; i < m; i++) {
+        unsigned g = problem.groups.empty() ? 0 : problem.groups[i];
+        ssr[g] += r[i] * r[i];
+        count[g]++;
+    }
+    // Degrees of freedom shared out between the groups by their size
+    std::vector<double> weight(num_groups, 0.0);
+    for (unsigned g = 0; g < num_groups; g++) {
+        double dof = count[g] - (double)n * count[g] / m;
+        if (count[g] != 0 && dof > 0 && ssr[g] > 0)
+            weight[g] = dof / ssr[g];
+    }
+
+    std::vector<size_t> active;
+    for (size_t j = 0; j < n; j++) {
+        bool at_bound = (!problem.lower.empty() && p[j] <= problem.lower[j]) ||
+                        (!problem.upper.empty() && p[j] >= problem.upper[j]);
+        bool has_effect = false;
+        for (size_t i = 0; i < m && !has_effect; i++)
+            has_effect = jac[j * m + i] != 0;
+        if (!at_bound && has_effect)
+            active.push_back(j);
+    }
+
+    size_t k = active.size();
+    std::vector<double> a(k * k, 0.0);
+    for (size_t x = 0; x < k; x++) {
+        for (size_t y = 0; y <= x; y++) {
+            const double* cx = &jac[active[x] * m];
+            const double* cy = &jac[active[y] * m];
+            double v = 0;
+            for (size_t i = 0; i < m; i++)
+                v += weight[problem.groups.empty() ? 0 : problem.groups[i]] * cx[i] * cy[i];
+            a[x * k + y] = a[y * k + x] = v;
+        }
+    }
+    if (!cholesky(a, k))
+        return sigma;
+
+    // Diagonal of the inverse, one column at a time
+    std::vector<double> col(k);
+    for (size_t x = 0; x < k; x++) {
+        std::fill(col.begin(), col.end(), 0.0);
+        col[x] = 1;
+        cholesky_solve(a, k, col);
+        sigma[active[x]] = sqrt(col[x]);
+    }
+    return sigma;
+}
+
+lsq_result_t
+lsq_fit (const lsq_problem_t& problem, const std::vector<double>& initial, const lsq_options_t& options)
+{
+    size_t n = problem.num_params;
+    unsigned num_starts = std::max(1u, options.num_starts);
+    unsigned threads_per_start = std::max(1u, options.num_threads / num_starts);
+
+    // Starting points are drawn up front so the result does not depend on the thread count
+    std::vector<std::vector<double>> starts(num_starts, initial);
+    rng_t rng(options.seed);
+    double log_spread = log(std::max(options.spread, 1.0));
+    for (unsigned s = 1; s < num_starts; s++) {
+        for (size_t j = 0; j < n; j++) {
+            double u = 2 * ((rng.next() >> 11) * 0x1.0p-53) - 1;
+            double v = (initial[j] != 0) ? initial[j] * exp(u * log_spread) : u;
+            starts[s][j] = clamp_param(problem, j, v);
+        }
+    }
+
+    std::vector<lm_result_t> fits(num_starts);
+    parallel_for(num_starts, options.num_threads, [&] (size_t s) {
+        fits[s] = levenberg_marquardt(problem, starts[s], options.max_iterations, threads_per_start);
+    });
+
+    lsq_result_t res;
+    res.best_start = 0;
+    for (unsigned s = 0; s < num_starts; s++) {
+        res.start_costs.push_back(fits[s].cost);
+        if (fits[s].cost < fits[res.best_start].cost)
+            res.best_start = s;
+    }
+    const lm_result_t& best = fits[res.best_start];
+    res.params = best.params;
+    res.cost = best.cost;
+    res.iterations = best.iterations;
+    res.starts_at_best = 0;
+    for (double c : res.start_costs)
+        res.starts_at_best += c <= best.cost * 1.001;
+
+    res.residuals.resize(problem.num_residuals);
+    problem.residuals(res.params.data(), res.residuals.data());
+    res.sigma = standard_errors(problem, res.params, res.residuals, options.num_threads);
+    return res;
+}
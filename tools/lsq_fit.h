@@ -0,0 +1,59 @@
+/**
+ * Bounded non-linear least squares with multi-start global search
+ */
+#ifndef LSQ_FIT_H_
+#define LSQ_FIT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * Minimizes the sum of squared residuals over the parameters. Residuals can be
+ * split into groups measured on different scales (e.g. BUF errors and
+ * PIPE - BUF errors); each group's own residual variance weights it in the
+ * parameter uncertainties.
+ */
+struct lsq_problem_t {
+    size_t num_params = 0;
+    size_t num_residuals = 0;
+    // Group of each residual, all in group 0 if empty
+    std::vector<unsigned> groups;
+    // Optional bounds, unbounded if empty
+    std::vector<double> lower;
+    std::vector<double> upper;
+    // Fills num_residuals residuals; called from several threads at once
+    std::function<void (const double* params, double* residuals)> residuals;
+};
+
+struct lsq_options_t {
+    unsigned num_starts = 1;
+    unsigned max_iterations = 100;
+    unsigned num_threads = 1;
+    // Other starts scale each initial parameter by a log-uniform factor in [1/spread, spread]
+    double spread = 3.0;
+    uint64_t seed = 1;
+};
+
+struct lsq_result_t {
+    std::vector<double> params;
+    // Standard errors from the covariance at the best fit, NaN where not determined
+    std::vector<double> sigma;
+    std::vector<double> residuals;
+    double cost;                    // sum of squared residuals
+    unsigned iterations;            // of the best start
+    unsigned best_start;
+    unsigned starts_at_best;        // starts that ended within 0.1% of the best cost
+    std::vector<double> start_costs;
+};
+
+/**
+ * Levenberg-Marquardt with a forward difference Jacobian from `initial` and
+ * from num_starts - 1 perturbed points, spread over all threads. Threads not
+ * needed for separate starts compute Jacobian columns in parallel.
+ */
+lsq_result_t
+lsq_fit (const lsq_problem_t& problem, const std::vector<double>& initial, const lsq_options_t& options);
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ * Fits the analytical fill timing model to measured specs, reports the error
+ * for each spec and predicts configurations that have not been measured.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fill_model.h"
+#include "parallel.h"
+#include "results_io.h"
+#include "stats.h"
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [RESULTS]\n"
+            "\n"
+            "Fits the model to RESULTS (sample_results.txt or any results file) and\n"
+            "reports measured and modelled BUF/PIPE clocks for every spec.\n"
+            "\n"
+            "Options:\n"
+            "  -i N        Fitting iterations (default 100)\n"
+            "  -l FILE     Load parameters instead of fitting\n"
+            "  -o FILE     Save the parameters\n"
+            "  -j N        Worker threads (default: all cores)\n"
+            "\n"
+            "Prediction, instead of the per-spec report when RESULTS is not given:\n"
+            "  -m MODES    Comma-separated: 2cycle, im_rd, z_cmp, z_upd, z_fail, ac_fail, vi\n"
+            "  -r RECT     X0,Y0,X1,Y1 in pixels (default 0,0,320,240)\n"
+            "  -w WIDTH    Color image width in pixels (default 320)\n"
+            "  -f ADDR     Color image address (default 0x%X)\n"
+            "  -z ADDR     Depth image address (default 0x%X)\n"
+            "  -v ADDR     VI origin (default 0x%X)\n",
+            prog, FILL_FB_ADDR, FILL_ZB_ADDR_DIFF, FILL_VI_ADDR_DIFF);
+    exit(EXIT_FAILURE);
+}
+
+static void
+print_params (const fill_params_t& params)
+{
+    printf("Parameters (RDP clocks):\n");
+    for (size_t i = 0; i < FILL_NUM_PARAMS; i++)
+        printf("    %-20s %9.4f\n", fill_param_names[i], params.p[i]);
+}
+
+static void
+report (const std::vector<fill_sample_t>& samples, const fill_params_t& params, unsigned num_threads)
+{
+    std::vector<fill_estimate_t> est(samples.size());
+    parallel_for(samples.size(), num_threads, [&] (size_t i) {
+        est[i] = fill_model_predict(samples[i].cfg, params);
+    });
+
+    printf("\n%10s  %10s  %8s  %10s  %10s  %8s  %s\n",
+           "Buf clk", "Model", "Error", "Pipe clk", "Model", "Error", "Spec");
+
+    double sum_buf = 0, sum_pipe = 0, max_buf = 0, max_pipe = 0;
+    size_t worst = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        const fill_sample_t& s = samples[i];
+        double buf_err = 100 * (est[i].buf - s.buf) / s.buf;
+        double pipe_err = 100 * (est[i].pipe - s.pipe) / s.pipe;
+        printf("%10.1f  %10.1f  %+7.2f%%  %10.1f  %10.1f  %+7.2f%%  %s\n",
+               s.buf, est[i].buf, buf_err, s.pipe, est[i].pipe, pipe_err, s.desc.c_str());
+
+        sum_buf += fabs(buf_err);
+        sum_pipe += fabs(pipe_err);
+        if (fabs(buf_err) > max_buf)
+            worst = i;
+        max_buf = std::max(max_buf, fabs(buf_err));
+        max_pipe = std::max(max_pipe, fabs(pipe_err));
+    }
+
+    fprintf(stderr, "%zu specs: mean absolute error buf %.2f%%, pipe %.2f%%; largest buf %.2f%%, pipe %.2f%%\n",
+            samples.size(), sum_buf / samples.size(), sum_pipe / samples.size(), max_buf, max_pipe);
+    fprintf(stderr, "Largest buf error: %s\n", samples[worst].desc.c_str());
+}
+
+int
+main (int argc, char** argv)
+{
+    lsq_options_t fit;
+    const char* load_path = nullptr;
+    const char* save_path = nullptr;
+    unsigned num_threads = default_num_threads();
+    fill_config_t cfg;
+    bool predict = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:l:o:j:m:r:w:f:z:v:")) != -1) {
+        switch (opt) {
+            case 'i':
+                fit.max_iterations = std::max(1, atoi(optarg));
+                break;
+            case 'l':
+                load_path = optarg;
+                break;
+            case 'o':
+                save_path = optarg;
+                break;
+            case 'j':
+                num_threads = std::max(1, atoi(optarg));
+                break;
+            case 'm':
+                if (!fill_modes_parse(optarg, cfg))
+                    fatal("Unknown mode in \"%s\"", optarg);
+                predict = true;
+                break;
+            case 'r':
+                if (sscanf(optarg, "%u,%u,%u,%u", &cfg.x0, &cfg.y0, &cfg.x1, &cfg.y1) != 4 ||
+                    cfg.x1 < cfg.x0 || cfg.y1 < cfg.y0)
+                    fatal("Bad rectangle \"%s\"", optarg);
+                predict = true;
+                break;
+            case 'w':
+                cfg.width = std::max(1, atoi(optarg));
+                predict = true;
+                break;
+            case 'f':
+                cfg.fb_addr = strtoul(optarg, nullptr, 0);
+                predict = true;
+                break;
+            case 'z':
+                cfg.zb_addr = strtoul(optarg, nullptr, 0);
+                predict = true;
+                break;
+            case 'v':
+                cfg.vi_addr = strtoul(optarg, nullptr, 0);
+                predict = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind > 1 || (argc - optind == 0 && load_path == nullptr))
+        usage(argv[0]);
+    const char* results_path = (optind < argc) ? argv[optind] : nullptr;
+
+    std::vector<fill_sample_t> samples;
+    if (results_path != nullptr) {
+        samples = fill_samples_load(results_path);
+        if (samples.empty())
+            fatal("No specs in %s with a recognized description", results_path);
+    }
+
+    fill_params_t params = fill_params_default();
+    if (load_path != nullptr) {
+        params = fill_params_load(load_path);
+    } else {
+        fit.num_threads = num_threads;
+        lsq_result_t res = fill_model_fit(samples, params, fit);
+        double ss = 0;
+        for (size_t i = 0; i < samples.size(); i++)
+            ss += res.residuals[2 * i] * res.residuals[2 * i];
+        fprintf(stderr, "Fitted %d parameters to %zu specs in %u iterations, RMS relative buf error %.3f%%\n",
+                (int)FILL_NUM_PARAMS, samples.size(), res.iterations, 100 * sqrt(ss / samples.size()));
+    }
+    if (save_path != nullptr)
+        fill_params_save(save_path, params);
+
+    if (predict) {
+        fill_estimate_t est = fill_model_predict(cfg, params);
+        printf("%zu segments, %zu row opens, %zu VI fetches\n", est.segments, est.row_misses, est.vi_fetches);
+        printf("Buf:  %.1f clocks, %.7fms\n", est.buf, rdp_clk_to_ms(est.buf));
+        printf("Pipe: %.1f clocks, %.7fms\n", est.pipe, rdp_clk_to_ms(est.pipe));
+        return 0;
+    }
+
+    print_params(params);
+    if (!samples.empty())
+        report(samples, params, num_threads);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/**
+ * Removes the state changes and syncs a display list does not need, checks
+ * that every primitive still sees the same state, and reports the bytes and
+ * the RDP clocks saved.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fill_model.h"
+#include "gfx_disasm.h"
+#include "gfx_optimize.h"
+#include "gfx_state.h"
+#include "parallel.h"
+#include "rdp.h"
+#include "results_io.h"
+#include "stats.h"
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] DISPLAYLIST\n"
+            "\n"
+            "Options:\n"
+            "  -o FILE     Write the optimized list to FILE\n"
+            "  -s OFFSET   Start at this byte offset of the file (default 0)\n"
+            "  -l FILE     Model parameters from rdp_model or rdp_fit (default: built in)\n"
+            "  -r          List every command removed and why\n"
+            "  -c FILE     Only check that FILE, from offset 0, gives every primitive the same\n"
+            "              state as DISPLAYLIST\n"
+            "  -j N        Worker threads (default: all cores)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+static void
+write_list (const char* path, const std::vector<uint32_t>& words)
+{
+    FILE* f = fopen(path, "wb");
+    if (f == nullptr)
+        fatal("Could not open %s for writing", path);
+    std::vector<unsigned char> bytes(4 * words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+        bytes[4 * i + 0] = words[i] >> 24;
+        bytes[4 * i + 1] = words[i] >> 16;
+        bytes[4 * i + 2] = words[i] >> 8;
+        bytes[4 * i + 3] = words[i];
+    }
+    if (fwrite(bytes.data(), 1, bytes.size(), f) != bytes.size() || fclose(f) != 0)
+        fatal("Could not write %s", path);
+}
+
+struct drain_t {
+    size_t index;           // Gfx index of the primitive
+    gfx_state_t state;
+    double clocks = 0;
+};
+
+/*
+ * A pipe sync waits for the primitive before it to leave the pipeline, which
+ * the model puts at PIPE - BUF of that primitive. Removed pipe syncs that came
+ * after a primitive no kept sync had waited for save that time.
+ */
+static std::vector<drain_t>
+saved_drains (const uint32_t* words, const gfx_optimized_t& opt)
+{
+    std::vector<drain_t> drains;
+    gfx_state_t state;
+    gfx_state_t prim_state;
+    size_t last_prim = SIZE_MAX;
+    bool drained = true;
+    for (size_t k = 0; k < opt.starts.size(); k++) {
+        const uint32_t* w = &words[2 * opt.starts[k]];
+        unsigned op = gfx_opcode(w[0]);
+        if (gfx_is_primitive(w[0])) {
+            last_prim = opt.starts[k];
+            prim_state = state;
+            drained = false;
+        } else if (op == G_RDPPIPESYNC || op == G_RDPFULLSYNC) {
+            if (!drained && opt.removal[k] == GFX_PIPE_SYNC)
+                drains.push_back({ last_prim, prim_state });
+            drained = true;
+        } else if (opt.removal[k] == GFX_KEPT) {
+            gfx_state_apply(state, w);
+        }
+    }
+    return drains;
+}
+
+int
+main (int argc, char** argv)
+{
+    const char* out_path = nullptr;
+    const char* params_path = nullptr;
+    size_t offset = 0;
+    bool list_removed = false;
+    const char* check_path = nullptr;
+    unsigned num_threads = default_num_threads();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:s:l:rc:j:")) != -1) {
+        switch (opt) {
+            case 'o':
+                out_path = optarg;
+                break;
+            case 's':
+                offset = strtoull(optarg, nullptr, 0);
+                break;
+            case 'l':
+                params_path = optarg;
+                break;
+            case 'r':
+                list_removed = true;
+                break;
+            case 'c':
+                check_path = optarg;
+                break;
+            case 'j':
+                num_threads = std::max(1, atoi(optarg));
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    fill_params_t params = (params_path != nullptr) ? fill_params_load(params_path) : fill_params_default();
+    std::vector<uint32_t> words = gfx_load(argv[optind], offset);
+    size_t num_gfx = words.size() / 2;
+
+    if (check_path != nullptr) {
+        std::vector<uint32_t> other = gfx_load(check_path, 0);
+        gfx_state_check_t check = gfx_compare_state(words.data(), num_gfx, other.data(), other.size() / 2);
+        if (!check.error.empty()) {
+            printf("Not equivalent: %s\n", check.error.c_str());
+            return EXIT_FAILURE;
+        }
+        printf("Same state at all %zu primitives and loads and at the end; state changes without their sync: "
+               "%zu before, %zu after\n", check.primitives, check.hazards_before, check.hazards_after);
+        return (check.hazards_after > check.hazards_before) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    gfx_optimized_t opt_list = gfx_optimize(words.data(), num_gfx);
+    gfx_state_check_t check = gfx_compare_state(words.data(), num_gfx, opt_list.words.data(),
+                                                opt_list.words.size() / 2);
+
+    std::vector<drain_t> drains = saved_drains(words.data(), opt_list);
+    parallel_for(drains.size(), num_threads, [&] (size_t d) {
+        gfx_prim_t shape;
+        gfx_prim_decode(drains[d].state, &words[2 * drains[d].index], shape);
+        if (shape.spans.empty())
+            return;
+        fill_estimate_t est = fill_model_predict(gfx_fill_config(drains[d].state), params, shape.spans.data(),
+                                                 shape.spans.size());
+        drains[d].clocks = est.pipe - est.buf;
+    });
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!check.error.empty())
+        fatal("The optimized list is not equivalent: %s", check.error.c_str());
+    if (check.hazards_after > check.hazards_before)
+        fatal("The optimized list changes state after %zu primitives without a sync, the original after %zu",
+              check.hazards_after, check.hazards_before);
+
+    size_t counts[GFX_NUM_REMOVALS] = {};
+    size_t bytes[GFX_NUM_REMOVALS] = {};
+    for (size_t k = 0; k < opt_list.starts.size(); k++) {
+        unsigned r = opt_list.removal[k];
+        size_t next = (k + 1 < opt_list.starts.size()) ? opt_list.starts[k + 1] : num_gfx;
+        counts[r]++;
+        bytes[r] += 8 * std::min(next - opt_list.starts[k], gfx_command_length(words[2 * opt_list.starts[k]]));
+        if (list_removed && r != GFX_KEPT)
+            printf("%08zX  %-24s  %s\n", offset + 8 * opt_list.starts[k],
+                   gfx_command_name(words[2 * opt_list.starts[k]]), gfx_removal_names[r]);
+    }
+    if (list_removed)
+        printf("\n");
+
+    size_t num_commands = opt_list.starts.size();
+    size_t in_bytes = 8 * num_gfx, out_bytes = 4 * opt_list.words.size();
+    printf("%zu commands, %zu bytes -> %zu commands, %zu bytes (%.1f%% smaller)\n", num_commands, in_bytes,
+           counts[GFX_KEPT], out_bytes, (in_bytes > 0) ? 100.0 * (in_bytes - out_bytes) / in_bytes : 0.0);
+    printf("\n%-14s  %9s  %9s\n", "Removed", "Commands", "Bytes");
+    for (unsigned r = GFX_KEPT + 1; r < GFX_NUM_REMOVALS; r++)
+        printf("%-14s  %9zu  %9zu\n", gfx_removal_names[r], counts[r], bytes[r]);
+
+    double saved = 0;
+    for (const drain_t& d : drains)
+        saved += d.clocks;
+    printf("\nEstimated %.0f RDP clocks (%.4f ms) saved by %zu pipeline drains no longer waited for\n", saved,
+           rdp_clk_to_ms(saved), drains.size());
+    printf("Same state at all %zu primitives and loads and at the end; state changes without their sync: "
+           "%zu before, %zu after\n", check.primitives, check.hazards_before, check.hazards_after);
+
+    if (out_path != nullptr)
+        write_list(out_path, opt_list.words);
+    fprintf(stderr, "%zu commands in %.1f ms\n", num_commands, ms);
+    return 0;
+}
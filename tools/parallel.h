@@ -0,0 +1,48 @@
+/**
+ * Minimal work distribution over all cores for the host tools
+ */
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+static inline unsigned
+default_num_threads (void)
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * Calls fn(i) for every i in [0, n) over `num_threads` threads. Indices are
+ * handed out dynamically so uneven tasks still balance.
+ */
+template <typename Fn>
+void
+parallel_for (size_t n, unsigned num_threads, Fn fn)
+{
+    num_threads = (unsigned)std::min<size_t>(std::max(1u, num_threads), n);
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < n; i++)
+            fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&] () {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n; )
+            fn(i);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& t : threads)
+        t.join();
+}
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * Minimal PNG output for the host tools, without external dependencies
+ */
+#include "png.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <vector>
+
+static uint32_t
+crc32 (const uint8_t* data, size_t len, uint32_t crc = 0)
+{
+    // Built once on first use; the static's initialization is thread-safe
+    static const std::array<uint32_t, 256> table = [] () {
+        std::array<uint32_t, 256> out {};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            out[n] = c;
+        }
+        return out;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void
+put_be32 (std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+static void
+put_chunk (std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+{
+    put_be32(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_be32(out, crc32(&out[start], out.size() - start));
+}
+
+bool
+png_write_gray (const char* path, const uint8_t* pixels, unsigned width, unsigned height)
+{
+    std::vector<uint8_t> ihdr;
+    put_be32(ihdr, width);
+    put_be32(ihdr, height);
+    ihdr.push_back(8); // bit depth
+    ihdr.push_back(0); // grayscale
+    ihdr.push_back(0); // deflate
+    ihdr.push_back(0); // adaptive filtering
+    ihdr.push_back(0); // no interlace
+
+    // Each row is preceded by its filter type (none)
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t)(width + 1) * height);
+    for (unsigned y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels + (size_t)y * width, pixels + (size_t)(y + 1) * width);
+    }
+
+    // zlib stream of stored deflate blocks
+    std::vector<uint8_t> idat = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+    for (size_t pos = 0; pos == 0 || pos < raw.size(); ) {
+        size_t len = std::min<size_t>(raw.size() - pos, 65535);
+        bool last = pos + len == raw.size();
+        idat.push_back(last);
+        idat.push_back(len);
+        idat.push_back(len >> 8);
+        idat.push_back(~len);
+        idat.push_back(~len >> 8);
+        for (size_t i = pos; i < pos + len; i++) {
+            idat.push_back(raw[i]);
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        pos += len;
+        if (last)
+            break;
+    }
+    put_be32(idat, (b << 16) | a);
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> out(signature, signature + 8);
+    put_chunk(out, "IHDR", ihdr);
+    put_chunk(out, "IDAT", idat);
+    put_chunk(out, "IEND", {});
+
+    FILE* f = fopen(path, "wb");
+    if (f == nullptr)
+        return false;
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    return (fclose(f) == 0) && ok;
+}
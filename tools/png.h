@@ -0,0 +1,16 @@
+/**
+ * Minimal PNG output for the host tools, without external dependencies
+ */
+#ifndef PNG_H_
+#define PNG_H_
+
+#include <cstdint>
+
+/**
+ * Writes an 8-bit grayscale image, `pixels` holding `height` rows of `width` bytes.
+ * The image data is stored uncompressed. Returns false if the file could not be written.
+ */
+bool
+png_write_gray (const char* path, const uint8_t* pixels, unsigned width, unsigned height);
+
+#endif
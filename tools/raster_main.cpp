@@ -0,0 +1,501 @@
+/**
+ * Rasterizes every triangle and rectangle of a display list under the RDP's
+ * edge rules and counts the spans, pixels, span buffer segments and RDRAM
+ * rows they touch, or checks the vectorized rasterizer against a scalar one.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gfx_disasm.h"
+#include "gfx_raster.h"
+#include "gfx_state.h"
+#include "parallel.h"
+#include "rdp.h"
+#include "rdram_sim.h"
+#include "results_io.h"
+
+// Primitives rasterized per task
+#define CHUNK_PRIMITIVES    4096
+
+// Random primitives checked against the scalar rasterizer
+#define VERIFY_PRIMITIVES   20000
+// Failures listed before only counting them
+#define VERIFY_MAX_LISTED   10
+
+struct options_t {
+    size_t offset = 0;
+    size_t max_commands = SIZE_MAX;
+    bool list = false;
+    bool spans = false;
+};
+
+struct primitive_t {
+    size_t index;           // Gfx index of the command
+    gfx_state_t state;
+};
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] DISPLAYLIST\n"
+            "       %s -V\n"
+            "\n"
+            "Options:\n"
+            "  -s OFFSET   Start at this byte offset of the file (default 0)\n"
+            "  -n COUNT    Rasterize the primitives of at most COUNT commands\n"
+            "  -a          List every primitive with its counts\n"
+            "  -S          List every span, as its line and [x0, x1)\n"
+            "  -j N        Worker threads (default: all cores)\n"
+            "  -V          Check the rasterizer against a scalar one on random primitives,\n"
+            "              states and scissors, then exit\n",
+            prog, prog);
+    exit(EXIT_FAILURE);
+}
+
+static gfx_raster_t
+rasterize (const primitive_t& p, const uint32_t* words, std::vector<fill_span_t>* spans)
+{
+    gfx_edges_t edges;
+    gfx_edges_decode(p.state, &words[2 * p.index], edges);
+    return gfx_rasterize(p.state, edges, spans);
+}
+
+/*
+ * Self-check: the edge rules of gfx_raster.cpp applied one subscanline and one
+ * coverage sample at a time, straight from the command words, and row touches
+ * counted from the address of every pixel
+ */
+
+struct reference_t {
+    gfx_raster_t counts;
+    std::vector<fill_span_t> spans;
+};
+
+static int32_t
+field_s14 (uint32_t w)
+{
+    int32_t v = w & 0x3FFF;
+    return (v & 0x2000) ? v - 0x4000 : v;
+}
+
+// Distinct RDRAM rows of the pixels [x0, x1) of line y in an image of `bits` per pixel
+static uint64_t
+reference_rows (uint32_t base, unsigned width, unsigned bits, unsigned y, unsigned x0, unsigned x1)
+{
+    uint64_t rows = 0, last_row = UINT64_MAX;
+    for (unsigned x = x0; x < x1; x++) {
+        uint64_t bit = ((uint64_t)y * width + x) * bits;
+        for (uint64_t addr : { base + bit / 8, base + (bit + bits - 1) / 8 }) {
+            if ((addr >> RDRAM_ROW_SHIFT) != last_row) {
+                last_row = addr >> RDRAM_ROW_SHIFT;
+                rows++;
+            }
+        }
+    }
+    return rows;
+}
+
+static void
+reference_span (const gfx_state_t& state, reference_t& ref, unsigned y, unsigned x0, unsigned x1, unsigned pixels)
+{
+    gfx_raster_t& r = ref.counts;
+    if (r.spans == 0) {
+        r.x0 = x0;
+        r.y0 = y;
+    }
+    r.x0 = std::min(r.x0, x0);
+    r.x1 = std::max(r.x1, x1);
+    r.y1 = y + 1;
+    r.spans++;
+    r.pixels += pixels;
+    for (unsigned x = x0; x < x1; x++)
+        r.segments += x == x0 || x % FILL_SEGMENT_PIXELS == 0;
+    r.color_rows += reference_rows(state.cimg_addr, state.cimg_width, 4 << state.cimg_siz, y, x0, x1);
+    if (!state.fill_or_copy() && (state.mode_lo & (Z_CMP | Z_UPD)))
+        r.depth_rows += reference_rows(state.zimg_addr, state.cimg_width, 16, y, x0, x1);
+    ref.spans.push_back({ y, x0, x1 });
+}
+
+static reference_t
+reference_rasterize (const gfx_state_t& state, const uint32_t* words)
+{
+    reference_t ref;
+    unsigned op = gfx_opcode(words[0]);
+    bool whole = state.fill_or_copy();
+    bool lft;
+    int32_t yh, ym, yl, xh, xm, xl, dxhdy, dxmdy, dxldy;
+    if (op == G_FILLRECT || op == G_TEXRECT || op == G_TEXRECTFLIP) {
+        lft = true;
+        yh = words[1] & 0xFFF;
+        ym = yl = (words[0] & 0xFFF) | (whole ? 3 : 0);
+        xh = ((words[1] >> 12) & 0xFFF) << 14;
+        xm = xl = ((words[0] >> 12) & 0xFFF) << 14;
+        dxhdy = dxmdy = dxldy = 0;
+    } else {
+        lft = (words[0] >> 23) & 1;
+        yl = field_s14(words[0]);
+        ym = field_s14(words[1] >> 16);
+        yh = field_s14(words[1]);
+        xl = words[2];
+        dxldy = words[3];
+        xh = words[4];
+        dxhdy = words[5];
+        xm = words[6];
+        dxmdy = words[7];
+    }
+
+    int32_t clip_l = 2 * state.sc_ulx, clip_r = 2 * state.sc_lrx;
+    int32_t ky0 = std::max<int32_t>(yh, state.sc_uly), ky1 = std::min<int32_t>(yl, state.sc_lry);
+    if (ky1 <= ky0 || clip_r <= clip_l)
+        return ref;
+    int32_t top = yh & ~3;
+    auto at = [] (int32_t x, int32_t dxdy, int32_t k) {
+        return (int32_t)((uint32_t)(x & ~1) + (uint32_t)k * (uint32_t)((dxdy >> 2) & ~1));
+    };
+    auto eighths = [] (int32_t x) { return (x >> 14) * 2 + ((x & 0x3FFE) != 0); };
+
+    for (int32_t y = ky0 >> 2; y <= (ky1 - 1) >> 2; y++) {
+        bool in_y[4], crossed[4];
+        int32_t major[4], minor[4];
+        bool all_right = true, all_left = true;
+        for (int j = 0; j < 4; j++) {
+            int32_t k = 4 * y + j;
+            int32_t xj = at(xh, dxhdy, k - top);
+            int32_t xn = (k >= ym && ym >= top) ? at(xl, dxldy, k - ym) : at(xm, dxmdy, k - top);
+            in_y[j] = k >= ky0 && k < ky1;
+            crossed[j] = lft ? (xn >> 14) < (xj >> 14) : (xn >> 14) > (xj >> 14);
+            major[j] = eighths(xj);
+            minor[j] = eighths(xn);
+            if (in_y[j]) {
+                all_right = all_right && major[j] >= clip_r && minor[j] >= clip_r;
+                all_left = all_left && major[j] < clip_l && minor[j] < clip_l;
+            }
+        }
+        if (all_right || all_left)
+            continue;
+
+        int32_t lx = INT32_MAX, rx = INT32_MIN;
+        std::vector<bool> covered(1026);
+        for (int j = 0; j < 4; j++) {
+            if (!in_y[j] || crossed[j])
+                continue;
+            int32_t a = std::min(std::max(major[j], clip_l), clip_r);
+            int32_t b = std::min(std::max(minor[j], clip_l), clip_r);
+            int32_t left = lft ? a : b, right = lft ? b : a;
+            lx = std::min(lx, left >> 3);
+            rx = std::max(rx, right >> 3);
+            int32_t column = ((4 * y + j) & 1) * 2;
+            for (int32_t p = (left >> 3) - 1; p <= (right >> 3) + 1; p++) {
+                for (int32_t sample : { 8 * p + column, 8 * p + column + 4 }) {
+                    if (sample >= left && sample < right)
+                        covered[p + 1] = true;
+                }
+            }
+        }
+        if (lx > rx)
+            continue;
+
+        if (whole) {
+            int32_t end = std::min(rx + 1, clip_r >> 3);
+            if (end > lx) {
+                ref.counts.processed += end - lx;
+                reference_span(state, ref, y, lx, end, end - lx);
+            }
+            continue;
+        }
+        ref.counts.processed += rx - lx + 1;
+        int32_t first = -1, last = -1, pixels = 0;
+        for (int32_t p = 0; p < 1024; p++) {
+            if (covered[p + 1]) {
+                first = (first < 0) ? p : first;
+                last = p;
+                pixels++;
+            }
+        }
+        if (pixels > 0)
+            reference_span(state, ref, y, first, last + 1, pixels);
+    }
+    return ref;
+}
+
+static bool
+same_counts (const gfx_raster_t& a, const gfx_raster_t& b)
+{
+    bool same_box = a.spans == 0 || (a.x0 == b.x0 && a.x1 == b.x1 && a.y0 == b.y0 && a.y1 == b.y1);
+    return a.spans == b.spans && a.pixels == b.pixels && a.processed == b.processed && a.segments == b.segments &&
+           a.color_rows == b.color_rows && a.depth_rows == b.depth_rows && same_box;
+}
+
+static bool
+same_spans (const std::vector<fill_span_t>& a, const std::vector<fill_span_t>& b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [] (const fill_span_t& s, const fill_span_t& t) {
+        return s.y == t.y && s.x0 == t.x0 && s.x1 == t.x1;
+    });
+}
+
+static void
+apply (gfx_state_t& state, Gfx g)
+{
+    uint32_t words[2] = { g.w0, g.w1 };
+    gfx_state_apply(state, words);
+}
+
+// A random state and primitive, the primitive's words in `words`
+static void
+random_case (std::mt19937& rng, gfx_state_t& state, std::vector<uint32_t>& words)
+{
+    auto range = [&] (int32_t lo, int32_t hi) { return lo + (int32_t)(rng() % (uint32_t)(hi - lo)); };
+
+    state = gfx_state_t();
+    apply(state, gsDPSetColorImage(G_IM_FMT_RGBA, rng() % 4, range(1, 1025), rng() & 0x7FFFC0));
+    apply(state, gsDPSetDepthImage(rng() & 0x7FFFC0));
+    static const uint32_t cycles[] = { G_CYC_1CYCLE, G_CYC_1CYCLE, G_CYC_2CYCLE, G_CYC_COPY, G_CYC_FILL };
+    apply(state, gsDPSetOtherMode(cycles[rng() % 5], rng() & (Z_CMP | Z_UPD)));
+    if (rng() % 8 != 0) {
+        // Scissors with fractions, around the screen or anywhere on it, now and then empty
+        bool near = rng() % 2;
+        int32_t ulx = near ? range(0, 32) : range(0, 1400), uly = near ? range(0, 32) : range(0, 1100);
+        int32_t lrx = near ? range(1200, 1400) : ulx + range(-8, 1400);
+        int32_t lry = near ? range(900, 1100) : uly + range(-8, 1100);
+        apply(state, gsDPSetScissorFrac(G_SC_NON_INTERLACE, ulx, uly, std::min(lrx, 4095), std::min(lry, 4095)));
+    }
+
+    words.clear();
+    auto put = [&] (Gfx g) {
+        words.push_back(g.w0);
+        words.push_back(g.w1);
+    };
+    unsigned kind = rng() % 10;
+    if (kind == 0) {
+        int32_t ulx = range(0, 340), uly = range(0, 260);
+        put(gsDPFillRectangle(ulx, uly, std::min(ulx + range(0, 64), 1023), std::min(uly + range(0, 64), 1023)));
+    } else if (kind == 1) {
+        int32_t ulx = range(0, 1360), uly = range(0, 1040);
+        Gfx rect[] = { gsTexRect(ulx, uly, std::min(ulx + range(0, 256), 4095), std::min(uly + range(0, 256), 4095),
+                                 0, 0, 0, 1 << 10, 1 << 10) };
+        for (const Gfx& g : rect)
+            put(g);
+    } else {
+        // Slopes mostly shallow, some steep enough to wrap, and vertical
+        auto slope = [&] () {
+            switch (rng() % 3) {
+                case 0:
+                    return range(-(3 << 16), 3 << 16);
+                case 1:
+                    return range(-(200 << 16), 200 << 16);
+                default:
+                    return 0;
+            }
+        };
+        int32_t yh = range(-50, 1000);
+        int32_t ym = (rng() % 8 == 0) ? yh - range(0, 8) : yh + range(0, 240);
+        int32_t yl = ym + range(-4, 240);
+        int32_t xh = range(-(20 << 16), 340 << 16);
+        Gfx tri[] = { gsDPTriFill(rng() % 2, 0, 0,
+                                  xh + range(-(60 << 16), 60 << 16), yl, slope(),
+                                  xh + range(-(8 << 16), 8 << 16), ym, slope(),
+                                  xh, yh, slope()) };
+        for (const Gfx& g : tri)
+            put(g);
+    }
+}
+
+static int
+verify (void)
+{
+    size_t failed = 0, checked = 0;
+
+    // Whole rectangles, whose counts follow from their size alone
+    struct fixed_case_t {
+        const char* name;
+        uint32_t cycle;
+        unsigned sc_lrx, sc_lry;
+        uint64_t pixels, processed;
+    };
+    static const fixed_case_t fixed_cases[] = {
+        // The walker steps onto the pixel the right edge starts
+        { "1-cycle 320x240",                G_CYC_1CYCLE, 4095, 4095, 320 * 240, 321 * 240 },
+        // Fill mode includes the lower right edges
+        { "fill 320x240",                   G_CYC_FILL,   4095, 4095, 321 * 241, 321 * 241 },
+        { "fill 320x240 in a 320x240 scissor", G_CYC_FILL, 320 * 4, 240 * 4, 320 * 240, 320 * 240 },
+    };
+    for (const fixed_case_t& c : fixed_cases) {
+        gfx_state_t state;
+        apply(state, gsDPSetOtherMode(c.cycle, 0));
+        apply(state, gsDPSetScissorFrac(G_SC_NON_INTERLACE, 0, 0, c.sc_lrx, c.sc_lry));
+        Gfx g = gsDPFillRectangle(0, 0, 320, 240);
+        uint32_t words[2] = { g.w0, g.w1 };
+        gfx_edges_t edges;
+        gfx_edges_decode(state, words, edges);
+        gfx_raster_t r = gfx_rasterize(state, edges, nullptr);
+        checked++;
+        if (r.pixels != c.pixels || r.processed != c.processed) {
+            printf("FAIL %s: %llu pixels, %llu processed, expected %llu, %llu\n", c.name,
+                   (unsigned long long)r.pixels, (unsigned long long)r.processed,
+                   (unsigned long long)c.pixels, (unsigned long long)c.processed);
+            failed++;
+        }
+    }
+
+    std::mt19937 rng(1);
+    gfx_state_t state;
+    std::vector<uint32_t> words;
+    std::vector<fill_span_t> spans;
+    uint64_t total_spans = 0;
+    for (size_t i = 0; i < VERIFY_PRIMITIVES; i++) {
+        random_case(rng, state, words);
+        gfx_edges_t edges;
+        gfx_edges_decode(state, words.data(), edges);
+        spans.clear();
+        gfx_raster_t r = gfx_rasterize(state, edges, &spans);
+        reference_t ref = reference_rasterize(state, words.data());
+        total_spans += ref.counts.spans;
+        checked++;
+        if (same_counts(r, ref.counts) && same_spans(spans, ref.spans))
+            continue;
+        if (failed++ < VERIFY_MAX_LISTED) {
+            printf("FAIL case %zu, %llu spans %llu pixels where the scalar rasterizer has %llu spans %llu pixels:", i,
+                   (unsigned long long)r.spans, (unsigned long long)r.pixels,
+                   (unsigned long long)ref.counts.spans, (unsigned long long)ref.counts.pixels);
+            for (uint32_t w : words)
+                printf(" %08X", w);
+            printf("\n");
+        }
+    }
+
+    printf("%zu checks, %llu spans, %zu failed\n", checked, (unsigned long long)total_spans, failed);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void
+print_row (const char* name, uint64_t total, size_t num_prims)
+{
+    printf("%-12s  %14llu  %12.2f\n", name, (unsigned long long)total,
+           (num_prims > 0) ? (double)total / num_prims : 0.0);
+}
+
+int
+main (int argc, char** argv)
+{
+    options_t opts;
+    unsigned num_threads = default_num_threads();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:aSj:V")) != -1) {
+        switch (opt) {
+            case 's':
+                opts.offset = strtoull(optarg, nullptr, 0);
+                break;
+            case 'n':
+                opts.max_commands = strtoull(optarg, nullptr, 0);
+                break;
+            case 'a':
+                opts.list = true;
+                break;
+            case 'S':
+                opts.spans = true;
+                break;
+            case 'j':
+                num_threads = std::max(1, atoi(optarg));
+                break;
+            case 'V':
+                return verify();
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    std::vector<uint32_t> words = gfx_load(argv[optind], opts.offset);
+    size_t num_gfx = words.size() / 2;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // State is sequential, so collect the primitives with theirs before rasterizing them in parallel
+    gfx_state_t state;
+    std::vector<primitive_t> prims;
+    size_t num_commands = 0, num_triangles = 0;
+    for (size_t i = 0; i < num_gfx && num_commands < opts.max_commands; num_commands++) {
+        size_t length = gfx_command_length(words[2 * i]);
+        if (i + length > num_gfx) {
+            fprintf(stderr, "Warning: the last command is cut short, only %zu of its Gfx are there\n", num_gfx - i);
+            break;
+        }
+        if (gfx_is_primitive(words[2 * i])) {
+            prims.push_back({ i, state });
+            unsigned op = gfx_opcode(words[2 * i]);
+            num_triangles += op >= G_TRI_FILL && op <= G_TRI_SHADE_TXTR_ZBUFF;
+        } else {
+            gfx_state_apply(state, &words[2 * i]);
+        }
+        i += length;
+    }
+
+    std::vector<gfx_raster_t> results(opts.list ? prims.size() : 0);
+    size_t num_chunks = (prims.size() + CHUNK_PRIMITIVES - 1) / CHUNK_PRIMITIVES;
+    std::vector<gfx_raster_t> chunk_totals(num_chunks);
+    parallel_for(num_chunks, num_threads, [&] (size_t c) {
+        size_t end = std::min(prims.size(), (c + 1) * CHUNK_PRIMITIVES);
+        for (size_t k = c * CHUNK_PRIMITIVES; k < end; k++) {
+            gfx_raster_t r = rasterize(prims[k], words.data(), nullptr);
+            chunk_totals[c].add(r);
+            if (opts.list)
+                results[k] = r;
+        }
+    });
+    gfx_raster_t total;
+    for (const gfx_raster_t& t : chunk_totals)
+        total.add(t);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (opts.list) {
+        printf("%-8s  %-24s  %6s  %9s  %9s  %8s  %6s  %6s  %s\n", "Offset", "Command", "Spans", "Pixels",
+               "Processed", "Segments", "C rows", "Z rows", "Box");
+        for (size_t k = 0; k < prims.size(); k++) {
+            const gfx_raster_t& r = results[k];
+            printf("%08zX  %-24s  %6llu  %9llu  %9llu  %8llu  %6llu  %6llu  ", opts.offset + 8 * prims[k].index,
+                   gfx_command_name(words[2 * prims[k].index]), (unsigned long long)r.spans,
+                   (unsigned long long)r.pixels, (unsigned long long)r.processed, (unsigned long long)r.segments,
+                   (unsigned long long)r.color_rows, (unsigned long long)r.depth_rows);
+            if (r.spans > 0)
+                printf("[%u, %u) x [%u, %u)\n", r.x0, r.x1, r.y0, r.y1);
+            else
+                printf("-\n");
+        }
+        printf("\n");
+    }
+
+    if (opts.spans) {
+        std::vector<fill_span_t> spans;
+        for (const primitive_t& p : prims) {
+            spans.clear();
+            rasterize(p, words.data(), &spans);
+            for (const fill_span_t& s : spans)
+                printf("%08zX  %4u  %4u %4u\n", opts.offset + 8 * p.index, s.y, s.x0, s.x1);
+        }
+        printf("\n");
+    }
+
+    printf("%zu commands, %zu primitives: %zu triangles, %zu rectangles\n\n", num_commands, prims.size(),
+           num_triangles, prims.size() - num_triangles);
+    printf("%-12s  %14s  %12s\n", "", "Total", "Per primitive");
+    print_row("Spans", total.spans, prims.size());
+    print_row("Pixels", total.pixels, prims.size());
+    print_row("Processed", total.processed, prims.size());
+    print_row("Segments", total.segments, prims.size());
+    print_row("Color rows", total.color_rows, prims.size());
+    print_row("Depth rows", total.depth_rows, prims.size());
+
+    fprintf(stderr, "%zu primitives in %.1f ms\n", prims.size(), ms);
+    return 0;
+}
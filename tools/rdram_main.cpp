@@ -0,0 +1,284 @@
+/**
+ * Simulates the RDRAM transactions of a fill rectangle against the open rows
+ * of each bank and counts row hits, row opens and bank conflicts per agent,
+ * for one buffer layout or a sweep over many.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fill_model.h"
+#include "parallel.h"
+#include "rdram_sim.h"
+#include "results_io.h"
+
+static void
+usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "Options:\n"
+            "  -m MODES    Comma-separated: 2cycle, im_rd, z_cmp, z_upd, z_fail, ac_fail, vi\n"
+            "  -r RECT     X0,Y0,X1,Y1 in pixels (default 0,0,320,240)\n"
+            "  -w WIDTH    Color image width in pixels (default 320)\n"
+            "  -f ADDR     Color image address (default 0x%X)\n"
+            "  -z ADDR     Depth image address (default 0x%X)\n"
+            "  -v ADDR     VI origin (default 0x%X)\n"
+            "  -W WxH      VI image size (default the color image width by the rectangle bottom)\n"
+            "  -s LINE     Field line the VI is on when the fill starts (default 0)\n"
+            "  -c CLOCKS   RDP clocks per 8 pixel segment, sets how VI fetches interleave (default 16)\n"
+            "  -t FILE     Write the transaction trace to FILE\n"
+            "\n"
+            "Sweep, each a list of addresses \"A,B,...\" or a range \"START:END:STEP\":\n"
+            "  -F LIST     Color image addresses\n"
+            "  -Z LIST     Depth image addresses\n"
+            "  -V LIST     VI origins\n"
+            "  -n N        Layouts listed, fewest row opens first (default 20, 0 for all)\n"
+            "  -j N        Worker threads (default: all cores)\n",
+            prog, FILL_FB_ADDR, FILL_ZB_ADDR_DIFF, FILL_VI_ADDR_DIFF);
+    exit(EXIT_FAILURE);
+}
+
+static uint32_t
+parse_address (const std::string& text)
+{
+    char* end;
+    unsigned long addr = strtoul(text.c_str(), &end, 0);
+    if (text.empty() || *end != '\0')
+        fatal("Bad address \"%s\"", text.c_str());
+    return (uint32_t)addr;
+}
+
+static std::vector<uint32_t>
+parse_addresses (const char* arg)
+{
+    std::vector<std::string> items;
+    std::string list(arg);
+    char sep = (list.find(':') != std::string::npos) ? ':' : ',';
+    for (size_t pos = 0; pos <= list.size(); ) {
+        size_t next = std::min(list.find(sep, pos), list.size());
+        items.push_back(list.substr(pos, next - pos));
+        pos = next + 1;
+    }
+
+    std::vector<uint32_t> out;
+    if (sep == ':') {
+        if (items.size() != 3)
+            fatal("Bad address range \"%s\"", arg);
+        uint64_t start = parse_address(items[0]), end = parse_address(items[1]), step = parse_address(items[2]);
+        if (step == 0)
+            fatal("Bad address range \"%s\"", arg);
+        for (uint64_t a = start; a < end; a += step)
+            out.push_back((uint32_t)a);
+    } else {
+        for (const std::string& item : items)
+            if (!item.empty())
+                out.push_back(parse_address(item));
+    }
+    return out;
+}
+
+static void
+print_stats (const rdram_sim_result_t& res)
+{
+    printf("%llu segments, %.0f RDP clocks\n\n", (unsigned long long)res.segments, res.clocks);
+    printf("%-12s  %10s  %10s  %10s  %14s\n", "Agent", "Accesses", "Row hits", "Row opens", "Bank conflicts");
+
+    rdram_agent_stats_t total = {};
+    for (size_t a = 0; a < RDRAM_NUM_AGENTS; a++) {
+        const rdram_agent_stats_t& s = res.agents[a];
+        if (s.accesses == 0)
+            continue;
+        printf("%-12s  %10llu  %10llu  %10llu  %14llu\n", rdram_agent_names[a], (unsigned long long)s.accesses,
+               (unsigned long long)s.row_hits, (unsigned long long)s.row_opens,
+               (unsigned long long)s.bank_conflicts);
+        total.accesses += s.accesses;
+        total.row_hits += s.row_hits;
+        total.row_opens += s.row_opens;
+        total.bank_conflicts += s.bank_conflicts;
+    }
+    printf("%-12s  %10llu  %10llu  %10llu  %14llu\n", "total", (unsigned long long)total.accesses,
+           (unsigned long long)total.row_hits, (unsigned long long)total.row_opens,
+           (unsigned long long)total.bank_conflicts);
+}
+
+static void
+write_trace (const char* path, const std::vector<rdram_access_t>& trace)
+{
+    FILE* f = fopen(path, "w");
+    if (f == nullptr)
+        fatal("Could not open %s for writing", path);
+    fprintf(f, "# clock agent address bank row result\n");
+    for (const rdram_access_t& a : trace) {
+        fprintf(f, "%.1f %s 0x%06X %u 0x%03X %s\n", a.clock, rdram_agent_names[a.agent], a.addr,
+                (a.addr >> RDRAM_BANK_SHIFT) % RDRAM_NUM_BANKS, (a.addr >> RDRAM_ROW_SHIFT) & 0x1FF,
+                a.conflict ? "conflict" : a.row_open ? "open" : "hit");
+    }
+    if (fclose(f) != 0)
+        fatal("Could not write %s", path);
+}
+
+struct layout_t {
+    uint32_t fb, zb, vi;
+    uint64_t row_opens;
+    uint64_t bank_conflicts;
+};
+
+int
+main (int argc, char** argv)
+{
+    fill_config_t cfg;
+    rdram_vi_t vi;
+    bool vi_size_set = false;
+    double segment_clocks = 16;
+    const char* trace_path = nullptr;
+    std::vector<uint32_t> sweep_fb, sweep_zb, sweep_vi;
+    size_t num_listed = 20;
+    unsigned num_threads = default_num_threads();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:r:w:f:z:v:W:s:c:t:F:Z:V:n:j:")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (!fill_modes_parse(optarg, cfg))
+                    fatal("Unknown mode in \"%s\"", optarg);
+                break;
+            case 'r':
+                if (sscanf(optarg, "%u,%u,%u,%u", &cfg.x0, &cfg.y0, &cfg.x1, &cfg.y1) != 4 ||
+                    cfg.x1 < cfg.x0 || cfg.y1 < cfg.y0)
+                    fatal("Bad rectangle \"%s\"", optarg);
+                break;
+            case 'w':
+                cfg.width = std::max(1, atoi(optarg));
+                break;
+            case 'f':
+                cfg.fb_addr = strtoul(optarg, nullptr, 0);
+                break;
+            case 'z':
+                cfg.zb_addr = strtoul(optarg, nullptr, 0);
+                break;
+            case 'v':
+                cfg.vi_addr = strtoul(optarg, nullptr, 0);
+                break;
+            case 'W':
+                if (sscanf(optarg, "%ux%u", &vi.width, &vi.height) != 2 || vi.width == 0)
+                    fatal("Bad VI size \"%s\"", optarg);
+                vi_size_set = true;
+                break;
+            case 's':
+                vi.start_line = atoi(optarg);
+                break;
+            case 'c':
+                segment_clocks = atof(optarg);
+                if (!(segment_clocks > 0))
+                    fatal("Bad segment time \"%s\"", optarg);
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
+            case 'F':
+                sweep_fb = parse_addresses(optarg);
+                break;
+            case 'Z':
+                sweep_zb = parse_addresses(optarg);
+                break;
+            case 'V':
+                sweep_vi = parse_addresses(optarg);
+                break;
+            case 'n':
+                num_listed = strtoull(optarg, nullptr, 0);
+                break;
+            case 'j':
+                num_threads = std::max(1, atoi(optarg));
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc)
+        usage(argv[0]);
+
+    vi.on = cfg.vi_on;
+    if (!vi_size_set) {
+        vi.width = cfg.width;
+        vi.height = cfg.y1;
+    }
+
+    bool sweep = !sweep_fb.empty() || !sweep_zb.empty() || !sweep_vi.empty();
+    if (!sweep) {
+        vi.addr = cfg.vi_addr;
+        std::vector<rdram_access_t> trace;
+        rdram_sim_result_t res = rdram_simulate(cfg, vi, segment_clocks, trace_path ? &trace : nullptr);
+        print_stats(res);
+        if (trace_path != nullptr)
+            write_trace(trace_path, trace);
+        return 0;
+    }
+    if (trace_path != nullptr)
+        fatal("A trace can only be written for a single layout");
+
+    if (sweep_fb.empty())
+        sweep_fb.push_back(cfg.fb_addr);
+    if (sweep_zb.empty())
+        sweep_zb.push_back(cfg.zb_addr);
+    if (sweep_vi.empty())
+        sweep_vi.push_back(cfg.vi_addr);
+
+    std::vector<layout_t> layouts;
+    layouts.reserve(sweep_fb.size() * sweep_zb.size() * sweep_vi.size());
+    // Color and depth images that overlap are not a layout anyone can use
+    bool uses_depth = cfg.depth_read || cfg.depth_writes();
+    uint64_t image_bytes = (uint64_t)cfg.width * cfg.y1 * 2;
+    size_t overlapping = 0;
+    for (uint32_t fb : sweep_fb) {
+        for (uint32_t zb : sweep_zb) {
+            if (uses_depth && fb < zb + image_bytes && zb < fb + image_bytes) {
+                overlapping += sweep_vi.size();
+                continue;
+            }
+            for (uint32_t v : sweep_vi)
+                layouts.push_back({ fb, zb, v, 0, 0 });
+        }
+    }
+    if (layouts.empty())
+        fatal("Every layout of the sweep has overlapping color and depth images");
+
+    auto start = std::chrono::steady_clock::now();
+    parallel_for(layouts.size(), num_threads, [&] (size_t i) {
+        layout_t& l = layouts[i];
+        fill_config_t c = cfg;
+        c.fb_addr = l.fb;
+        c.zb_addr = l.zb;
+        rdram_vi_t v = vi;
+        v.addr = l.vi;
+        rdram_sim_result_t res = rdram_simulate(c, v, segment_clocks);
+        for (const rdram_agent_stats_t& s : res.agents) {
+            l.row_opens += s.row_opens;
+            l.bank_conflicts += s.bank_conflicts;
+        }
+    });
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::stable_sort(layouts.begin(), layouts.end(), [] (const layout_t& a, const layout_t& b) {
+        return (a.row_opens != b.row_opens) ? a.row_opens < b.row_opens : a.bank_conflicts < b.bank_conflicts;
+    });
+    if (num_listed == 0 || num_listed > layouts.size())
+        num_listed = layouts.size();
+
+    printf("%-10s  %-10s  %-10s  %10s  %14s\n", "Color", "Depth", "VI", "Row opens", "Bank conflicts");
+    for (size_t i = 0; i < num_listed; i++) {
+        const layout_t& l = layouts[i];
+        printf("0x%08X  0x%08X  0x%08X  %10llu  %14llu\n", l.fb, l.zb, l.vi, (unsigned long long)l.row_opens,
+               (unsigned long long)l.bank_conflicts);
+    }
+    if (overlapping != 0)
+        fprintf(stderr, "Skipped %zu layouts with overlapping color and depth images\n", overlapping);
+    fprintf(stderr, "%zu layouts in %.1f ms (%.3f ms each)\n", layouts.size(), ms, ms / layouts.size());
+    return 0;
+}
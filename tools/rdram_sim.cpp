@@ -0,0 +1,72 @@
+/**
+ * RDRAM bank and row-buffer simulation of the transactions of a fill
+ */
+#include "rdram_sim.h"
+
+#include "fill_model.h"
+
+const char* const rdram_agent_names[RDRAM_NUM_AGENTS] = {
+    "color read",
+    "depth read",
+    "color write",
+    "depth write",
+    "vi",
+};
+
+template <bool record>
+static rdram_sim_result_t
+simulate (const fill_config_t& cfg, const rdram_vi_t& vi, double segment_clocks, std::vector<rdram_access_t>* trace)
+{
+    bool color_write = cfg.color_write();
+    bool depth_write = cfg.depth_writes();
+
+    rdram_banks_t banks;
+    rdram_vi_scan_t scan(vi);
+    double t = 0;
+    uint64_t segments = 0;
+
+    auto access = [&] (uint32_t addr, unsigned agent) {
+        if (record) {
+            uint64_t conflicts = banks.stats[agent].bank_conflicts;
+            bool opened = banks.access(addr, agent);
+            trace->push_back({ t, addr, (uint8_t)agent, opened, banks.stats[agent].bank_conflicts != conflicts });
+        } else {
+            banks.access(addr, agent);
+        }
+    };
+
+    for (unsigned y = cfg.y0; y < cfg.y1; y++) {
+        uint32_t line = y * cfg.width * 2;
+        for (unsigned sx = cfg.x0 & ~(FILL_SEGMENT_PIXELS - 1); sx < cfg.x1; sx += FILL_SEGMENT_PIXELS) {
+            while (scan.next() <= t)
+                access(scan.fetch(), RDRAM_VI);
+
+            uint32_t offset = line + sx * 2;
+            if (cfg.color_read)
+                access(cfg.fb_addr + offset, RDRAM_COLOR_READ);
+            if (cfg.depth_read)
+                access(cfg.zb_addr + offset, RDRAM_DEPTH_READ);
+            if (color_write)
+                access(cfg.fb_addr + offset, RDRAM_COLOR_WRITE);
+            if (depth_write)
+                access(cfg.zb_addr + offset, RDRAM_DEPTH_WRITE);
+
+            t += segment_clocks;
+            segments++;
+        }
+    }
+
+    rdram_sim_result_t res;
+    std::copy(banks.stats, banks.stats + RDRAM_NUM_AGENTS, res.agents);
+    res.segments = segments;
+    res.clocks = t;
+    return res;
+}
+
+rdram_sim_result_t
+rdram_simulate (const fill_config_t& cfg, const rdram_vi_t& vi, double segment_clocks,
+                std::vector<rdram_access_t>* trace)
+{
+    return (trace != nullptr) ? simulate<true>(cfg, vi, segment_clocks, trace)
+                              : simulate<false>(cfg, vi, segment_clocks, nullptr);
+}
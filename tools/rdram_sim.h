@@ -0,0 +1,192 @@
+/**
+ * RDRAM bank and row-buffer simulation of the transactions of a fill
+ */
+#ifndef RDRAM_SIM_H_
+#define RDRAM_SIM_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// RDRAM geometry from the README: 1 MB banks made of 0x800 byte rows
+#define RDRAM_BANK_SHIFT    20
+#define RDRAM_ROW_SHIFT     11
+#define RDRAM_NUM_BANKS     8
+
+// NTSC lines per field the VI spends in vertical blanking
+#define RDRAM_VI_BLANK_LINES    22
+
+/**
+ * Sources of RDRAM transactions, the RDP ones in the order it issues them
+ */
+enum rdram_agent_t {
+    RDRAM_COLOR_READ,
+    RDRAM_DEPTH_READ,
+    RDRAM_COLOR_WRITE,
+    RDRAM_DEPTH_WRITE,
+    RDRAM_VI,
+    RDRAM_NUM_AGENTS
+};
+
+extern const char* const rdram_agent_names[RDRAM_NUM_AGENTS];
+
+struct rdram_agent_stats_t {
+    uint64_t accesses;
+    uint64_t row_hits;
+    uint64_t row_opens;
+    // Row opens because another agent had opened a different row of the bank
+    uint64_t bank_conflicts;
+};
+
+/**
+ * Open row of every bank and which agent opened it
+ */
+struct rdram_banks_t {
+    uint32_t open_row[RDRAM_NUM_BANKS];
+    uint8_t opener[RDRAM_NUM_BANKS];
+    rdram_agent_stats_t stats[RDRAM_NUM_AGENTS] = {};
+
+    rdram_banks_t ()
+    {
+        for (size_t b = 0; b < RDRAM_NUM_BANKS; b++) {
+            open_row[b] = ~0u;
+            opener[b] = RDRAM_NUM_AGENTS;
+        }
+    }
+
+    // Accesses addr for `agent`, returning whether its row had to be opened
+    bool access (uint32_t addr, unsigned agent)
+    {
+        unsigned bank = (addr >> RDRAM_BANK_SHIFT) % RDRAM_NUM_BANKS;
+        uint32_t row = addr >> RDRAM_ROW_SHIFT;
+        rdram_agent_stats_t& s = stats[agent];
+        s.accesses++;
+        if (open_row[bank] == row) {
+            s.row_hits++;
+            return false;
+        }
+        s.row_opens++;
+        s.bank_conflicts += opener[bank] != agent && opener[bank] != RDRAM_NUM_AGENTS;
+        open_row[bank] = row;
+        opener[bank] = agent;
+        return true;
+    }
+
+    uint64_t row_opens () const
+    {
+        uint64_t n = 0;
+        for (const rdram_agent_stats_t& s : stats)
+            n += s.row_opens;
+        return n;
+    }
+};
+
+/**
+ * VI scanout, by default as src/test_main.c sets it up for NTSC. Images taller
+ * than a field are scanned out interlaced, alternate lines in alternate fields.
+ */
+struct rdram_vi_t {
+    bool on = false;
+    uint32_t addr = 0;
+    unsigned width = 320;           // rgba16 pixels
+    unsigned height = 240;
+    double line_clocks = 993.0;     // RDP clocks per line, 3094/4 VI clocks at 48.68 MHz
+    unsigned lines_per_field = 262;
+    unsigned fetch_bytes = 128;     // not known, sets how often the VI reopens its row
+    unsigned start_line = 0;        // field line being scanned out when the fill starts
+};
+
+/**
+ * Schedule of the VI's fetches: each line is fetched in `fetch_bytes` pieces
+ * spread evenly over the line time, nothing during vertical blanking
+ */
+class rdram_vi_scan_t {
+public:
+    explicit rdram_vi_scan_t (const rdram_vi_t& vi)
+        : vi_(vi)
+    {
+        interlaced_ = vi.height > vi.lines_per_field - RDRAM_VI_BLANK_LINES;
+        active_lines_ = interlaced_ ? (vi.height + 1) / 2 : vi.height;
+        fetches_per_line_ = std::max(1u, (vi.width * 2 + vi.fetch_bytes - 1) / vi.fetch_bytes);
+        interval_ = vi.line_clocks / fetches_per_line_;
+        line_ = vi.start_line % vi.lines_per_field;
+        next_ = INFINITY;
+        if (vi.on && active_lines_ != 0) {
+            next_ = 0;
+            skip_blank();
+        }
+    }
+
+    // Clock of the next fetch, infinite with the VI off
+    double next () const { return next_; }
+
+    // Address of the next fetch, then moves on to the one after
+    uint32_t fetch ()
+    {
+        unsigned y = interlaced_ ? 2 * line_ + field_ : line_;
+        uint32_t addr = vi_.addr + y * vi_.width * 2 + fetch_ * vi_.fetch_bytes;
+        next_ += interval_;
+        if (++fetch_ == fetches_per_line_) {
+            fetch_ = 0;
+            next_line();
+            skip_blank();
+        }
+        return addr;
+    }
+
+private:
+    void next_line ()
+    {
+        if (++line_ == vi_.lines_per_field) {
+            line_ = 0;
+            field_ ^= interlaced_;
+        }
+    }
+
+    void skip_blank ()
+    {
+        while (line_ >= active_lines_ || (interlaced_ && 2 * line_ + field_ >= vi_.height)) {
+            next_ += vi_.line_clocks;
+            next_line();
+        }
+    }
+
+    const rdram_vi_t& vi_;
+    bool interlaced_;
+    unsigned active_lines_;
+    unsigned fetches_per_line_;
+    double interval_;
+    double next_;
+    unsigned line_;
+    unsigned field_ = 0;
+    unsigned fetch_ = 0;
+};
+
+struct rdram_access_t {
+    double clock;
+    uint32_t addr;
+    uint8_t agent;
+    bool row_open;
+    bool conflict;
+};
+
+struct rdram_sim_result_t {
+    rdram_agent_stats_t agents[RDRAM_NUM_AGENTS];
+    uint64_t segments;
+    double clocks;
+};
+
+struct fill_config_t;
+
+/**
+ * Issues the transactions of the fill in `cfg` span-buffer segment by
+ * segment, each segment taking `segment_clocks` RDP clocks, with VI fetches
+ * interleaved as they come due. The trace is recorded if `trace` is given.
+ */
+rdram_sim_result_t
+rdram_simulate (const fill_config_t& cfg, const rdram_vi_t& vi, double segment_clocks,
+                std::vector<rdram_access_t>* trace = nullptr);
+
+#endif
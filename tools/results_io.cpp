@@ -0,0 +1,384 @@
+/**
+ * Host-side loading of rdp_fill_timing results
+ */
+#include "results_io.h"
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "results.h"
+
+const char* const results_counter_names[RESULTS_NUM_COUNTERS] = { "buf", "pipe", "tmem", "clock" };
+
+void
+fatal (const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    exit(EXIT_FAILURE);
+}
+
+mapped_file_t::mapped_file_t (const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        fatal("Could not open %s: %s", path, strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        fatal("Could not stat %s: %s", path, strerror(errno));
+
+    size_ = st.st_size;
+    if (size_ != 0) {
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+            fatal("Could not map %s: %s", path, strerror(errno));
+        madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = (const char*)p;
+    }
+    close(fd);
+}
+
+mapped_file_t::~mapped_file_t ()
+{
+    if (data_ != nullptr)
+        munmap((void*)data_, size_);
+}
+
+/*
+ * Integer parsing
+ */
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+// Number of leading (lowest address) ASCII digits in an 8-byte chunk
+static inline unsigned
+swar_digit_count (uint64_t chunk)
+{
+    uint64_t hi = (chunk & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull;
+    uint64_t lo = ((chunk & 0x0F0F0F0F0F0F0F0Full) + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull;
+    uint64_t nd = hi | lo; // zero bytes are digits
+    uint64_t nonzero = (((nd & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | nd) & 0x8080808080808080ull;
+    return (nonzero == 0) ? 8 : __builtin_ctzll(nonzero) / 8;
+}
+
+// Converts the first `n` (1..8) digits of an 8-byte chunk
+static inline uint32_t
+swar_parse_digits (uint64_t chunk, unsigned n)
+{
+    // Move the digits to the top so the last digit lands in the least significant position
+    uint64_t val = (chunk - 0x3030303030303030ull) << (8 * (8 - n));
+    val = ((val & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+    val = ((val & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+    return ((val & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
+}
+
+#endif
+
+void
+parse_u32_list (const char* p, const char* end, std::vector<uint32_t>& out)
+{
+    while (true) {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+        if (p == end)
+            return;
+
+        uint32_t v = 0;
+        const char* num_start = p;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if (end - p >= 9) {
+            uint64_t chunk;
+            memcpy(&chunk, p, sizeof(chunk));
+            unsigned n = swar_digit_count(chunk);
+            if (n != 0 && (n != 8 || (unsigned)(p[8] - '0') > 9)) {
+                v = swar_parse_digits(chunk, n);
+                p += n;
+            }
+        }
+#endif
+        if (p == num_start) {
+            // Scalar path for the tail of the buffer and for numbers longer than 8 digits
+            uint64_t wide = 0;
+            while (p != end && (unsigned)(*p - '0') <= 9)
+                wide = wide * 10 + (*p++ - '0');
+            if (p == num_start || wide > UINT32_MAX)
+                fatal("Bad integer in sample list near \"%.16s\"", num_start);
+            v = wide;
+        }
+        out.push_back(v);
+
+        if (p == end || *p != ',')
+            fatal("Expected ',' in sample list near \"%.16s\"", p);
+        p++;
+    }
+}
+
+/*
+ * Text logs
+ */
+
+static const char*
+find (const char* start, const char* end, const char* needle)
+{
+    size_t len = strlen(needle);
+    const void* p = memmem(start, end - start, needle, len);
+    return (p == nullptr) ? nullptr : (const char*)p;
+}
+
+static bool
+is_space (char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Takes the next line, without its terminator, advancing `p`
+static bool
+next_line (const char*& p, const char* end, const char*& line, const char*& line_end)
+{
+    if (p == end)
+        return false;
+    line = p;
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    line_end = (nl == nullptr) ? end : nl;
+    p = (nl == nullptr) ? end : nl + 1;
+    if (line_end != line && line_end[-1] == '\r')
+        line_end--;
+    return true;
+}
+
+// The expect_ functions return false if the log ends first
+static bool
+expect_line (const char*& p, const char* end, const char* expected)
+{
+    const char* line;
+    const char* line_end;
+    if (!next_line(p, end, line, line_end))
+        return false;
+    if ((size_t)(line_end - line) != strlen(expected) || memcmp(line, expected, line_end - line) != 0)
+        fatal("Expected \"%s\", got \"%.*s\"", expected, (int)(line_end - line), line);
+    return true;
+}
+
+static bool
+expect_samples (const char*& p, const char* end, std::vector<uint32_t>& out)
+{
+    const char* line;
+    const char* line_end;
+    if (!next_line(p, end, line, line_end))
+        return false;
+    parse_u32_list(line, line_end, out);
+    return true;
+}
+
+// Whether the next line is `expected`, without taking it
+static bool
+peek_line (const char* p, const char* end, const char* expected)
+{
+    const char* line;
+    const char* line_end;
+    if (!next_line(p, end, line, line_end))
+        return false;
+    return (size_t)(line_end - line) == strlen(expected) && memcmp(line, expected, line_end - line) == 0;
+}
+
+// End of the last spec whose CLOCK block closed before `end`, the point client.py resumes a restarted console from
+static const char*
+finished_specs_end (const char* p, const char* end)
+{
+    const char* finished = p;
+    const char* line;
+    const char* line_end;
+    bool in_clock = false;
+    for (; p != end; next_line(p, end, line, line_end)) {
+        if (peek_line(p, end, "CLOCK = [")) {
+            in_clock = true;
+        } else if (in_clock && peek_line(p, end, "]")) {
+            in_clock = false;
+            finished = p;
+            next_line(finished, end, line, line_end);
+        }
+    }
+    return finished;
+}
+
+// Specs between `begin` and `done`
+static void
+parse_specs (const char* begin, const char* done, std::vector<spec_result_t>& out)
+{
+    // Same as str.strip() on the fenced contents
+    while (begin != done && is_space(*begin))
+        begin++;
+    while (done != begin && is_space(done[-1]))
+        done--;
+
+    const char* p = begin;
+    const char* desc;
+    const char* desc_end;
+    while (next_line(p, done, desc, desc_end)) {
+        spec_result_t res;
+        res.spec_id = out.size();
+        res.desc.assign(desc, desc_end);
+
+        // BUF and PIPE always, then TMEM and CLOCK from ROMs that send them
+        bool complete = true;
+        for (size_t c = 0; c < RESULTS_NUM_COUNTERS && complete; c++) {
+            std::string block = results_counter_names[c];
+            for (char& ch : block)
+                ch = toupper(ch);
+            block += " = [";
+            if (c >= 2 && !peek_line(p, done, block.c_str()))
+                break;
+            complete = expect_line(p, done, block.c_str()) &&
+                       expect_samples(p, done, res.counter(c)) &&
+                       expect_line(p, done, "]");
+        }
+        if (!complete) {
+            fprintf(stderr, "Warning: log ends with an incomplete spec, using the %zu finished specs\n", out.size());
+            return;
+        }
+
+        for (size_t c = 1; c < RESULTS_NUM_COUNTERS; c++) {
+            if (!res.counter(c).empty() && res.counter(c).size() != res.buf.size())
+                fatal("Sample count mismatch between counters for \"%s\"", res.desc.c_str());
+        }
+
+        out.push_back(std::move(res));
+    }
+}
+
+void
+results_parse_text (const char* start, const char* end, std::vector<spec_result_t>& out)
+{
+    const char* begin = find(start, end, "!!BEGIN!!");
+    if (begin == nullptr)
+        fatal("No !!BEGIN!! in log");
+    begin += strlen("!!BEGIN!!");
+
+    const char* done = find(begin, end, "!!DONE!!");
+    if (done == nullptr) {
+        // Unfinished run, only whole lines can be trusted
+        done = begin;
+        for (const char* nl = begin; (nl = (const char*)memchr(nl, '\n', end - nl)) != nullptr; nl++)
+            done = nl + 1;
+    }
+
+    // A console restarted by client.py --max-restarts begins again, running the spec it was cut off in
+    const char* restart;
+    while ((restart = find(begin, done, "!!BEGIN!!")) != nullptr) {
+        parse_specs(begin, finished_specs_end(begin, restart), out);
+        begin = restart + strlen("!!BEGIN!!");
+    }
+    parse_specs(begin, done, out);
+}
+
+/*
+ * Binary result packets
+ */
+
+static inline uint32_t
+be32 (const char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap32(v);
+}
+
+static inline uint16_t
+be16 (const char* p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap16(v);
+}
+
+static void
+read_be32_array (const char* p, size_t n, std::vector<uint32_t>& out)
+{
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+        out[i] = be32(p + 4 * i);
+}
+
+void
+results_parse_binary (const char* start, const char* end, std::vector<spec_result_t>& out)
+{
+    const char* p = start;
+
+    while (p != end) {
+        if ((size_t)(end - p) < RESULTS_HEADER_SIZE_V1)
+            break;
+
+        uint32_t magic = be32(p + offsetof(results_header_t, magic));
+        uint16_t version = be16(p + offsetof(results_header_t, version));
+        uint16_t spec_id = be16(p + offsetof(results_header_t, spec_id));
+        uint16_t counter_mask = be16(p + offsetof(results_header_t, counter_mask));
+        uint16_t desc_len = be16(p + offsetof(results_header_t, desc_len));
+        uint32_t num_samples = be32(p + offsetof(results_header_t, num_samples));
+
+        if (magic != RESULTS_MAGIC)
+            fatal("Bad result magic 0x%08X at offset %zu", magic, (size_t)(p - start));
+        if (version < 1 || version > RESULTS_VERSION)
+            fatal("Unsupported result version %u", version);
+
+        size_t header_size = (version == 1) ? RESULTS_HEADER_SIZE_V1 :
+                             (version == 2) ? RESULTS_HEADER_SIZE_V2 : sizeof(results_header_t);
+        size_t num_counters = __builtin_popcount(counter_mask);
+        size_t size = header_size + RESULTS_ALIGN4(desc_len) + 4 * num_counters * (size_t)num_samples;
+        if ((size_t)(end - p) < size)
+            break;
+
+        spec_result_t res;
+        res.spec_id = spec_id;
+        res.console = (version == 1) ? 0 : be16(p + offsetof(results_header_t, console_id));
+        if (version >= 3) {
+            // client.py joins partial packets, a file holding one was not written by it
+            uint32_t first_sample = be32(p + offsetof(results_header_t, first_sample));
+            uint32_t total_samples = be32(p + offsetof(results_header_t, total_samples));
+            if (first_sample != 0 || total_samples != num_samples)
+                fatal("Packet for spec %u holds only samples %u..%u of %u", spec_id, first_sample,
+                      first_sample + num_samples, total_samples);
+        }
+        p += header_size;
+        res.desc.assign(p, desc_len);
+        p += RESULTS_ALIGN4(desc_len);
+
+        for (unsigned bit = 1; bit <= counter_mask; bit <<= 1) {
+            if (!(counter_mask & bit))
+                continue;
+            // Counters this tool does not know are skipped
+            if (bit < (1u << RESULTS_NUM_COUNTERS))
+                read_be32_array(p, num_samples, res.counter(__builtin_ctz(bit)));
+            p += 4 * (size_t)num_samples;
+        }
+
+        out.push_back(std::move(res));
+    }
+
+    if (p != end)
+        fprintf(stderr, "Warning: results end with an incomplete packet, using the %zu finished specs\n", out.size());
+}
+
+std::vector<spec_result_t>
+results_load (const char* path)
+{
+    mapped_file_t file(path);
+    std::vector<spec_result_t> out;
+
+    if (file.size() >= 4 && be32(file.begin()) == RESULTS_MAGIC)
+        results_parse_binary(file.begin(), file.end(), out);
+    else
+        results_parse_text(file.begin(), file.end(), out);
+    return out;
+}
@@ -0,0 +1,80 @@
+/**
+ * Host-side loading of rdp_fill_timing results
+ */
+#ifndef RESULTS_IO_H_
+#define RESULTS_IO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Read-only memory mapping of a whole file
+ */
+class mapped_file_t {
+public:
+    explicit mapped_file_t (const char* path);
+    ~mapped_file_t ();
+
+    mapped_file_t (const mapped_file_t&) = delete;
+    mapped_file_t& operator= (const mapped_file_t&) = delete;
+
+    const char* begin () const { return data_; }
+    const char* end () const { return data_ + size_; }
+    size_t size () const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Counters a result can carry, in RESULTS_CTR_ bit order (src/results.h)
+#define RESULTS_NUM_COUNTERS    4
+
+// Lower case counter names as in analyze.py, upper case in the text log
+extern const char* const results_counter_names[RESULTS_NUM_COUNTERS];
+
+struct spec_result_t {
+    unsigned spec_id;
+    unsigned console = 0;   // console of a farm that ran the spec
+    std::string desc;
+    std::vector<uint32_t> buf;
+    std::vector<uint32_t> pipe;
+    // Empty for results from ROMs that only sent BUF and PIPE
+    std::vector<uint32_t> tmem;
+    std::vector<uint32_t> clock;
+
+    // Counter i of results_counter_names
+    std::vector<uint32_t>& counter (size_t i) { return (i == 0) ? buf : (i == 1) ? pipe : (i == 2) ? tmem : clock; }
+    const std::vector<uint32_t>& counter (size_t i) const { return const_cast<spec_result_t*>(this)->counter(i); }
+};
+
+[[noreturn]] void
+fatal (const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Parses a comma-separated list of decimal integers as printed by the ROM ("1, 2, 3, "), appending to `out`
+ */
+void
+parse_u32_list (const char* p, const char* end, std::vector<uint32_t>& out);
+
+/**
+ * Parses the debugf text log between the !!BEGIN!! and !!DONE!! fences
+ */
+void
+results_parse_text (const char* start, const char* end, std::vector<spec_result_t>& out);
+
+/**
+ * Parses concatenated binary result packets (src/results.h)
+ */
+void
+results_parse_binary (const char* start, const char* end, std::vector<spec_result_t>& out);
+
+/**
+ * Loads a results file of either format
+ */
+std::vector<spec_result_t>
+results_load (const char* path);
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * Sample statistics matching analyze.py
+ */
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+double
+quantile_linear (uint32_t* data, size_t n, double q)
+{
+    // numpy's virtual index for method="linear" (alpha = beta = 1), evaluated in the same order
+    double vi = ((double)n * q + (1.0 + q * -1.0)) - 1.0;
+
+    size_t prev, next;
+    if (vi >= (double)(n - 1)) {
+        prev = next = n - 1;
+    } else if (vi < 0) {
+        prev = next = 0;
+    } else {
+        prev = (size_t)std::floor(vi);
+        next = prev + 1;
+    }
+    double gamma = vi - std::floor(vi);
+
+    std::nth_element(data, data + prev, data + n);
+    double a = data[prev];
+    double b = (next == prev) ? a : *std::min_element(data + prev + 1, data + n);
+
+    // np.lib._function_base_impl._lerp
+    double diff = b - a;
+    if (gamma >= 0.5)
+        return b - diff * (1.0 - gamma);
+    return a + diff * gamma;
+}
+
+static void
+prune_bounds (const std::vector<uint32_t>& samples, std::vector<uint32_t>& scratch, double lo_q, double hi_q,
+              double& lo, double& hi)
+{
+    scratch.assign(samples.begin(), samples.end());
+    lo = quantile_linear(scratch.data(), scratch.size(), lo_q);
+    hi = quantile_linear(scratch.data(), scratch.size(), hi_q);
+}
+
+prune_summary_t
+prune_outliers (const std::vector<uint32_t>& samples, std::vector<uint32_t>& scratch, double lo_q, double hi_q)
+{
+    double lo, hi;
+    prune_bounds(samples, scratch, lo_q, hi_q, lo, hi);
+
+    prune_summary_t s;
+    s.orig_num = samples.size();
+    s.num = 0;
+    s.min = UINT32_MAX;
+    s.max = 0;
+    s.sum = 0;
+
+    // Samples are integers below 2^53 so the comparison against doubles is exact, as in Python
+    for (uint32_t v : samples) {
+        if (lo <= v && v <= hi) {
+            s.num++;
+            s.sum += v;
+            s.min = std::min(s.min, v);
+            s.max = std::max(s.max, v);
+        }
+    }
+    return s;
+}
+
+std::vector<uint32_t>
+pruned_samples (const std::vector<uint32_t>& samples, double lo_q, double hi_q)
+{
+    std::vector<uint32_t> out;
+    double lo, hi;
+    prune_bounds(samples, out, lo_q, hi_q, lo, hi);
+
+    out.clear();
+    for (uint32_t v : samples) {
+        if (lo <= v && v <= hi)
+            out.push_back(v);
+    }
+    return out;
+}
+
+double
+mann_whitney_u (const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, double* u_out)
+{
+    size_t n1 = a.size();
+    size_t n2 = b.size();
+    size_t n = n1 + n2;
+
+    // Sorted copies merged in one pass, assigning midranks to runs of equal values
+    std::vector<uint32_t> sa(a), sb(b);
+    std::sort(sa.begin(), sa.end());
+    std::sort(sb.begin(), sb.end());
+
+    double rank_sum_a = 0;
+    double tie_term = 0;
+    size_t i = 0, j = 0, rank = 1;
+    while (i < n1 || j < n2) {
+        uint32_t v = (j == n2 || (i < n1 && sa[i] <= sb[j])) ? sa[i] : sb[j];
+        size_t ca = 0, cb = 0;
+        while (i < n1 && sa[i] == v) { i++; ca++; }
+        while (j < n2 && sb[j] == v) { j++; cb++; }
+
+        double t = ca + cb;
+        double midrank = rank + (t - 1) / 2;
+        rank_sum_a += ca * midrank;
+        tie_term += t * t * t - t;
+        rank += ca + cb;
+    }
+
+    double u = rank_sum_a - (double)n1 * (n1 + 1) / 2;
+    if (u_out != nullptr)
+        *u_out = u;
+
+    double mu = (double)n1 * n2 / 2;
+    double sigma2 = (double)n1 * n2 / 12 * ((n + 1) - tie_term / ((double)n * (n - 1)));
+    if (sigma2 <= 0)
+        return 1.0;
+
+    double z = (std::fabs(u - mu) - 0.5) / std::sqrt(sigma2);
+    if (z < 0)
+        z = 0;
+    return std::min(1.0, std::erfc(z / std::sqrt(2.0)));
+}
+
+static inline uint64_t
+rotl (uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+rng_t::rng_t (uint64_t seed)
+{
+    // Expand the seed with splitmix64
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        s[i] = z ^ (z >> 31);
+    }
+}
+
+uint64_t
+rng_t::next ()
+{
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+static double
+resampled_mean (const std::vector<uint32_t>& v, rng_t& rng)
+{
+    uint64_t sum = 0;
+    uint32_t n = v.size();
+    for (uint32_t i = 0; i < n; i++)
+        sum += v[rng.below(n)];
+    return (double)sum / n;
+}
+
+bootstrap_ci_t
+bootstrap_mean_diff (const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                     unsigned num_resamples, double level, rng_t& rng)
+{
+    std::vector<double> diffs(num_resamples);
+    for (unsigned r = 0; r < num_resamples; r++)
+        diffs[r] = resampled_mean(b, rng) - resampled_mean(a, rng);
+
+    double tail = (1.0 - level) / 2;
+    size_t lo_i = (size_t)std::floor(tail * (num_resamples - 1));
+    size_t hi_i = (size_t)std::ceil((1.0 - tail) * (num_resamples - 1));
+
+    bootstrap_ci_t ci;
+    std::nth_element(diffs.begin(), diffs.begin() + lo_i, diffs.end());
+    ci.lo = diffs[lo_i];
+    std::nth_element(diffs.begin(), diffs.begin() + hi_i, diffs.end());
+    ci.hi = diffs[hi_i];
+    return ci;
+}
+
+std::vector<double>
+benjamini_hochberg (const std::vector<double>& p)
+{
+    size_t m = p.size();
+    std::vector<size_t> order(m);
+    for (size_t i = 0; i < m; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&] (size_t x, size_t y) { return p[x] < p[y]; });
+
+    std::vector<double> q(m);
+    double running = 1.0;
+    for (size_t k = m; k-- > 0; ) {
+        running = std::min(running, p[order[k]] * m / (k + 1));
+        q[order[k]] = running;
+    }
+    return q;
+}
@@ -0,0 +1,106 @@
+/**
+ * Sample statistics matching analyze.py
+ */
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// RDP clock rate in clocks per millisecond, as rdp_clk_to_ms in analyze.py
+#define RDP_CLK_PER_MS  62500
+
+static inline double
+rdp_clk_to_ms (double clk)
+{
+    return clk / RDP_CLK_PER_MS;
+}
+
+// Outlier pruning bounds used by analyze.py
+#define PRUNE_LO_Q  0.01
+#define PRUNE_HI_Q  0.99
+
+/**
+ * Summary of a sample set after outlier pruning
+ */
+struct prune_summary_t {
+    size_t orig_num;
+    size_t num;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+
+    double avg () const { return (double)sum / (double)num; }
+};
+
+/**
+ * Quantile with numpy's default linear interpolation, bit-identical to np.quantile.
+ * Partially reorders `data` using selection rather than a full sort.
+ */
+double
+quantile_linear (uint32_t* data, size_t n, double q);
+
+/**
+ * Drops samples outside the [lo_q, hi_q] quantiles and summarizes the remainder.
+ * `scratch` is reused between calls to avoid reallocation.
+ */
+prune_summary_t
+prune_outliers (const std::vector<uint32_t>& samples, std::vector<uint32_t>& scratch,
+                double lo_q = PRUNE_LO_Q, double hi_q = PRUNE_HI_Q);
+
+/**
+ * The samples analyze.py keeps after outlier pruning, in their original order
+ */
+std::vector<uint32_t>
+pruned_samples (const std::vector<uint32_t>& samples, double lo_q = PRUNE_LO_Q, double hi_q = PRUNE_HI_Q);
+
+static inline double
+mean (const std::vector<uint32_t>& samples)
+{
+    uint64_t sum = 0;
+    for (uint32_t v : samples)
+        sum += v;
+    return (double)sum / (double)samples.size();
+}
+
+/**
+ * Two-sided Mann-Whitney U test using the normal approximation with tie and continuity corrections.
+ * Returns the p-value, and the U statistic of `a` in `u_out` if non-null.
+ */
+double
+mann_whitney_u (const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, double* u_out = nullptr);
+
+/**
+ * Small fast PRNG (xoshiro256**) so bootstrap resampling is reproducible per task
+ */
+struct rng_t {
+    uint64_t s[4];
+
+    explicit rng_t (uint64_t seed);
+
+    uint64_t next ();
+
+    // Uniform integer in [0, n)
+    uint32_t below (uint32_t n) { return (uint32_t)(((next() >> 32) * (uint64_t)n) >> 32); }
+};
+
+struct bootstrap_ci_t {
+    double lo;
+    double hi;
+};
+
+/**
+ * Percentile bootstrap confidence interval for mean(b) - mean(a) at the given level (e.g. 0.95)
+ */
+bootstrap_ci_t
+bootstrap_mean_diff (const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                     unsigned num_resamples, double level, rng_t& rng);
+
+/**
+ * Benjamini-Hochberg adjusted p-values (q-values) for a family of tests
+ */
+std::vector<double>
+benjamini_hochberg (const std::vector<double>& p);
+
+#endif